@@ -19,12 +19,19 @@ class FormatDefaults: DefaultManager {
 
 open class FormatImpl: LNExtensionBase, LNExtensionService {
 
+    let deltas = HighlightDeltas()
+
     open var defaults: DefaultManager {
         return FormatDefaults()
     }
 
+    open override func forgetHighlights(forFile filepath: String) {
+        deltas.forget(file: filepath)
+    }
+
     open override func getConfig(_ callback: @escaping LNConfigCallback) {
         callback([
+            LNExtraColorKey: defaults.extraColor.stringRepresentation,
             LNApplyTitleKey: "Format Lint",
             LNApplyPromptKey: "Apply style suggestion to lines %d-%d",
             LNApplyConfirmKey: "Modify",
@@ -53,17 +60,19 @@ open class FormatImpl: LNExtensionBase, LNExtensionService {
             return
         }
 
-        DispatchQueue.global().async {
-            let generator = TaskGenerator(launchPath: script,
-                                          arguments: [url.lastPathComponent],
-                                          directory: url.deletingLastPathComponent().path)
-
-            for _ in 0 ..< 2 {
-                _ = generator.next()
+        requests.request(forFile: filepath, callback: callback) {
+            request in
+            DispatchQueue.global().async {
+                let generator = TaskGenerator(launchPath: script,
+                                              arguments: [url.lastPathComponent],
+                                              directory: url.deletingLastPathComponent().path)
+                request.running(generator.task)
+
+                let highlights = diffgen.generateHighlights(generator: generator, defaults: self.defaults)
+                request.finish {
+                    self.encoded(self.deltas.delta(highlights, forFile: filepath))
+                }
             }
-
-            let highlights = diffgen.generateHighlights(sequence: generator.lineSequence, defaults: self.defaults)
-            callback(highlights.jsonData(), nil)
         }
     }
 
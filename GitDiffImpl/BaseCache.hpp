@@ -0,0 +1,181 @@
+//
+//  BaseCache.hpp
+//  LNProvider
+//
+//  Copyright © 2017 John Holdsworth. All rights reserved.
+//
+//  The staged or HEAD version of a file rarely changes between saves
+//  so the texts diffed against are cached by blob id, already split
+//  into lines and interned. A re-diff then only has to split and hash
+//  the working copy, adding its lines to the base's table for the
+//  diff and truncating them after. The cache is an LRU bounded by an
+//  approximate number of bytes with counts kept to size it by.
+//
+
+#ifndef BaseCache_hpp
+#define BaseCache_hpp
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DiffMatchPatch/DiffMatchPatchLines.hpp"
+#include "GitRepository.hpp"
+
+namespace git {
+
+// A base text with its lines interned, lock it while diffing against it
+struct Base {
+    std::mutex lock;
+    std::string text;
+    dmp::LineTable<char> table;
+    std::vector<uint32_t> ids;
+    std::vector<size_t> offsets;
+
+    explicit Base(std::string &&contents)
+        : text(std::move(contents))
+    {
+        table.linesToIds(text.data(), text.size(), ids, &offsets);
+        lines = table.size();
+    }
+
+    /**
+     * Split another text into ids from the same table as the base's.
+     * Call done() when finished with them.
+     */
+
+    void idsFor(const char *other, size_t length, std::vector<uint32_t> &other_ids, std::vector<size_t> *other_offsets)
+    {
+        table.linesToIds(other, length, other_ids, other_offsets);
+    }
+
+    void done()
+    {
+        table.truncate(lines);
+    }
+
+    size_t footprint() const
+    {
+        return sizeof *this + text.capacity() + table.memory() +
+            ids.capacity() * sizeof ids[0] + offsets.capacity() * sizeof offsets[0];
+    }
+
+private:
+    // Lines in the table from the base alone
+    size_t lines;
+};
+
+class BaseCache {
+public:
+    struct Statistics {
+        size_t hits, misses, evictions;
+        size_t entries, bytes, capacity;
+    };
+
+    explicit BaseCache(size_t capacity = 32 << 20)
+        : capacity(capacity) {}
+
+    /**
+     * Find a blob's base, making it the most recently used.
+     * @return nullptr, counted as a miss, if not cached.
+     */
+
+    std::shared_ptr<Base> find(const ObjectId &id)
+    {
+        std::lock_guard<std::mutex> locked(lock);
+        auto found = index.find(id);
+        if (found == index.end()) {
+            counts.misses++;
+            return nullptr;
+        }
+
+        counts.hits++;
+        entries.splice(entries.begin(), entries, found->second);
+        return found->second->base;
+    }
+
+    /**
+     * Split a blob's text into a base and cache it, evicting the least
+     * recently used to stay within capacity. A base larger than the
+     * capacity is returned without being cached.
+     */
+
+    std::shared_ptr<Base> insert(const ObjectId &id, std::string &&text)
+    {
+        std::shared_ptr<Base> base = std::make_shared<Base>(std::move(text));
+        size_t footprint = base->footprint();
+
+        std::lock_guard<std::mutex> locked(lock);
+        auto found = index.find(id);
+        if (found != index.end()) {
+            // Inserted by another thread meanwhile
+            entries.splice(entries.begin(), entries, found->second);
+            return found->second->base;
+        }
+        if (footprint > capacity)
+            return base;
+
+        entries.push_front(Entry{id, base, footprint});
+        index[id] = entries.begin();
+        bytes += footprint;
+        evict();
+        return base;
+    }
+
+    void setCapacity(size_t bytes_capacity)
+    {
+        std::lock_guard<std::mutex> locked(lock);
+        capacity = bytes_capacity;
+        evict();
+    }
+
+    Statistics statistics() const
+    {
+        std::lock_guard<std::mutex> locked(lock);
+        Statistics statistics = counts;
+        statistics.entries = entries.size();
+        statistics.bytes = bytes;
+        statistics.capacity = capacity;
+        return statistics;
+    }
+
+private:
+    struct Entry {
+        ObjectId id;
+        std::shared_ptr<Base> base;
+        size_t footprint;
+    };
+
+    struct Hash {
+        size_t operator()(const ObjectId &id) const
+        {
+            // Object ids are already uniformly distributed
+            size_t hash;
+            memcpy(&hash, id.bytes, sizeof hash);
+            return hash;
+        }
+    };
+
+    mutable std::mutex lock;
+    std::list<Entry> entries;   // Most recently used first
+    std::unordered_map<ObjectId, std::list<Entry>::iterator, Hash> index;
+    size_t capacity, bytes = 0;
+    Statistics counts = {};
+
+    void evict()
+    {
+        while (bytes > capacity && !entries.empty()) {
+            bytes -= entries.back().footprint;
+            index.erase(entries.back().id);
+            entries.pop_back();
+            counts.evictions++;
+        }
+    }
+};
+
+} // namespace git
+
+#endif /* BaseCache_hpp */
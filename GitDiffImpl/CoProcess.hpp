@@ -0,0 +1,480 @@
+//
+//  CoProcess.hpp
+//  LNProvider
+//
+//  Copyright © 2017 John Holdsworth. All rights reserved.
+//
+//  Long-lived git processes for what the repository can't be read for in
+//  process: objects it can't find, as in alternates, through "git cat-file
+//  --batch" and attributes through "git check-attr --stdin". Requests are
+//  written to a process's stdin and the responses read back in order,
+//  several at a time when the caller has them, so git's fork, exec and
+//  repository discovery are paid once rather than per request. A process
+//  found to have exited, or that stops responding mid-response, is
+//  restarted and the request retried once. Processes are pooled by work
+//  tree, those least recently used stopped beyond a limit.
+//
+
+#ifndef CoProcess_hpp
+#define CoProcess_hpp
+
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "GitRepository.hpp"
+
+extern char **environ;
+
+namespace git {
+
+// A process answering requests written to its stdin on its stdout
+class CoProcess {
+public:
+    // Seconds to wait for output before assuming the process has hung
+    static constexpr int Timeout = 10;
+
+    explicit CoProcess(std::vector<std::string> arguments)
+        : arguments(std::move(arguments)), buffer(64 * 1024) {}
+
+    CoProcess(const CoProcess &) = delete;
+    CoProcess &operator=(const CoProcess &) = delete;
+
+    ~CoProcess()
+    {
+        stop();
+    }
+
+    bool start()
+    {
+        stop();
+        int in[2], out[2];
+        if (!closedOnExec(in))
+            return false;
+        if (!closedOnExec(out)) {
+            close(in[0]);
+            close(in[1]);
+            return false;
+        }
+#ifdef F_SETNOSIGPIPE
+        // Writing to a process that has exited must fail rather than kill the service
+        fcntl(in[1], F_SETNOSIGPIPE, 1);
+#endif
+
+        // Only the child's ends are inherited, by it alone as stdin and stdout
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, in[0], 0);
+        posix_spawn_file_actions_adddup2(&actions, out[1], 1);
+        posix_spawn_file_actions_addclose(&actions, in[0]);
+        posix_spawn_file_actions_addclose(&actions, out[1]);
+        posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+
+        std::vector<char *> argv;
+        for (std::string &argument : arguments)
+            argv.push_back(&argument[0]);
+        argv.push_back(nullptr);
+
+        int spawned = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+        posix_spawn_file_actions_destroy(&actions);
+        close(in[0]);
+        close(out[1]);
+        input = in[1];
+        output = out[0];
+
+        if (spawned != 0) {
+            pid = -1;
+            stop();
+            return false;
+        }
+        starts++;
+        return true;
+    }
+
+    void stop()
+    {
+        if (input >= 0)
+            close(input);
+        if (output >= 0)
+            close(output);
+        input = output = -1;
+        start_offset = end_offset = 0;
+
+        if (pid > 0) {
+            kill(pid, SIGTERM);
+            while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR)
+                ;
+        }
+        pid = -1;
+    }
+
+    // Whether the process is running, reaping it if it has exited
+    bool alive()
+    {
+        if (pid <= 0)
+            return false;
+        if (waitpid(pid, nullptr, WNOHANG) == 0)
+            return true;
+        pid = -1;
+        stop();
+        return false;
+    }
+
+    pid_t processId() const
+    {
+        return pid;
+    }
+
+    // Times the process has been started
+    size_t startCount() const
+    {
+        return starts;
+    }
+
+    bool write(const std::string &request)
+    {
+#ifndef F_SETNOSIGPIPE
+        // Writing to a process that has exited must fail rather than kill the
+        // service: SIGPIPE is held back from this thread while it writes and
+        // any raised discarded, leaving the process's handling of it alone
+        sigset_t pipe_signal, blocked, pending;
+        sigemptyset(&pipe_signal);
+        sigaddset(&pipe_signal, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &pipe_signal, &blocked);
+        sigpending(&pending);
+        bool was_pending = sigismember(&pending, SIGPIPE);
+#endif
+
+        bool succeeded = true;
+        for (size_t written = 0; written < request.size();) {
+            ssize_t bytesWritten = ::write(input, request.data() + written, request.size() - written);
+            if (bytesWritten < 0 && errno == EINTR)
+                continue;
+            if (bytesWritten <= 0) {
+                succeeded = false;
+                break;
+            }
+            written += bytesWritten;
+        }
+
+#ifndef F_SETNOSIGPIPE
+        if (!succeeded && errno == EPIPE && !was_pending) {
+            struct timespec now = {0, 0};
+            while (sigtimedwait(&pipe_signal, nullptr, &now) < 0 && errno == EINTR)
+                ;
+        }
+        pthread_sigmask(SIG_SETMASK, &blocked, nullptr);
+#endif
+        return succeeded;
+    }
+
+    /**
+     * Read up to a delimiter, not included.
+     * @return False if the process exited or timed out first.
+     */
+
+    bool readLine(std::string &line, char delimiter = '\n')
+    {
+        line.clear();
+        while (true) {
+            const char *start = buffer.data() + start_offset;
+            if (const char *found = (const char *)memchr(start, delimiter, end_offset - start_offset)) {
+                line.append(start, found);
+                start_offset = found + 1 - buffer.data();
+                return true;
+            }
+            line.append(start, end_offset - start_offset);
+            start_offset = end_offset;
+            if (!fill())
+                return false;
+        }
+    }
+
+    bool readBytes(size_t length, std::string &data)
+    {
+        data.clear();
+        data.reserve(length);
+        while (data.size() < length) {
+            if (start_offset == end_offset && !fill())
+                return false;
+            size_t available = std::min(length - data.size(), end_offset - start_offset);
+            data.append(buffer.data() + start_offset, available);
+            start_offset += available;
+        }
+        return true;
+    }
+
+private:
+    // A pipe neither of whose ends is inherited by processes spawned meanwhile
+    static bool closedOnExec(int fds[2])
+    {
+#ifdef __linux__
+        return pipe2(fds, O_CLOEXEC) == 0;
+#else
+        if (pipe(fds) != 0)
+            return false;
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        return true;
+#endif
+    }
+
+    std::vector<std::string> arguments;
+    pid_t pid = -1;
+    int input = -1, output = -1;
+    size_t starts = 0;
+    // Output read but not yet consumed is buffer[start_offset, end_offset)
+    std::vector<char> buffer;
+    size_t start_offset = 0, end_offset = 0;
+
+    bool fill()
+    {
+        start_offset = end_offset = 0;
+        pollfd readable = {output, POLLIN, 0};
+        int polled;
+        while ((polled = poll(&readable, 1, Timeout * 1000)) < 0 && errno == EINTR)
+            ;
+        if (polled <= 0)
+            return false;
+
+        ssize_t bytesRead;
+        while ((bytesRead = ::read(output, buffer.data(), buffer.size())) < 0 && errno == EINTR)
+            ;
+        if (bytesRead <= 0)
+            return false;
+        end_offset = bytesRead;
+        return true;
+    }
+};
+
+// How git would diff a file: line by line as its texts are, as binary with no
+// lines or some other way, for which git is to be run
+enum class DiffAs {
+    Text,
+    Binary,
+    Git,
+};
+
+// The cat-file and check-attr processes for a work tree, started when first used
+class GitProcesses {
+public:
+    // Bytes of requests written before reading their responses, well within
+    // a pipe's buffer so git never blocks writing output while we write input.
+    static constexpr size_t PipelineBytes = 16 * 1024;
+
+    struct Statistics {
+        size_t requests, starts, restarts;
+    };
+
+    explicit GitProcesses(const std::string &work_tree)
+        : cat_file({"git", "-C", work_tree, "cat-file", "--batch"}),
+          check_attr({"git", "-C", work_tree, "check-attr", "--stdin", "-z",
+                      "filter", "ident", "working-tree-encoding", "text", "eol", "crlf", "diff"}) {}
+
+    /**
+     * Read objects by id or name, such as "HEAD:path" or ":path", with requests
+     * pipelined. The callback is passed each object in order, with type None
+     * for those missing.
+     * @return False if git could not be run or its response was not understood.
+     */
+
+    bool catFile(const std::vector<std::string> &names,
+                 const std::function<void (size_t index, ObjectType type, std::string &data)> &callback)
+    {
+        for (const std::string &name : names)
+            if (name.empty() || name.find('\n') != std::string::npos)
+                return false;
+
+        std::lock_guard<std::mutex> locked(lock);
+        std::string response, data;
+        size_t next = 0;
+
+        return exchange(cat_file, [&] {
+            while (next < names.size()) {
+                size_t batch = next;
+                std::string requests;
+                while (batch < names.size() && (requests.empty() || requests.size() + names[batch].size() < PipelineBytes))
+                    requests += names[batch++] + "\n";
+                if (!cat_file.write(requests))
+                    return false;
+
+                // "<id> <type> <size>\n<contents>\n" or "<name> missing\n"
+                for (; next < batch; next++) {
+                    if (!cat_file.readLine(response))
+                        return false;
+                    size_t space = response.find(' '), last = response.rfind(' ');
+                    if (space == std::string::npos)
+                        return false;
+
+                    ObjectType type = ObjectType::None;
+                    std::string status = response.substr(last + 1);
+                    if (status != "missing" && status != "ambiguous") {
+                        static const char *const types[] = {"commit", "tree", "blob", "tag"};
+                        for (int i = 0; i < 4; i++)
+                            if (response.compare(space + 1, last - space - 1, types[i]) == 0)
+                                type = ObjectType(i + 1);
+                        if (!cat_file.readBytes(strtoull(response.c_str() + last + 1, nullptr, 10), data) ||
+                            !cat_file.readLine(response) || !response.empty())
+                            return false;
+                    } else
+                        data.clear();
+
+                    callback(next, type, data);
+                }
+            }
+            return true;
+        });
+    }
+
+    Lookup catFile(const std::string &name, ObjectType &type, std::string &data)
+    {
+        bool found = false;
+        if (!catFile({name}, [&](size_t, ObjectType object_type, std::string &object) {
+                found = object_type != ObjectType::None;
+                type = object_type;
+                data.swap(object);
+            }))
+            return Lookup::Failed;
+        return found ? Lookup::Found : Lookup::Missing;
+    }
+
+    // Those asked of check-attr
+    static constexpr int Attributes = 7;
+
+    /**
+     * The attributes text is converted and diffed by for a path relative to the
+     * work tree, by name: "unspecified", "set", "unset" or their value.
+     */
+
+    bool attributes(const std::string &path, std::map<std::string, std::string> &values)
+    {
+        if (path.empty() || path.find('\0') != std::string::npos)
+            return false;
+
+        std::lock_guard<std::mutex> locked(lock);
+        return exchange(check_attr, [&] {
+            // "<path>\0<attribute>\0<value>\0" for each attribute
+            std::string field, attribute;
+            if (!check_attr.write(path + std::string(1, '\0')))
+                return false;
+            values.clear();
+            for (int i = 0; i < Attributes; i++) {
+                if (!check_attr.readLine(field, '\0') || field != path ||
+                    !check_attr.readLine(attribute, '\0') || !check_attr.readLine(field, '\0'))
+                    return false;
+                values[attribute] = field;
+            }
+            return true;
+        });
+    }
+
+    /**
+     * How git would diff a file's texts. Filters, ident and encodings could
+     * change anything, as could a diff driver's textconv, but line ending
+     * conversions only change text with carriage returns. Texts with a NUL
+     * are binary unless the diff attribute is set.
+     * @param line_endings Whether the configuration converts line endings.
+     * @return Git as well if the attributes could not be read.
+     */
+
+    DiffAs diffAs(const std::string &path, bool line_endings, const std::string &base, const std::string &working)
+    {
+        std::map<std::string, std::string> values;
+        if (!attributes(path, values))
+            return DiffAs::Git;
+
+        auto specified = [&](const char *attribute) {
+            const std::string &value = values[attribute];
+            return value != "unspecified" && value != "unset";
+        };
+        if (specified("filter") || specified("ident") || specified("working-tree-encoding"))
+            return DiffAs::Git;
+        // -diff or binary, or a driver
+        const std::string &diff = values["diff"];
+        if (diff != "unspecified" && diff != "set")
+            return DiffAs::Git;
+        if (diff != "set" && (isBinary(base) || isBinary(working)))
+            return DiffAs::Binary;
+
+        line_endings = line_endings || specified("text") || specified("eol") || specified("crlf");
+        if (line_endings && (memchr(base.data(), '\r', base.size()) || memchr(working.data(), '\r', working.size())))
+            return DiffAs::Git;
+        return DiffAs::Text;
+    }
+
+    Statistics statistics() const
+    {
+        std::lock_guard<std::mutex> locked(lock);
+        return {requests, cat_file.startCount() + check_attr.startCount(), restarts};
+    }
+
+private:
+    mutable std::mutex lock;
+    CoProcess cat_file, check_attr;
+    size_t requests = 0, restarts = 0;
+
+    // Make a request of a process, restarting it to retry once
+    template <typename Request>
+    bool exchange(CoProcess &process, Request &&request)
+    {
+        requests++;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            bool running = process.alive();
+            if (!running && process.startCount() != 0)
+                restarts++;
+            if (!running && !process.start())
+                return false;
+            if (request())
+                return true;
+
+            // Exited or hung part way, what's left of a response can't be trusted
+            process.stop();
+        }
+        return false;
+    }
+};
+
+// Processes by work tree
+class CoProcessPool {
+public:
+    explicit CoProcessPool(size_t limit = 8)
+        : limit(limit) {}
+
+    std::shared_ptr<GitProcesses> forWorkTree(const std::string &work_tree)
+    {
+        std::lock_guard<std::mutex> locked(lock);
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+            if (it->first == work_tree) {
+                entries.splice(entries.begin(), entries, it);
+                return it->second;
+            }
+
+        entries.emplace_front(work_tree, std::make_shared<GitProcesses>(work_tree));
+        // Stopped when the last request using them finishes
+        if (entries.size() > limit)
+            entries.pop_back();
+        return entries.front().second;
+    }
+
+private:
+    std::mutex lock;
+    size_t limit;
+    std::list<std::pair<std::string, std::shared_ptr<GitProcesses>>> entries;   // Most recently used first
+};
+
+} // namespace git
+
+#endif /* CoProcess_hpp */
@@ -30,6 +30,8 @@
 
 #import <Foundation/Foundation.h>
 
+#import "DMDiff.h"
+
 #pragma mark -
 #pragma mark Generating Diffs
 
@@ -61,6 +63,33 @@ NSArray *diff_diffsBetweenTexts(NSString *text1, NSString *text2);
 NSArray *diff_diffsBetweenTextsWithOptions(NSString *text1, NSString *text2, BOOL highQuality, NSTimeInterval timeLimit);
 
 
+/**
+ * A difference between two UTF-8 texts as byte ranges and as the
+ * equivalent ranges of UTF-16 units for use with NSString.
+ */
+
+typedef struct {
+	DMDiffOperation operation;
+	NSRange bytes;			// Into text2 for inserts, text1 otherwise
+	NSRange characters;		// The same range in UTF-16 units
+} DMUTF8Diff;
+
+
+/**
+ * Find the differences between two UTF-8 texts, such as those read from git,
+ * without first converting them to NSStrings. No range divides a character.
+ * 
+ * @param text1			Old UTF-8 text to be diffed.
+ * @param text2			New UTF-8 text to be diffed.
+ * @param timeLimit		The number in seconds (from the current time) to allow the function to process the diff.
+ *						Enter 0.0 to allow the function an unlimited period.
+ *
+ * @return Returns NSData holding an array of DMUTF8Diff structs.
+ */
+
+NSData *diff_utf8DiffsBetweenTexts(NSData *text1, NSData *text2, NSTimeInterval timeLimit);
+
+
 #pragma mark -
 #pragma mark Formatting Diffs into a human readable output
 
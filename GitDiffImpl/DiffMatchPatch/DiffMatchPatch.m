@@ -44,6 +44,9 @@ DiffProperties diff_defaultDiffProperties()
 	DiffProperties diffProperties;
 	diffProperties.checkLines = FALSE;		// Perform a slower, more accurate diff
 	diffProperties.deadline = 0.0;			// No timeout
+	diffProperties.lineAlgorithm = DiffLineAlgorithmBisect;
+	diffProperties.parallel = TRUE;			// Same result, only used for large texts
+	diffProperties.reuseLineTable = FALSE;
 	return diffProperties;
 }
 
@@ -133,6 +136,12 @@ NSMutableArray *diff_diffsBetweenTextsWithProperties(NSString *text1, NSString *
 	}
 	
 	
+	// Character level diffs are handled entirely by the C++ core.
+	if(!properties.checkLines) {
+		return diff_coreDiffsBetweenTexts(text1, text2, properties);
+	}
+	
+	
 	// Check for equality (speedup).
 	NSMutableArray *diffs;
 	
@@ -281,15 +290,9 @@ NSMutableArray *diff_computeDiffsUsingLineMode(NSString *text1, NSString *text2,
 	nextDiffProperties.checkLines = FALSE;
 	
 	// Scan the text on a line-by-line basis first.
-	NSArray *b = diff_linesToCharsForStrings(text1, text2);
-	text1 = (NSString *)b[0];
-	text2 = (NSString *)b[1];
-	NSMutableArray *linearray = (NSMutableArray *)b[2];
-	
-	NSMutableArray *diffs = diff_diffsBetweenTextsWithProperties(text1, text2, nextDiffProperties);
-	
-	// Convert the diff back to original text.
-	diff_charsToLines(&diffs, linearray);
+	// Lines are interned as 32 bit ids rather than munged into UniChars
+	// so there is no limit of 65535 lines.
+	NSMutableArray *diffs = diff_coreLineDiffsOfStrings(text1, text2, properties);
 	
 	// Eliminate freak matches (e.g. blank lines)
 	diff_cleanupSemantic(&diffs);
@@ -360,175 +363,8 @@ NSMutableArray *diff_computeDiffsUsingLineMode(NSString *text1, NSString *text2,
 
 NSMutableArray *diff_bisectOfStrings(NSString *text1, NSString *text2, DiffProperties properties)
 {
-	BOOL validDeadline = properties.deadline != [[NSDate distantFuture] timeIntervalSinceReferenceDate];
-	
-	NSMutableArray *diffs = nil;
-	BOOL haveFoundDiffs = FALSE;
-	
-	CFStringRef _text1 = (__bridge CFStringRef)text1;
-	CFStringRef _text2 = (__bridge CFStringRef)text2;	
-	
-	// Cache the text lengths to prevent multiple calls.
-	CFIndex text1_length = CFStringGetLength(_text1);
-	CFIndex text2_length = CFStringGetLength(_text2);
-	CFIndex max_d = (text1_length + text2_length + 1) / 2;
-	CFIndex v_offset = max_d;
-	CFIndex v_length = 2 * max_d;
-	CFIndex *v1 = malloc(v_length * sizeof(CFIndex));
-	CFIndex *v2 = malloc(v_length * sizeof(CFIndex));
-	
-	for(CFIndex x = 0; x < v_length; x++) {
-		v1[x] = -1;
-		v2[x] = -1;
-	}
-	
-	v1[v_offset + 1] = 0;
-	v2[v_offset + 1] = 0;
-	CFIndex delta = text1_length - text2_length;
-	
-	// Prepare access to chars arrays for text1 (massive speedup).
-	const UniChar *text1_chars;
-	UniChar *text1_buffer = NULL;
-	diff_CFStringPrepareUniCharBuffer(_text1, &text1_chars, &text1_buffer, CFRangeMake(0, text1_length));
-	
-	// Prepare access to chars arrays for text2 (massive speedup).
-	const UniChar *text2_chars;
-	UniChar *text2_buffer = NULL;
-	diff_CFStringPrepareUniCharBuffer(_text2, &text2_chars, &text2_buffer, CFRangeMake(0, text2_length));
-	
-	// If the total number of characters is odd, then the front path will collide with the reverse path.
-	BOOL front = (delta % 2 != 0);
-	
-	// Offsets for start and end of k loop. Prevents mapping of space beyond the grid.
-	CFIndex k1start = 0;
-	CFIndex k1end = 0;
-	CFIndex k2start = 0;
-	CFIndex k2end = 0;
-	
-	for(CFIndex d = 0; d < max_d; d++) {
-		// Bail out if deadline is reached.
-		if(validDeadline && ([NSDate timeIntervalSinceReferenceDate] > properties.deadline)) {
-			break;
-		}
-		
-		// Walk the front path one step.
-		for(CFIndex k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
-			CFIndex k1_offset = v_offset + k1;
-			CFIndex x1;
-			
-			if(k1 == -d || (k1 != d && v1[k1_offset - 1] < v1[k1_offset + 1])) {
-				x1 = v1[k1_offset + 1];
-			} else {
-				x1 = v1[k1_offset - 1] + 1;
-			}
-			
-			CFIndex y1 = x1 - k1;
-			
-			while(x1 < text1_length && y1 < text2_length && text1_chars[x1] == text2_chars[y1]) {
-				x1++;
-				y1++;
-			}
-			
-			v1[k1_offset] = x1;
-			
-			if(x1 > text1_length) {
-				// Ran off the right of the graph.
-				k1end += 2;
-			} else if(y1 > text2_length) {
-				// Ran off the bottom of the graph.
-				k1start += 2;
-			} else if(front) {
-				CFIndex k2_offset = v_offset + delta - k1;
-				
-				if(k2_offset >= 0 && k2_offset < v_length && v2[k2_offset] != -1) {
-					// Mirror x2 onto top-left coordinate system.
-					CFIndex x2 = text1_length - v2[k2_offset];
-					
-					if(x1 >= x2) {
-						// Overlap detected.
-						diffs = diff_bisectSplitOfStrings(text1, text2, x1, y1, properties);
-						haveFoundDiffs = TRUE;
-						break;
-					}
-				}
-			}
-		}
-		
-		if(haveFoundDiffs)
-			break;
-		
-		// Walk the reverse path one step.
-		for(CFIndex k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
-			CFIndex k2_offset = v_offset + k2;
-			CFIndex x2;
-			
-			if(k2 == -d || (k2 != d && v2[k2_offset - 1] < v2[k2_offset + 1])) {
-				x2 = v2[k2_offset + 1];
-			} else {
-				x2 = v2[k2_offset - 1] + 1;
-			}
-			
-			CFIndex y2 = x2 - k2;
-			
-			while((x2 < text1_length && y2 < text2_length) && (text1_chars[text1_length - x2 - 1] == text2_chars[text2_length - y2 - 1])) {
-				x2++;
-				y2++;
-			}
-			
-			v2[k2_offset] = x2;
-			
-			if(x2 > text1_length) {
-				// Ran off the left of the graph.
-				k2end += 2;
-			} else if(y2 > text2_length) {
-				// Ran off the top of the graph.
-				k2start += 2;
-			} else if(!front) {
-				CFIndex k1_offset = v_offset + delta - k2;
-				
-				if(k1_offset >= 0 && k1_offset < v_length && v1[k1_offset] != -1) {
-					CFIndex x1 = v1[k1_offset];
-					CFIndex y1 = v_offset + x1 - k1_offset;
-					// Mirror x2 onto top-left coordinate system.
-					x2 = text1_length - x2;
-					
-					if(x1 >= x2) {
-						// Overlap detected.
-						diffs = diff_bisectSplitOfStrings(text1, text2, x1, y1, properties);
-						haveFoundDiffs = TRUE;
-						break;
-					}
-				}
-			}
-		}
-		
-		if(haveFoundDiffs)
-			break;
-	}
-	
-	
-	// Free buffers
-	if(text1_buffer != NULL) {
-		free(text1_buffer);
-	};
-	
-	if(text2_buffer != NULL) {
-		free(text2_buffer);
-	};
-	
-	free(v1);
-	free(v2);
-	
-	
-	// Diff took too long and hit the deadline or
-	// number of diffs equals number of characters, no commonality at all.
-	if(!diffs) {
-		diffs = [[NSMutableArray alloc] initWithCapacity:2];
-		[diffs addObject:[DMDiff diffWithOperation:DIFF_DELETE andText:text1]];
-		[diffs addObject:[DMDiff diffWithOperation:DIFF_INSERT andText:text2]];
-	}
-	
-	return diffs;
+	// See diff_coreBisectOfStrings() in DiffMatchPatchCore.mm
+	return diff_coreBisectOfStrings(text1, text2, properties);
 }
 
 
@@ -560,38 +396,6 @@ NSMutableArray *diff_bisectOfStrings(NSString *text1, NSString *text2, DiffPrope
 
 
 
-/**
- * Split two texts into a list of strings.  Reduce the texts to a string of
- * hashes where each Unicode character represents one line.
- * @param text1 First NSString.
- * @param text2 Second NSString.
- * @return Three element NSArray, containing the encoded text1, the
- *     encoded text2 and the NSMutableArray of unique strings. The zeroth element
- *     of the NSArray of unique strings is intentionally blank.
- */
-
-NSArray *diff_linesToCharsForStrings(NSString *text1, NSString *text2)
-{
-	NSMutableArray *lineArray = [NSMutableArray array];		// NSString objects
-	CFMutableDictionaryRef lineHash = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
-	// keys: NSString, values:raw CFIndex
-	// e.g. [lineArray objectAtIndex:4] == "Hello\n"
-	// e.g. [lineHash objectForKey:"Hello\n"] == 4
-	
-	// "\x00" is a valid character, but various debuggers don't like it.
-	// So we'll insert a junk entry to avoid generating a nil character.
-	[lineArray addObject:@""];
-	
-	NSString *chars1 = (NSString *)CFBridgingRelease(diff_linesToCharsMungeCFStringCreate((__bridge CFStringRef)text1, (__bridge CFMutableArrayRef)lineArray, lineHash));
-	NSString *chars2 = (NSString *)CFBridgingRelease(diff_linesToCharsMungeCFStringCreate((__bridge CFStringRef)text2, (__bridge CFMutableArrayRef)lineArray, lineHash));
-	NSArray *result = @[chars1, chars2, lineArray];
-	CFRelease(lineHash);
-	
-	return result;
-}
-
-
-
 /**
  * Split two texts into a list of strings.  Reduce the texts to a string of
  * hashes where each Unicode character represents one token (or boundary between tokens).
@@ -650,25 +454,6 @@ NSArray *diff_tokensToCharsForStrings(NSString *text1, NSString *text2, DiffToke
 
 
 
-/**
- * Rehydrate the text in a diff from an NSString of line hashes to real lines
- * of text.
- * @param NSArray of Diff objects.
- * @param NSArray of unique strings.
- */
-
-void diff_charsToLines(NSArray **diffs, NSArray *lineArray)
-{
-	if(diffs == NULL)
-		return;
-	
-	for(DMDiff *diff in *diffs) {
-		diff.text = (__bridge_transfer NSString *)diff_charsToTokenCFStringCreate((__bridge CFStringRef)diff.text, (__bridge CFArrayRef)lineArray);
-	}
-}
-
-
-
 /**
  * Rehydrate the text in a diff from an NSString of token hashes to real text tokens.
  * @param NSArray of Diff objects.
@@ -695,132 +480,8 @@ void diff_charsToTokens(NSArray **diffs, NSArray *tokenArray)
 
 void diff_cleanupMerge(NSMutableArray **inputDiffs)
 {
-	if(inputDiffs == NULL || [*inputDiffs count] == 0) {
-		return;
-	}
-	
-	NSMutableArray *diffs = *inputDiffs;
-	[diffs addObject:[DMDiff diffWithOperation:DIFF_EQUAL andText:@""]];	// Add a dummy entry at the end.
-	
-	NSUInteger indexOfCurrentDiff = 0;
-	NSUInteger count_delete = 0;
-	NSUInteger count_insert = 0;
-	NSString *text_delete = @"";
-	NSString *text_insert = @"";
-	NSUInteger commonlength;
-	
-	while(indexOfCurrentDiff < diffs.count) {
-		DMDiff *thisDiff = diffs[indexOfCurrentDiff];
-		
-		switch(thisDiff.operation) {
-			case DIFF_INSERT:
-				count_insert++;
-				text_insert = [text_insert stringByAppendingString:thisDiff.text];
-				indexOfCurrentDiff++;
-				break;
-			
-			case DIFF_DELETE:
-				count_delete++;
-				text_delete = [text_delete stringByAppendingString:thisDiff.text];
-				indexOfCurrentDiff++;
-				break;
-			
-			case DIFF_EQUAL:
-				// Upon reaching an equality, check for prior redundancies.
-				if(count_delete + count_insert > 1) {
-					if(count_delete != 0 && count_insert != 0) {
-						// Factor out any common prefixes.
-						commonlength = (NSUInteger)diff_commonPrefix((__bridge CFStringRef)text_insert, (__bridge CFStringRef)text_delete);
-						
-						if(commonlength != 0) {
-							if((indexOfCurrentDiff - count_delete - count_insert) > 0 && ((DMDiff *)[diffs objectAtIndex:(indexOfCurrentDiff - count_delete - count_insert - 1)]).operation == DIFF_EQUAL) {
-								((DMDiff *)[diffs objectAtIndex:(indexOfCurrentDiff - count_delete - count_insert - 1)]).text = [((DMDiff *)[diffs objectAtIndex:(indexOfCurrentDiff - count_delete - count_insert - 1)]).text stringByAppendingString:[text_insert substringToIndex:commonlength]];
-							} else {
-								[diffs insertObject:[DMDiff diffWithOperation:DIFF_EQUAL andText:[text_insert substringToIndex:commonlength]] atIndex:0];
-								indexOfCurrentDiff++;
-							}
-							text_insert = [text_insert substringFromIndex:commonlength];
-							text_delete = [text_delete substringFromIndex:commonlength];
-						}
-						
-						// Factor out any common suffixes.
-						commonlength = (NSUInteger)diff_commonSuffix((__bridge CFStringRef)text_insert, (__bridge CFStringRef)text_delete);
-						
-						if(commonlength != 0) {
-							thisDiff.text = [[text_insert substringFromIndex:(text_insert.length - commonlength)] stringByAppendingString:thisDiff.text];
-							text_insert = [text_insert substringWithRange:NSMakeRange(0, text_insert.length - commonlength)];
-							text_delete = [text_delete substringWithRange:NSMakeRange(0, text_delete.length - commonlength)];
-						}
-					}
-					
-					// Delete the offending records and add the merged ones.
-					if(count_delete == 0) {
-						diff_spliceTwoArrays(&diffs, indexOfCurrentDiff - count_insert, count_delete + count_insert, [NSMutableArray arrayWithObject:[DMDiff diffWithOperation:DIFF_INSERT andText:text_insert]]);
-					} else if(count_insert == 0) {
-						diff_spliceTwoArrays(&diffs, indexOfCurrentDiff - count_delete, count_delete + count_insert, [NSMutableArray arrayWithObject:[DMDiff diffWithOperation:DIFF_DELETE andText:text_delete]]);
-					} else {
-						diff_spliceTwoArrays(&diffs, indexOfCurrentDiff - count_delete - count_insert, count_delete + count_insert, [NSMutableArray arrayWithObjects:[DMDiff diffWithOperation:DIFF_DELETE andText:text_delete], [DMDiff diffWithOperation:DIFF_INSERT andText:text_insert], nil]);
-					}
-					
-					indexOfCurrentDiff = indexOfCurrentDiff - count_delete - count_insert +
-					(count_delete != 0 ? 1 : 0) + (count_insert != 0 ? 1 : 0) + 1;
-				} else if(indexOfCurrentDiff != 0 && [diffs[indexOfCurrentDiff - 1] operation] == DIFF_EQUAL) {
-					// Merge this equality with the previous one.
-					DMDiff *prevDiff = diffs[indexOfCurrentDiff - 1];
-					prevDiff.text = [prevDiff.text stringByAppendingString:thisDiff.text];
-					[diffs removeObjectAtIndex:indexOfCurrentDiff];
-				} else {
-					indexOfCurrentDiff++;
-				}
-				
-				count_insert = 0;
-				count_delete = 0;
-				text_delete = @"";
-				text_insert = @"";
-				break;
-		}
-	}
-	
-	if(((DMDiff *)diffs.lastObject).text.length == 0) {
-		[diffs removeLastObject];  // Remove the dummy entry at the end.
-	}
-	
-	// Second pass: look for single edits surrounded on both sides by
-	// equalities which can be shifted sideways to eliminate an equality.
-	// e.g: A<ins>BA</ins>C -> <ins>AB</ins>AC
-	BOOL changes = NO;
-	indexOfCurrentDiff = 1;
-	
-	// Intentionally ignore the first and last element (as they don't need checking).
-	while(indexOfCurrentDiff < (diffs.count - 1)) {
-		DMDiff *prevDiff = diffs[indexOfCurrentDiff - 1];
-		DMDiff *thisDiff = diffs[indexOfCurrentDiff];
-		DMDiff *nextDiff = diffs[indexOfCurrentDiff + 1];
-		
-		if(prevDiff.operation == DIFF_EQUAL && nextDiff.operation == DIFF_EQUAL) {
-			// This is a single edit surrounded by equalities.
-			if([thisDiff.text hasSuffix:prevDiff.text]) {
-				// Shift the edit over the previous equality.
-				thisDiff.text = [prevDiff.text stringByAppendingString:[thisDiff.text substringToIndex:(thisDiff.text.length - prevDiff.text.length)]];
-				nextDiff.text = [prevDiff.text stringByAppendingString:nextDiff.text];
-				diff_spliceTwoArrays(inputDiffs, indexOfCurrentDiff - 1, 1, nil);
-				changes = YES;
-			} else if([thisDiff.text hasPrefix:nextDiff.text]) {
-				// Shift the edit over the next equality.
-				prevDiff.text = [prevDiff.text stringByAppendingString:nextDiff.text];
-				thisDiff.text = [[thisDiff.text substringFromIndex:nextDiff.text.length] stringByAppendingString:nextDiff.text];
-				diff_spliceTwoArrays(inputDiffs, indexOfCurrentDiff + 1, 1, nil);
-				changes = YES;
-			}
-		}
-		
-		indexOfCurrentDiff++;
-	}
-	
-	// If shifts were made, the diff needs reordering and another shift sweep.
-	if(changes) {
-		diff_cleanupMerge(inputDiffs);
-	}
+	// Merged in a single pass over spans rather than splicing the array.
+	diff_coreCleanupMerge(inputDiffs);
 }
 
 
@@ -834,80 +495,7 @@ void diff_cleanupMerge(NSMutableArray **inputDiffs)
 
 void diff_cleanupSemanticLossless(NSMutableArray **mutableDiffs)
 {
-	if(mutableDiffs == NULL || [*mutableDiffs count] == 0) {
-		return;
-	}
-	
-	
-	NSMutableArray *diffs = *mutableDiffs;
-	NSUInteger indexOfCurrentDiff = 1;
-	
-	// Intentionally ignore the first and last element (as they don't need checking).
-	while(indexOfCurrentDiff < (diffs.count - 1)) {
-		DMDiff *prevDiff = diffs[indexOfCurrentDiff - 1];
-		DMDiff *thisDiff = diffs[indexOfCurrentDiff];
-		DMDiff *nextDiff = diffs[indexOfCurrentDiff + 1];
-		
-		if(prevDiff.operation == DIFF_EQUAL && nextDiff.operation == DIFF_EQUAL) {
-			// This is a single edit surrounded by equalities.
-			NSString *equality1 = prevDiff.text;
-			NSString *edit = thisDiff.text;
-			NSString *equality2 = nextDiff.text;
-			
-			// First, shift the edit as far left as possible.
-			NSUInteger commonOffset = (NSUInteger)diff_commonSuffix((__bridge CFStringRef)equality1, (__bridge CFStringRef)edit);
-			
-			if(commonOffset > 0) {
-				NSString *commonString = [edit substringFromIndex:(edit.length - commonOffset)];
-				equality1 = [equality1 substringToIndex:(equality1.length - commonOffset)];
-				edit = [commonString stringByAppendingString:[edit substringToIndex:(edit.length - commonOffset)]];
-				equality2 = [commonString stringByAppendingString:equality2];
-			}
-			
-			// Second, step right character by character,
-			// looking for the best fit.
-			NSString *bestEquality1 = equality1;
-			NSString *bestEdit = edit;
-			NSString *bestEquality2 = equality2;
-			CFIndex bestScore = diff_cleanupSemanticScore((__bridge CFStringRef)equality1, (__bridge CFStringRef)edit) + diff_cleanupSemanticScore((__bridge CFStringRef)edit, (__bridge CFStringRef)equality2);
-			
-			while((edit.length != 0 && equality2.length != 0) && ([edit characterAtIndex:0] == [equality2 characterAtIndex:0])) {
-				equality1 = [equality1 stringByAppendingString:[edit substringToIndex:1]];
-				edit = [[edit substringFromIndex:1] stringByAppendingString:[equality2 substringToIndex:1]];
-				equality2 = [equality2 substringFromIndex:1];
-				CFIndex score = diff_cleanupSemanticScore((__bridge CFStringRef)equality1, (__bridge CFStringRef)edit) + diff_cleanupSemanticScore((__bridge CFStringRef)edit, (__bridge CFStringRef)equality2);
-				
-				// The >= encourages trailing rather than leading whitespace on edits.
-				if(score >= bestScore) {
-					bestScore = score;
-					bestEquality1 = equality1;
-					bestEdit = edit;
-					bestEquality2 = equality2;
-				}
-			}
-			
-			if(prevDiff.text != bestEquality1) {
-				// We have an improvement, save it back to the diff.
-				if(bestEquality1.length != 0) {
-					prevDiff.text = bestEquality1;
-				} else {
-					[diffs removeObjectAtIndex:indexOfCurrentDiff - 1];
-					indexOfCurrentDiff--;
-				}
-				
-				thisDiff.text = bestEdit;
-				
-				if(bestEquality2.length != 0) {
-					nextDiff.text = bestEquality2;
-				} else {
-					[diffs removeObjectAtIndex:indexOfCurrentDiff + 1];
-					indexOfCurrentDiff--;
-				}
-			}
-		}
-		
-		indexOfCurrentDiff++;
-	}
+	diff_coreCleanupSemanticLossless(mutableDiffs);
 }
 
 
@@ -920,101 +508,8 @@ void diff_cleanupSemanticLossless(NSMutableArray **mutableDiffs)
 
 void patch_cleanupDiffsForEfficiency(NSMutableArray **diffs, PatchProperties properties)
 {
-	if(diffs == NULL || [*diffs count] == 0) {
-		return;
-	}
-	
-	BOOL changes = NO;
-	// Stack of indices where equalities are found.
-	CFMutableArrayRef equalities = CFArrayCreateMutable(kCFAllocatorDefault, 0, NULL);
-	
-	// Always equal to equalities.lastObject.text
-	NSString *lastequality = nil;
-	CFIndex indexOfCurrentDiff = 0;	// Index of current position.
-	BOOL pre_ins = NO;		// Is there an insertion operation before the last equality.
-	BOOL pre_del = NO;		// Is there a deletion operation before the last equality.
-	BOOL post_ins = NO;		// Is there an insertion operation after the last equality.
-	BOOL post_del = NO;		// Is there a deletion operation after the last equality.
-	
-	NSUInteger indexToChange = 0;
-	DMDiff *diffToChange = nil;
-	
-	while(indexOfCurrentDiff < [*diffs count]) {
-		DMDiff *thisDiff = [*diffs objectAtIndex:indexOfCurrentDiff];
-		
-		if(thisDiff.operation == DIFF_EQUAL) {
-			// Equality found.
-			if(thisDiff.text.length < properties.diffEditingCost && (post_ins || post_del)) {
-				// Candidate found.
-				CFArrayAppendValue(equalities, (void *)indexOfCurrentDiff);
-				pre_ins = post_ins;
-				pre_del = post_del;
-				lastequality = thisDiff.text;
-			} else {
-				// Not a candidate, and can never become one.
-				CFArrayRemoveAllValues(equalities);
-				lastequality = nil;
-			}
-			
-			post_ins = post_del = NO;
-		} else {                                                                                                                                                                                                                                                                                                                        
-			// An insertion or deletion.
-			if(thisDiff.operation == DIFF_DELETE) {
-				post_del = YES;
-			} else {
-				post_ins = YES;
-			}
-			
-			/*
-			 * Five types to be split:
-			 * <ins>A</ins><del>B</del>XY<ins>C</ins><del>D</del>
-			 * <ins>A</ins>X<ins>C</ins><del>D</del>
-			 * <ins>A</ins><del>B</del>X<ins>C</ins>
-			 * <ins>A</del>X<ins>C</ins><del>D</del>
-			 * <ins>A</ins><del>B</del>X<del>C</del>
-			 */
-			if((lastequality != nil) && ((pre_ins && pre_del && post_ins && post_del) 
-				|| ((lastequality.length < properties.diffEditingCost / 2)
-					&& ((pre_ins ? 1 : 0) + (pre_del ? 1 : 0) + (post_ins ? 1 : 0) + (post_del ? 1 : 0)) == 3))) {
-				// Duplicate record.
-				CFIndex indexOfLastEquality = diff_CFArrayLastValueAsCFIndex(equalities);
-				[*diffs insertObject:[DMDiff diffWithOperation:DIFF_DELETE andText:lastequality] atIndex:indexOfLastEquality];
-				
-				// Change second copy to insert.
-				indexToChange = indexOfLastEquality + 1;
-				diffToChange = [*diffs objectAtIndex:indexToChange];
-				
-				// The following assumes, that the diff we are changing is currently not used in a collection where its hash determines its position (e.g. a dictionary)
-				diffToChange.operation = DIFF_INSERT;
-				
-				diff_CFArrayRemoveLastValue(equalities);	// Throw away the equality we just deleted.
-				lastequality = nil;
-				
-				if(pre_ins && pre_del) {
-				   // No changes made which could affect previous entry, keep going.
-				   post_ins = post_del = YES;
-				   CFArrayRemoveAllValues(equalities);
-				} else {
-				   if(CFArrayGetCount(equalities) > 0) {
-					   diff_CFArrayRemoveLastValue(equalities);
-				   }
-					
-				   indexOfCurrentDiff = CFArrayGetCount(equalities) > 0 ? indexOfLastEquality : -1;
-				   post_ins = post_del = NO;
-				}
-				
-				changes = YES;
-			}
-		}
-		
-		indexOfCurrentDiff++;
-	}
-	
-	if(changes) {
-		diff_cleanupMerge(diffs);
-	}
-	
-	CFRelease(equalities);
+	// Equalities are split in place rather than inserting into the array.
+	diff_coreCleanupEfficiency(diffs, properties.diffEditingCost);
 }
 
 
@@ -1342,150 +837,8 @@ NSUInteger diff_levenshtein(NSArray *diffs)
 
 void diff_cleanupSemantic(NSMutableArray **diffs)
 {
-	if(diffs == NULL || [*diffs count] == 0) {
-		return;
-	}
-	
-	// Stack of indices where equalities are found.
-	CFMutableArrayRef equalities = CFArrayCreateMutable(kCFAllocatorDefault, 0, NULL);
-	
-	NSString *lastEquality = nil;		// Always equal to [diffs objectAtIndex:equalitiesLastValue].text
-	NSUInteger indexOfCurrentDiff = 0;	// Index of current position.
-									
-	// Number of characters that changed prior to the equality.	
-	NSUInteger length_insertions1 = 0;
-	NSUInteger length_deletions1 = 0;
-	
-	// Number of characters that changed after the equality.
-	NSUInteger length_insertions2 = 0;
-	NSUInteger length_deletions2 = 0;
-	
-	NSUInteger indexToChange;
-	DMDiff *diffToChange = nil;
-	BOOL changes = NO;
-	
-	while(indexOfCurrentDiff < [*diffs count]) {
-		DMDiff *thisDiff = [*diffs objectAtIndex:indexOfCurrentDiff];
-		
-		if(thisDiff.operation == DIFF_EQUAL) {                                                                                                                                                                                                                                                                                                // Equality found.
-			CFArrayAppendValue(equalities, (void *)indexOfCurrentDiff);
-			length_insertions1 = length_insertions2;
-			length_deletions1 = length_deletions2;
-			length_insertions2 = 0;
-			length_deletions2 = 0;
-			lastEquality = thisDiff.text;
-		} else {                                                                                                                                                                                                                                                                                                                              // an insertion or deletion
-			if(thisDiff.operation == DIFF_INSERT) {
-				length_insertions2 += thisDiff.text.length;
-			} else {
-				length_deletions2 += thisDiff.text.length;
-			}
-			
-			// Eliminate an equality that is smaller or equal to the edits on both sides of it.
-			if(lastEquality != nil
-			   && (lastEquality.length <= MAX(length_insertions1, length_deletions1))
-			   && (lastEquality.length <= MAX(length_insertions2, length_deletions2))) {
-				// Duplicate record.
-				CFIndex indexOfLastEquality = diff_CFArrayLastValueAsCFIndex(equalities);
-				[*diffs insertObject:[DMDiff diffWithOperation:DIFF_DELETE andText:lastEquality] atIndex:indexOfLastEquality];
-				
-				// Change second copy to insert.
-				indexToChange = indexOfLastEquality + 1;
-				diffToChange = [*diffs objectAtIndex:indexToChange];
-				
-				// The following assumes, that the diff we are changing is currently not used in a collection where its hash determines its position (e.g. a dictionary)
-				diffToChange.operation = DIFF_INSERT;
-				
-				// Throw away the equality we just deleted.
-				diff_CFArrayRemoveLastValue(equalities);
-				
-				if(CFArrayGetCount(equalities) > 0) {
-					diff_CFArrayRemoveLastValue(equalities);
-				}
-				
-				// Setting an unsigned value to -1 may seem weird to some,
-				// but we will pass thru a ++ below:
-				// => overflow => 0
-				indexOfCurrentDiff = CFArrayGetCount(equalities) > 0 ? diff_CFArrayLastValueAsCFIndex(equalities) : -1;
-				
-				// Reset the counters.
-				length_insertions1 = 0;
-				length_deletions1 = 0;
-				length_insertions2 = 0;
-				length_deletions2 = 0;
-				lastEquality = nil;
-				changes = YES;
-			}
-		}
-		
-		indexOfCurrentDiff++;
-	}
-	
-	// Normalize the diff.
-	if(changes) {
-		diff_cleanupMerge(diffs);
-	}
-	
-	
-	diff_cleanupSemanticLossless(diffs);
-	
-	// Jan: someDiff.text will NOT retain and autorelease the NSString object.
-	// This is why “prevDiff.text = ” below can cause it’s previous value to be deallocated
-	// instead of just released as one would expect without taking the above into account.
-	// Thus we need to retain its previous value before “prevDiff.text = ” and release afterwards.
-	// Alternatively, we could remove the nonatomic from the “text” @property definition.
-	// This would cause much more of a perfomance hit then warranted, though.
-	
-	// Find any overlaps between deletions and insertions.
-	// e.g: <del>abcxxx</del><ins>xxxdef</ins>
-	// -> <del>abc</del>xxx<ins>def</ins>
-	// e.g: <del>xxxabc</del><ins>defxxx</ins>
-	// -> <ins>def</ins>xxx<del>abc</del>
-	// Only extract an overlap if it is as big as the edit ahead or behind it.
-	indexOfCurrentDiff = 1;
-	
-	while(indexOfCurrentDiff < [*diffs count]) {
-		DMDiff *prevDiff = [*diffs objectAtIndex:indexOfCurrentDiff - 1];
-		DMDiff *thisDiff = [*diffs objectAtIndex:indexOfCurrentDiff];
-		
-		if(prevDiff.operation == DIFF_DELETE && thisDiff.operation == DIFF_INSERT) {
-			NSString *deletion = prevDiff.text;
-			NSString *insertion = thisDiff.text;
-			NSUInteger overlap_length1 = (NSUInteger)diff_commonOverlap((__bridge CFStringRef)deletion, (__bridge CFStringRef)insertion);
-			NSUInteger overlap_length2 = (NSUInteger)diff_commonOverlap((__bridge CFStringRef)insertion, (__bridge CFStringRef)deletion);
-			
-			if(overlap_length1 >= overlap_length2) {
-				if((overlap_length1 >= deletion.length / 2.0f) || (overlap_length1 >= insertion.length / 2.0f)) {
-					// Overlap found. Insert an equality and trim the surrounding edits.
-					[*diffs insertObject:[DMDiff diffWithOperation:DIFF_EQUAL andText:[insertion substringToIndex:overlap_length1]] atIndex:indexOfCurrentDiff];
-					prevDiff.text = [deletion substringToIndex:(deletion.length - overlap_length1)];
-					
-					DMDiff *nextDiff = [*diffs objectAtIndex:indexOfCurrentDiff + 1];
-					nextDiff.text = [insertion substringFromIndex:overlap_length1];
-					indexOfCurrentDiff++;
-				}
-			} else {
-				if(overlap_length2 >= deletion.length / 2.0f ||
-				   overlap_length2 >= insertion.length / 2.0f) {
-					// Reverse overlap found.
-					// Insert an equality and swap and trim the surrounding edits.
-					[*diffs insertObject:[DMDiff diffWithOperation:DIFF_EQUAL andText:[deletion substringToIndex:overlap_length2]] atIndex:indexOfCurrentDiff];
-					prevDiff.operation = DIFF_INSERT;
-					prevDiff.text = [insertion substringToIndex:(insertion.length - overlap_length2)];
-			DMDiff *nextDiff = [*diffs objectAtIndex:indexOfCurrentDiff + 1];
-					nextDiff.operation = DIFF_DELETE;
-					nextDiff.text = [deletion substringFromIndex:overlap_length2];
-					indexOfCurrentDiff++;
-				}
-			}
-			
-			indexOfCurrentDiff++;
-		}
-		
-		indexOfCurrentDiff++;
-	}
-	
-	CFRelease(equalities);
+	// See Differ::cleanupSemantic(), equalities are marked and the spans compacted once.
+	diff_coreCleanupSemantic(diffs);
 }
 
 
@@ -1567,126 +920,8 @@ NSUInteger match_locationOfMatchInTextWithProperties(NSString *text, NSString *p
 
 NSUInteger match_bitapOfTextAndPattern(NSString *text, NSString *pattern, NSUInteger approximateLocation, MatchProperties properties)
 {
-	NSCAssert((properties.matchMaximumBits == 0 || pattern.length <= properties.matchMaximumBits), @"Pattern too long for this application.");
-	
-	// Initialise the alphabet.
-	NSMutableDictionary *alphabet = match_alphabetFromPattern(pattern);
-	
-	// Highest score beyond which we give up.
-	double score_threshold = properties.matchThreshold;
-	
-	// Is there a nearby exact match? (speedup)
-	NSUInteger best_loc = [text rangeOfString:pattern options:NSLiteralSearch range:NSMakeRange(approximateLocation, text.length - approximateLocation)].location;
-	
-	if(best_loc != NSNotFound) {
-		score_threshold = MIN(match_bitapScoreForErrorCount(0, best_loc, approximateLocation, pattern, properties), score_threshold);
-		
-		// What about in the other direction? (speedup)
-		NSUInteger searchRangeLoc = MIN(approximateLocation + pattern.length, text.length);
-		NSRange searchRange = NSMakeRange(0, searchRangeLoc);
-		best_loc = [text rangeOfString:pattern options:(NSLiteralSearch | NSBackwardsSearch) range:searchRange].location;
-		
-		if(best_loc != NSNotFound) {
-			score_threshold = MIN(match_bitapScoreForErrorCount(0, best_loc, approximateLocation, pattern, properties), score_threshold);
-		}
-	}
-	
-	// Initialise the bit arrays.
-	NSUInteger matchmask = 1 << (pattern.length - 1);
-	best_loc = NSNotFound;
-	
-	NSUInteger bin_min, bin_mid;
-	NSUInteger bin_max = pattern.length + text.length;
-	NSUInteger *rd = NULL;
-	NSUInteger *last_rd = NULL;
-	
-	for(NSUInteger d = 0; d < pattern.length; d++) {
-		// Scan for the best match; each iteration allows for one more error.
-		// Run a binary search to determine how far from 'loc' we can stray at
-		// this error level.
-		bin_min = 0;
-		bin_mid = bin_max;
-		
-		while(bin_min < bin_mid) {
-			double score = match_bitapScoreForErrorCount(d, (approximateLocation + bin_mid), approximateLocation, pattern, properties);
-			
-			if(score <= score_threshold) {
-				bin_min = bin_mid;
-			} else {
-				bin_max = bin_mid;
-			}
-			
-			bin_mid = (bin_max - bin_min) / 2 + bin_min;
-		}
-		
-		// Use the result from this iteration as the maximum for the next.
-		bin_max = bin_mid;
-		NSUInteger start = MAX_OF_CONST_AND_DIFF(1, approximateLocation, bin_mid);
-		NSUInteger finish = MIN(approximateLocation + bin_mid, text.length) + pattern.length;
-		
-		rd = (NSUInteger *)calloc((finish + 2), sizeof(NSUInteger));
-		rd[finish + 1] = (1 << d) - 1;
-		
-		for(NSUInteger j = finish; j >= start; j--) {
-			NSUInteger charMatch;
-			
-			if(text.length <= j - 1 || ![alphabet objectForKey:[text substringWithRange:NSMakeRange((j - 1), 1)]]) {
-				// Out of range.
-				charMatch = 0;
-			} else {
-				charMatch = [(NSNumber *)[alphabet objectForKey:[text substringWithRange:NSMakeRange((j - 1), 1)]] unsignedIntegerValue];
-			}
-			
-			if(d == 0) {
-				// First pass: exact match.
-				rd[j] = (((rd[j + 1] << 1) | 1) & charMatch);
-			} else {
-				// Subsequent passes: fuzzy match.
-				rd[j] = (((rd[j + 1] << 1) | 1) & charMatch)
-				| (((last_rd[j + 1] | last_rd[j]) << 1) | 1) | last_rd[j + 1];
-			}
-			
-			if((rd[j] & matchmask) != 0) {
-				double score = match_bitapScoreForErrorCount(d, (j - 1), approximateLocation, pattern, properties);
-				
-				// This match will almost certainly be better than any existing match. But check anyway.
-				if(score <= score_threshold) {
-					// Told you so.
-					score_threshold = score;
-					best_loc = j - 1;
-					
-					if(best_loc > approximateLocation) {
-						// When passing loc, don't exceed our current distance from loc.
-						start = MAX_OF_CONST_AND_DIFF(1, 2 * approximateLocation, best_loc);
-					} else {
-						// Already passed loc, downhill from here.
-						break;
-					}
-				}
-			}
-		}
-		
-		if(last_rd != NULL) {
-			free(last_rd);
-		}
-		
-		last_rd = rd;
-		
-		if(match_bitapScoreForErrorCount((d + 1), approximateLocation, approximateLocation, pattern, properties) > score_threshold) {
-			// No hope for a (better) match at greater error levels.
-			break;
-		}
-	}
-	
-	if(last_rd != NULL && last_rd != rd) {
-		free(last_rd);
-	}
-	
-	if(rd != NULL) {
-		free(rd);
-	}
-	
-	return best_loc;
+	// Patterns of any length are matched using multiple words per bit array.
+	return match_coreBitapOfTextAndPattern(text, pattern, approximateLocation, properties);
 }
 
 
@@ -51,7 +51,7 @@ CF_INLINE void diff_CFStringPrepareUniCharBuffer(CFStringRef string, const UniCh
 	
 	if(*string_chars == NULL) {
 		// Fallback in case CFStringGetCharactersPtr() didn’t work.
-		*string_buffer = malloc(string_range.length * sizeof(UniChar) );
+		*string_buffer = (UniChar *)malloc(string_range.length * sizeof(UniChar) );
 		CFStringGetCharacters(string, string_range, *string_buffer);
 		*string_chars = *string_buffer;
 	}
@@ -72,9 +72,15 @@ CFIndex diff_commonPrefix(CFStringRef text1, CFStringRef text2);
 CFIndex diff_commonSuffix(CFStringRef text1, CFStringRef text2);
 CFIndex diff_commonOverlap(CFStringRef text1, CFStringRef text2);
 
+// Vectorised buffer comparisons (see DiffMatchPatchSIMD.hpp), lengths are in bytes.
+CF_EXTERN_C_BEGIN
+CFIndex diff_commonPrefixOfBytes(const void *text1, const void *text2, CFIndex length);
+CFIndex diff_commonSuffixOfBytes(const void *text1_end, const void *text2_end, CFIndex length);
+CFIndex diff_commonOverlapOfUniChars(const UniChar *text1, CFIndex text1_length, const UniChar *text2, CFIndex text2_length);
+CF_EXTERN_C_END
+
 CFArrayRef diff_halfMatchCreate(CFStringRef text1, CFStringRef text2);
 CFArrayRef diff_halfMatchICreate(CFStringRef longtext, CFStringRef shorttext, CFIndex i);
-CFStringRef diff_linesToCharsMungeCFStringCreate(CFStringRef text, CFMutableArrayRef lineArray, CFMutableDictionaryRef lineHash);
 CFStringRef diff_tokensToCharsMungeCFStringCreate(CFStringRef text, CFMutableArrayRef tokenArray, CFMutableDictionaryRef tokenHash, CFOptionFlags tokenizerOptions);
 CFStringRef diff_wordsToCharsMungeCFStringCreate(CFStringRef text, CFMutableArrayRef tokenArray, CFMutableDictionaryRef tokenHash);
 CFStringRef diff_sentencesToCharsMungeCFStringCreate(CFStringRef text, CFMutableArrayRef tokenArray, CFMutableDictionaryRef tokenHash);
@@ -90,33 +90,67 @@ Boolean diff_regExMatch(CFStringRef text, const regex_t *re)
 
 
 
+// Characters copied out per block when a string’s storage isn’t directly accessible.
+#define diff_AffixBlockLength 256
+
+CFIndex diff_commonAffix(CFStringRef text1, CFStringRef text2, Boolean suffix);
+
+
 /**
- * Determine the common prefix of two strings.
+ * Compare the start or end of two strings using the vectorised kernels.
+ * Where CoreFoundation exposes both strings’ storage it is compared in
+ * place, otherwise characters are copied out a block at a time so the
+ * work done remains proportional to the length of the common affix.
  * @param text1 First string.
  * @param text2 Second string.
- * @return The number of characters common to the start of each string.
+ * @param suffix Compare the ends of the strings rather than the starts.
+ * @return The number of characters in common.
  */
 
-CFIndex diff_commonPrefix(CFStringRef text1, CFStringRef text2)
+CFIndex diff_commonAffix(CFStringRef text1, CFStringRef text2, Boolean suffix)
 {
-	// Performance analysis: http://neil.fraser.name/news/2007/10/09/
 	CFIndex text1_length = CFStringGetLength(text1);
 	CFIndex text2_length = CFStringGetLength(text2);
+	CFIndex numberOfCommonCharacters = MIN(text1_length, text2_length);
 
-	CFStringInlineBuffer text1_inlineBuffer, text2_inlineBuffer;
+	const UniChar *text1_chars = CFStringGetCharactersPtr(text1);
+	const UniChar *text2_chars = CFStringGetCharactersPtr(text2);
 
-	CFStringInitInlineBuffer(text1, &text1_inlineBuffer, CFRangeMake(0, text1_length) );
-	CFStringInitInlineBuffer(text2, &text2_inlineBuffer, CFRangeMake(0, text2_length) );
+	if(text1_chars != NULL && text2_chars != NULL) {
+		CFIndex byteLength = numberOfCommonCharacters * sizeof(UniChar);
+		return (suffix ?
+				diff_commonSuffixOfBytes(text1_chars + text1_length, text2_chars + text2_length, byteLength) :
+				diff_commonPrefixOfBytes(text1_chars, text2_chars, byteLength)) / sizeof(UniChar);
+	}
 
-	UniChar char1, char2;
-	CFIndex numberOfCommonCharacters = MIN(text1_length, text2_length);
+	const char *text1_bytes = CFStringGetCStringPtr(text1, kCFStringEncodingASCII);
+	const char *text2_bytes = CFStringGetCStringPtr(text2, kCFStringEncodingASCII);
 
-	for(CFIndex i = 0; i < numberOfCommonCharacters; i++) {
-		char1 = CFStringGetCharacterFromInlineBuffer(&text1_inlineBuffer, i);
-		char2 = CFStringGetCharacterFromInlineBuffer(&text2_inlineBuffer, i);
+	if(text1_bytes != NULL && text2_bytes != NULL) {
+		return suffix ?
+			diff_commonSuffixOfBytes(text1_bytes + text1_length, text2_bytes + text2_length, numberOfCommonCharacters) :
+			diff_commonPrefixOfBytes(text1_bytes, text2_bytes, numberOfCommonCharacters);
+	}
+
+	UniChar text1_block[diff_AffixBlockLength], text2_block[diff_AffixBlockLength];
+
+	for(CFIndex i = 0; i < numberOfCommonCharacters; i += diff_AffixBlockLength) {
+		CFIndex blockLength = MIN(diff_AffixBlockLength, numberOfCommonCharacters - i);
+		CFIndex byteLength = blockLength * sizeof(UniChar);
+		CFIndex common;
+
+		if(suffix) {
+			CFStringGetCharacters(text1, CFRangeMake(text1_length - i - blockLength, blockLength), text1_block);
+			CFStringGetCharacters(text2, CFRangeMake(text2_length - i - blockLength, blockLength), text2_block);
+			common = diff_commonSuffixOfBytes(text1_block + blockLength, text2_block + blockLength, byteLength);
+		} else {
+			CFStringGetCharacters(text1, CFRangeMake(i, blockLength), text1_block);
+			CFStringGetCharacters(text2, CFRangeMake(i, blockLength), text2_block);
+			common = diff_commonPrefixOfBytes(text1_block, text2_block, byteLength);
+		}
 
-		if(char1 != char2) {
-			return i;
+		if(common < byteLength) {
+			return i + common / sizeof(UniChar);
 		}
 	}
 
@@ -126,36 +160,31 @@ CFIndex diff_commonPrefix(CFStringRef text1, CFStringRef text2)
 
 
 /**
- * Determine the common suffix of two strings.
+ * Determine the common prefix of two strings.
  * @param text1 First string.
  * @param text2 Second string.
- * @return The number of characters common to the end of each string.
+ * @return The number of characters common to the start of each string.
  */
 
-CFIndex diff_commonSuffix(CFStringRef text1, CFStringRef text2)
+CFIndex diff_commonPrefix(CFStringRef text1, CFStringRef text2)
 {
 	// Performance analysis: http://neil.fraser.name/news/2007/10/09/
-	CFIndex text1_length = CFStringGetLength(text1);
-	CFIndex text2_length = CFStringGetLength(text2);
-
-	CFStringInlineBuffer text1_inlineBuffer, text2_inlineBuffer;
+	return diff_commonAffix(text1, text2, false);
+}
 
-	CFStringInitInlineBuffer(text1, &text1_inlineBuffer, CFRangeMake(0, text1_length) );
-	CFStringInitInlineBuffer(text2, &text2_inlineBuffer, CFRangeMake(0, text2_length) );
 
-	UniChar char1, char2;
-	CFIndex numberOfCommonCharacters = MIN(text1_length, text2_length);
 
-	for(CFIndex i = 1; i <= numberOfCommonCharacters; i++) {
-		char1 = CFStringGetCharacterFromInlineBuffer(&text1_inlineBuffer, (text1_length - i) );
-		char2 = CFStringGetCharacterFromInlineBuffer(&text2_inlineBuffer, (text2_length - i) );
+/**
+ * Determine the common suffix of two strings.
+ * @param text1 First string.
+ * @param text2 Second string.
+ * @return The number of characters common to the end of each string.
+ */
 
-		if(char1 != char2) {
-			return i - 1;
-		}
-	}
-	
-	return numberOfCommonCharacters;
+CFIndex diff_commonSuffix(CFStringRef text1, CFStringRef text2)
+{
+	// Performance analysis: http://neil.fraser.name/news/2007/10/09/
+	return diff_commonAffix(text1, text2, true);
 }
 
 
@@ -170,8 +199,6 @@ CFIndex diff_commonSuffix(CFStringRef text1, CFStringRef text2)
 
 CFIndex diff_commonOverlap(CFStringRef text1, CFStringRef text2)
 {
-	CFIndex common_overlap = 0;
-	
 	// Cache the text lengths to prevent multiple calls.
 	CFIndex text1_length = CFStringGetLength(text1);
 	CFIndex text2_length = CFStringGetLength(text2);
@@ -180,66 +207,33 @@ CFIndex diff_commonOverlap(CFStringRef text1, CFStringRef text2)
 	if(text1_length == 0 || text2_length == 0) {
 		return 0;
 	}
-	
-	// Truncate the longer CFStringRef.
-	CFStringRef text1_trunc;
-	CFStringRef text2_trunc;
-	CFIndex text1_trunc_length;
-	
-	if(text1_length > text2_length) {
-		text1_trunc_length = text2_length;
-		text1_trunc = diff_CFStringCreateRightSubstring(text1, text1_length, text1_trunc_length);
 
-		text2_trunc = CFRetain(text2);
-	} else if(text1_length < text2_length) {
-		text1_trunc_length = text1_length;
-		text1_trunc = CFRetain(text1);
-
-		CFIndex text2_trunc_length = text1_length;
-		text2_trunc = diff_CFStringCreateLeftSubstring(text2, text2_trunc_length);
-	} else {
-		text1_trunc_length = text1_length;
-		text1_trunc = CFRetain(text1);
-		text2_trunc = CFRetain(text2);
+	// Only the overlapping ends of the strings are needed.
+	CFIndex text_length = MIN(text1_length, text2_length);
+	CFRange text1_range = CFRangeMake(text1_length - text_length, text_length);
+	CFRange text2_range = CFRangeMake(0, text_length);
+
+	const UniChar *text1_chars;
+	UniChar *text1_buffer = NULL;
+	diff_CFStringPrepareUniCharBuffer(text1, &text1_chars, &text1_buffer, text1_range);
+	if(text1_buffer == NULL) {
+		text1_chars += text1_range.location;
 	}
 
-	CFIndex text_length = MIN(text1_length, text2_length);
-	// Quick check for the worst case.
-	if(CFStringCompare(text1_trunc, text2_trunc, 0) == kCFCompareEqualTo) {
-		common_overlap = text_length;
-	} else {
-		// Start by looking for a single character match
-		// and increase length until no match is found.
-		// Performance analysis: http://neil.fraser.name/news/2010/11/04/
-		CFIndex best = 0;
-		CFIndex length = 1;
-		while(true) {
-			CFStringRef pattern = diff_CFStringCreateRightSubstring(text1_trunc, text1_trunc_length, length);
-			CFRange foundRange = CFStringFind(text2_trunc, pattern, 0);
-			CFRelease(pattern);
-
-			CFIndex found =  foundRange.location;
-			if(found == kCFNotFound) {
-				common_overlap = best;
-				break;
-			}
-			length += found;
+	const UniChar *text2_chars;
+	UniChar *text2_buffer = NULL;
+	diff_CFStringPrepareUniCharBuffer(text2, &text2_chars, &text2_buffer, text2_range);
 
-			CFStringRef text1_sub = diff_CFStringCreateRightSubstring(text1_trunc, text1_trunc_length, length);
-			CFStringRef text2_sub = diff_CFStringCreateLeftSubstring(text2_trunc, length);
+	CFIndex common_overlap = diff_commonOverlapOfUniChars(text1_chars, text_length, text2_chars, text_length);
 
-			if( found == 0 || (CFStringCompare(text1_sub, text2_sub, 0) == kCFCompareEqualTo) ) {
-				best = length;
-				length++;
-			}
+	if(text1_buffer != NULL) {
+		free(text1_buffer);
+	}
 
-			CFRelease(text1_sub);
-			CFRelease(text2_sub);
-		}
+	if(text2_buffer != NULL) {
+		free(text2_buffer);
 	}
 
-	CFRelease(text1_trunc);
-	CFRelease(text2_trunc);
 	return common_overlap;
 }
 
@@ -408,7 +402,7 @@ void diff_mungeHelper(CFStringRef token, CFMutableArrayRef tokenArray, CFMutable
 	} else {
 		CFArrayAppendValue(tokenArray, token);
 		hash = CFArrayGetCount(tokenArray) - 1;
-		NSCAssert(!(hash <= diff_UniCharMax), @"Hash value has exceeded UniCharMax!");
+		NSCAssert(hash <= diff_UniCharMax, @"Hash value has exceeded UniCharMax!");
 		CFDictionaryAddValue(tokenHash, token, (void *)hash);
 		const UniChar hashChar = (UniChar)hash;
 		CFStringAppendCharacters(chars, &hashChar, 1);
@@ -425,49 +419,6 @@ CF_INLINE void diff_mungeTokenForRange(CFStringRef text, CFRange tokenRange, CFM
 
 
 
-/**
- * Split a text into a list of strings.   Reduce the texts to a CFStringRef of
- * hashes where each Unicode character represents one line.
- * @param text CFString to encode.
- * @param lineArray CFMutableArray of unique strings.
- * @param lineHash Map of strings to indices.
- * @return Encoded CFStringRef.
- */
-
-CFStringRef diff_linesToCharsMungeCFStringCreate(CFStringRef text, CFMutableArrayRef lineArray, CFMutableDictionaryRef lineHash)
-{
-	CFRange lineStartRange;
-	CFRange lineEndRange;
-	lineStartRange.location = 0;
-	lineEndRange.location = -1;
-	CFStringRef line;
-	CFMutableStringRef chars = CFStringCreateMutable(kCFAllocatorDefault, 0);
-
-	CFIndex textLength = CFStringGetLength(text);
-
-	// Walk the text, pulling out a Substring for each line.
-	// CFStringCreateArrayBySeparatingStrings(kCFAllocatorDefault, text, CFSTR("\n")) would temporarily double our memory footprint.
-	// Modifying text would create many large strings.
-	while(lineEndRange.location < textLength - 1) {
-		lineStartRange.length = textLength - lineStartRange.location;
-
-		if(CFStringFindWithOptions(text, CFSTR("\n"), lineStartRange, 0, &lineEndRange) == false) {
-			lineEndRange.location = textLength - 1;
-		}
-		
-		line = diff_CFStringCreateSubstring(text, lineStartRange.location, lineEndRange.location + 1 - lineStartRange.location);
-		lineStartRange.location = lineEndRange.location + 1;
-		
-		diff_mungeHelper(line, lineArray, lineHash, chars);
-
-		CFRelease(line);
-	}
-
-	return chars;
-}
-
-
-
 /**
  * Split a text into a list of strings.   Reduce the texts to a CFStringRef of
  * hashes where where each Unicode character represents one token (or boundary between tokens).
@@ -0,0 +1,1441 @@
+/*
+ * Diff Match and Patch
+ *
+ * Copyright 2010 geheimwerk.de.
+ * http://code.google.com/p/google-diff-match-patch/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: fraser@google.com (Neil Fraser)
+ * ObjC port: jan@geheimwerk.de (Jan Weiß)
+ * Refactoring & mangling: @inquisitivesoft (Harry Jordan)
+ *
+ *
+ * Portable, header-only C++17 core of the diff pipeline
+ * (diff_main -> diff_compute -> diff_bisect -> diff_bisectSplit -> diff_cleanupMerge)
+ * along with a histogram diff for line mode.
+ *
+ * Rather than an array of DMDiff objects the core produces a contiguous
+ * vector of Spans which refer back into the two texts being diffed:
+ * DELETE and EQUAL spans are offsets into text1, INSERT spans into text2.
+ * All working storage lives in an Arena which can be reused between calls
+ * so that, once warmed up, diffing does not allocate.
+ *
+ * Output is intended to be identical to the Objective-C implementation
+ * in DiffMatchPatch.m which is now a thin wrapper (see DiffMatchPatchCore.mm).
+ */
+
+#ifndef DiffMatchPatchCore_hpp
+#define DiffMatchPatchCore_hpp
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "DiffMatchPatchParallel.hpp"
+#include "DiffMatchPatchSIMD.hpp"
+
+namespace dmp {
+
+// Values match DMDiffOperation
+enum class Op : uint8_t {
+	Delete = 1,
+	Insert = 2,
+	Equal = 3
+};
+
+struct Span {
+	Op op;
+	uint32_t offset;	// Into text1 for Delete & Equal, text2 for Insert
+	uint32_t length;
+};
+
+typedef std::chrono::steady_clock Clock;
+typedef Clock::time_point Deadline;
+
+inline constexpr Deadline NoDeadline = Deadline::max();
+
+
+// Scratch storage reused between diffs, typically one per thread.
+
+struct Arena {
+	std::vector<Span> spans;		// Result of the last diff
+	std::vector<Span> scratch;		// Output buffer for the cleanup passes
+	std::vector<ptrdiff_t> v;		// v1 & v2 for diff_bisect
+	std::vector<uint32_t> counts;	// Occurrences of each element for histogram()
+	std::vector<uint32_t> heads;	// First occurrence of each element for histogram()
+	std::vector<uint32_t> chain;	// Next occurrence of the element at each offset
+	std::vector<uint32_t> equalities;	// Stack of equalities for the cleanup passes
+	std::vector<uint8_t> split;		// Equalities a cleanup pass has made a delete and an insert
+};
+
+
+// Character level helpers
+
+/**
+ * Determine the common prefix of two buffers.
+ * @return The number of characters common to the start of each buffer.
+ */
+
+template <typename Char>
+inline size_t commonPrefix(const Char *text1, const Char *text2, size_t length)
+{
+	if constexpr(std::is_integral<Char>::value) {
+		return simd::commonPrefix(text1, text2, length * sizeof(Char)) / sizeof(Char);
+	}
+
+	size_t i = 0;
+	while(i < length && text1[i] == text2[i])
+		i++;
+	return i;
+}
+
+/**
+ * Determine the common suffix of two buffers given pointers to their ends.
+ * @return The number of characters common to the end of each buffer.
+ */
+
+template <typename Char>
+inline size_t commonSuffix(const Char *text1_end, const Char *text2_end, size_t length)
+{
+	if constexpr(std::is_integral<Char>::value) {
+		return simd::commonSuffix(text1_end, text2_end, length * sizeof(Char)) / sizeof(Char);
+	}
+
+	size_t i = 0;
+	while(i < length && text1_end[-1 - (ptrdiff_t)i] == text2_end[-1 - (ptrdiff_t)i])
+		i++;
+	return i;
+}
+
+/**
+ * Find the first occurrence of needle in haystack.
+ * @return Offset of the match or SIZE_MAX if not found.
+ */
+
+template <typename Char>
+inline size_t find(const Char *haystack, size_t haystack_length, const Char *needle, size_t needle_length)
+{
+	const Char *found = std::search(haystack, haystack + haystack_length, needle, needle + needle_length);
+	return found == haystack + haystack_length && needle_length != 0 ? SIZE_MAX : (size_t)(found - haystack);
+}
+
+
+/**
+ * Determine if the suffix of one buffer is the prefix of another.
+ * @return The number of characters common to the end of the first
+ *     buffer and the start of the second buffer.
+ */
+
+template <typename Char>
+inline size_t commonOverlap(const Char *text1, size_t text1_length, const Char *text2, size_t text2_length)
+{
+	// Truncate the longer buffer.
+	size_t text_length = std::min(text1_length, text2_length);
+	text1 += text1_length - text_length;
+
+	// Quick check for the worst case.
+	if(commonPrefix(text1, text2, text_length) == text_length) {
+		return text_length;
+	}
+
+	// Start by looking for a single character match
+	// and increase length until no match is found.
+	// Performance analysis: http://neil.fraser.name/news/2010/11/04/
+	size_t best = 0;
+	for(size_t length = 1; length < text_length;) {
+		size_t found = find(text2, text_length, text1 + text_length - length, length);
+		if(found == SIZE_MAX) {
+			break;
+		}
+
+		length += found;
+		if(found == 0 || commonPrefix(text1 + text_length - length, text2, length) == length) {
+			best = length;
+			length++;
+		}
+	}
+
+	return best;
+}
+
+
+// Semantic scoring for diff_cleanupSemanticLossless
+
+enum CharacterClass : uint8_t {
+	AlphaNumeric = 1,
+	Whitespace = 2,
+	Control = 4
+};
+
+typedef uint8_t (*CharacterClassifier)(uint32_t c);
+
+/**
+ * Default classification: ASCII rules with anything beyond ASCII treated
+ * as alphanumeric. DiffMatchPatchCore.mm supplies the CFCharacterSet
+ * classification used by diff_cleanupSemanticScore().
+ */
+
+inline uint8_t asciiCharacterClasses(uint32_t c)
+{
+	if((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80) {
+		return AlphaNumeric;
+	}
+
+	uint8_t classes = c < 0x20 || c == 0x7f ? Control : 0;
+	if(c == ' ' || (c >= '\t' && c <= '\r')) {
+		classes |= Whitespace;
+	}
+	return classes;
+}
+
+/**
+ * Given two buffers, compute a score representing whether the internal
+ * boundary falls on logical boundaries (diff_cleanupSemanticScore).
+ * @return The score, 6 (best) to 0 (worst).
+ */
+
+template <typename Char>
+inline int semanticScore(const Char *one, size_t one_length, const Char *two, size_t two_length, CharacterClassifier classify)
+{
+	if(one_length == 0 || two_length == 0) {
+		// Edges are the best.
+		return 6;
+	}
+
+	uint8_t classes1 = classify((uint32_t)one[one_length - 1]);
+	uint8_t classes2 = classify((uint32_t)two[0]);
+	bool nonAlphaNumeric1 = !(classes1 & AlphaNumeric);
+	bool nonAlphaNumeric2 = !(classes2 & AlphaNumeric);
+	bool whitespace1 = nonAlphaNumeric1 && (classes1 & Whitespace);
+	bool whitespace2 = nonAlphaNumeric2 && (classes2 & Whitespace);
+	bool lineBreak1 = whitespace1 && (classes1 & Control);
+	bool lineBreak2 = whitespace2 && (classes2 & Control);
+
+	// As the regexes \n\r?\n$ and ^\r?\n\r?\n
+	const Char *end = one + one_length;
+	bool blankLine1 = lineBreak1 && one_length >= 2 && end[-1] == '\n' &&
+		(end[-2] == '\n' || (one_length >= 3 && end[-2] == '\r' && end[-3] == '\n'));
+	bool blankLine2 = false;
+	if(lineBreak2) {
+		size_t i = two[0] == '\r' ? 1 : 0;
+		if(i < two_length && two[i] == '\n') {
+			i++;
+			i += i < two_length && two[i] == '\r' ? 1 : 0;
+			blankLine2 = i < two_length && two[i] == '\n';
+		}
+	}
+
+	if(blankLine1 || blankLine2) {
+		// Five points for blank lines.
+		return 5;
+	} else if(lineBreak1 || lineBreak2) {
+		// Four points for line breaks.
+		return 4;
+	} else if(nonAlphaNumeric1 && !whitespace1 && whitespace2) {
+		// Three points for end of sentences.
+		return 3;
+	} else if(whitespace1 || whitespace2) {
+		// Two points for whitespace.
+		return 2;
+	} else if(nonAlphaNumeric1 || nonAlphaNumeric2) {
+		// One point for non-alphanumeric.
+		return 1;
+	}
+	return 0;
+}
+
+
+// Differ
+
+template <typename Char>
+class Differ {
+public:
+	/**
+	 * @param pool If set, the halves of large bisections are diffed in parallel.
+	 *     The result is the same as without a pool.
+	 */
+
+	Differ(const Char *text1, size_t text1_length, const Char *text2, size_t text2_length,
+		   Arena &arena, Deadline deadline = NoDeadline, WorkStealingPool *pool = nullptr)
+		: text1(text1), text2(text2), text1_length(text1_length), text2_length(text2_length),
+		  arena(arena), spans(arena.spans), deadline(deadline), pool(pool) {}
+
+	/**
+	 * Find the differences between the two texts (diff_diffsBetweenTextsWithProperties).
+	 * @return Spans in the arena, valid until the arena is next used.
+	 */
+
+	const std::vector<Span> &diff()
+	{
+		spans.clear();
+		diffRange(0, text1_length, 0, text2_length);
+		return spans;
+	}
+
+	/**
+	 * Find the 'middle snake' of the texts and recurse (diff_bisectOfStrings).
+	 * @return Spans in the arena, valid until the arena is next used.
+	 */
+
+	const std::vector<Span> &bisect()
+	{
+		spans.clear();
+		bisectRange(0, text1_length, 0, text2_length);
+		return spans;
+	}
+
+	/**
+	 * Find the differences using the histogram algorithm (as git diff --histogram).
+	 * Intended for line mode where each character is a line: the texts are split
+	 * around the longest run of matches anchored on the least frequent element.
+	 * Ranges with no element occurring at most MaxChainLength times fall back
+	 * to diff(). Roughly linear for typical edits with no Diff_Timeout cliff.
+	 * @return Spans in the arena, valid until the arena is next used.
+	 */
+
+	const std::vector<Span> &histogram()
+	{
+		static_assert(std::is_integral<Char>::value, "histogram() requires integral elements");
+		spans.clear();
+		histogramRange(0, text1_length, 0, text2_length);
+		cleanupMerge();
+		return spans;
+	}
+
+	static constexpr uint32_t MaxChainLength = 64;
+
+	// Both halves of a bisection must be at least this long to be diffed in parallel.
+	static constexpr size_t ParallelMinimumLength = 8192;
+
+	/**
+	 * Reorder and merge like edit sections.  Merge equalities.
+	 * Any edit section can move as long as it doesn't cross an equality.
+	 * @param first Index of the first span of the arena to be processed.
+	 */
+
+	void cleanupMerge(size_t first = 0);
+
+	/**
+	 * Reduce the number of edits by eliminating semantically trivial
+	 * equalities (diff_cleanupSemantic). Equalities are split in place and
+	 * the vector compacted once rather than inserting into the middle of it.
+	 * The spans must cover the whole of both texts.
+	 */
+
+	void cleanupSemantic(CharacterClassifier classify = asciiCharacterClasses);
+
+	/**
+	 * Look for single edits surrounded on both sides by equalities
+	 * which can be shifted sideways to align the edit to a word boundary.
+	 * e.g: The c<ins>at c</ins>ame. -> The <ins>cat </ins>came.
+	 */
+
+	void cleanupSemanticLossless(CharacterClassifier classify = asciiCharacterClasses);
+
+	/**
+	 * Reduce the number of edits by eliminating operationally trivial
+	 * equalities (patch_cleanupDiffsForEfficiency).
+	 * The spans must cover the whole of both texts.
+	 */
+
+	void cleanupEfficiency(size_t edit_cost);
+
+	const Char *textFor(const Span &span) const
+	{
+		return (span.op == Op::Insert ? text2 : text1) + span.offset;
+	}
+
+private:
+	const Char *text1, *text2;
+	size_t text1_length, text2_length;
+	Arena &arena;
+	std::vector<Span> &spans;
+	Deadline deadline;
+	WorkStealingPool *pool;
+
+	struct HalfMatch {
+		size_t long_offset;
+		size_t short_offset;
+		size_t length;
+	};
+
+	void append(Op op, size_t offset, size_t length)
+	{
+		spans.push_back(Span{op, (uint32_t)offset, (uint32_t)length});
+	}
+
+	void diffRange(size_t start1, size_t count1, size_t start2, size_t count2);
+	void computeRange(size_t start1, size_t count1, size_t start2, size_t count2);
+	bool halfMatchRange(size_t start1, size_t count1, size_t start2, size_t count2);
+	HalfMatch halfMatchI(const Char *longtext, size_t long_length, const Char *shorttext, size_t short_length, size_t i);
+	void bisectRange(size_t start1, size_t count1, size_t start2, size_t count2);
+
+	struct Region {
+		size_t start1;
+		size_t start2;
+		size_t length;
+	};
+
+	void histogramRange(size_t start1, size_t count1, size_t start2, size_t count2);
+	Region histogramRegion(size_t start1, size_t count1, size_t start2, size_t count2);
+
+	void splitEqualities();
+	void cleanupOverlaps();
+};
+
+
+/**
+ * Find the differences between two ranges. Simplifies the problem by
+ * stripping any common prefix or suffix off the texts before diffing.
+ */
+
+template <typename Char>
+void Differ<Char>::diffRange(size_t start1, size_t count1, size_t start2, size_t count2)
+{
+	size_t first = spans.size();
+	const Char *chars1 = text1 + start1;
+	const Char *chars2 = text2 + start2;
+
+	// Check for equality (speedup).
+	if(count1 == count2 && std::equal(chars1, chars1 + count1, chars2)) {
+		if(count1 != 0) {
+			append(Op::Equal, start1, count1);
+		}
+		return;
+	}
+
+	// Trim off common prefix and suffix (speedup).
+	size_t prefix = commonPrefix(chars1, chars2, std::min(count1, count2));
+	size_t suffix = commonSuffix(chars1 + count1, chars2 + count2, std::min(count1, count2) - prefix);
+
+	if(prefix != 0) {
+		append(Op::Equal, start1, prefix);
+	}
+
+	// Compute the diff on the middle block.
+	computeRange(start1 + prefix, count1 - prefix - suffix, start2 + prefix, count2 - prefix - suffix);
+
+	if(suffix != 0) {
+		append(Op::Equal, start1 + count1 - suffix, suffix);
+	}
+
+	cleanupMerge(first);
+}
+
+
+/**
+ * Compute the differences between two ranges. Assumes that the texts do not
+ * have any common prefix or suffix.
+ */
+
+template <typename Char>
+void Differ<Char>::computeRange(size_t start1, size_t count1, size_t start2, size_t count2)
+{
+	if(count1 == 0) {
+		// Just add some text (speedup).
+		append(Op::Insert, start2, count2);
+		return;
+	}
+
+	if(count2 == 0) {
+		// Just delete some text (speedup).
+		append(Op::Delete, start1, count1);
+		return;
+	}
+
+	bool text1_longer = count1 > count2;
+	size_t long_start = text1_longer ? start1 : start2;
+	size_t long_length = text1_longer ? count1 : count2;
+	size_t short_length = text1_longer ? count2 : count1;
+	const Char *longtext = (text1_longer ? text1 : text2) + long_start;
+	const Char *shorttext = text1_longer ? text2 + start2 : text1 + start1;
+	size_t i = find(longtext, long_length, shorttext, short_length);
+
+	if(i != SIZE_MAX) {
+		// Shorter text is inside the longer text (speedup).
+		Op op = text1_longer ? Op::Delete : Op::Insert;
+		append(op, long_start, i);
+		append(Op::Equal, text1_longer ? start1 + i : start1, short_length);
+		append(op, long_start + i + short_length, long_length - i - short_length);
+		return;
+	}
+
+	if(short_length == 1) {
+		// Single character string.
+		// After the previous speedup, the character can't be an equality.
+		append(Op::Delete, start1, count1);
+		append(Op::Insert, start2, count2);
+		return;
+	}
+
+	// Only risk returning a non-optimal diff if we have limited time.
+	if(deadline != NoDeadline && halfMatchRange(start1, count1, start2, count2)) {
+		return;
+	}
+
+	bisectRange(start1, count1, start2, count2);
+}
+
+
+/**
+ * Do the two ranges share a substring which is at least half the length of
+ * the longer text? If so diff either side of it separately.
+ * This speedup can produce non-minimal diffs.
+ * @return true if a half-match was found and the diff emitted.
+ */
+
+template <typename Char>
+bool Differ<Char>::halfMatchRange(size_t start1, size_t count1, size_t start2, size_t count2)
+{
+	bool text1_longer = count1 > count2;
+	const Char *longtext = text1_longer ? text1 + start1 : text2 + start2;
+	const Char *shorttext = text1_longer ? text2 + start2 : text1 + start1;
+	size_t long_length = text1_longer ? count1 : count2;
+	size_t short_length = text1_longer ? count2 : count1;
+
+	if(long_length < 4 || short_length * 2 < long_length) {
+		return false;	// Pointless.
+	}
+
+	// First check if the second quarter is the seed for a half-match.
+	HalfMatch hm1 = halfMatchI(longtext, long_length, shorttext, short_length, (long_length + 3) / 4);
+
+	// Check again based on the third quarter.
+	HalfMatch hm2 = halfMatchI(longtext, long_length, shorttext, short_length, (long_length + 1) / 2);
+
+	if(hm1.length == 0 && hm2.length == 0) {
+		return false;
+	}
+
+	// If both matched select the longest.
+	const HalfMatch &hm = hm2.length == 0 || hm1.length > hm2.length ? hm1 : hm2;
+	size_t common1 = start1 + (text1_longer ? hm.long_offset : hm.short_offset);
+	size_t common2 = start2 + (text1_longer ? hm.short_offset : hm.long_offset);
+
+	// Send both pairs off for separate processing and merge the results.
+	diffRange(start1, common1 - start1, start2, common2 - start2);
+	append(Op::Equal, common1, hm.length);
+	diffRange(common1 + hm.length, start1 + count1 - common1 - hm.length,
+			  common2 + hm.length, start2 + count2 - common2 - hm.length);
+	return true;
+}
+
+
+/**
+ * Does a substring of shorttext exist within longtext such that the
+ * substring is at least half the length of longtext?
+ * @param i Start index of quarter length substring within longtext.
+ * @return Location of the common middle or a zero length if there was no match.
+ */
+
+template <typename Char>
+typename Differ<Char>::HalfMatch Differ<Char>::halfMatchI(const Char *longtext, size_t long_length,
+														   const Char *shorttext, size_t short_length, size_t i)
+{
+	// Start with a 1/4 length substring at position i as a seed.
+	const Char *seed = longtext + i;
+	size_t seed_length = long_length / 4;
+	HalfMatch best = {0, 0, 0};
+
+	for(size_t j = 0; j < short_length; j++) {
+		size_t found = find(shorttext + j, short_length - j, seed, seed_length);
+		if(found == SIZE_MAX) {
+			break;
+		}
+
+		j += found;
+		size_t prefix_length = commonPrefix(longtext + i, shorttext + j, std::min(long_length - i, short_length - j));
+		size_t suffix_length = commonSuffix(longtext + i, shorttext + j, std::min(i, j));
+
+		if(best.length < suffix_length + prefix_length) {
+			best.long_offset = i - suffix_length;
+			best.short_offset = j - suffix_length;
+			best.length = suffix_length + prefix_length;
+		}
+	}
+
+	if(best.length * 2 < long_length) {
+		best.length = 0;
+	}
+
+	return best;
+}
+
+
+/**
+ * Find the 'middle snake' of a diff, split the problem in two and emit the recursively constructed diff.
+ * See Myers 1986 paper: An O(ND) Difference Algorithm and Its Variations.
+ */
+
+template <typename Char>
+void Differ<Char>::bisectRange(size_t start1, size_t count1, size_t start2, size_t count2)
+{
+	const Char *text1_chars = text1 + start1;
+	const Char *text2_chars = text2 + start2;
+	ptrdiff_t range1_length = (ptrdiff_t)count1;
+	ptrdiff_t range2_length = (ptrdiff_t)count2;
+	ptrdiff_t max_d = (range1_length + range2_length + 1) / 2;
+	ptrdiff_t v_offset = max_d;
+	ptrdiff_t v_length = 2 * max_d;
+
+	// Both vectors share the arena's allocation.
+	arena.v.assign(2 * v_length, -1);
+	ptrdiff_t *v1 = arena.v.data();
+	ptrdiff_t *v2 = v1 + v_length;
+
+	v1[v_offset + 1] = 0;
+	v2[v_offset + 1] = 0;
+	ptrdiff_t delta = range1_length - range2_length;
+
+	// If the total number of characters is odd, then the front path will collide with the reverse path.
+	bool front = (delta % 2 != 0);
+
+	// Offsets for start and end of k loop. Prevents mapping of space beyond the grid.
+	ptrdiff_t k1start = 0;
+	ptrdiff_t k1end = 0;
+	ptrdiff_t k2start = 0;
+	ptrdiff_t k2end = 0;
+
+	bool found = false;
+	ptrdiff_t x = 0, y = 0;
+
+	for(ptrdiff_t d = 0; d < max_d && !found; d++) {
+		// Bail out if deadline is reached.
+		if(deadline != NoDeadline && Clock::now() > deadline) {
+			break;
+		}
+
+		// Walk the front path one step.
+		for(ptrdiff_t k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+			ptrdiff_t k1_offset = v_offset + k1;
+			ptrdiff_t x1;
+
+			if(k1 == -d || (k1 != d && v1[k1_offset - 1] < v1[k1_offset + 1])) {
+				x1 = v1[k1_offset + 1];
+			} else {
+				x1 = v1[k1_offset - 1] + 1;
+			}
+
+			ptrdiff_t y1 = x1 - k1;
+
+			while(x1 < range1_length && y1 < range2_length && text1_chars[x1] == text2_chars[y1]) {
+				x1++;
+				y1++;
+			}
+
+			v1[k1_offset] = x1;
+
+			if(x1 > range1_length) {
+				// Ran off the right of the graph.
+				k1end += 2;
+			} else if(y1 > range2_length) {
+				// Ran off the bottom of the graph.
+				k1start += 2;
+			} else if(front) {
+				ptrdiff_t k2_offset = v_offset + delta - k1;
+
+				if(k2_offset >= 0 && k2_offset < v_length && v2[k2_offset] != -1) {
+					// Mirror x2 onto top-left coordinate system.
+					ptrdiff_t x2 = range1_length - v2[k2_offset];
+
+					if(x1 >= x2) {
+						// Overlap detected.
+						x = x1;
+						y = y1;
+						found = true;
+						break;
+					}
+				}
+			}
+		}
+
+		if(found) {
+			break;
+		}
+
+		// Walk the reverse path one step.
+		for(ptrdiff_t k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+			ptrdiff_t k2_offset = v_offset + k2;
+			ptrdiff_t x2;
+
+			if(k2 == -d || (k2 != d && v2[k2_offset - 1] < v2[k2_offset + 1])) {
+				x2 = v2[k2_offset + 1];
+			} else {
+				x2 = v2[k2_offset - 1] + 1;
+			}
+
+			ptrdiff_t y2 = x2 - k2;
+
+			while(x2 < range1_length && y2 < range2_length &&
+				  text1_chars[range1_length - x2 - 1] == text2_chars[range2_length - y2 - 1]) {
+				x2++;
+				y2++;
+			}
+
+			v2[k2_offset] = x2;
+
+			if(x2 > range1_length) {
+				// Ran off the left of the graph.
+				k2end += 2;
+			} else if(y2 > range2_length) {
+				// Ran off the top of the graph.
+				k2start += 2;
+			} else if(!front) {
+				ptrdiff_t k1_offset = v_offset + delta - k2;
+
+				if(k1_offset >= 0 && k1_offset < v_length && v1[k1_offset] != -1) {
+					ptrdiff_t x1 = v1[k1_offset];
+					ptrdiff_t y1 = v_offset + x1 - k1_offset;
+					// Mirror x2 onto top-left coordinate system.
+					x2 = range1_length - x2;
+
+					if(x1 >= x2) {
+						// Overlap detected.
+						x = x1;
+						y = y1;
+						found = true;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	if(found) {
+		// Split the problem in two and recurse, v1 & v2 are free for reuse from here on.
+		size_t first_length = x + y, second_length = count1 - x + count2 - y;
+
+		if(pool != nullptr && first_length >= ParallelMinimumLength && second_length >= ParallelMinimumLength) {
+			// The halves are independent: diff the second into its own arena on the
+			// pool while this thread does the first then append it once joined.
+			Arena second_arena;
+			Differ second(text1, this->text1_length, text2, this->text2_length, second_arena, deadline, pool);
+			WorkStealingPool::Task task;
+			task.work = [&] { second.diffRange(start1 + x, count1 - x, start2 + y, count2 - y); };
+
+			pool->fork(task);
+			diffRange(start1, x, start2, y);
+			pool->join(task);
+
+			spans.insert(spans.end(), second_arena.spans.begin(), second_arena.spans.end());
+		} else {
+			diffRange(start1, x, start2, y);
+			diffRange(start1 + x, count1 - x, start2 + y, count2 - y);
+		}
+	} else {
+		// Diff took too long and hit the deadline or
+		// number of diffs equals number of characters, no commonality at all.
+		append(Op::Delete, start1, count1);
+		append(Op::Insert, start2, count2);
+	}
+}
+
+
+/**
+ * Histogram diff of two ranges. Recurses on the part before the best common
+ * region and loops on the part after it.
+ */
+
+template <typename Char>
+void Differ<Char>::histogramRange(size_t start1, size_t count1, size_t start2, size_t count2)
+{
+	size_t suffix = commonSuffix(text1 + start1 + count1, text2 + start2 + count2, std::min(count1, count2));
+	count1 -= suffix;
+	count2 -= suffix;
+
+	while(true) {
+		size_t prefix = commonPrefix(text1 + start1, text2 + start2, std::min(count1, count2));
+		if(prefix != 0) {
+			append(Op::Equal, start1, prefix);
+			start1 += prefix, count1 -= prefix;
+			start2 += prefix, count2 -= prefix;
+		}
+
+		if(count1 == 0 || count2 == 0) {
+			computeRange(start1, count1, start2, count2);
+			break;
+		}
+
+		if(deadline != NoDeadline && Clock::now() > deadline) {
+			// Out of time, treat what remains as a replacement.
+			append(Op::Delete, start1, count1);
+			append(Op::Insert, start2, count2);
+			break;
+		}
+
+		Region region = histogramRegion(start1, count1, start2, count2);
+		if(region.length == 0) {
+			// Nothing suitable to anchor on, fall back to O(ND).
+			diffRange(start1, count1, start2, count2);
+			break;
+		}
+
+		histogramRange(start1, region.start1 - start1, start2, region.start2 - start2);
+		append(Op::Equal, region.start1, region.length);
+
+		size_t end1 = start1 + count1, end2 = start2 + count2;
+		start1 = region.start1 + region.length, count1 = end1 - start1;
+		start2 = region.start2 + region.length, count2 = end2 - start2;
+	}
+
+	if(suffix != 0) {
+		append(Op::Equal, start1 + count1, suffix);
+	}
+}
+
+
+/**
+ * Find the longest common region of two ranges containing the element
+ * with fewest occurrences in the first range.
+ * @return The region or one of zero length if there is no suitable region.
+ */
+
+template <typename Char>
+typename Differ<Char>::Region Differ<Char>::histogramRegion(size_t start1, size_t count1, size_t start2, size_t count2)
+{
+	typedef typename std::make_unsigned<Char>::type Element;
+	const uint32_t none = UINT32_MAX;
+	size_t end1 = start1 + count1, end2 = start2 + count2;
+
+	// Build the histogram of text1, each element's chain of offsets ascending.
+	std::vector<uint32_t> &counts = arena.counts, &heads = arena.heads, &chain = arena.chain;
+	Element max_element = 0;
+	for(size_t i = start1; i < end1; i++) {
+		max_element = std::max(max_element, (Element)text1[i]);
+	}
+
+	if(counts.size() <= max_element) {
+		counts.resize((size_t)max_element + 1, 0);
+		heads.resize((size_t)max_element + 1, none);
+	}
+
+	chain.resize(count1);
+	for(size_t i = end1; i-- > start1;) {
+		Element element = text1[i];
+		chain[i - start1] = heads[element];
+		heads[element] = (uint32_t)i;
+		counts[element]++;
+	}
+
+	// Scan text2 for the longest region with the lowest occurrence count.
+	Region best = {0, 0, 0};
+	uint32_t best_count = MaxChainLength;
+
+	for(size_t j = start2; j < end2;) {
+		Element element = text2[j];
+		size_t next_j = j + 1;
+
+		if(element > max_element || counts[element] == 0 || counts[element] > best_count) {
+			j = next_j;
+			continue;
+		}
+
+		for(uint32_t i = heads[element]; i != none; i = chain[i - start1]) {
+			size_t region_start1 = i, region_start2 = j, region_end1 = i + 1, region_end2 = j + 1;
+			uint32_t region_count = counts[element];
+
+			while(region_start1 > start1 && region_start2 > start2 &&
+				  text1[region_start1 - 1] == text2[region_start2 - 1]) {
+				region_start1--, region_start2--;
+				region_count = std::min(region_count, counts[(Element)text1[region_start1]]);
+			}
+
+			while(region_end1 < end1 && region_end2 < end2 && text1[region_end1] == text2[region_end2]) {
+				region_count = std::min(region_count, counts[(Element)text1[region_end1]]);
+				region_end1++, region_end2++;
+			}
+
+			next_j = std::max(next_j, region_end2);
+
+			if(region_end1 - region_start1 > best.length || region_count < best_count) {
+				best = {region_start1, region_start2, region_end1 - region_start1};
+				best_count = region_count;
+			}
+		}
+
+		j = next_j;
+	}
+
+	// Reset only the entries used so the tables can be reused without clearing.
+	for(size_t i = start1; i < end1; i++) {
+		Element element = text1[i];
+		counts[element] = 0;
+		heads[element] = none;
+	}
+
+	return best;
+}
+
+
+template <typename Char>
+void Differ<Char>::cleanupMerge(size_t first)
+{
+	if(spans.size() <= first) {
+		return;
+	}
+
+	// The dummy equality at the end needs a location in text1.
+	size_t text1_end = 0;
+	for(size_t i = spans.size(); i > first; i--) {
+		if(spans[i - 1].op != Op::Insert) {
+			text1_end = spans[i - 1].offset + spans[i - 1].length;
+			break;
+		}
+	}
+
+	spans.push_back(Span{Op::Equal, (uint32_t)text1_end, 0});	// Add a dummy entry at the end.
+
+	// First pass: coalesce runs of edits between equalities into at most
+	// one delete and one insert, factoring out common affixes.
+	std::vector<Span> &out = arena.scratch;
+	out.clear();
+
+	size_t count_delete = 0;
+	size_t count_insert = 0;
+	size_t delete_offset = 0, delete_length = 0;
+	size_t insert_offset = 0, insert_length = 0;
+
+	for(size_t index = first; index < spans.size(); index++) {
+		Span span = spans[index];
+
+		switch(span.op) {
+			case Op::Insert:
+				if(count_insert++ == 0) {
+					insert_offset = span.offset;
+				}
+				insert_length += span.length;
+				break;
+
+			case Op::Delete:
+				if(count_delete++ == 0) {
+					delete_offset = span.offset;
+				}
+				delete_length += span.length;
+				break;
+
+			case Op::Equal:
+				// Upon reaching an equality, check for prior redundancies.
+				if(count_delete + count_insert > 1 && count_delete != 0 && count_insert != 0) {
+					// Factor out any common prefixes.
+					size_t common = commonPrefix(text2 + insert_offset, text1 + delete_offset, std::min(insert_length, delete_length));
+
+					if(common != 0) {
+						if(!out.empty() && out.back().op == Op::Equal) {
+							out.back().length += common;
+						} else {
+							out.push_back(Span{Op::Equal, (uint32_t)delete_offset, (uint32_t)common});
+						}
+						insert_offset += common;
+						insert_length -= common;
+						delete_offset += common;
+						delete_length -= common;
+					}
+
+					// Factor out any common suffixes.
+					common = commonSuffix(text2 + insert_offset + insert_length, text1 + delete_offset + delete_length,
+										  std::min(insert_length, delete_length));
+
+					if(common != 0) {
+						span.offset -= common;
+						span.length += common;
+						insert_length -= common;
+						delete_length -= common;
+					}
+				}
+
+				if(count_delete != 0) {
+					out.push_back(Span{Op::Delete, (uint32_t)delete_offset, (uint32_t)delete_length});
+				}
+				if(count_insert != 0) {
+					out.push_back(Span{Op::Insert, (uint32_t)insert_offset, (uint32_t)insert_length});
+				}
+
+				if(count_delete + count_insert == 0 && !out.empty() && out.back().op == Op::Equal) {
+					// Merge this equality with the previous one.
+					out.back().length += span.length;
+				} else {
+					out.push_back(span);
+				}
+
+				count_insert = 0;
+				count_delete = 0;
+				delete_length = 0;
+				insert_length = 0;
+				break;
+		}
+	}
+
+	if(out.back().length == 0) {
+		out.pop_back();		// Remove the dummy entry at the end.
+	}
+
+	// Second pass: look for single edits surrounded on both sides by
+	// equalities which can be shifted sideways to eliminate an equality.
+	// e.g: A<ins>BA</ins>C -> <ins>AB</ins>AC
+	// Spans before the write cursor are final, removed spans are skipped.
+	bool changes = false;
+	size_t write = 1, index = 1;
+
+	// Intentionally ignore the first and last element (as they don't need checking).
+	for(; index + 1 < out.size(); index++) {
+		Span &prev = out[write - 1];
+		Span &edit = out[index];
+		Span &next = out[index + 1];
+
+		if(prev.op == Op::Equal && next.op == Op::Equal) {
+			// This is a single edit surrounded by equalities.
+			const Char *edit_text = textFor(edit);
+			const Char *prev_text = text1 + prev.offset;
+			const Char *next_text = text1 + next.offset;
+
+			// As -[NSString hasSuffix:] and -hasPrefix: an empty equality never matches.
+			if(prev.length != 0 && edit.length >= prev.length &&
+			   std::equal(prev_text, prev_text + prev.length, edit_text + edit.length - prev.length)) {
+				// Shift the edit over the previous equality.
+				edit.offset -= prev.length;
+				next.offset -= prev.length;
+				next.length += prev.length;
+				write--;
+				changes = true;
+			} else if(next.length != 0 && edit.length >= next.length &&
+					  std::equal(next_text, next_text + next.length, edit_text)) {
+				// Shift the edit over the next equality.
+				prev.length += next.length;
+				edit.offset += next.length;
+				out[write++] = edit;
+				index++;
+				changes = true;
+				continue;
+			}
+		}
+
+		out[write++] = edit;
+	}
+
+	for(; index < out.size(); index++) {
+		out[write++] = out[index];
+	}
+	out.resize(std::min(write, out.size()));
+
+	spans.resize(first);
+	spans.insert(spans.end(), out.begin(), out.end());
+
+	// If shifts were made, the diff needs reordering and another shift sweep.
+	if(changes) {
+		cleanupMerge(first);
+	}
+}
+
+
+/**
+ * Replace each equality marked in arena.split with a delete and an insert
+ * of the same text, compacting the spans in a single pass.
+ */
+
+template <typename Char>
+void Differ<Char>::splitEqualities()
+{
+	std::vector<Span> &out = arena.scratch;
+	out.clear();
+
+	// Equalities only hold an offset into text1, track the position in text2.
+	size_t offset2 = 0;
+
+	for(size_t index = 0; index < spans.size(); index++) {
+		Span span = spans[index];
+
+		if(span.op == Op::Insert) {
+			offset2 = span.offset + span.length;
+			out.push_back(span);
+		} else if(span.op == Op::Equal && arena.split[index]) {
+			out.push_back(Span{Op::Delete, span.offset, span.length});
+			out.push_back(Span{Op::Insert, (uint32_t)offset2, span.length});
+			offset2 += span.length;
+		} else {
+			offset2 += span.op == Op::Equal ? span.length : 0;
+			out.push_back(span);
+		}
+	}
+
+	spans.swap(out);
+}
+
+
+template <typename Char>
+void Differ<Char>::cleanupSemantic(CharacterClassifier classify)
+{
+	if(spans.empty()) {
+		return;
+	}
+
+	std::vector<uint32_t> &equalities = arena.equalities;	// Stack of indices where equalities are found.
+	std::vector<uint8_t> &split = arena.split;
+	equalities.clear();
+	split.assign(spans.size(), 0);
+
+	bool have_last_equality = false;
+	size_t last_equality = 0;	// Always equal to spans[equalities.back()].length
+
+	// Number of characters that changed prior to the equality.
+	size_t length_insertions1 = 0;
+	size_t length_deletions1 = 0;
+
+	// Number of characters that changed after the equality.
+	size_t length_insertions2 = 0;
+	size_t length_deletions2 = 0;
+
+	bool changes = false;
+
+	// A split equality is visited twice, first as its delete then as its insert.
+	size_t index = 0;
+	bool second_half = false;
+
+	while(index < spans.size()) {
+		const Span &span = spans[index];
+
+		if(span.op == Op::Equal && !split[index]) {
+			// Equality found.
+			equalities.push_back((uint32_t)index);
+			length_insertions1 = length_insertions2;
+			length_deletions1 = length_deletions2;
+			length_insertions2 = 0;
+			length_deletions2 = 0;
+			last_equality = span.length;
+			have_last_equality = true;
+		} else {
+			// An insertion or deletion.
+			if(span.op == Op::Insert || second_half) {
+				length_insertions2 += span.length;
+			} else {
+				length_deletions2 += span.length;
+			}
+
+			// Eliminate an equality that is smaller or equal to the edits on both sides of it.
+			if(have_last_equality
+			   && (last_equality <= std::max(length_insertions1, length_deletions1))
+			   && (last_equality <= std::max(length_insertions2, length_deletions2))) {
+				split[equalities.back()] = 1;
+
+				// Throw away the equality we just deleted.
+				equalities.pop_back();
+
+				if(!equalities.empty()) {
+					equalities.pop_back();
+				}
+
+				// Continue after the previous equality, or from the start.
+				index = equalities.empty() ? 0 : equalities.back() + 1;
+				second_half = false;
+
+				// Reset the counters.
+				length_insertions1 = 0;
+				length_deletions1 = 0;
+				length_insertions2 = 0;
+				length_deletions2 = 0;
+				have_last_equality = false;
+				changes = true;
+				continue;
+			}
+		}
+
+		if(split[index] && !second_half) {
+			second_half = true;
+		} else {
+			index++;
+			second_half = false;
+		}
+	}
+
+	// Normalize the diff.
+	if(changes) {
+		splitEqualities();
+		cleanupMerge();
+	}
+
+	cleanupSemanticLossless(classify);
+	cleanupOverlaps();
+}
+
+
+/**
+ * Find any overlaps between deletions and insertions.
+ * e.g: <del>abcxxx</del><ins>xxxdef</ins>
+ * -> <del>abc</del>xxx<ins>def</ins>
+ * e.g: <del>xxxabc</del><ins>defxxx</ins>
+ * -> <ins>def</ins>xxx<del>abc</del>
+ * Only extract an overlap if it is as big as the edit ahead or behind it.
+ */
+
+template <typename Char>
+void Differ<Char>::cleanupOverlaps()
+{
+	std::vector<Span> &out = arena.scratch;
+	out.clear();
+
+	size_t index = 0;
+
+	for(; index + 1 < spans.size(); index++) {
+		Span deletion = spans[index];
+		Span insertion = spans[index + 1];
+
+		if(deletion.op != Op::Delete || insertion.op != Op::Insert) {
+			out.push_back(deletion);
+			continue;
+		}
+
+		const Char *deleted = text1 + deletion.offset;
+		const Char *inserted = text2 + insertion.offset;
+		size_t overlap_length1 = commonOverlap(deleted, deletion.length, inserted, insertion.length);
+		size_t overlap_length2 = commonOverlap(inserted, insertion.length, deleted, deletion.length);
+
+		if(overlap_length1 >= overlap_length2) {
+			if(overlap_length1 * 2 >= deletion.length || overlap_length1 * 2 >= insertion.length) {
+				// Overlap found. Insert an equality and trim the surrounding edits.
+				deletion.length -= overlap_length1;
+				out.push_back(deletion);
+				out.push_back(Span{Op::Equal, deletion.offset + deletion.length, (uint32_t)overlap_length1});
+				insertion.offset += overlap_length1;
+				insertion.length -= overlap_length1;
+				out.push_back(insertion);
+			} else {
+				out.push_back(deletion);
+				out.push_back(insertion);
+			}
+		} else {
+			if(overlap_length2 * 2 >= deletion.length || overlap_length2 * 2 >= insertion.length) {
+				// Reverse overlap found.
+				// Insert an equality and swap and trim the surrounding edits.
+				insertion.length -= overlap_length2;
+				out.push_back(insertion);
+				out.push_back(Span{Op::Equal, deletion.offset, (uint32_t)overlap_length2});
+				deletion.offset += overlap_length2;
+				deletion.length -= overlap_length2;
+				out.push_back(deletion);
+			} else {
+				out.push_back(deletion);
+				out.push_back(insertion);
+			}
+		}
+
+		index++;
+	}
+
+	for(; index < spans.size(); index++) {
+		out.push_back(spans[index]);
+	}
+
+	spans.swap(out);
+}
+
+
+template <typename Char>
+void Differ<Char>::cleanupSemanticLossless(CharacterClassifier classify)
+{
+	if(spans.empty()) {
+		return;
+	}
+
+	// Spans before the write cursor are final, removed spans are skipped.
+	size_t write = 1, index = 1;
+
+	// Intentionally ignore the first and last element (as they don't need checking).
+	while(index + 1 < spans.size()) {
+		Span edit = spans[index];
+		if(write == 0) {
+			spans[write++] = edit;
+			index++;
+			continue;
+		}
+
+		Span &prev = spans[write - 1];
+		Span &next = spans[index + 1];
+
+		if(prev.op == Op::Equal && next.op == Op::Equal) {
+			// This is a single edit surrounded by equalities.
+			size_t equality1 = prev.length;
+			size_t edit_offset = edit.offset;
+			size_t equality2_offset = next.offset, equality2 = next.length;
+
+			// First, shift the edit as far left as possible.
+			size_t common = commonSuffix(text1 + prev.offset + equality1, textFor(edit) + edit.length,
+										 std::min<size_t>(equality1, edit.length));
+			equality1 -= common;
+			edit_offset -= common;
+			equality2_offset -= common;
+			equality2 += common;
+
+			// Second, step right character by character,
+			// looking for the best fit.
+			const Char *edit_base = (edit.op == Op::Insert ? text2 : text1) + edit_offset;
+			const Char *equality2_base = text1 + equality2_offset;
+			auto score = [&](size_t step) {
+				return semanticScore(text1 + prev.offset, equality1 + step, edit_base + step, edit.length, classify) +
+					semanticScore(edit_base + step, edit.length, equality2_base + step, equality2 - step, classify);
+			};
+
+			size_t best_step = 0;
+			int best_score = score(0);
+
+			for(size_t step = 1; edit.length != 0 && step <= equality2 && edit_base[step - 1] == equality2_base[step - 1]; step++) {
+				int step_score = score(step);
+
+				// The >= encourages trailing rather than leading whitespace on edits.
+				if(step_score >= best_score) {
+					best_score = step_score;
+					best_step = step;
+				}
+			}
+
+			if(common != 0 || best_step != 0) {
+				// We have an improvement, save it back to the diff.
+				prev.length = (uint32_t)(equality1 + best_step);
+				edit.offset = (uint32_t)(edit_offset + best_step);
+				next.offset = (uint32_t)(equality2_offset + best_step);
+				next.length = (uint32_t)(equality2 - best_step);
+
+				if(prev.length == 0) {
+					write--;
+				}
+
+				if(next.length == 0) {
+					// Look at the edit again between the neighbouring spans.
+					spans[++index] = edit;
+					continue;
+				}
+			}
+		}
+
+		spans[write++] = edit;
+		index++;
+	}
+
+	while(index < spans.size()) {
+		spans[write++] = spans[index++];
+	}
+	spans.resize(write);
+}
+
+
+template <typename Char>
+void Differ<Char>::cleanupEfficiency(size_t edit_cost)
+{
+	if(spans.empty()) {
+		return;
+	}
+
+	std::vector<uint32_t> &equalities = arena.equalities;	// Stack of indices where equalities are found.
+	std::vector<uint8_t> &split = arena.split;
+	equalities.clear();
+	split.assign(spans.size(), 0);
+
+	bool have_last_equality = false;
+	size_t last_equality = 0;	// Always equal to spans[equalities.back()].length
+	bool pre_ins = false;		// Is there an insertion operation before the last equality.
+	bool pre_del = false;		// Is there a deletion operation before the last equality.
+	bool post_ins = false;		// Is there an insertion operation after the last equality.
+	bool post_del = false;		// Is there a deletion operation after the last equality.
+	bool changes = false;
+
+	// A split equality is visited twice, first as its delete then as its insert.
+	size_t index = 0;
+	bool second_half = false;
+
+	while(index < spans.size()) {
+		const Span &span = spans[index];
+
+		if(span.op == Op::Equal && !split[index]) {
+			// Equality found.
+			if(span.length < edit_cost && (post_ins || post_del)) {
+				// Candidate found.
+				equalities.push_back((uint32_t)index);
+				pre_ins = post_ins;
+				pre_del = post_del;
+				last_equality = span.length;
+				have_last_equality = true;
+			} else {
+				// Not a candidate, and can never become one.
+				equalities.clear();
+				have_last_equality = false;
+			}
+
+			post_ins = post_del = false;
+		} else {
+			// An insertion or deletion.
+			if(span.op == Op::Delete || (span.op == Op::Equal && !second_half)) {
+				post_del = true;
+			} else {
+				post_ins = true;
+			}
+
+			/*
+			 * Five types to be split:
+			 * <ins>A</ins><del>B</del>XY<ins>C</ins><del>D</del>
+			 * <ins>A</ins>X<ins>C</ins><del>D</del>
+			 * <ins>A</ins><del>B</del>X<ins>C</ins>
+			 * <ins>A</del>X<ins>C</ins><del>D</del>
+			 * <ins>A</ins><del>B</del>X<del>C</del>
+			 */
+			if(have_last_equality && ((pre_ins && pre_del && post_ins && post_del)
+				|| ((last_equality < edit_cost / 2) && (pre_ins + pre_del + post_ins + post_del) == 3))) {
+				size_t split_index = equalities.back();
+				split[split_index] = 1;
+				equalities.pop_back();	// Throw away the equality we just deleted.
+				have_last_equality = false;
+				changes = true;
+
+				if(pre_ins && pre_del) {
+					// No changes made which could affect previous entry, keep going.
+					post_ins = post_del = true;
+					equalities.clear();
+				} else {
+					if(!equalities.empty()) {
+						equalities.pop_back();
+					}
+
+					post_ins = post_del = false;
+
+					// As DiffMatchPatch.m, continue from the insert just made
+					// when any equalities remain, else from the start.
+					if(!equalities.empty()) {
+						index = split_index;
+						second_half = true;
+					} else {
+						index = 0;
+						second_half = false;
+					}
+					continue;
+				}
+			}
+		}
+
+		if(split[index] && !second_half) {
+			second_half = true;
+		} else {
+			index++;
+			second_half = false;
+		}
+	}
+
+	if(changes) {
+		splitEqualities();
+		cleanupMerge();
+	}
+}
+
+} // namespace dmp
+
+#endif /* DiffMatchPatchCore_hpp */
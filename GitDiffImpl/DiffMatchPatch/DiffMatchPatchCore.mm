@@ -0,0 +1,309 @@
+/*
+ * Diff Match and Patch
+ *
+ * Copyright 2010 geheimwerk.de.
+ * http://code.google.com/p/google-diff-match-patch/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: fraser@google.com (Neil Fraser)
+ * ObjC port: jan@geheimwerk.de (Jan Weiß)
+ * Refactoring & mangling: @inquisitivesoft (Harry Jordan)
+ *
+ *
+ * Objective-C entry points into the C++ core in DiffMatchPatchCore.hpp.
+ * DMDiff objects are only created once the final diff is known.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "DiffMatchPatch.h"
+#import "DiffMatchPatchInternals.h"
+#import "DiffMatchPatchCFUtilities.h"
+#import "DMDiff.h"
+
+#include "DiffMatchPatchCore.hpp"
+#include "DiffMatchPatchLines.hpp"
+#include "DiffMatchPatchMatch.hpp"
+#include "DiffMatchPatchUTF8.hpp"
+
+
+// Scratch storage reused by every diff made on a thread.
+static thread_local dmp::Arena diff_arena;
+static thread_local std::vector<UniChar> diff_text1_buffer, diff_text2_buffer;
+static thread_local std::vector<uint32_t> diff_line_ids1, diff_line_ids2;
+static thread_local std::vector<size_t> diff_line_offsets1, diff_line_offsets2;
+static thread_local std::vector<dmp::utf8::Utf16Span> diff_utf16_spans;
+
+// Interned lines kept between diffs when DiffProperties.reuseLineTable is set.
+static thread_local dmp::LineTable<UniChar> diff_line_table(true);
+
+
+static const UniChar *diff_uniCharsOfString(NSString *text, std::vector<UniChar> &buffer)
+{
+	CFStringRef string = (__bridge CFStringRef)text;
+	const UniChar *chars = CFStringGetCharactersPtr(string);
+
+	if(chars == NULL) {
+		// Fallback in case CFStringGetCharactersPtr() didn’t work.
+		buffer.resize(CFStringGetLength(string));
+		CFStringGetCharacters(string, CFRangeMake(0, buffer.size()), buffer.data());
+		chars = buffer.data();
+	}
+
+	return chars;
+}
+
+
+static dmp::Deadline diff_coreDeadline(DiffProperties properties)
+{
+	if(properties.deadline == [[NSDate distantFuture] timeIntervalSinceReferenceDate]) {
+		return dmp::NoDeadline;
+	}
+
+	std::chrono::duration<double> remaining(properties.deadline - [NSDate timeIntervalSinceReferenceDate]);
+	return dmp::Clock::now() + std::chrono::duration_cast<dmp::Clock::duration>(remaining);
+}
+
+
+static dmp::WorkStealingPool *diff_corePool(DiffProperties properties)
+{
+	return properties.parallel ? &dmp::WorkStealingPool::shared() : nullptr;
+}
+
+
+static NSMutableArray *diff_diffsFromSpans(const std::vector<dmp::Span> &spans, NSString *text1, NSString *text2)
+{
+	NSMutableArray *diffs = [[NSMutableArray alloc] initWithCapacity:spans.size()];
+
+	for(const dmp::Span &span : spans) {
+		NSString *text = span.op == dmp::Op::Insert ? text2 : text1;
+		[diffs addObject:[DMDiff diffWithOperation:(DMDiffOperation)span.op
+										   andText:[text substringWithRange:NSMakeRange(span.offset, span.length)]]];
+	}
+
+	return diffs;
+}
+
+
+// Described in DiffMatchPatchInternals.h
+NSMutableArray *diff_coreDiffsBetweenTexts(NSString *text1, NSString *text2, DiffProperties properties)
+{
+	dmp::Differ<UniChar> differ(diff_uniCharsOfString(text1, diff_text1_buffer), text1.length,
+								diff_uniCharsOfString(text2, diff_text2_buffer), text2.length,
+								diff_arena, diff_coreDeadline(properties), diff_corePool(properties));
+	return diff_diffsFromSpans(differ.diff(), text1, text2);
+}
+
+
+// Described in DiffMatchPatchInternals.h
+NSMutableArray *diff_coreBisectOfStrings(NSString *text1, NSString *text2, DiffProperties properties)
+{
+	dmp::Differ<UniChar> differ(diff_uniCharsOfString(text1, diff_text1_buffer), text1.length,
+								diff_uniCharsOfString(text2, diff_text2_buffer), text2.length,
+								diff_arena, diff_coreDeadline(properties), diff_corePool(properties));
+	return diff_diffsFromSpans(differ.bisect(), text1, text2);
+}
+
+
+// Described in DiffMatchPatchInternals.h
+NSMutableArray *diff_coreLineDiffsOfStrings(NSString *text1, NSString *text2, DiffProperties properties)
+{
+	const UniChar *chars1 = diff_uniCharsOfString(text1, diff_text1_buffer);
+	const UniChar *chars2 = diff_uniCharsOfString(text2, diff_text2_buffer);
+
+	dmp::LineTable<UniChar> local_table;
+	dmp::LineTable<UniChar> &table = properties.reuseLineTable ? diff_line_table : local_table;
+	table.trim();
+	table.linesToIds(chars1, text1.length, diff_line_ids1, &diff_line_offsets1);
+	table.linesToIds(chars2, text2.length, diff_line_ids2, &diff_line_offsets2);
+
+	dmp::Differ<uint32_t> differ(diff_line_ids1.data(), diff_line_ids1.size(), diff_line_ids2.data(), diff_line_ids2.size(),
+								 diff_arena, diff_coreDeadline(properties), diff_corePool(properties));
+	const std::vector<dmp::Span> &spans = properties.lineAlgorithm == DiffLineAlgorithmHistogram ?
+		differ.histogram() : differ.diff();
+
+	// Lines of a span are contiguous in the original text.
+	NSMutableArray *diffs = [[NSMutableArray alloc] initWithCapacity:spans.size()];
+
+	for(const dmp::Span &span : spans) {
+		bool inserted = span.op == dmp::Op::Insert;
+		const std::vector<size_t> &offsets = inserted ? diff_line_offsets2 : diff_line_offsets1;
+		NSRange range = NSMakeRange(offsets[span.offset], offsets[span.offset + span.length] - offsets[span.offset]);
+		[diffs addObject:[DMDiff diffWithOperation:(DMDiffOperation)span.op
+										   andText:[inserted ? text2 : text1 substringWithRange:range]]];
+	}
+
+	return diffs;
+}
+
+
+// As the character sets used by diff_cleanupSemanticScore()
+static uint8_t diff_characterClasses(uint32_t c)
+{
+	static CFCharacterSetRef alphaNumericSet = CFCharacterSetGetPredefined(kCFCharacterSetAlphaNumeric);
+	static CFCharacterSetRef whiteSpaceSet = CFCharacterSetGetPredefined(kCFCharacterSetWhitespaceAndNewline);
+	static CFCharacterSetRef controlSet = CFCharacterSetGetPredefined(kCFCharacterSetControl);
+
+	uint8_t classes = 0;
+	if(CFCharacterSetIsCharacterMember(alphaNumericSet, (UniChar)c)) {
+		classes |= dmp::AlphaNumeric;
+	}
+	if(CFCharacterSetIsCharacterMember(whiteSpaceSet, (UniChar)c)) {
+		classes |= dmp::Whitespace;
+	}
+	if(CFCharacterSetIsCharacterMember(controlSet, (UniChar)c)) {
+		classes |= dmp::Control;
+	}
+	return classes;
+}
+
+
+/**
+ * Run a cleanup pass of the core over an array of DMDiffs. The texts of
+ * the diffs are laid out end to end in the thread's buffers as text1 and
+ * text2 and the array is replaced with the diffs of the resulting spans.
+ */
+
+template <typename Pass>
+static void diff_coreCleanup(NSMutableArray **diffs, Pass pass)
+{
+	if(diffs == NULL || [*diffs count] == 0) {
+		return;
+	}
+
+	std::vector<dmp::Span> &spans = diff_arena.spans;
+	spans.clear();
+	diff_text1_buffer.clear();
+	diff_text2_buffer.clear();
+
+	for(DMDiff *diff in *diffs) {
+		CFStringRef text = (__bridge CFStringRef)diff.text;
+		CFIndex length = text ? CFStringGetLength(text) : 0;
+		dmp::Op op = (dmp::Op)diff.operation;
+
+		std::vector<UniChar> &buffer = op == dmp::Op::Insert ? diff_text2_buffer : diff_text1_buffer;
+		spans.push_back(dmp::Span{op, (uint32_t)buffer.size(), (uint32_t)length});
+		if(length == 0) {
+			continue;
+		}
+
+		buffer.resize(buffer.size() + length);
+		CFStringGetCharacters(text, CFRangeMake(0, length), buffer.data() + buffer.size() - length);
+
+		if(op == dmp::Op::Equal) {
+			diff_text2_buffer.insert(diff_text2_buffer.end(), buffer.end() - length, buffer.end());
+		}
+	}
+
+	dmp::Differ<UniChar> differ(diff_text1_buffer.data(), diff_text1_buffer.size(),
+								diff_text2_buffer.data(), diff_text2_buffer.size(), diff_arena);
+	pass(differ);
+
+	NSString *text1 = [[NSString alloc] initWithCharacters:diff_text1_buffer.data() length:diff_text1_buffer.size()];
+	NSString *text2 = [[NSString alloc] initWithCharacters:diff_text2_buffer.data() length:diff_text2_buffer.size()];
+	[*diffs setArray:diff_diffsFromSpans(spans, text1, text2)];
+}
+
+
+// Described in DiffMatchPatchInternals.h
+void diff_coreCleanupMerge(NSMutableArray **diffs)
+{
+	diff_coreCleanup(diffs, [](dmp::Differ<UniChar> &differ) {
+		differ.cleanupMerge();
+	});
+}
+
+
+// Described in DiffMatchPatchInternals.h
+void diff_coreCleanupSemantic(NSMutableArray **diffs)
+{
+	diff_coreCleanup(diffs, [](dmp::Differ<UniChar> &differ) {
+		differ.cleanupSemantic(diff_characterClasses);
+	});
+}
+
+
+// Described in DiffMatchPatchInternals.h
+void diff_coreCleanupSemanticLossless(NSMutableArray **diffs)
+{
+	diff_coreCleanup(diffs, [](dmp::Differ<UniChar> &differ) {
+		differ.cleanupSemanticLossless(diff_characterClasses);
+	});
+}
+
+
+// Described in DiffMatchPatchInternals.h
+void diff_coreCleanupEfficiency(NSMutableArray **diffs, NSUInteger editCost)
+{
+	diff_coreCleanup(diffs, [=](dmp::Differ<UniChar> &differ) {
+		differ.cleanupEfficiency(editCost);
+	});
+}
+
+
+// Described in DiffMatchPatch.h
+NSData *diff_utf8DiffsBetweenTexts(NSData *text1, NSData *text2, NSTimeInterval timeLimit)
+{
+	dmp::Deadline deadline = dmp::NoDeadline;
+	if(timeLimit > 0.0) {
+		std::chrono::duration<double> remaining(timeLimit);
+		deadline = dmp::Clock::now() + std::chrono::duration_cast<dmp::Clock::duration>(remaining);
+	}
+
+	const uint8_t *bytes1 = (const uint8_t *)text1.bytes, *bytes2 = (const uint8_t *)text2.bytes;
+	const std::vector<dmp::Span> &spans = dmp::utf8::diff(bytes1, text1.length, bytes2, text2.length,
+														  diff_arena, deadline, &dmp::WorkStealingPool::shared());
+	dmp::utf8::utf16Spans(bytes1, bytes2, spans, diff_utf16_spans);
+
+	NSMutableData *data = [NSMutableData dataWithLength:diff_utf16_spans.size() * sizeof(DMUTF8Diff)];
+	DMUTF8Diff *diffs = (DMUTF8Diff *)data.mutableBytes;
+
+	for(const dmp::utf8::Utf16Span &span : diff_utf16_spans) {
+		*diffs++ = DMUTF8Diff{(DMDiffOperation)span.op, NSMakeRange(span.offset, span.length),
+							  NSMakeRange(span.utf16_offset, span.utf16_length)};
+	}
+
+	return data;
+}
+
+
+// Described in DiffMatchPatchInternals.h
+NSUInteger match_coreBitapOfTextAndPattern(NSString *text, NSString *pattern, NSUInteger nearLocation, MatchProperties properties)
+{
+	dmp::Bitap<UniChar> bitap(diff_uniCharsOfString(pattern, diff_text2_buffer), pattern.length);
+	size_t location = bitap.locate(diff_uniCharsOfString(text, diff_text1_buffer), text.length, nearLocation,
+								   properties.matchThreshold, properties.matchDistance);
+	return location == SIZE_MAX ? NSNotFound : location;
+}
+
+
+// Described in DiffMatchPatchCFUtilities.h
+CFIndex diff_commonPrefixOfBytes(const void *text1, const void *text2, CFIndex length)
+{
+	return dmp::simd::commonPrefix(text1, text2, length);
+}
+
+
+// Described in DiffMatchPatchCFUtilities.h
+CFIndex diff_commonSuffixOfBytes(const void *text1_end, const void *text2_end, CFIndex length)
+{
+	return dmp::simd::commonSuffix(text1_end, text2_end, length);
+}
+
+
+// Described in DiffMatchPatchCFUtilities.h
+CFIndex diff_commonOverlapOfUniChars(const UniChar *text1, CFIndex text1_length, const UniChar *text2, CFIndex text2_length)
+{
+	return dmp::commonOverlap(text1, text1_length, text2, text2_length);
+}
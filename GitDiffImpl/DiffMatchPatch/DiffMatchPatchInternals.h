@@ -34,9 +34,17 @@
 
 // Structs which are used internally to define properties
 
+typedef enum {
+	DiffLineAlgorithmBisect = 0,	// Myers O(ND) over the lines (the default)
+	DiffLineAlgorithmHistogram		// As git diff --histogram, better for large rewrites
+} DiffLineAlgorithm;
+
 struct DiffProperties {
 	BOOL checkLines;			// Set to YES for a faster but less optimal diff
 	NSTimeInterval deadline;
+	DiffLineAlgorithm lineAlgorithm;	// How lines are diffed when checkLines is set
+	BOOL parallel;				// Diff the halves of large texts on multiple cores
+	BOOL reuseLineTable;		// Keep interned lines between line mode diffs on a thread
 };
 
 typedef struct DiffProperties DiffProperties;
@@ -45,7 +53,7 @@ typedef struct DiffProperties DiffProperties;
 struct MatchProperties {
 	CGFloat matchThreshold;
 	NSUInteger matchDistance;
-	NSUInteger matchMaximumBits;	// The number of bits in an int
+	NSUInteger matchMaximumBits;	// Maximum pattern length used when splitting patches, Bitap itself has no limit
 };
 
 typedef struct MatchProperties MatchProperties;
@@ -83,14 +91,29 @@ NSUInteger diff_translateLocationFromText1ToText2(NSArray *diffs, NSUInteger loc
 NSMutableArray *diff_computeDiffsBetweenTexts(NSString *text1, NSString *text2, DiffProperties properties);
 NSMutableArray *diff_computeDiffsUsingLineMode(NSString *text1, NSString *text2, DiffProperties properties);
 
-NSArray *diff_linesToCharsForStrings(NSString *text1, NSString * text2);
 NSArray *diff_tokensToCharsForStrings(NSString *text1, NSString *text2, DiffTokenMode mode);
-void diff_charsToLines(NSArray **diffs, NSArray *lineArray);
 void diff_charsToTokens(NSArray **diffs, NSArray *tokenArray);
 
 NSMutableArray *diff_bisectOfStrings(NSString *text1, NSString *text2, DiffProperties properties);
 NSMutableArray *diff_bisectSplitOfStrings(NSString *text1, NSString *text2, NSUInteger x, NSUInteger y, DiffProperties properties);
 
+// Character level diffing, the cleanup passes and Bitap matching are performed
+// by the C++ core (DiffMatchPatchCore.hpp, DiffMatchPatchMatch.hpp)
+#ifdef __cplusplus
+extern "C" {
+#endif
+NSMutableArray *diff_coreDiffsBetweenTexts(NSString *text1, NSString *text2, DiffProperties properties);
+NSMutableArray *diff_coreBisectOfStrings(NSString *text1, NSString *text2, DiffProperties properties);
+NSMutableArray *diff_coreLineDiffsOfStrings(NSString *text1, NSString *text2, DiffProperties properties);
+void diff_coreCleanupMerge(NSMutableArray **diffs);
+void diff_coreCleanupSemantic(NSMutableArray **diffs);
+void diff_coreCleanupSemanticLossless(NSMutableArray **diffs);
+void diff_coreCleanupEfficiency(NSMutableArray **diffs, NSUInteger editCost);
+NSUInteger match_coreBitapOfTextAndPattern(NSString *text, NSString *pattern, NSUInteger nearLocation, MatchProperties properties);
+#ifdef __cplusplus
+}
+#endif
+
 void diff_cleanupSemantic(NSMutableArray **diffs);
 void diff_cleanupMerge(NSMutableArray **diffs);
 void diff_cleanupSemanticLossless(NSMutableArray **diffs);
@@ -0,0 +1,284 @@
+/*
+ * Diff Match and Patch
+ *
+ * Copyright 2010 geheimwerk.de.
+ * http://code.google.com/p/google-diff-match-patch/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: fraser@google.com (Neil Fraser)
+ * ObjC port: jan@geheimwerk.de (Jan Weiß)
+ * Refactoring & mangling: @inquisitivesoft (Harry Jordan)
+ *
+ *
+ * Interned line table for line mode (diff_computeDiffsUsingLineMode).
+ * Lines are reduced to 32 bit ids using a flat open addressing hash table
+ * of (pointer, length, hash) views so there is no 65535 line limit and no
+ * string is created per line. Id 0 is reserved as in the lineArray.
+ *
+ * A persistent table copies the lines it interns so it can be kept between
+ * diffs. It also remembers the last texts it split so that diffing against
+ * the same base text again doesn't rehash any of its lines.
+ */
+
+#ifndef DiffMatchPatchLines_hpp
+#define DiffMatchPatchLines_hpp
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "DiffMatchPatchSIMD.hpp"
+
+namespace dmp {
+
+template <typename Char>
+class LineTable {
+public:
+	struct Line {
+		const Char *chars;
+		uint32_t length;
+		uint32_t hash;
+	};
+
+	// A persistent table is cleared when it holds more lines than this.
+	static constexpr size_t MaximumLines = 1 << 20;
+
+	explicit LineTable(bool persistent = false) : persistent(persistent)
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		lines.assign(1, Line{nullptr, 0, 0});
+		slots.assign(1024, 0);
+		chunks.clear();
+		chunk_used = chunk_capacity = 0;
+		remembered[0].text.clear();
+		remembered[1].text.clear();
+	}
+
+	// Keep a persistent table from growing without bound, call between diffs.
+	void trim()
+	{
+		if(lines.size() > MaximumLines) {
+			clear();
+		}
+	}
+
+	size_t size() const
+	{
+		return lines.size();
+	}
+
+	/**
+	 * Forget the lines interned since the table had size lines so it can be
+	 * reused for another diff against the same text. The ids of the lines
+	 * kept are unchanged. Not for persistent tables, which own their lines.
+	 */
+
+	void truncate(size_t size)
+	{
+		size_t mask = slots.size() - 1;
+
+		// Latest first so the probe sequence of each is intact when it's removed.
+		while(lines.size() > std::max<size_t>(size, 1)) {
+			uint32_t id = (uint32_t)lines.size() - 1;
+			size_t slot = lines[id].hash & mask;
+			while(slots[slot] != id) {
+				slot = (slot + 1) & mask;
+			}
+			slots[slot] = 0;
+			lines.pop_back();
+		}
+	}
+
+	/**
+	 * Bytes used to index the lines, not counting their text.
+	 */
+
+	size_t memory() const
+	{
+		return lines.capacity() * sizeof(Line) + slots.capacity() * sizeof(uint32_t);
+	}
+
+	const Line &line(uint32_t id) const
+	{
+		return lines[id];
+	}
+
+	static uint32_t hash(const Char *chars, size_t length)
+	{
+		const uint8_t *bytes = (const uint8_t *)chars;
+		size_t byte_length = length * sizeof(Char);
+		uint64_t h = 0x9E3779B97F4A7C15ull ^ byte_length;
+		size_t i = 0;
+
+		for(; i + 8 <= byte_length; i += 8) {
+			uint64_t word;
+			memcpy(&word, bytes + i, 8);
+			h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+			h ^= h >> 32;
+		}
+
+		for(; i < byte_length; i++) {
+			h = (h ^ bytes[i]) * 0x100000001B3ull;
+		}
+
+		h ^= h >> 29;
+		return (uint32_t)h;
+	}
+
+	/**
+	 * Find the id of a line, adding it to the table if new.
+	 */
+
+	uint32_t intern(const Char *chars, size_t length)
+	{
+		uint32_t line_hash = hash(chars, length);
+		size_t mask = slots.size() - 1;
+
+		for(size_t slot = line_hash & mask;; slot = (slot + 1) & mask) {
+			uint32_t id = slots[slot];
+			if(id == 0) {
+				id = (uint32_t)lines.size();
+				lines.push_back(Line{persistent ? store(chars, length) : chars, (uint32_t)length, line_hash});
+				slots[slot] = id;
+				if(lines.size() * 2 > slots.size()) {
+					grow();
+				}
+				return id;
+			}
+
+			const Line &line = lines[id];
+			if(line.hash == line_hash && line.length == length &&
+			   simd::commonPrefix(line.chars, chars, length * sizeof(Char)) == length * sizeof(Char)) {
+				return id;
+			}
+		}
+	}
+
+	/**
+	 * Split a text into lines, each including its newline, appending their ids.
+	 * @param offsets If not null, receives the offset of the start of each line
+	 *     followed by the length of the text.
+	 */
+
+	void linesToIds(const Char *text, size_t length, std::vector<uint32_t> &ids, std::vector<size_t> *offsets = nullptr)
+	{
+		ids.clear();
+		if(offsets) {
+			offsets->clear();
+		}
+
+		Remembered *reuse = persistent ? recall(text, length) : nullptr;
+		if(reuse) {
+			ids = reuse->ids;
+			if(offsets) {
+				*offsets = reuse->offsets;
+			}
+			return;
+		}
+
+		std::vector<size_t> line_offsets;
+		std::vector<size_t> &starts = offsets ? *offsets : line_offsets;
+
+		for(size_t start = 0; start < length;) {
+			size_t end = std::find(text + start, text + length, (Char)'\n') - text;
+			end = std::min(end + 1, length);
+			ids.push_back(intern(text + start, end - start));
+			starts.push_back(start);
+			start = end;
+		}
+
+		starts.push_back(length);
+
+		if(persistent) {
+			remember(text, length, ids, starts);
+		}
+	}
+
+private:
+	bool persistent;
+	std::vector<Line> lines;		// Indexed by id
+	std::vector<uint32_t> slots;	// Power of two sized, 0 is empty
+
+	// Storage for the lines of a persistent table, chunks never move.
+	std::vector<std::unique_ptr<Char[]>> chunks;
+	size_t chunk_used, chunk_capacity;
+
+	// The last two texts split by a persistent table.
+	struct Remembered {
+		std::vector<Char> text;
+		std::vector<uint32_t> ids;
+		std::vector<size_t> offsets;
+	} remembered[2];
+
+	const Char *store(const Char *chars, size_t length)
+	{
+		if(chunk_capacity - chunk_used < length) {
+			chunk_capacity = std::max<size_t>(length, 64 * 1024);
+			chunks.emplace_back(new Char[chunk_capacity]);
+			chunk_used = 0;
+		}
+
+		Char *stored = chunks.back().get() + chunk_used;
+		std::copy(chars, chars + length, stored);
+		chunk_used += length;
+		return stored;
+	}
+
+	void grow()
+	{
+		slots.assign(slots.size() * 2, 0);
+		size_t mask = slots.size() - 1;
+
+		for(uint32_t id = 1; id < lines.size(); id++) {
+			size_t slot = lines[id].hash & mask;
+			while(slots[slot] != 0) {
+				slot = (slot + 1) & mask;
+			}
+			slots[slot] = id;
+		}
+	}
+
+	Remembered *recall(const Char *text, size_t length)
+	{
+		for(Remembered &entry : remembered) {
+			if(entry.text.size() == length && length != 0 &&
+			   simd::commonPrefix(entry.text.data(), text, length * sizeof(Char)) == length * sizeof(Char)) {
+				// Move to the front so it outlives the next text remembered.
+				std::swap(entry, remembered[0]);
+				return &remembered[0];
+			}
+		}
+
+		return nullptr;
+	}
+
+	void remember(const Char *text, size_t length, const std::vector<uint32_t> &ids, const std::vector<size_t> &offsets)
+	{
+		// Most recently used first.
+		std::swap(remembered[0], remembered[1]);
+		remembered[0].text.assign(text, text + length);
+		remembered[0].ids = ids;
+		remembered[0].offsets = offsets;
+	}
+};
+
+} // namespace dmp
+
+#endif /* DiffMatchPatchLines_hpp */
@@ -0,0 +1,296 @@
+/*
+ * Diff Match and Patch
+ *
+ * Copyright 2010 geheimwerk.de.
+ * http://code.google.com/p/google-diff-match-patch/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: fraser@google.com (Neil Fraser)
+ * ObjC port: jan@geheimwerk.de (Jan Weiß)
+ * Refactoring & mangling: @inquisitivesoft (Harry Jordan)
+ *
+ *
+ * Bitap fuzzy matching (match_bitapOfTextAndPattern) over raw buffers.
+ * The alphabet is a table indexed directly by character below 256 with
+ * an open addressing hash for other characters, and the bit vectors span
+ * as many 64 bit words as the pattern needs so patterns of any length
+ * can be matched rather than being limited to the bits in an int.
+ */
+
+#ifndef DiffMatchPatchMatch_hpp
+#define DiffMatchPatchMatch_hpp
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace dmp {
+
+template <typename Char>
+class Bitap {
+public:
+	typedef uint64_t Word;
+
+	/**
+	 * Initialise the alphabet for the pattern (match_alphabetFromPattern).
+	 */
+
+	Bitap(const Char *pattern, size_t pattern_length)
+		: pattern(pattern), pattern_length(pattern_length), words((pattern_length + 63) / 64),
+		  direct(DirectSize * words, 0), zero(words, 0)
+	{
+		for(size_t i = 0; i < pattern_length; i++) {
+			size_t bit = pattern_length - i - 1;
+			maskFor(pattern[i])[bit / 64] |= Word(1) << (bit % 64);
+		}
+	}
+
+	/**
+	 * The mask of pattern positions at which a character occurs.
+	 * @return words() Words, least significant first.
+	 */
+
+	const Word *mask(Char c) const
+	{
+		Element element = (Element)c;
+		if(element < DirectSize) {
+			return &direct[element * words];
+		}
+
+		if(!hashed_keys.empty()) {
+			size_t slot_mask = hashed_keys.size() - 1;
+			for(size_t slot = hash(element) & slot_mask; hashed_masks[slot] != None; slot = (slot + 1) & slot_mask) {
+				if(hashed_keys[slot] == element) {
+					return &hashed_words[hashed_masks[slot]];
+				}
+			}
+		}
+
+		return zero.data();
+	}
+
+	size_t wordCount() const
+	{
+		return words;
+	}
+
+	/**
+	 * Compute the score for a match with e errors and x location (match_bitapScoreForErrorCount).
+	 * @return Overall score for match (0.0 = good, 1.0 = bad).
+	 */
+
+	double score(size_t e, size_t x, size_t loc, size_t distance) const
+	{
+		double accuracy = (double)e / pattern_length;
+		size_t proximity = loc > x ? loc - x : x - loc;
+
+		if(distance == 0) {
+			return proximity == 0 ? accuracy : 1.0;		// Dodge divide by zero error.
+		}
+
+		return accuracy + (proximity / (double)distance);
+	}
+
+	/**
+	 * Locate the best instance of the pattern in text near loc.
+	 * @return Best match index or SIZE_MAX if no match found.
+	 */
+
+	size_t locate(const Char *text, size_t text_length, size_t loc, double threshold, size_t distance)
+	{
+		if(pattern_length == 0) {
+			return std::min(loc, text_length);
+		}
+
+		// Highest score beyond which we give up.
+		double score_threshold = threshold;
+
+		// Is there a nearby exact match? (speedup)
+		const Char *found = std::search(text + std::min(loc, text_length), text + text_length, pattern, pattern + pattern_length);
+		if(found != text + text_length) {
+			score_threshold = std::min(score(0, found - text, loc, distance), score_threshold);
+
+			// What about in the other direction? (speedup)
+			const Char *search_end = text + std::min(loc + pattern_length, text_length);
+			found = std::find_end(text, search_end, pattern, pattern + pattern_length);
+			if(found != search_end) {
+				score_threshold = std::min(score(0, found - text, loc, distance), score_threshold);
+			}
+		}
+
+		// Initialise the bit arrays.
+		size_t match_word = (pattern_length - 1) / 64;
+		Word match_bit = Word(1) << ((pattern_length - 1) % 64);
+		size_t best_loc = SIZE_MAX;
+
+		size_t bin_min, bin_mid;
+		size_t bin_max = pattern_length + text_length;
+		bool have_last = false;
+
+		for(size_t d = 0; d < pattern_length; d++) {
+			// Scan for the best match; each iteration allows for one more error.
+			// Run a binary search to determine how far from 'loc' we can stray at
+			// this error level.
+			bin_min = 0;
+			bin_mid = bin_max;
+
+			while(bin_min < bin_mid) {
+				if(score(d, loc + bin_mid, loc, distance) <= score_threshold) {
+					bin_min = bin_mid;
+				} else {
+					bin_max = bin_mid;
+				}
+
+				bin_mid = (bin_max - bin_min) / 2 + bin_min;
+			}
+
+			// Use the result from this iteration as the maximum for the next.
+			bin_max = bin_mid;
+			size_t start = loc <= bin_mid ? 1 : loc - bin_mid + 1;
+			size_t finish = std::min(loc + bin_mid, text_length) + pattern_length;
+
+			rd.assign((finish + 2) * words, 0);
+			Word *last_row = &rd[(finish + 1) * words];
+			for(size_t bit = 0; bit < d; bit++) {
+				last_row[bit / 64] |= Word(1) << (bit % 64);
+			}
+
+			for(size_t j = finish; j >= start; j--) {
+				const Word *char_match = text_length <= j - 1 ? zero.data() : mask(text[j - 1]);
+				Word *row = &rd[j * words];
+				const Word *next_row = row + words;
+				Word carry = 1, last_carry = 1;
+
+				for(size_t w = 0; w < words; w++) {
+					Word value = ((next_row[w] << 1) | carry) & char_match[w];
+					carry = next_row[w] >> 63;
+
+					if(have_last) {
+						// Subsequent passes: fuzzy match.
+						const Word *last = &last_rd[j * words];
+						Word either = last[words + w] | last[w];
+						value |= (either << 1) | last_carry | last[words + w];
+						last_carry = either >> 63;
+					}
+
+					row[w] = value;
+				}
+
+				if((row[match_word] & match_bit) != 0) {
+					double match_score = score(d, j - 1, loc, distance);
+
+					// This match will almost certainly be better than any existing match. But check anyway.
+					if(match_score <= score_threshold) {
+						// Told you so.
+						score_threshold = match_score;
+						best_loc = j - 1;
+
+						if(best_loc > loc) {
+							// When passing loc, don't exceed our current distance from loc.
+							start = 2 * loc <= best_loc ? 1 : 2 * loc - best_loc + 1;
+						} else {
+							// Already passed loc, downhill from here.
+							break;
+						}
+					}
+				}
+			}
+
+			std::swap(rd, last_rd);
+			have_last = true;
+
+			if(score(d + 1, loc, loc, distance) > score_threshold) {
+				// No hope for a (better) match at greater error levels.
+				break;
+			}
+		}
+
+		return best_loc;
+	}
+
+private:
+	typedef typename std::make_unsigned<Char>::type Element;
+	static constexpr size_t DirectSize = 256;
+	static constexpr uint32_t None = UINT32_MAX;
+
+	const Char *pattern;
+	size_t pattern_length;
+	size_t words;
+
+	std::vector<Word> direct;			// DirectSize rows of words
+	std::vector<Element> hashed_keys;	// Characters outside the direct table
+	std::vector<uint32_t> hashed_masks;	// Offset into hashed_words or None
+	std::vector<Word> hashed_words;
+	size_t hashed_count = 0;
+	std::vector<Word> zero;				// Mask of characters not in the pattern
+
+	std::vector<Word> rd, last_rd;
+
+	static size_t hash(Element element)
+	{
+		return (size_t)((uint64_t)element * 0x9E3779B97F4A7C15ull >> 32);
+	}
+
+	Word *maskFor(Char c)
+	{
+		Element element = (Element)c;
+		if(element < DirectSize) {
+			return &direct[element * words];
+		}
+
+		if((hashed_count + 1) * 2 > hashed_keys.size()) {
+			rehash(std::max<size_t>(16, hashed_keys.size() * 2));
+		}
+
+		size_t slot_mask = hashed_keys.size() - 1;
+		size_t slot = hash(element) & slot_mask;
+		for(; hashed_masks[slot] != None; slot = (slot + 1) & slot_mask) {
+			if(hashed_keys[slot] == element) {
+				return &hashed_words[hashed_masks[slot]];
+			}
+		}
+
+		hashed_keys[slot] = element;
+		hashed_masks[slot] = (uint32_t)hashed_words.size();
+		hashed_words.resize(hashed_words.size() + words, 0);
+		hashed_count++;
+		return &hashed_words[hashed_masks[slot]];
+	}
+
+	void rehash(size_t capacity)
+	{
+		std::vector<Element> keys(capacity);
+		std::vector<uint32_t> masks(capacity, None);
+
+		for(size_t i = 0; i < hashed_keys.size(); i++) {
+			if(hashed_masks[i] != None) {
+				size_t slot = hash(hashed_keys[i]) & (capacity - 1);
+				while(masks[slot] != None) {
+					slot = (slot + 1) & (capacity - 1);
+				}
+				keys[slot] = hashed_keys[i];
+				masks[slot] = hashed_masks[i];
+			}
+		}
+
+		hashed_keys.swap(keys);
+		hashed_masks.swap(masks);
+	}
+};
+
+} // namespace dmp
+
+#endif /* DiffMatchPatchMatch_hpp */
@@ -0,0 +1,217 @@
+/*
+ * Diff Match and Patch
+ *
+ * Copyright 2010 geheimwerk.de.
+ * http://code.google.com/p/google-diff-match-patch/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: fraser@google.com (Neil Fraser)
+ * ObjC port: jan@geheimwerk.de (Jan Weiß)
+ * Refactoring & mangling: @inquisitivesoft (Harry Jordan)
+ *
+ *
+ * Minimal work-stealing thread pool for fork/join parallelism in the
+ * diff core. Each worker has its own deque of tasks: it pushes and pops
+ * forked tasks at the back and, when idle, steals from the front of the
+ * other workers' deques. Threads waiting in join() run tasks rather than
+ * block so nested forks cannot deadlock the pool.
+ */
+
+#ifndef DiffMatchPatchParallel_hpp
+#define DiffMatchPatchParallel_hpp
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dmp {
+
+class WorkStealingPool {
+public:
+	struct Task {
+		std::function<void ()> work;
+		std::atomic<bool> done{false};
+	};
+
+	explicit WorkStealingPool(size_t worker_count = std::max(1u, std::thread::hardware_concurrency()) - 1)
+		: queues(worker_count + 1)
+	{
+		for(size_t i = 0; i < worker_count; i++) {
+			workers.emplace_back([this, i] { run(i); });
+		}
+	}
+
+	~WorkStealingPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(sleep_lock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for(std::thread &worker : workers) {
+			worker.join();
+		}
+	}
+
+	// Shared pool sized to the machine, created on first use.
+	static WorkStealingPool &shared()
+	{
+		static WorkStealingPool pool;
+		return pool;
+	}
+
+	size_t workerCount() const
+	{
+		return workers.size();
+	}
+
+	/**
+	 * Make a task available to be run by any thread in the pool. The task
+	 * must stay alive until join() has returned for it.
+	 */
+
+	void fork(Task &task)
+	{
+		Queue &queue = queues[currentQueue()];
+		{
+			std::lock_guard<std::mutex> guard(queue.lock);
+			queue.tasks.push_back(&task);
+		}
+		{
+			std::lock_guard<std::mutex> guard(sleep_lock);
+			pending++;
+		}
+		wake.notify_one();
+	}
+
+	/**
+	 * Wait for a forked task to complete, running other tasks meanwhile.
+	 * If the task hasn't been started it will usually be run by the caller.
+	 */
+
+	void join(Task &task)
+	{
+		while(!task.done.load(std::memory_order_acquire)) {
+			if(Task *other = findTask(currentQueue())) {
+				execute(*other);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleep_lock);
+			wake.wait(lock, [&] { return task.done.load(std::memory_order_acquire) || pending != 0; });
+		}
+	}
+
+private:
+	struct Queue {
+		std::mutex lock;
+		std::deque<Task *> tasks;
+	};
+
+	std::vector<Queue> queues;		// One per worker plus one for other threads
+	std::vector<std::thread> workers;
+	std::mutex sleep_lock;
+	std::condition_variable wake;
+	size_t pending = 0;				// Tasks queued but not yet taken, guarded by sleep_lock
+	bool stopping = false;
+
+	static size_t &workerIndex()
+	{
+		static thread_local size_t index = SIZE_MAX;
+		return index;
+	}
+
+	size_t currentQueue() const
+	{
+		size_t index = workerIndex();
+		return index < workers.size() ? index : workers.size();
+	}
+
+	Task *take(size_t index, bool newest)
+	{
+		Queue &queue = queues[index];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if(queue.tasks.empty()) {
+			return nullptr;
+		}
+
+		Task *task;
+		if(newest) {
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+		} else {
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+		}
+
+		std::lock_guard<std::mutex> sleep_guard(sleep_lock);
+		pending--;
+		return task;
+	}
+
+	// Own queue newest first (still hot in cache), then steal oldest (largest) from the others.
+	Task *findTask(size_t own)
+	{
+		if(Task *task = take(own, true)) {
+			return task;
+		}
+
+		for(size_t i = 1; i < queues.size(); i++) {
+			if(Task *task = take((own + i) % queues.size(), false)) {
+				return task;
+			}
+		}
+
+		return nullptr;
+	}
+
+	void execute(Task &task)
+	{
+		task.work();
+		{
+			std::lock_guard<std::mutex> guard(sleep_lock);
+			task.done.store(true, std::memory_order_release);
+		}
+		wake.notify_all();
+	}
+
+	void run(size_t index)
+	{
+		workerIndex() = index;
+
+		while(true) {
+			if(Task *task = findTask(index)) {
+				execute(*task);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleep_lock);
+			wake.wait(lock, [&] { return stopping || pending != 0; });
+			if(stopping) {
+				return;
+			}
+		}
+	}
+};
+
+} // namespace dmp
+
+#endif /* DiffMatchPatchParallel_hpp */
@@ -0,0 +1,230 @@
+/*
+ * Diff Match and Patch
+ *
+ * Copyright 2010 geheimwerk.de.
+ * http://code.google.com/p/google-diff-match-patch/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: fraser@google.com (Neil Fraser)
+ * ObjC port: jan@geheimwerk.de (Jan Weiß)
+ * Refactoring & mangling: @inquisitivesoft (Harry Jordan)
+ *
+ *
+ * Vectorised kernels measuring how many bytes two buffers have in common
+ * at their start or end. These underlie commonPrefix/commonSuffix for any
+ * integral character type as a character matches only if all its bytes do.
+ *
+ * SSE2 is the baseline on x86_64 with AVX2 selected at runtime if the CPU
+ * supports it. NEON is always available on arm64 and other architectures
+ * use a scalar kernel comparing a 64 bit word at a time.
+ */
+
+#ifndef DiffMatchPatchSIMD_hpp
+#define DiffMatchPatchSIMD_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DMP_SIMD_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define DMP_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace dmp {
+namespace simd {
+
+typedef size_t (*AffixKernel)(const uint8_t *text1, const uint8_t *text2, size_t length);
+
+// Prefix kernels take pointers to the start of the buffers,
+// suffix kernels pointers to the end of the buffers.
+
+inline size_t commonPrefixScalar(const uint8_t *text1, const uint8_t *text2, size_t length)
+{
+	size_t i = 0;
+	for(; i + 8 <= length; i += 8) {
+		uint64_t word1, word2;
+		memcpy(&word1, text1 + i, 8);
+		memcpy(&word2, text2 + i, 8);
+		if(word1 != word2)
+			break;
+	}
+	while(i < length && text1[i] == text2[i])
+		i++;
+	return i;
+}
+
+inline size_t commonSuffixScalar(const uint8_t *text1_end, const uint8_t *text2_end, size_t length)
+{
+	size_t i = 0;
+	for(; i + 8 <= length; i += 8) {
+		uint64_t word1, word2;
+		memcpy(&word1, text1_end - i - 8, 8);
+		memcpy(&word2, text2_end - i - 8, 8);
+		if(word1 != word2)
+			break;
+	}
+	while(i < length && text1_end[-1 - (ptrdiff_t)i] == text2_end[-1 - (ptrdiff_t)i])
+		i++;
+	return i;
+}
+
+#if DMP_SIMD_X86
+
+inline size_t commonPrefixSSE2(const uint8_t *text1, const uint8_t *text2, size_t length)
+{
+	size_t i = 0;
+	for(; i + 16 <= length; i += 16) {
+		__m128i block1 = _mm_loadu_si128((const __m128i *)(text1 + i));
+		__m128i block2 = _mm_loadu_si128((const __m128i *)(text2 + i));
+		unsigned differ = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block1, block2)) ^ 0xFFFFu;
+		if(differ)
+			return i + __builtin_ctz(differ);
+	}
+	return i + commonPrefixScalar(text1 + i, text2 + i, length - i);
+}
+
+inline size_t commonSuffixSSE2(const uint8_t *text1_end, const uint8_t *text2_end, size_t length)
+{
+	size_t i = 0;
+	for(; i + 16 <= length; i += 16) {
+		__m128i block1 = _mm_loadu_si128((const __m128i *)(text1_end - i - 16));
+		__m128i block2 = _mm_loadu_si128((const __m128i *)(text2_end - i - 16));
+		unsigned differ = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block1, block2)) ^ 0xFFFFu;
+		if(differ)
+			return i + __builtin_clz(differ) - 16;
+	}
+	return i + commonSuffixScalar(text1_end - i, text2_end - i, length - i);
+}
+
+__attribute__((target("avx2")))
+inline size_t commonPrefixAVX2(const uint8_t *text1, const uint8_t *text2, size_t length)
+{
+	size_t i = 0;
+	for(; i + 32 <= length; i += 32) {
+		__m256i block1 = _mm256_loadu_si256((const __m256i *)(text1 + i));
+		__m256i block2 = _mm256_loadu_si256((const __m256i *)(text2 + i));
+		unsigned differ = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block1, block2));
+		if(differ)
+			return i + __builtin_ctz(differ);
+	}
+	return i + commonPrefixSSE2(text1 + i, text2 + i, length - i);
+}
+
+__attribute__((target("avx2")))
+inline size_t commonSuffixAVX2(const uint8_t *text1_end, const uint8_t *text2_end, size_t length)
+{
+	size_t i = 0;
+	for(; i + 32 <= length; i += 32) {
+		__m256i block1 = _mm256_loadu_si256((const __m256i *)(text1_end - i - 32));
+		__m256i block2 = _mm256_loadu_si256((const __m256i *)(text2_end - i - 32));
+		unsigned differ = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block1, block2));
+		if(differ)
+			return i + __builtin_clz(differ);
+	}
+	return i + commonSuffixSSE2(text1_end - i, text2_end - i, length - i);
+}
+
+#elif DMP_SIMD_NEON
+
+// NEON has no movemask, narrowing the comparison leaves a nibble per byte.
+inline uint64_t differenceMaskNEON(uint8x16_t block1, uint8x16_t block2)
+{
+	uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(vceqq_u8(block1, block2)), 4);
+	return ~vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+}
+
+inline size_t commonPrefixNEON(const uint8_t *text1, const uint8_t *text2, size_t length)
+{
+	size_t i = 0;
+	for(; i + 16 <= length; i += 16) {
+		uint64_t differ = differenceMaskNEON(vld1q_u8(text1 + i), vld1q_u8(text2 + i));
+		if(differ)
+			return i + __builtin_ctzll(differ) / 4;
+	}
+	return i + commonPrefixScalar(text1 + i, text2 + i, length - i);
+}
+
+inline size_t commonSuffixNEON(const uint8_t *text1_end, const uint8_t *text2_end, size_t length)
+{
+	size_t i = 0;
+	for(; i + 16 <= length; i += 16) {
+		uint64_t differ = differenceMaskNEON(vld1q_u8(text1_end - i - 16), vld1q_u8(text2_end - i - 16));
+		if(differ)
+			return i + __builtin_clzll(differ) / 4;
+	}
+	return i + commonSuffixScalar(text1_end - i, text2_end - i, length - i);
+}
+
+#endif
+
+
+struct Kernels {
+	const char *name;
+	AffixKernel commonPrefix;
+	AffixKernel commonSuffix;
+};
+
+inline Kernels selectKernels()
+{
+#if DMP_SIMD_X86
+	if(__builtin_cpu_supports("avx2"))
+		return {"avx2", commonPrefixAVX2, commonSuffixAVX2};
+	return {"sse2", commonPrefixSSE2, commonSuffixSSE2};
+#elif DMP_SIMD_NEON
+	return {"neon", commonPrefixNEON, commonSuffixNEON};
+#else
+	return {"scalar", commonPrefixScalar, commonSuffixScalar};
+#endif
+}
+
+// The best kernels for this CPU, chosen on first use.
+inline const Kernels &kernels()
+{
+	static const Kernels selected = selectKernels();
+	return selected;
+}
+
+// Below this many bytes the call through the dispatch table isn't worth it.
+inline constexpr size_t MinimumLength = 16;
+
+/**
+ * Determine the number of bytes common to the start of two buffers.
+ */
+
+inline size_t commonPrefix(const void *text1, const void *text2, size_t length)
+{
+	const uint8_t *bytes1 = (const uint8_t *)text1, *bytes2 = (const uint8_t *)text2;
+	return length < MinimumLength ? commonPrefixScalar(bytes1, bytes2, length) :
+		kernels().commonPrefix(bytes1, bytes2, length);
+}
+
+/**
+ * Determine the number of bytes common to the end of two buffers.
+ */
+
+inline size_t commonSuffix(const void *text1_end, const void *text2_end, size_t length)
+{
+	const uint8_t *bytes1 = (const uint8_t *)text1_end, *bytes2 = (const uint8_t *)text2_end;
+	return length < MinimumLength ? commonSuffixScalar(bytes1, bytes2, length) :
+		kernels().commonSuffix(bytes1, bytes2, length);
+}
+
+} // namespace simd
+} // namespace dmp
+
+#endif /* DiffMatchPatchSIMD_hpp */
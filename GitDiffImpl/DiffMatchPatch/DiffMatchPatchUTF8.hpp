@@ -0,0 +1,217 @@
+/*
+ * Diff Match and Patch
+ *
+ * Copyright 2010 geheimwerk.de.
+ * http://code.google.com/p/google-diff-match-patch/
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: fraser@google.com (Neil Fraser)
+ * ObjC port: jan@geheimwerk.de (Jan Weiß)
+ * Refactoring & mangling: @inquisitivesoft (Harry Jordan)
+ *
+ *
+ * Byte level diffing of UTF-8 texts as they come from git, without
+ * transcoding them to UTF-16 first. The diff is made over bytes and the
+ * boundaries of the spans are then moved so none falls inside a code
+ * point. Offsets can be reported in UTF-16 units for use with NSString.
+ * Texts are assumed to be valid UTF-8.
+ */
+
+#ifndef DiffMatchPatchUTF8_hpp
+#define DiffMatchPatchUTF8_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "DiffMatchPatchCore.hpp"
+
+namespace dmp {
+namespace utf8 {
+
+// A span with its range in both UTF-8 bytes and UTF-16 units.
+struct Utf16Span {
+	Op op;
+	uint32_t offset;		// Bytes into text1 for Delete & Equal, text2 for Insert
+	uint32_t length;
+	uint32_t utf16_offset;	// The same range in UTF-16 units
+	uint32_t utf16_length;
+};
+
+inline bool isContinuation(uint8_t byte)
+{
+	return (byte & 0xC0) == 0x80;
+}
+
+/**
+ * Count the UTF-16 units needed for some UTF-8: one for each byte that
+ * starts a code point and another for those that need a surrogate pair.
+ */
+
+inline size_t utf16Length(const uint8_t *bytes, size_t length)
+{
+	size_t units = 0;
+	for(size_t i = 0; i < length; i++) {
+		units += !isContinuation(bytes[i]) + (bytes[i] >= 0xF0);
+	}
+	return units;
+}
+
+/**
+ * Move the boundaries of spans covering the whole of both texts so that
+ * none falls inside a code point. Bytes at the edges of equalities are
+ * given to the edits either side, equalities emptied this way are removed
+ * and their neighbouring edits joined. Edits between two equalities are
+ * output as at most one delete followed by one insert, less any whole
+ * code points they have in common.
+ * @param scratch Storage for the output which is swapped into spans.
+ */
+
+inline void snapToCodePoints(const uint8_t *text1, size_t length1, const uint8_t *text2, size_t length2,
+							 std::vector<Span> &spans, std::vector<Span> &scratch)
+{
+	std::vector<Span> &out = scratch;
+	out.clear();
+
+	// The edits since the last equality output start at run1 and run2.
+	size_t run1 = 0, run2 = 0;
+
+	// Equalities only hold an offset into text1, track the position in text2.
+	size_t offset2 = 0;
+
+	auto equal = [&](size_t offset, size_t length) {
+		if(!out.empty() && out.back().op == Op::Equal) {
+			out.back().length += length;
+		} else {
+			out.push_back(Span{Op::Equal, (uint32_t)offset, (uint32_t)length});
+		}
+	};
+
+	// Output the edits up to end1 and end2 factoring out any common prefix or
+	// suffix of whole code points, which the edits may have gained from the
+	// equalities. @return The length of the common suffix for the caller to output.
+	auto flush = [&](size_t end1, size_t end2) {
+		size_t count1 = end1 - run1, count2 = end2 - run2;
+		size_t prefix = commonPrefix(text1 + run1, text2 + run2, std::min(count1, count2));
+		while(prefix != 0 && ((prefix < count1 && isContinuation(text1[run1 + prefix])) ||
+							  (prefix < count2 && isContinuation(text2[run2 + prefix])))) {
+			prefix--;
+		}
+
+		size_t suffix = commonSuffix(text1 + end1, text2 + end2, std::min(count1, count2) - prefix);
+		while(suffix != 0 && isContinuation(text1[end1 - suffix])) {
+			suffix--;
+		}
+
+		if(prefix != 0) {
+			equal(run1, prefix);
+		}
+		if(count1 != prefix + suffix) {
+			out.push_back(Span{Op::Delete, (uint32_t)(run1 + prefix), (uint32_t)(count1 - prefix - suffix)});
+		}
+		if(count2 != prefix + suffix) {
+			out.push_back(Span{Op::Insert, (uint32_t)(run2 + prefix), (uint32_t)(count2 - prefix - suffix)});
+		}
+		return suffix;
+	};
+
+	for(const Span &span : spans) {
+		if(span.op != Op::Equal) {
+			if(span.op == Op::Insert) {
+				offset2 = span.offset + span.length;
+			}
+			continue;
+		}
+
+		size_t start1 = span.offset, start2 = offset2, length = span.length;
+		offset2 = start2 + length;
+
+		// An equality starting part way through a code point gives its first bytes to the edits before it.
+		if(start1 != run1 || start2 != run2) {
+			while(length != 0 && isContinuation(text1[start1])) {
+				start1++;
+				start2++;
+				length--;
+			}
+		}
+
+		// And its last bytes to the edits after it if either text continues the code point.
+		while(length != 0 && ((start1 + length < length1 && isContinuation(text1[start1 + length])) ||
+							  (start2 + length < length2 && isContinuation(text2[start2 + length])))) {
+			length--;
+		}
+
+		if(length == 0) {
+			continue;
+		}
+
+		size_t suffix = flush(start1, start2);
+		equal(start1 - suffix, length + suffix);
+		run1 = start1 + length;
+		run2 = start2 + length;
+	}
+
+	if(size_t suffix = flush(length1, length2)) {
+		equal(length1 - suffix, suffix);
+	}
+
+	spans.swap(out);
+}
+
+/**
+ * Find the differences between two UTF-8 texts with no span boundary
+ * falling inside a code point.
+ * @return Spans of byte ranges in the arena, valid until the arena is next used.
+ */
+
+inline const std::vector<Span> &diff(const uint8_t *text1, size_t length1, const uint8_t *text2, size_t length2,
+									 Arena &arena, Deadline deadline = NoDeadline, WorkStealingPool *pool = nullptr)
+{
+	Differ<uint8_t> differ(text1, length1, text2, length2, arena, deadline, pool);
+	differ.diff();
+	snapToCodePoints(text1, length1, text2, length2, arena.spans, arena.scratch);
+	return arena.spans;
+}
+
+/**
+ * Add the UTF-16 ranges to spans covering the whole of both texts.
+ */
+
+inline void utf16Spans(const uint8_t *text1, const uint8_t *text2, const std::vector<Span> &spans, std::vector<Utf16Span> &out)
+{
+	out.clear();
+	out.reserve(spans.size());
+
+	// UTF-16 units reached in each text, spans of a text are contiguous.
+	size_t units1 = 0, units2 = 0;
+
+	for(const Span &span : spans) {
+		bool inserted = span.op == Op::Insert;
+		size_t &units = inserted ? units2 : units1;
+		size_t length = utf16Length((inserted ? text2 : text1) + span.offset, span.length);
+
+		out.push_back(Utf16Span{span.op, span.offset, span.length, (uint32_t)units, (uint32_t)length});
+		units += length;
+
+		if(span.op == Op::Equal) {
+			// The equality is also in text2.
+			units2 += length;
+		}
+	}
+}
+
+} // namespace utf8
+} // namespace dmp
+
+#endif /* DiffMatchPatchUTF8_hpp */
@@ -10,8 +10,6 @@ import Foundation
 
 class DiffProcessor {
 
-    let regex = try! NSRegularExpression(pattern: "^(?:(?:@@ -\\d+,\\d+ \\+(\\d+),\\d+ @@)|([-+])(.*))", options: [])
-
     enum Delta {
         case start(lineno: Int)
         case delete(text: String)
@@ -19,43 +17,39 @@ class DiffProcessor {
         case other
     }
 
-    func delta(line: String) -> Delta {
-        if let match = regex.firstMatch(in: line, options: [], range: NSMakeRange(0, line.utf16.count)) {
-            if let lineno = match.group(1, in: line) {
-                return .start(lineno: Int(lineno) ?? -1)
-            } else if let delta = match.group(2, in: line), let text = match.group(3, in: line) {
-                if delta == "-" {
-                    return .delete(text: text)
-                } else {
-                    return .insert(text: text)
-                }
-            }
+    func delta(line: UnsafePointer<UnifiedDiffLine>) -> Delta? {
+        switch line.pointee.type {
+        case .hunk:
+            return .start(lineno: line.pointee.newStart)
+        case .delete:
+            return .delete(text: text(of: line))
+        case .insert:
+            return .insert(text: text(of: line))
+        case .context:
+            return .other
+        default:
+            // File headers and "\ No newline at end of file"
+            return nil
         }
-        return .other
     }
 
-    func textDiff(_ inserted: String, against deleted: String, defaults: DefaultManager) -> NSAttributedString {
-        let attributes = [NSAttributedStringKey.foregroundColor: defaults.extraColor]
-        let attributed = NSMutableAttributedString()
-
-        for diff in diff_diffsBetweenTexts(deleted, inserted) {
-            let diff = diff as! DMDiff
-            if diff.operation == DIFF_INSERT {
-                continue
-            }
-
-            let next = NSMutableAttributedString(string: diff.text ?? "")
-            if diff.operation == DIFF_DELETE {
-                next.setAttributes(attributes, range: NSMakeRange(0, next.length))
-            }
-
-            attributed.append(next)
+    func text(of line: UnsafePointer<UnifiedDiffLine>) -> String {
+        let length = line.pointee.length
+        return line.pointee.text.withMemoryRebound(to: UInt8.self, capacity: length) {
+            String(decoding: UnsafeBufferPointer(start: $0, count: length), as: UTF8.self)
         }
+    }
 
-        return attributed
+    /// Parses git diff output straight from the generator's file handle, next() should not have been called.
+    open func generateHighlights(generator: FileGenerator, defaults: DefaultManager) -> LNFileHighlights {
+        return generateHighlights(defaults: defaults) {
+            unifiedDiffParseFileDescriptor(generator.handle.fileDescriptor, $0)
+        }
     }
 
-    open func generateHighlights(sequence: AnySequence<String>, defaults: DefaultManager) -> LNFileHighlights {
+    /// Highlights from diff lines passed to the block given to lines, however they are produced.
+    open func generateHighlights(defaults: DefaultManager,
+                                 lines: (_ block: (UnsafePointer<UnifiedDiffLine>) -> Void) -> Void) -> LNFileHighlights {
         let deletedColor = defaults.deletedColor
         let modifiedColor = defaults.modifiedColor
         let addedColor = defaults.addedColor
@@ -66,14 +60,14 @@ class DiffProcessor {
 
         func closeRange() {
             element?.range = "\(startLine) \(currentLine - startLine)"
-            if let deleted = element?.text {
-                element?.setAttributedText(textDiff(insertedText, against: deleted, defaults: defaults))
+            if element?.text != nil {
+                // Diffed against the deleted text when hovered
+                element?.inserted = insertedText
             }
         }
 
-        for line in sequence {
-
-            switch delta(line: line) {
+        func process(_ delta: Delta) {
+            switch delta {
             case .start(let lineno):
                 currentLine = lineno
                 break
@@ -100,7 +94,7 @@ class DiffProcessor {
                     element?.color = addedColor
                 }
                 fileHighlights[currentLine] = element
-                insertedText += text
+                insertedText += text + "\n"
                 currentLine += 1
                 break
             case .other:
@@ -116,18 +110,72 @@ class DiffProcessor {
             }
         }
 
+        lines {
+            line in
+            if let delta = delta(line: line) {
+                process(delta)
+            }
+        }
+
+        // Close any range still open at the end of the diff
+        process(.other)
+
         return fileHighlights
     }
 
 }
 
-extension NSTextCheckingResult {
+// The highlights last sent for each file, so that only the lines that changed
+// since need be sent, as a splice of the version the client should hold.
+class HighlightDeltas {
+
+    private var sent = [String: (highlights: LNFileHighlights, version: Int)]()
+    // Unlike those of a service that ran before
+    private var version = Int(Date().timeIntervalSince1970 * 1000)
+    private let lock = NSLock()
+
+    // Highlights of a file to send, changes to those last sent if there were any
+    func delta(_ highlights: LNFileHighlights, forFile filepath: String) -> LNFileHighlights {
+        lock.lock()
+        defer { lock.unlock() }
+        let last = sent[filepath]
+        let delta = last.flatMap { highlights.highlightsChanged(from: $0.highlights) } ?? highlights
+        record(highlights, sending: delta, after: last?.version, forFile: filepath)
+        return delta
+    }
 
-    func group(_ group: Int, in string: String) -> String? {
-        if range(at: group).location != NSNotFound {
-            return string[range(at: group)]
-        }
-        return nil
+    // A window of lines diffed again, nil if what it splices wasn't sent
+    func splice(_ window: LNFileHighlights, forFile filepath: String) -> LNFileHighlights? {
+        lock.lock()
+        defer { lock.unlock() }
+        guard let last = sent[filepath] else { return nil }
+        record(last.highlights.highlightsSplicing(window), sending: window, after: last.version, forFile: filepath)
+        return window
+    }
+
+    // The client doesn't hold the version last sent
+    func forget(file filepath: String) {
+        lock.lock()
+        sent[filepath] = nil
+        lock.unlock()
+    }
+
+    private func record(_ highlights: LNFileHighlights, sending: LNFileHighlights,
+                        after base: Int?, forFile filepath: String) {
+        version += 1
+        sending.version = version
+        sending.baseVersion = base ?? 0
+        sent[filepath] = (highlights, version)
+    }
+
+}
+
+extension LNExtensionBase {
+
+    // Highlights in the format the client prefers of those it accepts
+    func encoded(_ highlights: LNFileHighlights) -> Data {
+        return highlightFormats.first == LNHighlightFormatBinary ?
+            highlights.binaryData() : highlights.jsonData()
     }
 
 }
@@ -0,0 +1,229 @@
+//
+//  EditSession.hpp
+//  LNProvider
+//
+//  Copyright © 2017 John Holdsworth. All rights reserved.
+//
+//  Diffs successive versions of an editor's unsaved buffer against the
+//  same base, re-diffing only the lines edited since the last version.
+//  The lines in common at the start and end of the two versions are
+//  found with memcmp and the edited lines widened to the nearest lines
+//  the last diff had as equal either side. Only the lines between these
+//  "anchors" are split into lines and diffed, the spans of the last diff
+//  before and after them being kept with those after moved by the
+//  change in the number of lines.
+//
+
+#ifndef EditSession_hpp
+#define EditSession_hpp
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BaseCache.hpp"
+#include "DiffMatchPatch/DiffMatchPatchCore.hpp"
+
+namespace git {
+
+class EditSession {
+public:
+    // Lines (0 based) re-diffed: those in [start, old_end) of the last text
+    // are now [start, end) and those after moved by end - old_end. Anchors,
+    // the equal lines either side, are not included.
+    struct Window {
+        bool whole;                 // The whole text was diffed, no last text
+        uint32_t start, old_end, end;
+        uint32_t base_start;        // Base line aligned with start
+        bool anchored_start, anchored_end;
+    };
+
+    /**
+     * Diff a text against a base, incrementally if the last text diffed
+     * was against the same blob. Hold the base's lock while calling.
+     */
+
+    Window diff(const ObjectId &id, const std::shared_ptr<Base> &new_base, std::string &&new_text, dmp::Arena &arena)
+    {
+        std::vector<size_t> new_offsets;
+        splitLines(new_text, new_offsets);
+
+        if (!base || base != new_base || !(base_id == id)) {
+            base = new_base;
+            base_id = id;
+            text.swap(new_text);
+            offsets.swap(new_offsets);
+
+            std::vector<uint32_t> ids;
+            base->idsFor(text.data(), text.size(), ids, nullptr);
+            dmp::Differ<uint32_t> differ(base->ids.data(), base->ids.size(), ids.data(), ids.size(), arena);
+            spans = differ.diff();
+            base->done();
+
+            window_spans = spans;
+            uint32_t lines = uint32_t(offsets.size() - 1);
+            return Window{true, 0, lines, lines, 0, false, false};
+        }
+
+        uint32_t old_lines = uint32_t(offsets.size() - 1), new_lines = uint32_t(new_offsets.size() - 1);
+        uint32_t prefix, suffix;
+        commonLines(new_text, new_lines, prefix, suffix);
+        int64_t delta = int64_t(new_lines) - old_lines;
+
+        // The last equal lines before and first after the edited lines, if any
+        uint32_t start_base = 0, start_line = 0, end_base = uint32_t(base->ids.size()), end_line = old_lines;
+        bool anchored_start = false, anchored_end = false;
+        uint32_t b = 0, w = 0;
+        for (const dmp::Span &span : spans) {
+            if (span.op == dmp::Op::Equal) {
+                if (w < prefix) {
+                    start_line = std::min(w + span.length - 1, prefix - 1);
+                    start_base = b + (start_line - w);
+                    anchored_start = true;
+                }
+                if (w + span.length > old_lines - suffix) {
+                    end_line = std::max(w, old_lines - suffix);
+                    end_base = b + (end_line - w);
+                    anchored_end = true;
+                    break;
+                }
+            }
+            b += span.op != dmp::Op::Insert ? span.length : 0;
+            w += span.op != dmp::Op::Delete ? span.length : 0;
+        }
+
+        // Between the anchors in base, old and new texts
+        uint32_t base_start = anchored_start ? start_base + 1 : 0, line_start = anchored_start ? start_line + 1 : 0;
+        uint32_t old_end = end_line, new_end = uint32_t(end_line + delta);
+
+        std::vector<uint32_t> ids;
+        base->idsFor(new_text.data() + new_offsets[line_start], new_offsets[new_end] - new_offsets[line_start], ids, nullptr);
+        dmp::Differ<uint32_t> differ(base->ids.data() + base_start, end_base - base_start, ids.data(), ids.size(), arena);
+        window_spans.clear();
+        for (dmp::Span span : differ.diff()) {
+            span.offset += span.op == dmp::Op::Insert ? line_start : base_start;
+            window_spans.push_back(span);
+        }
+        base->done();
+
+        // Spans before the start anchor (included), the window's, then those from the end anchor
+        std::vector<dmp::Span> spliced;
+        b = w = 0;
+        for (const dmp::Span &span : spans) {
+            if (span.op == dmp::Op::Equal) {
+                if (w < line_start)
+                    push(spliced, {dmp::Op::Equal, b, std::min(span.length, line_start - w)});
+            } else if (span.op == dmp::Op::Delete ? b < base_start : w < line_start)
+                push(spliced, span);
+            b += span.op != dmp::Op::Insert ? span.length : 0;
+            w += span.op != dmp::Op::Delete ? span.length : 0;
+        }
+
+        for (const dmp::Span &span : window_spans)
+            push(spliced, span);
+
+        b = w = 0;
+        for (dmp::Span span : spans) {
+            if (span.op == dmp::Op::Equal) {
+                if (w + span.length > old_end) {
+                    uint32_t skip = old_end > w ? old_end - w : 0;
+                    push(spliced, {dmp::Op::Equal, b + skip, span.length - skip});
+                }
+            } else if (span.op == dmp::Op::Delete ? b >= end_base : w >= old_end) {
+                if (span.op == dmp::Op::Insert)
+                    span.offset = uint32_t(span.offset + delta);
+                push(spliced, span);
+            }
+            b += span.op != dmp::Op::Insert ? span.length : 0;
+            w += span.op != dmp::Op::Delete ? span.length : 0;
+        }
+
+        spans.swap(spliced);
+        text.swap(new_text);
+        offsets.swap(new_offsets);
+        return Window{false, line_start, old_end, new_end, base_start, anchored_start, anchored_end};
+    }
+
+    // Spans of the whole of the base and text
+    const std::vector<dmp::Span> &allSpans() const
+    {
+        return spans;
+    }
+
+    // Spans between the anchors of the last diff
+    const std::vector<dmp::Span> &windowSpans() const
+    {
+        return window_spans;
+    }
+
+    const std::string &currentText() const
+    {
+        return text;
+    }
+
+    // The offset of each line of the text followed by its length
+    const std::vector<size_t> &lineOffsets() const
+    {
+        return offsets;
+    }
+
+private:
+    std::shared_ptr<Base> base;
+    ObjectId base_id = {};
+    std::string text;
+    std::vector<size_t> offsets;
+    std::vector<dmp::Span> spans, window_spans;
+
+    static void splitLines(const std::string &text, std::vector<size_t> &offsets)
+    {
+        offsets.clear();
+        for (const char *start = text.data(), *end = start + text.size(), *next = start; next < end;) {
+            offsets.push_back(next - start);
+            const char *eol = (const char *)memchr(next, '\n', end - next);
+            next = eol ? eol + 1 : end;
+        }
+        offsets.push_back(text.size());
+    }
+
+    // Whole lines in common at the start and end of the last and new texts
+    void commonLines(const std::string &new_text, uint32_t new_lines, uint32_t &prefix, uint32_t &suffix) const
+    {
+        uint32_t old_lines = uint32_t(offsets.size() - 1);
+        size_t bytes = dmp::commonPrefix(text.data(), new_text.data(), std::min(text.size(), new_text.size()));
+
+        // Lines ending in a newline within the common bytes
+        prefix = uint32_t(std::upper_bound(offsets.begin(), offsets.end(), bytes) - offsets.begin() - 1);
+        if (prefix > 0 && text[offsets[prefix] - 1] != '\n')
+            prefix--;
+        prefix = std::min({prefix, old_lines, new_lines});
+
+        size_t from = offsets[prefix];
+        bytes = dmp::commonSuffix(text.data() + text.size(), new_text.data() + new_text.size(),
+                                  std::min(text.size(), new_text.size()) - from);
+
+        // Lines within the common bytes that also start a line of the new text
+        suffix = 0;
+        while (suffix < old_lines - prefix && suffix < new_lines - prefix) {
+            size_t tail = text.size() - offsets[old_lines - suffix - 1], line = new_text.size() - tail;
+            if (tail > bytes || (line > 0 && new_text[line - 1] != '\n'))
+                break;
+            suffix++;
+        }
+    }
+
+    static void push(std::vector<dmp::Span> &out, const dmp::Span &span)
+    {
+        if (span.length == 0)
+            return;
+        if (!out.empty() && out.back().op == span.op &&
+            out.back().offset + out.back().length == span.offset)
+            out.back().length += span.length;
+        else
+            out.push_back(span);
+    }
+};
+
+} // namespace git
+
+#endif /* EditSession_hpp */
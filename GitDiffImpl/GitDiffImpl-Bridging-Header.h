@@ -7,3 +7,5 @@
 
 #import "DiffMatchPatch.h"
 #import "DMDiff.h"
+#import "UnifiedDiffParser.h"
+#import "GitRepository.h"
@@ -12,35 +12,144 @@ let implementationFactory = GitDiffImpl.self
 var lineNumberDefaults = DefaultManager()
 var diffgen = DiffProcessor()
 
+// Highlights last made for each file with the state of the file and colours they were made from
+var lastHighlights = [String: (state: Data, colors: String, highlights: LNFileHighlights)]()
+let lastHighlightsLock = NSLock()
+
+// Buffers are diffed in the order edited against the last diffed
+let bufferQueue = DispatchQueue(label: "GitDiffBuffer")
+
 open class GitDiffImpl: LNExtensionBase, LNExtensionService {
 
+    let deltas = HighlightDeltas()
+
+    public required init?(connection: NSXPCConnection?) {
+        super.init(connection: connection)
+        // Highlights are sent as files change rather than when next polled
+        gitWatchChanges {
+            [weak self] files in
+            for filepath in files {
+                self?.refreshHighlights(forFile: filepath)
+            }
+        }
+    }
+
     open override func getConfig(_ callback: @escaping LNConfigCallback) {
         callback([
             LNPopoverColorKey: lineNumberDefaults.popoverColor.stringRepresentation,
+            LNExtraColorKey: lineNumberDefaults.extraColor.stringRepresentation,
             LNApplyTitleKey: "GitDiff",
             LNApplyPromptKey: "Revert code at lines %d-%d to staged version?",
             LNApplyConfirmKey: "Revert",
+            LNBufferDiffKey: "1",
+            LNWatchFilesKey: "1",
         ])
     }
 
+    open override func forgetHighlights(forFile filepath: String) {
+        deltas.forget(file: filepath)
+    }
+
+    // Send the client highlights for a file changed on disk unless its diff can't have
+    func refreshHighlights(forFile filepath: String) {
+        lastHighlightsLock.lock()
+        let last = lastHighlights[filepath]
+        lastHighlightsLock.unlock()
+        if let last = last, gitWorkingFileState(filepath, lineNumberDefaults.showHead) == last.state {
+            return
+        }
+        requestHighlights(forFile: filepath) {
+            json, error in
+            self.owner?.updateHighlights(json, error: error, forFile: filepath)
+        }
+    }
+
     open func requestHighlights(forFile filepath: String, callback: @escaping LNHighlightCallback) {
-        DispatchQueue.global().async {
-            let url = URL(fileURLWithPath: filepath)
-            var arguments = ["git", "diff", "--no-ext-diff", "--no-color"]
-            if lineNumberDefaults.showHead {
-                arguments.append("HEAD")
+        requests.request(forFile: filepath, callback: callback) {
+            request in
+            DispatchQueue.global().async {
+                gitWatchFile(filepath)
+                // Unchanged files need not be diffed again
+                let state = gitWorkingFileState(filepath, lineNumberDefaults.showHead)
+                let colors = [lineNumberDefaults.deletedColor, lineNumberDefaults.modifiedColor,
+                              lineNumberDefaults.addedColor].map { $0.stringRepresentation }.joined(separator: " ")
+                lastHighlightsLock.lock()
+                let last = lastHighlights[filepath]
+                lastHighlightsLock.unlock()
+                if let state = state, let last = last, last.state == state && last.colors == colors {
+                    request.finish {
+                        self.encoded(self.deltas.delta(last.highlights, forFile: filepath))
+                    }
+                    return
+                }
+
+                // Read from the repository directly unless git would convert the text
+                var readable = false
+                let highlights = diffgen.generateHighlights(defaults: lineNumberDefaults) {
+                    readable = gitDiffWorkingFile(filepath, lineNumberDefaults.showHead, $0)
+                }
+                if readable {
+                    lastHighlightsLock.lock()
+                    lastHighlights[filepath] = state.flatMap { (state: $0, colors: colors, highlights: highlights) }
+                    lastHighlightsLock.unlock()
+                    request.finish {
+                        self.encoded(self.deltas.delta(highlights, forFile: filepath))
+                    }
+                    return
+                }
+
+                // Not worth running git for if already superseded
+                guard !request.isStale else {
+                    request.finish(nil, nil)
+                    return
+                }
+
+                let url = URL(fileURLWithPath: filepath)
+                var arguments = ["git", "diff", "--no-ext-diff", "--no-color"]
+                if lineNumberDefaults.showHead {
+                    arguments.append("HEAD")
+                }
+                arguments.append(url.lastPathComponent)
+                let generator = TaskGenerator(launchPath: "/usr/bin/env", arguments: arguments,
+                                              directory: url.deletingLastPathComponent().path)
+                request.running(generator.task)
+
+                let highlights = diffgen.generateHighlights(generator: generator, defaults: lineNumberDefaults)
+                request.finish {
+                    self.encoded(self.deltas.delta(highlights, forFile: filepath))
+                }
+            }
+        }
+    }
+
+    open override func requestHighlights(forFile filepath: String, buffer: String, callback: @escaping LNHighlightCallback) {
+        bufferQueue.async {
+            var readable = false, window = GitBufferWindow()
+            let highlights = diffgen.generateHighlights(defaults: lineNumberDefaults) {
+                readable = gitDiffBuffer(filepath, lineNumberDefaults.showHead, Data(buffer.utf8), &window, $0)
+            }
+            guard readable else {
+                // Only the saved file can be diffed
+                self.requestHighlights(forFile: filepath, callback: callback)
+                return
             }
-            arguments.append(url.lastPathComponent)
-            let generator = TaskGenerator(launchPath: "/usr/bin/env", arguments: arguments,
-                                          directory: url.deletingLastPathComponent().path)
 
-            for _ in 0 ..< 4 {
-                _ = generator.next()
+            guard window.splice.boolValue else {
+                callback(self.encoded(self.deltas.delta(highlights, forFile: filepath)), nil)
+                return
             }
 
-            let highlights = diffgen.generateHighlights(sequence: generator.lineSequence, defaults: lineNumberDefaults)
-            callback(highlights.jsonData(), nil)
+            highlights.spliceStart = window.start
+            highlights.spliceOldEnd = window.oldEnd
+            highlights.spliceEnd = window.end
+            guard let spliced = self.deltas.splice(highlights, forFile: filepath) else {
+                // Forgotten as the client holds other highlights, start over from the saved file
+                self.requestHighlights(forFile: filepath, callback: callback)
+                return
+            }
+            callback(self.encoded(spliced), nil)
         }
     }
-    
+
+
 }
@@ -0,0 +1,73 @@
+//
+//  GitRepository.h
+//  LNProvider
+//
+//  Copyright © 2017 John Holdsworth. All rights reserved.
+//
+//  Diffs a file against its staged or HEAD version read in process
+//  by GitRepository.hpp rather than by running git diff.
+//
+
+#import "UnifiedDiffParser.h"
+
+/**
+ * Diff a working file against the version in the index, or at HEAD, calling
+ * the block with lines as if parsed from git diff. Untracked files have none,
+ * nor do binary files, for which git diff only says that they differ.
+ * @return NO, having called the block for no lines, if the repository can't
+ * be read in process or git would convert the text or diff it with a driver,
+ * so git diff should be run.
+ */
+
+BOOL gitDiffWorkingFile(NSString *_Nonnull path, BOOL head,
+                        void (^_Nonnull NS_NOESCAPE block)(const UnifiedDiffLine *_Nonnull line));
+
+/**
+ * The state of a file as far as its diff goes, equal for two calls only if
+ * the diff would be the same. nil when it can't be known so diff regardless.
+ */
+
+NSData *_Nullable gitWorkingFileState(NSString *_Nonnull path, BOOL head);
+
+typedef struct {
+    NSUInteger hits, misses, evictions;
+    NSUInteger entries, bytes, capacity;
+} GitBaseCacheStatistics;
+
+/**
+ * Counts for the cache of texts diffed against, by blob id, to size it by.
+ */
+
+GitBaseCacheStatistics gitBaseCacheStatistics(void);
+void gitBaseCacheSetCapacity(NSUInteger bytes);
+
+typedef struct {
+    BOOL splice;                    // only some lines were diffed
+    NSInteger start, oldEnd, end;   // lines [start, oldEnd) of the last diff are now [start, end)
+} GitBufferWindow;
+
+/**
+ * Diff the unsaved contents of an editor's buffer for a file, re-diffing only
+ * the lines edited since the last buffer when it was against the same base.
+ * Diffing the saved file starts over. Returns NO as gitDiffWorkingFile().
+ * @param window Whether the lines passed to the block are to be spliced into
+ * the highlights of the last diff.
+ */
+
+BOOL gitDiffBuffer(NSString *_Nonnull path, BOOL head, NSData *_Nonnull buffer, GitBufferWindow *_Nonnull window,
+                   void (^_Nonnull NS_NOESCAPE block)(const UnifiedDiffLine *_Nonnull line));
+
+/**
+ * Call a block with files passed to gitWatchFile() when they, or the index,
+ * HEAD or branches of their repository, change on disk. Changes made together,
+ * as by checking out a branch, are passed together once they stop. The block
+ * replaces any passed before and is called on a thread of the watcher's own.
+ */
+
+void gitWatchChanges(void (^_Nonnull changed)(NSArray<NSString *> *_Nonnull files));
+
+/**
+ * Watch a file in a repository until the service exits, NO if it isn't in one.
+ */
+
+BOOL gitWatchFile(NSString *_Nonnull path);
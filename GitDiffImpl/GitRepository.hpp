@@ -0,0 +1,1036 @@
+//
+//  GitRepository.hpp
+//  LNProvider
+//
+//  Copyright © 2017 John Holdsworth. All rights reserved.
+//
+//  Reads a git repository in process so the staged or HEAD version of
+//  a file can be diffed without running git. Loose objects are inflated
+//  with zlib, packfiles are mmap'd and looked up through their v2 .idx
+//  with offset and ref deltas resolved. The index is read in versions 2
+//  to 4, parsed again only when it is rewritten, and its cached stat
+//  data says whether a working file is unchanged from its blob without
+//  reading it. Only SHA-1 repositories are supported, as signalled by
+//  a lookup returning Failed, and callers fall back to running git.
+//
+
+#ifndef GitRepository_hpp
+#define GitRepository_hpp
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace git {
+
+struct ObjectId {
+    uint8_t bytes[20];
+
+    static bool fromHex(const char *hex, ObjectId &id)
+    {
+        for (int i = 0; i < 20; i++) {
+            int high = hexValue(hex[2 * i]), low = high < 0 ? -1 : hexValue(hex[2 * i + 1]);
+            if (low < 0)
+                return false;
+            id.bytes[i] = uint8_t(high << 4 | low);
+        }
+        return true;
+    }
+
+    std::string hex() const
+    {
+        static const char digits[] = "0123456789abcdef";
+        std::string out(40, '0');
+        for (int i = 0; i < 20; i++) {
+            out[2 * i] = digits[bytes[i] >> 4];
+            out[2 * i + 1] = digits[bytes[i] & 15];
+        }
+        return out;
+    }
+
+    bool operator==(const ObjectId &other) const
+    {
+        return memcmp(bytes, other.bytes, sizeof bytes) == 0;
+    }
+
+private:
+    static int hexValue(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+};
+
+enum class ObjectType : uint8_t {
+    None,
+    Commit,
+    Tree,
+    Blob,
+    Tag,
+    OffsetDelta = 6,
+    RefDelta
+};
+
+enum class Lookup {
+    Found,
+    Missing,    // Not in the tree or index
+    Failed      // Repository could not be read, run git instead
+};
+
+inline timespec modifiedTime(const struct stat &info)
+{
+#ifdef __APPLE__
+    return info.st_mtimespec;
+#else
+    return info.st_mtim;
+#endif
+}
+
+inline timespec changedTime(const struct stat &info)
+{
+#ifdef __APPLE__
+    return info.st_ctimespec;
+#else
+    return info.st_ctim;
+#endif
+}
+
+struct IndexEntry {
+    ObjectId id;
+    uint32_t ctime_seconds, ctime_nanoseconds, mtime_seconds, mtime_nanoseconds;
+    uint32_t dev, ino, mode, uid, gid, size;
+    uint16_t flags, extended_flags;
+
+    int stage() const
+    {
+        return flags >> 12 & 3;
+    }
+
+    /**
+     * Whether a file's stat is that cached when git last hashed it into the
+     * entry, truncated to 32 bits as git does. Nanoseconds are only compared
+     * when git recorded them.
+     */
+
+    bool matches(const struct stat &info) const
+    {
+        timespec mtime = modifiedTime(info), ctime = changedTime(info);
+        return S_ISREG(info.st_mode) && (mode & S_IFMT) == S_IFREG &&
+            size == uint32_t(info.st_size) && ino == uint32_t(info.st_ino) &&
+            mtime_seconds == uint32_t(mtime.tv_sec) &&
+            (!mtime_nanoseconds || mtime_nanoseconds == uint32_t(mtime.tv_nsec)) &&
+            ctime_seconds == uint32_t(ctime.tv_sec) &&
+            (!ctime_nanoseconds || ctime_nanoseconds == uint32_t(ctime.tv_nsec));
+    }
+};
+
+inline uint32_t bigEndian32(const uint8_t *p)
+{
+    return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+}
+
+inline bool readFile(const std::string &path, std::string &contents)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    contents.clear();
+    char buffer[64 * 1024];
+    ssize_t bytesRead;
+    while ((bytesRead = read(fd, buffer, sizeof buffer)) > 0)
+        contents.append(buffer, bytesRead);
+
+    close(fd);
+    return bytesRead == 0;
+}
+
+// Whether git would take a text as binary, for a NUL in its first 8000 bytes as buffer_is_binary() does
+inline bool isBinary(const std::string &text)
+{
+    return memchr(text.data(), '\0', std::min(text.size(), size_t(8000))) != nullptr;
+}
+
+// A file mapped read only
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        if (bytes)
+            munmap((void *)bytes, length);
+    }
+
+    bool open(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                bytes = (const uint8_t *)mapped;
+                length = info.st_size;
+            }
+        }
+
+        close(fd);
+        return bytes != nullptr;
+    }
+
+    const uint8_t *bytes = nullptr;
+    size_t length = 0;
+};
+
+/**
+ * Inflate a zlib stream of known size, or of any size when expected is SIZE_MAX.
+ * Data following the stream is ignored so length may run to the end of a pack.
+ */
+
+inline bool inflate(const uint8_t *data, size_t length, std::string &out, size_t expected = SIZE_MAX)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof stream);
+    if (inflateInit(&stream) != Z_OK)
+        return false;
+
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = (uInt)std::min<size_t>(length, UINT_MAX);
+
+    // One spare byte to find streams longer than expected
+    out.resize(expected != SIZE_MAX ? expected + 1 : std::max<size_t>(length * 4, 256));
+
+    int status = Z_OK;
+    while (status == Z_OK) {
+        if (stream.total_out == out.size()) {
+            if (expected != SIZE_MAX)
+                break;
+            out.resize(out.size() * 2);
+        }
+        stream.next_out = (Bytef *)&out[stream.total_out];
+        stream.avail_out = (uInt)(out.size() - stream.total_out);
+        status = ::inflate(&stream, Z_NO_FLUSH);
+    }
+
+    bool inflated = status == Z_STREAM_END && (expected == SIZE_MAX || stream.total_out == expected);
+    out.resize(stream.total_out);
+    inflateEnd(&stream);
+    return inflated;
+}
+
+// The variable length numbers of OFS_DELTA and index v4
+inline bool offsetNumber(const uint8_t *&p, const uint8_t *end, uint64_t &value)
+{
+    if (p == end)
+        return false;
+    uint8_t c = *p++;
+    value = c & 0x7f;
+    while (c & 0x80) {
+        if (p == end || value >> 56)
+            return false;
+        c = *p++;
+        value = (value + 1) << 7 | (c & 0x7f);
+    }
+    return true;
+}
+
+/**
+ * Apply a pack delta (copy and insert instructions) to its base.
+ */
+
+inline bool applyDelta(const std::string &base, const std::string &delta, std::string &out)
+{
+    const uint8_t *p = (const uint8_t *)delta.data(), *end = p + delta.size();
+
+    auto size = [&](uint64_t &value) {
+        value = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7) {
+            value |= uint64_t(*p & 0x7f) << shift;
+            if (!(*p++ & 0x80))
+                return true;
+        }
+        return false;
+    };
+
+    uint64_t source_size, target_size;
+    if (!size(source_size) || source_size != base.size() || !size(target_size))
+        return false;
+
+    out.resize(target_size);
+    uint64_t written = 0;
+
+    while (p < end) {
+        uint8_t op = *p++;
+        if (op & 0x80) {
+            uint64_t copy_offset = 0, copy_size = 0;
+            for (int i = 0; i < 4; i++)
+                if (op & 1 << i) {
+                    if (p == end)
+                        return false;
+                    copy_offset |= uint64_t(*p++) << 8 * i;
+                }
+            for (int i = 0; i < 3; i++)
+                if (op & 0x10 << i) {
+                    if (p == end)
+                        return false;
+                    copy_size |= uint64_t(*p++) << 8 * i;
+                }
+            if (copy_size == 0)
+                copy_size = 0x10000;
+            if (copy_offset + copy_size > base.size() || copy_size > target_size - written)
+                return false;
+            memcpy(&out[written], base.data() + copy_offset, copy_size);
+            written += copy_size;
+        } else if (op) {
+            if (op > end - p || op > target_size - written)
+                return false;
+            memcpy(&out[written], p, op);
+            p += op;
+            written += op;
+        } else
+            return false;
+    }
+
+    return written == target_size;
+}
+
+// A packfile and its v2 index
+class Pack {
+public:
+    bool open(const std::string &index_path)
+    {
+        if (!index.open(index_path) || !pack.open(index_path.substr(0, index_path.size() - 4) + ".pack"))
+            return false;
+
+        if (index.length < 8 + 256 * 4 || bigEndian32(index.bytes) != 0xff744f63 || bigEndian32(index.bytes + 4) != 2)
+            return false;
+        count = bigEndian32(index.bytes + 8 + 255 * 4);
+
+        // Object ids, CRCs and 32 bit offsets then any 64 bit offsets and two checksums
+        if (index.length < 8 + 256 * 4 + size_t(count) * 28 + 40)
+            return false;
+
+        return pack.length >= 12 && memcmp(pack.bytes, "PACK", 4) == 0;
+    }
+
+    bool find(const ObjectId &id, uint64_t &offset) const
+    {
+        const uint8_t *fanout = index.bytes + 8, *ids = fanout + 256 * 4;
+        uint32_t low = id.bytes[0] ? bigEndian32(fanout + (id.bytes[0] - 1) * 4) : 0;
+        uint32_t high = std::min(bigEndian32(fanout + id.bytes[0] * 4), count);
+
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            int order = memcmp(ids + size_t(middle) * 20, id.bytes, 20);
+            if (order < 0)
+                low = middle + 1;
+            else if (order > 0)
+                high = middle;
+            else {
+                const uint8_t *offsets = ids + size_t(count) * 24;
+                offset = bigEndian32(offsets + size_t(middle) * 4);
+                if (offset & 0x80000000) {
+                    const uint8_t *large = offsets + size_t(count) * 4 + (offset & 0x7fffffff) * 8;
+                    if (large + 8 > index.bytes + index.length - 40)
+                        return false;
+                    offset = uint64_t(bigEndian32(large)) << 32 | bigEndian32(large + 4);
+                }
+                return offset < pack.length;
+            }
+        }
+
+        return false;
+    }
+
+    const MappedFile &data() const
+    {
+        return pack;
+    }
+
+private:
+    MappedFile index, pack;
+    uint32_t count = 0;
+};
+
+// The index, parsed again only when it has been written
+class Index {
+public:
+
+    /**
+     * Read the index if it has changed on disk since it was last read.
+     * @return Missing if there is no index yet.
+     */
+
+    Lookup refresh(const std::string &path)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            clear();
+            return errno == ENOENT ? Lookup::Missing : Lookup::Failed;
+        }
+
+        // git replaces the index rather than writing to it, changing the inode
+        timespec mtime = modifiedTime(info);
+        if (loaded && info.st_ino == ino && info.st_size == size &&
+            mtime.tv_sec == modified.tv_sec && mtime.tv_nsec == modified.tv_nsec)
+            return Lookup::Found;
+
+        clear();
+        MappedFile file;
+        if (!file.open(path) || !parse(file.bytes, file.length)) {
+            clear();
+            return Lookup::Failed;
+        }
+
+        loaded = true;
+        ino = info.st_ino;
+        size = info.st_size;
+        modified = mtime;
+        return Lookup::Found;
+    }
+
+    Lookup find(const std::string &path, IndexEntry &entry) const
+    {
+        auto found = std::lower_bound(names.begin(), names.end(), path);
+        if (found == names.end() || *found != path)
+            return Lookup::Missing;
+
+        entry = entries[found - names.begin()];
+        // Unmerged paths get a combined diff from git
+        return entry.stage() == 0 ? Lookup::Found : Lookup::Failed;
+    }
+
+    /**
+     * Whether a file matches the stat of its entry and was not modified
+     * in the same instant the index was written, when a further change
+     * might not show in its stat (git's "racily clean" entries).
+     */
+
+    bool upToDate(const IndexEntry &entry, const struct stat &info) const
+    {
+        return loaded && entry.matches(info) &&
+            (entry.mtime_seconds < uint32_t(modified.tv_sec) ||
+             (entry.mtime_seconds == uint32_t(modified.tv_sec) && entry.mtime_nanoseconds &&
+              entry.mtime_nanoseconds < uint32_t(modified.tv_nsec)));
+    }
+
+private:
+    // Sorted by path then stage as in the file
+    std::vector<std::string> names;
+    std::vector<IndexEntry> entries;
+
+    bool loaded = false;
+    ino_t ino = 0;
+    off_t size = 0;
+    timespec modified = {};
+
+    void clear()
+    {
+        names.clear();
+        entries.clear();
+        loaded = false;
+    }
+
+    bool parse(const uint8_t *bytes, size_t length)
+    {
+        // Less the checksum at the end
+        const uint8_t *p = bytes, *end = p + length - std::min<size_t>(length, 20);
+        if (end - p < 12 || memcmp(p, "DIRC", 4) != 0)
+            return false;
+        uint32_t version = bigEndian32(p + 4), count = bigEndian32(p + 8);
+        if (version < 2 || version > 4 || count > length / 62)
+            return false;
+        p += 12;
+
+        names.reserve(count);
+        entries.reserve(count);
+        std::string name;
+
+        for (uint32_t i = 0; i < count; i++) {
+            const uint8_t *start = p;
+            if (end - p < 62)
+                return false;
+
+            IndexEntry entry;
+            entry.ctime_seconds = bigEndian32(p);
+            entry.ctime_nanoseconds = bigEndian32(p + 4);
+            entry.mtime_seconds = bigEndian32(p + 8);
+            entry.mtime_nanoseconds = bigEndian32(p + 12);
+            entry.dev = bigEndian32(p + 16);
+            entry.ino = bigEndian32(p + 20);
+            entry.mode = bigEndian32(p + 24);
+            entry.uid = bigEndian32(p + 28);
+            entry.gid = bigEndian32(p + 32);
+            entry.size = bigEndian32(p + 36);
+            memcpy(entry.id.bytes, p + 40, 20);
+            entry.flags = uint16_t(p[60] << 8 | p[61]);
+            entry.extended_flags = 0;
+            p += 62;
+
+            if (entry.flags & 0x4000) {
+                if (version < 3 || end - p < 2)
+                    return false;
+                entry.extended_flags = uint16_t(p[0] << 8 | p[1]);
+                p += 2;
+            }
+
+            if (version == 4) {
+                // Path compressed against the previous entry's
+                uint64_t strip;
+                if (!offsetNumber(p, end, strip) || strip > name.size())
+                    return false;
+                name.resize(name.size() - strip);
+            } else
+                name.clear();
+
+            const uint8_t *nul = (const uint8_t *)memchr(p, 0, end - p);
+            if (!nul)
+                return false;
+            name.append((const char *)p, nul - p);
+            p = nul + 1;
+
+            if (version != 4) {
+                // Entries are NUL padded to a multiple of eight bytes
+                p = start + ((nul - start + 8) & ~7);
+                if (p > end)
+                    return false;
+            }
+
+            // A sparse index's directory of entries not checked out
+            if ((entry.mode & 0170000) == 0040000)
+                return false;
+
+            names.push_back(name);
+            entries.push_back(entry);
+        }
+
+        // Extensions, those with entries elsewhere left to git: a split index's
+        // "link" to the shared index most are in and a sparse index's "sdir"
+        while (p < end) {
+            if (end - p < 8 || memcmp(p, "link", 4) == 0 || memcmp(p, "sdir", 4) == 0)
+                return false;
+            uint32_t extension_size = bigEndian32(p + 4);
+            if (extension_size > size_t(end - p - 8))
+                return false;
+            p += 8 + extension_size;
+        }
+
+        return true;
+    }
+};
+
+class Repository {
+public:
+    // Deeper than git makes chains even with --depth
+    static constexpr int MaximumDeltaDepth = 10000;
+
+    /**
+     * Find the repository containing an absolute path, following
+     * the .git file of linked worktrees and submodules.
+     */
+
+    bool open(const std::string &path)
+    {
+        std::string directory = path;
+
+        while (true) {
+            size_t slash = directory.rfind('/');
+            if (slash == std::string::npos)
+                return false;
+            directory.resize(slash);
+
+            std::string dot_git = directory + "/.git";
+            struct stat info;
+            if (stat(dot_git.c_str(), &info) != 0) {
+                if (directory.empty())
+                    return false;
+                continue;
+            }
+
+            work_tree = directory;
+            git_dir = dot_git;
+
+            std::string contents;
+            if (!S_ISDIR(info.st_mode)) {
+                if (!readFile(dot_git, contents) || contents.compare(0, 8, "gitdir: ") != 0)
+                    return false;
+                git_dir = relativeTo(directory, trimmed(contents.substr(8)));
+            }
+
+            common_dir = git_dir;
+            if (readFile(git_dir + "/commondir", contents))
+                common_dir = relativeTo(git_dir, trimmed(contents));
+
+            // SHA-256 repositories
+            return !readFile(common_dir + "/config", contents) || contents.find("sha256") == std::string::npos;
+        }
+    }
+
+    const std::string &workTree() const
+    {
+        return work_tree;
+    }
+
+    // The repository's directory, a linked work tree's own for one
+    const std::string &gitDir() const
+    {
+        return git_dir;
+    }
+
+    // That shared by linked work trees, holding objects and refs
+    const std::string &commonDir() const
+    {
+        return common_dir;
+    }
+
+    /**
+     * Whether git may convert line endings between the repository and work
+     * tree for every file, as configured by core.autocrlf. Conversions by
+     * attributes are for "git check-attr" to say. The configuration is read
+     * again only when one of its files has changed.
+     */
+
+    bool convertsLineEndings()
+    {
+        const char *home = getenv("HOME");
+        std::string user = home ? home : "";
+        // In increasing precedence
+        const std::string configs[] = {"/etc/gitconfig", user + "/.config/git/config", user + "/.gitconfig",
+                                       common_dir + "/config"};
+
+        std::string stamps;
+        for (const std::string &config : configs) {
+            struct stat info;
+            if (stat(config.c_str(), &info) == 0) {
+                timespec modified = modifiedTime(info);
+                stamps += std::to_string(modified.tv_sec) + "." + std::to_string(modified.tv_nsec) + " " +
+                          std::to_string(info.st_size);
+            }
+            stamps += "\n";
+        }
+        if (stamps == config_stamps)
+            return converts_line_endings;
+
+        bool converts = false;
+        std::string contents;
+        for (const std::string &config : configs)
+            if (readFile(config, contents))
+                configBoolean(contents, "core", "autocrlf", converts);
+
+        config_stamps = stamps;
+        converts_line_endings = converts;
+        return converts;
+    }
+
+    /**
+     * Set a value to the last setting of a key in a section of the contents of a
+     * git config file, if it has one, "input" counting as true as it does for
+     * core.autocrlf. Sections and keys are matched ignoring case, sections with
+     * a subsection as in [section "name"] not at all.
+     */
+
+    static void configBoolean(const std::string &contents, const char *section, const char *key, bool &value)
+    {
+        auto lowercase = [](std::string text) {
+            std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) {
+                return (char)tolower(c);
+            });
+            return text;
+        };
+
+        std::string current;
+        for (size_t start = 0, end; start < contents.size(); start = end + 1) {
+            end = contents.find('\n', start);
+            if (end == std::string::npos)
+                end = contents.size();
+            std::string line = contents.substr(start, end - start);
+            size_t i = line.find_first_not_of(" \t\r");
+            if (i == std::string::npos || line[i] == '#' || line[i] == ';')
+                continue;
+
+            // A setting may follow a section header on its line
+            if (line[i] == '[') {
+                size_t close = line.find(']', i);
+                if (close == std::string::npos)
+                    continue;
+                current = lowercase(trimmed(line.substr(i + 1, close - i - 1)));
+                if ((i = line.find_first_not_of(" \t\r", close + 1)) == std::string::npos ||
+                    line[i] == '#' || line[i] == ';')
+                    continue;
+            }
+            if (current != section)
+                continue;
+
+            size_t name_end = line.find_first_of(" \t\r=#;", i);
+            if (lowercase(line.substr(i, name_end - i)) != key)
+                continue;
+            size_t equals = name_end == std::string::npos ? name_end : line.find_first_not_of(" \t\r", name_end);
+            // A key alone is true
+            if (equals == std::string::npos || line[equals] != '=') {
+                value = true;
+                continue;
+            }
+
+            std::string setting;
+            bool quoted = false;
+            for (size_t c = equals + 1; c < line.size(); c++) {
+                if (line[c] == '"')
+                    quoted = !quoted;
+                else if (!quoted && (line[c] == '#' || line[c] == ';'))
+                    break;
+                else
+                    setting += line[c];
+            }
+            setting = lowercase(trimmed(setting));
+            setting.erase(0, setting.find_first_not_of(" \t"));
+            value = setting == "true" || setting == "yes" || setting == "on" || setting == "1" || setting == "input";
+        }
+    }
+
+    /**
+     * Read objects not found in the packs or loose objects another way, such
+     * as from alternates by running git.
+     */
+
+    void setMissingObjects(std::function<bool (const ObjectId &id, ObjectType &type, std::string &data)> reader)
+    {
+        missing_objects = std::move(reader);
+    }
+
+    /**
+     * Read an object from the packs or loose objects.
+     * @param type The type of the object, never a delta.
+     */
+
+    bool read(const ObjectId &id, ObjectType &type, std::string &data, int depth = 0)
+    {
+        if (!packs_loaded)
+            loadPacks();
+        if (readPacked(id, type, data, depth) || readLoose(id, type, data))
+            return true;
+
+        // Repacked since the packs were loaded
+        if (loadPacks() && readPacked(id, type, data, depth))
+            return true;
+        return missing_objects && missing_objects(id, type, data);
+    }
+
+    /**
+     * Resolve a ref such as "HEAD" or "refs/heads/main" to an object id.
+     */
+
+    bool resolve(std::string ref, ObjectId &id) const
+    {
+        for (int depth = 0; depth < 10; depth++) {
+            std::string contents;
+            if (!readFile((ref == "HEAD" ? git_dir : common_dir) + "/" + ref, contents))
+                return packedRef(ref, id);
+
+            contents = trimmed(contents);
+            if (contents.compare(0, 5, "ref: ") != 0)
+                return contents.size() >= 40 && ObjectId::fromHex(contents.data(), id);
+            ref = contents.substr(5);
+        }
+
+        return false;
+    }
+
+    /**
+     * Find a path relative to the work tree in the tree of the HEAD commit.
+     */
+
+    Lookup headEntry(const std::string &path, ObjectId &id)
+    {
+        ObjectType type;
+        std::string data;
+        if (!resolve("HEAD", id) || !read(id, type, data) || type != ObjectType::Commit ||
+            data.compare(0, 5, "tree ") != 0 || data.size() < 45 || !ObjectId::fromHex(data.data() + 5, id))
+            return Lookup::Failed;
+
+        for (size_t start = 0, slash; start <= path.size(); start = slash + 1) {
+            if (!read(id, type, data) || type != ObjectType::Tree)
+                return Lookup::Failed;
+
+            slash = std::min(path.find('/', start), path.size());
+            bool last = slash == path.size();
+            Lookup found = treeEntry(data, path.substr(start, slash - start), last, id);
+            if (found != Lookup::Found || last)
+                return found;
+        }
+
+        return Lookup::Missing;
+    }
+
+    /**
+     * Find the entry for a path relative to the work tree in the index.
+     */
+
+    Lookup indexEntry(const std::string &path, IndexEntry &entry)
+    {
+        Lookup read = index.refresh(git_dir + "/index");
+        return read == Lookup::Found ? index.find(path, entry) : read;
+    }
+
+    /**
+     * Whether a working file is the blob of its index entry going by its
+     * stat, without reading it.
+     */
+
+    bool upToDate(const IndexEntry &entry, const struct stat &info) const
+    {
+        return index.upToDate(entry, info);
+    }
+
+    /**
+     * Summarise what a diff of a file against the index or HEAD depends on:
+     * the file's stat, its index entry and the HEAD commit. While the state
+     * stays the same so does the diff.
+     * @return False if it can't be known, or the file was modified so recently
+     * that a further change might not show in its stat.
+     */
+
+    bool fileState(const std::string &path, bool head, std::string &state)
+    {
+        struct stat info;
+        if (stat((work_tree + "/" + path).c_str(), &info) != 0 || modifiedTime(info).tv_sec >= time(nullptr))
+            return false;
+
+        IndexEntry entry;
+        Lookup found = indexEntry(path, entry);
+        if (found == Lookup::Failed)
+            return false;
+
+        timespec mtime = modifiedTime(info), ctime = changedTime(info);
+        uint64_t fields[] = {uint64_t(info.st_dev), uint64_t(info.st_ino), uint64_t(info.st_size),
+                             uint64_t(mtime.tv_sec), uint64_t(mtime.tv_nsec), uint64_t(ctime.tv_sec), uint64_t(ctime.tv_nsec)};
+        state.assign((const char *)fields, sizeof fields);
+        state.append(found == Lookup::Found ? (const char *)entry.id.bytes : "", found == Lookup::Found ? 20 : 0);
+        state.append(1, head ? 'H' : 'I');
+
+        if (head) {
+            ObjectId commit;
+            if (!resolve("HEAD", commit))
+                return false;
+            state.append((const char *)commit.bytes, 20);
+        }
+
+        return true;
+    }
+
+    /**
+     * Find the blob of a file as staged or in HEAD.
+     */
+
+    Lookup blobId(const std::string &path, bool head, ObjectId &id)
+    {
+        IndexEntry entry;
+        Lookup found = head ? headEntry(path, id) : indexEntry(path, entry);
+        if (found == Lookup::Found && !head)
+            id = entry.id;
+        return found;
+    }
+
+    /**
+     * Read the text of a file as staged or in HEAD.
+     */
+
+    Lookup blob(const std::string &path, bool head, std::string &text)
+    {
+        ObjectId id;
+        Lookup found = blobId(path, head, id);
+        if (found != Lookup::Found)
+            return found;
+
+        ObjectType type;
+        return read(id, type, text) && type == ObjectType::Blob ? Lookup::Found : Lookup::Failed;
+    }
+
+private:
+    std::string work_tree, git_dir, common_dir;
+    Index index;
+    std::vector<std::unique_ptr<Pack>> packs;
+    bool packs_loaded = false;
+    std::function<bool (const ObjectId &, ObjectType &, std::string &)> missing_objects;
+    std::string config_stamps;          // Of the config files core.autocrlf was last read from
+    bool converts_line_endings = false;
+
+    static std::string trimmed(const std::string &text)
+    {
+        size_t end = text.find_last_not_of(" \t\r\n");
+        return end == std::string::npos ? std::string() : text.substr(0, end + 1);
+    }
+
+    static std::string relativeTo(const std::string &directory, const std::string &path)
+    {
+        return path.compare(0, 1, "/") == 0 ? path : directory + "/" + path;
+    }
+
+    // Returns whether packs were found that were not loaded before
+    bool loadPacks()
+    {
+        size_t before = packs.size();
+        packs.clear();
+        packs_loaded = true;
+
+        std::string directory = common_dir + "/objects/pack";
+        if (DIR *dir = opendir(directory.c_str())) {
+            while (struct dirent *file = readdir(dir)) {
+                size_t length = strlen(file->d_name);
+                if (length > 4 && strcmp(file->d_name + length - 4, ".idx") == 0) {
+                    std::unique_ptr<Pack> pack(new Pack);
+                    if (pack->open(directory + "/" + file->d_name))
+                        packs.push_back(std::move(pack));
+                }
+            }
+            closedir(dir);
+        }
+
+        return packs.size() != before;
+    }
+
+    bool readPacked(const ObjectId &id, ObjectType &type, std::string &data, int depth)
+    {
+        for (const std::unique_ptr<Pack> &pack : packs) {
+            uint64_t offset;
+            if (pack->find(id, offset))
+                return readPacked(*pack, offset, type, data, depth);
+        }
+        return false;
+    }
+
+    bool readPacked(const Pack &pack, uint64_t offset, ObjectType &type, std::string &data, int depth)
+    {
+        const uint8_t *p = pack.data().bytes + offset, *end = pack.data().bytes + pack.data().length;
+
+        uint8_t c = *p++;
+        type = ObjectType(c >> 4 & 7);
+        uint64_t size = c & 15;
+        for (int shift = 4; c & 0x80; shift += 7) {
+            if (p == end || shift > 57)
+                return false;
+            c = *p++;
+            size |= uint64_t(c & 0x7f) << shift;
+        }
+
+        // Not even the most compressible object inflates this much
+        if (size / 1032 > pack.data().length)
+            return false;
+
+        if (type != ObjectType::OffsetDelta && type != ObjectType::RefDelta)
+            return type >= ObjectType::Commit && type <= ObjectType::Tag && inflate(p, end - p, data, size);
+
+        std::string base;
+        if (depth >= MaximumDeltaDepth)
+            return false;
+
+        if (type == ObjectType::OffsetDelta) {
+            uint64_t distance;
+            if (!offsetNumber(p, end, distance) || distance == 0 || distance > offset ||
+                !readPacked(pack, offset - distance, type, base, depth + 1))
+                return false;
+        } else {
+            ObjectId base_id;
+            if (end - p < 20)
+                return false;
+            memcpy(base_id.bytes, p, 20);
+            p += 20;
+            if (!read(base_id, type, base, depth + 1))
+                return false;
+        }
+
+        std::string delta;
+        return inflate(p, end - p, delta, size) && applyDelta(base, delta, data);
+    }
+
+    bool readLoose(const ObjectId &id, ObjectType &type, std::string &data) const
+    {
+        std::string hex = id.hex(), compressed;
+        if (!readFile(common_dir + "/objects/" + hex.substr(0, 2) + "/" + hex.substr(2), compressed) ||
+            !inflate((const uint8_t *)compressed.data(), compressed.size(), data))
+            return false;
+
+        // "<type> <size>\0<data>"
+        size_t space = data.find(' '), nul = data.find('\0');
+        if (space == std::string::npos || nul == std::string::npos || space > nul ||
+            strtoull(data.c_str() + space + 1, nullptr, 10) != data.size() - nul - 1)
+            return false;
+
+        static const char *const types[] = {"commit", "tree", "blob", "tag"};
+        type = ObjectType::None;
+        for (int i = 0; i < 4; i++)
+            if (data.compare(0, space, types[i]) == 0)
+                type = ObjectType(i + 1);
+
+        data.erase(0, nul + 1);
+        return type != ObjectType::None;
+    }
+
+    static Lookup treeEntry(const std::string &tree, const std::string &name, bool file, ObjectId &id)
+    {
+        // "<octal mode> <name>\0<20 byte id>"
+        for (size_t p = 0; p < tree.size();) {
+            size_t space = tree.find(' ', p), nul = tree.find('\0', p);
+            if (space == std::string::npos || nul == std::string::npos || nul + 21 > tree.size())
+                return Lookup::Failed;
+
+            if (tree.compare(space + 1, nul - space - 1, name) == 0) {
+                bool directory = tree.compare(p, space - p, "40000") == 0;
+                // Submodules (160000) are not diffed
+                if (directory == file || tree.compare(p, space - p, "160000") == 0)
+                    return Lookup::Missing;
+                memcpy(id.bytes, tree.data() + nul + 1, 20);
+                return Lookup::Found;
+            }
+
+            p = nul + 21;
+        }
+
+        return Lookup::Missing;
+    }
+
+    bool packedRef(const std::string &ref, ObjectId &id) const
+    {
+        std::string contents;
+        if (!readFile(common_dir + "/packed-refs", contents))
+            return false;
+
+        // "<hex id> <ref>" lines amongst comments and "^<peeled id>" lines
+        for (size_t line = 0, eol; line < contents.size(); line = eol + 1) {
+            eol = std::min(contents.find('\n', line), contents.size());
+            size_t length = eol - line - (eol > line && contents[eol - 1] == '\r');
+            if (length == 41 + ref.size() && contents[line + 40] == ' ' && contents.compare(line + 41, ref.size(), ref) == 0)
+                return ObjectId::fromHex(contents.data() + line, id);
+        }
+
+        return false;
+    }
+};
+
+} // namespace git
+
+#endif /* GitRepository_hpp */
@@ -0,0 +1,419 @@
+//
+//  GitRepository.mm
+//  LNProvider
+//
+//  Copyright © 2017 John Holdsworth. All rights reserved.
+//
+
+#import "GitRepository.h"
+#import <CoreServices/CoreServices.h>
+
+#include "GitRepository.hpp"
+#include "BaseCache.hpp"
+#include "EditSession.hpp"
+#include "CoProcess.hpp"
+#include "Watcher.hpp"
+#include "DiffMatchPatchCore.hpp"
+
+#include <map>
+#include <mutex>
+#include <set>
+
+// repositories are kept open so packs stay mapped, and the index and its stat
+// cache are parsed once for each write of it whatever directories files are in
+struct LNOpenRepository {
+    std::mutex lock;
+    git::Repository repository;
+    bool opened = false;
+    // diffs of unsaved buffers by path
+    std::map<std::string, std::unique_ptr<git::EditSession>> sessions;
+};
+
+// one for each work tree, the directories of files found in it once
+static LNOpenRepository &LNRepositoryFor(const std::string &file) {
+    static std::mutex repositoriesLock;
+    static std::map<std::string, std::string> workTrees;
+    static std::map<std::string, std::unique_ptr<LNOpenRepository>> repositories;
+
+    std::string directory = file.substr(0, file.rfind('/')), workTree;
+    std::lock_guard<std::mutex> locked(repositoriesLock);
+    auto known = workTrees.find(directory);
+    if (known != workTrees.end())
+        workTree = known->second;
+    else {
+        // not remembered when there isn't one as it may yet be created,
+        // files outside a repository share an entry that fails to open
+        git::Repository found;
+        if (found.open(file))
+            workTrees[directory] = workTree = found.workTree();
+    }
+
+    std::unique_ptr<LNOpenRepository> &open = repositories[workTree];
+    if (!open)
+        open.reset(new LNOpenRepository());
+    return *open;
+}
+
+// texts diffed against, shared between repositories
+static git::BaseCache &LNBaseCache() {
+    static git::BaseCache cache;
+    return cache;
+}
+
+// git processes for what isn't read in process, by work tree
+static git::CoProcessPool &LNCoProcesses() {
+    static git::CoProcessPool pool;
+    return pool;
+}
+
+// opens the repository when first used, objects it can't find read by git
+static BOOL LNOpen(LNOpenRepository &open, const std::string &file) {
+    if (!open.opened && (open.opened = open.repository.open(file))) {
+        std::string workTree = open.repository.workTree();
+        open.repository.setMissingObjects([workTree](const git::ObjectId &id, git::ObjectType &type, std::string &data) {
+            return LNCoProcesses().forWorkTree(workTree)->catFile(id.hex(), type, data) == git::Lookup::Found;
+        });
+    }
+    return open.opened;
+}
+
+// how git would diff the texts, going by the file's attributes
+static git::DiffAs LNDiffAs(git::Repository &repository, const std::string &relative,
+                            const std::string &base, const std::string &working) {
+    return LNCoProcesses().forWorkTree(repository.workTree())->diffAs(relative, repository.convertsLineEndings(),
+                                                                      base, working);
+}
+
+NSData *gitWorkingFileState(NSString *path, BOOL head) {
+    std::string file = path.fileSystemRepresentation, state;
+    LNOpenRepository &open = LNRepositoryFor(file);
+    std::lock_guard<std::mutex> locked(open.lock);
+    git::Repository &repository = open.repository;
+    if (!LNOpen(open, file) || !repository.fileState(file.substr(repository.workTree().size() + 1), head, state))
+        return nil;
+    return [NSData dataWithBytes:state.data() length:state.size()];
+}
+
+// the base a file is diffed against, nullptr when it has no highlights
+static BOOL LNFindBase(git::Repository &repository, const std::string &relative, BOOL head,
+                       git::ObjectId &id, std::shared_ptr<git::Base> &base) {
+    base = nullptr;
+    git::IndexEntry entry;
+    git::Lookup staged = repository.indexEntry(relative, entry);
+    git::Lookup found = staged == git::Lookup::Failed ? staged : repository.blobId(relative, head, id);
+    if (found == git::Lookup::Failed)
+        return NO;
+
+    if (found == git::Lookup::Missing) {
+        // git diff HEAD shows a newly staged file as all added
+        if (head && staged == git::Lookup::Found) {
+            base = std::make_shared<git::Base>(std::string());
+            id = {};
+        }
+        return YES;
+    }
+
+    if ((base = LNBaseCache().find(id)))
+        return YES;
+
+    std::string text;
+    git::ObjectType type;
+    if (!repository.read(id, type, text) || type != git::ObjectType::Blob)
+        return NO;
+    base = LNBaseCache().insert(id, std::move(text));
+    return YES;
+}
+
+// lines of spans in unified diff form after a hunk line
+static void LNEmitLines(const std::vector<dmp::Span> &spans, const git::Base &base, const std::string &working,
+                        const std::vector<size_t> &offsets, UnifiedDiffLine &line,
+                        void (^block)(const UnifiedDiffLine *line)) {
+    block(&line);
+
+    auto emit = [&](UnifiedDiffLineType type, const std::string &text, size_t start, size_t end) {
+        line.type = type;
+        line.text = text.data() + start;
+        line.length = end - start;
+        if (line.length && line.text[line.length - 1] == '\n')
+            line.length--;
+        block(&line);
+    };
+
+    for (const dmp::Span &span : spans)
+        for (size_t i = span.offset; i < span.offset + span.length; i++)
+            if (span.op == dmp::Op::Insert)
+                emit(UnifiedDiffInsert, working, offsets[i], offsets[i + 1]);
+            else
+                emit(span.op == dmp::Op::Equal ? UnifiedDiffContext : UnifiedDiffDelete,
+                     base.text, base.offsets[i], base.offsets[i + 1]);
+}
+
+BOOL gitDiffWorkingFile(NSString *path, BOOL head, void (^block)(const UnifiedDiffLine *line)) {
+    std::string file = path.fileSystemRepresentation;
+    LNOpenRepository &open = LNRepositoryFor(file);
+    std::lock_guard<std::mutex> locked(open.lock);
+    git::Repository &repository = open.repository;
+    if (!LNOpen(open, file))
+        return NO;
+
+    // highlights from the saved file replace those from any buffer
+    open.sessions.erase(file);
+
+    std::string relative = file.substr(repository.workTree().size() + 1);
+    git::IndexEntry entry;
+    git::Lookup staged = repository.indexEntry(relative, entry);
+    if (staged == git::Lookup::Failed)
+        return NO;
+
+    // unchanged since staged going by the stat git cached, no need to read it
+    struct stat info;
+    if (staged == git::Lookup::Found && stat(file.c_str(), &info) == 0 && repository.upToDate(entry, info)) {
+        git::ObjectId committed;
+        if (!head || (repository.headEntry(relative, committed) == git::Lookup::Found && committed == entry.id))
+            return YES;
+    }
+
+    git::ObjectId id;
+    std::shared_ptr<git::Base> base;
+    if (!LNFindBase(repository, relative, head, id, base))
+        return NO;
+    if (!base)
+        return YES;
+
+    std::string working;
+    if (!git::readFile(file, working))
+        return NO;
+    switch (LNDiffAs(repository, relative, base->text, working)) {
+    case git::DiffAs::Git:
+        return NO;
+    case git::DiffAs::Binary:
+        // "Binary files differ", no lines
+        return YES;
+    case git::DiffAs::Text:
+        break;
+    }
+
+    std::lock_guard<std::mutex> diffing(base->lock);
+    std::vector<uint32_t> ids;
+    std::vector<size_t> offsets;
+    base->idsFor(working.data(), working.size(), ids, &offsets);
+
+    dmp::Arena arena;
+    dmp::Differ<uint32_t> differ(base->ids.data(), base->ids.size(), ids.data(), ids.size(), arena);
+    differ.diff();
+    base->done();
+
+    // The whole file as one hunk
+    UnifiedDiffLine line = {UnifiedDiffHunk, "", 0, 1, (NSInteger)base->ids.size(), 1, (NSInteger)ids.size()};
+    LNEmitLines(arena.spans, *base, working, offsets, line, block);
+    return YES;
+}
+
+BOOL gitDiffBuffer(NSString *path, BOOL head, NSData *buffer, GitBufferWindow *window,
+                   void (^block)(const UnifiedDiffLine *line)) {
+    *window = {NO, 0, 0, 0};
+    std::string file = path.fileSystemRepresentation;
+    LNOpenRepository &open = LNRepositoryFor(file);
+    std::lock_guard<std::mutex> locked(open.lock);
+    git::Repository &repository = open.repository;
+    if (!LNOpen(open, file))
+        return NO;
+
+    git::ObjectId id;
+    std::shared_ptr<git::Base> base;
+    std::string relative = file.substr(repository.workTree().size() + 1);
+    if (!LNFindBase(repository, relative, head, id, base))
+        return NO;
+    if (!base) {
+        open.sessions.erase(file);
+        return YES;
+    }
+
+    std::unique_ptr<git::EditSession> &session = open.sessions[file];
+    if (!session)
+        session.reset(new git::EditSession());
+
+    std::string text((const char *)buffer.bytes, buffer.length);
+    git::DiffAs diffAs = LNDiffAs(repository, relative, base->text, text);
+    if (diffAs != git::DiffAs::Text) {
+        // binary files have no lines
+        open.sessions.erase(file);
+        return diffAs == git::DiffAs::Binary;
+    }
+
+    std::lock_guard<std::mutex> diffing(base->lock);
+    dmp::Arena arena;
+    git::EditSession::Window edited = session->diff(id, base, std::move(text), arena);
+    const std::string &working = session->currentText();
+    const std::vector<size_t> &offsets = session->lineOffsets();
+
+    UnifiedDiffLine line = {UnifiedDiffHunk, "", 0, 1, (NSInteger)base->ids.size(), 1, (NSInteger)offsets.size() - 1};
+    if (edited.whole) {
+        LNEmitLines(session->allSpans(), *base, working, offsets, line, block);
+        return YES;
+    }
+
+    // Only the lines re-diffed, between the equal lines either side
+    std::vector<dmp::Span> spans;
+    if (edited.anchored_start)
+        spans.push_back({dmp::Op::Equal, edited.base_start - 1, 1});
+    spans.insert(spans.end(), session->windowSpans().begin(), session->windowSpans().end());
+    if (edited.anchored_end) {
+        uint32_t base_end = edited.base_start;
+        for (const dmp::Span &span : session->windowSpans())
+            base_end += span.op != dmp::Op::Insert ? span.length : 0;
+        spans.push_back({dmp::Op::Equal, base_end, 1});
+    }
+
+    line.oldStart = edited.base_start + !edited.anchored_start;
+    line.newStart = edited.start + !edited.anchored_start;
+    LNEmitLines(spans, *base, working, offsets, line, block);
+
+    // 1 based, including the end anchor which may hold a marker for lines deleted before it
+    *window = {YES, (NSInteger)edited.start + 1, (NSInteger)edited.old_end + 2, (NSInteger)edited.end + 2};
+    return YES;
+}
+
+GitBaseCacheStatistics gitBaseCacheStatistics(void) {
+    git::BaseCache::Statistics statistics = LNBaseCache().statistics();
+    return {statistics.hits, statistics.misses, statistics.evictions,
+            statistics.entries, statistics.bytes, statistics.capacity};
+}
+
+void gitBaseCacheSetCapacity(NSUInteger bytes) {
+    LNBaseCache().setCapacity(bytes);
+}
+
+// changes to directories watched reported by FSEvents, restarting its stream as more are
+class LNFSEventsBackend : public git::WatchBackend {
+public:
+    ~LNFSEventsBackend() {
+        {
+            std::lock_guard<std::mutex> locked(lock);
+            stopping = true;
+            stop();
+        }
+        // callbacks and restarts already queued finish before this goes
+        if (queue)
+            dispatch_sync(queue, ^{});
+    }
+
+    bool start(Changed changed) override {
+        this->changed = changed;
+        queue = dispatch_queue_create("GitWatcher", DISPATCH_QUEUE_SERIAL);
+        return true;
+    }
+
+    bool watch(const std::string &directory) override {
+        std::lock_guard<std::mutex> locked(lock);
+        if (!directories.insert(directory).second)
+            return true;
+        if (!stream)
+            return restart();
+
+        // directories are found from within the stream's own callback,
+        // so it's replaced on its queue once that has returned
+        if (!restarting) {
+            restarting = true;
+            dispatch_async(queue, ^{
+                bool restarted;
+                {
+                    std::lock_guard<std::mutex> locked(lock);
+                    restarting = false;
+                    restarted = stopping || restart();
+                }
+                if (!restarted)
+                    changed("");
+            });
+        }
+        return true;
+    }
+
+private:
+    Changed changed;
+    dispatch_queue_t queue;
+    FSEventStreamRef stream = NULL;
+    std::set<std::string> directories;
+    std::mutex lock;
+    bool restarting = false, stopping = false;
+
+    // the stream replacing another carries on from the last event it delivered
+    bool restart() {
+        FSEventStreamEventId since = stream ? FSEventStreamGetLatestEventId(stream) : FSEventsGetCurrentEventId();
+        stop();
+
+        NSMutableArray<NSString *> *paths = [NSMutableArray new];
+        for (const std::string &path : directories)
+            [paths addObject:[NSString stringWithUTF8String:path.c_str()]];
+        FSEventStreamContext context = {0, this, NULL, NULL, NULL};
+        stream = FSEventStreamCreate(NULL, &LNFSEventsBackend::callback, &context, (__bridge CFArrayRef)paths,
+                                     since, 0.05,
+                                     kFSEventStreamCreateFlagFileEvents | kFSEventStreamCreateFlagNoDefer);
+        if (!stream)
+            return false;
+        FSEventStreamSetDispatchQueue(stream, queue);
+        return FSEventStreamStart(stream);
+    }
+
+    void stop() {
+        if (!stream)
+            return;
+        FSEventStreamStop(stream);
+        FSEventStreamInvalidate(stream);
+        FSEventStreamRelease(stream);
+        stream = NULL;
+    }
+
+    static void callback(ConstFSEventStreamRef stream, void *info, size_t count, void *paths,
+                         const FSEventStreamEventFlags flags[], const FSEventStreamEventId ids[]) {
+        LNFSEventsBackend *backend = (LNFSEventsBackend *)info;
+        for (size_t i = 0; i < count; i++)
+            // marks the end of the events replayed since the stream was restarted
+            if (flags[i] & kFSEventStreamEventFlagHistoryDone)
+                continue;
+            // events dropped by the kernel or FSEvents could have been for anything
+            else if (flags[i] & (kFSEventStreamEventFlagKernelDropped | kFSEventStreamEventFlagUserDropped))
+                backend->changed("");
+            else
+                backend->changed(((const char **)paths)[i]);
+    }
+};
+
+// the block files changed are passed to
+static std::mutex watchLock;
+static void (^LNWatchChanged)(NSArray<NSString *> *files);
+
+static git::Watcher &LNWatcher() {
+    static git::Watcher watcher(std::unique_ptr<git::WatchBackend>(new LNFSEventsBackend()),
+                                [](const std::vector<std::string> &files) {
+        NSMutableArray<NSString *> *paths = [NSMutableArray new];
+        for (const std::string &file : files)
+            [paths addObject:[NSString stringWithUTF8String:file.c_str()]];
+        void (^changed)(NSArray<NSString *> *files);
+        {
+            std::lock_guard<std::mutex> locked(watchLock);
+            changed = LNWatchChanged;
+        }
+        if (changed)
+            changed(paths);
+    });
+    return watcher;
+}
+
+void gitWatchChanges(void (^changed)(NSArray<NSString *> *files)) {
+    std::lock_guard<std::mutex> locked(watchLock);
+    LNWatchChanged = changed;
+}
+
+BOOL gitWatchFile(NSString *path) {
+    std::string file = path.fileSystemRepresentation, gitDir, commonDir;
+    {
+        LNOpenRepository &open = LNRepositoryFor(file);
+        std::lock_guard<std::mutex> locked(open.lock);
+        if (!LNOpen(open, file))
+            return NO;
+        gitDir = open.repository.gitDir();
+        commonDir = open.repository.commonDir();
+    }
+    return LNWatcher().watch(file, gitDir, commonDir);
+}
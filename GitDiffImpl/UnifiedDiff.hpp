@@ -0,0 +1,185 @@
+//
+//  UnifiedDiff.hpp
+//  LNProvider
+//
+//  Copyright © 2017 John Holdsworth. All rights reserved.
+//
+//  Streaming parser for the unified diffs output by git diff.
+//  Lines are scanned in place and passed on as views into the
+//  caller's buffer so nothing is allocated per line. Hunk headers
+//  of all forms are recognised, "@@ -5 +5 @@" having an implied
+//  count of one, and hunk line counts are tracked so file headers
+//  ("--- a/file", "+++ b/file") are never taken for edits.
+//
+
+#ifndef UnifiedDiff_hpp
+#define UnifiedDiff_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace unidiff {
+
+enum class LineType : uint8_t {
+    Header,     // Anything outside a hunk: "diff --git", "index", "---", "+++"...
+    Hunk,       // "@@ -a,b +c,d @@"
+    Context,
+    Delete,
+    Insert,
+    NoNewline   // "\ No newline at end of file" for the line before
+};
+
+struct Line {
+    LineType type;
+    const char *text;   // After any one character prefix, without the newline
+    size_t length;
+
+    // Only set for Hunk lines
+    uint32_t old_start, old_count, new_start, new_count;
+};
+
+class Parser {
+public:
+
+    /**
+     * Parse the complete lines in a buffer calling back for each.
+     * The line passed is only valid for the duration of the call.
+     * @param final No more input will follow so parse any last line without a newline.
+     * @return Bytes consumed, the caller keeps the rest to prepend to the next buffer.
+     */
+
+    template <typename Callback>
+    size_t parse(const char *buffer, size_t length, bool final, Callback &&callback)
+    {
+        const char *next = buffer, *end = buffer + length;
+
+        while (next < end) {
+            const char *eol = (const char *)memchr(next, '\n', end - next);
+            if (!eol) {
+                if (!final)
+                    break;
+                eol = end;
+            }
+
+            Line line = {};
+            classify(next, eol, line);
+            callback(line);
+            next = eol < end ? eol + 1 : end;
+        }
+
+        return next - buffer;
+    }
+
+    /**
+     * Reset to the state before any input, for parsing another diff.
+     */
+
+    void reset()
+    {
+        old_remaining = new_remaining = 0;
+    }
+
+private:
+
+    // Lines still expected in the current hunk from each side
+    uint32_t old_remaining = 0, new_remaining = 0;
+
+    void classify(const char *start, const char *end, Line &line)
+    {
+        line.text = start + 1;
+        line.length = end > start ? end - start - 1 : 0;
+
+        char prefix = start < end ? *start : '\0';
+        if (prefix == '\\') {
+            line.type = LineType::NoNewline;
+            return;
+        }
+
+        if (old_remaining || new_remaining) {
+            switch (prefix) {
+            case ' ':
+            case '\0': // Context lines may have had their trailing space stripped
+                line.type = LineType::Context;
+                if (old_remaining)
+                    old_remaining--;
+                if (new_remaining)
+                    new_remaining--;
+                return;
+            case '-':
+                if (old_remaining) {
+                    line.type = LineType::Delete;
+                    old_remaining--;
+                    return;
+                }
+                break;
+            case '+':
+                if (new_remaining) {
+                    line.type = LineType::Insert;
+                    new_remaining--;
+                    return;
+                }
+                break;
+            }
+
+            // Hunk shorter than its header claimed
+            reset();
+        }
+
+        if (prefix == '@' && parseHunk(start, end, line)) {
+            old_remaining = line.old_count;
+            new_remaining = line.new_count;
+            line.type = LineType::Hunk;
+            return;
+        }
+
+        line.type = LineType::Header;
+        line.text = start;
+        line.length = end - start;
+    }
+
+    // "@@ -a[,b] +c[,d] @@[ section heading]"
+    static bool parseHunk(const char *p, const char *end, Line &line)
+    {
+        if (end - p < 4 || memcmp(p, "@@ -", 4) != 0)
+            return false;
+        p += 4;
+
+        if (!parseRange(p, end, line.old_start, line.old_count) || p == end || *p++ != ' ' ||
+            p == end || *p++ != '+' ||
+            !parseRange(p, end, line.new_start, line.new_count) ||
+            end - p < 3 || memcmp(p, " @@", 3) != 0)
+            return false;
+
+        // The section heading git adds, if any
+        p += 3;
+        line.text = p < end && *p == ' ' ? p + 1 : p;
+        line.length = end - line.text;
+        return true;
+    }
+
+    static bool parseRange(const char *&p, const char *end, uint32_t &start, uint32_t &count)
+    {
+        if (!parseNumber(p, end, start))
+            return false;
+        count = 1;
+        if (p < end && *p == ',') {
+            p++;
+            return parseNumber(p, end, count);
+        }
+        return true;
+    }
+
+    static bool parseNumber(const char *&p, const char *end, uint32_t &value)
+    {
+        const char *digits = p;
+        value = 0;
+        while (p < end && *p >= '0' && *p <= '9')
+            value = value * 10 + (*p++ - '0');
+        return p != digits;
+    }
+};
+
+} // namespace unidiff
+
+#endif /* UnifiedDiff_hpp */
@@ -0,0 +1,34 @@
+//
+//  UnifiedDiffParser.h
+//  LNProvider
+//
+//  Copyright © 2017 John Holdsworth. All rights reserved.
+//
+//  Swift facing shim onto the streaming parser in UnifiedDiff.hpp.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(uint8_t, UnifiedDiffLineType) {
+    UnifiedDiffHeader,
+    UnifiedDiffHunk,
+    UnifiedDiffContext,
+    UnifiedDiffDelete,
+    UnifiedDiffInsert,
+    UnifiedDiffNoNewline
+};
+
+typedef struct {
+    UnifiedDiffLineType type;
+    const char *_Nonnull text; // UTF-8 after any prefix, not NUL terminated
+    NSInteger length;
+    NSInteger oldStart, oldCount, newStart, newCount; // Hunk lines only
+} UnifiedDiffLine;
+
+/**
+ * Read a unified diff from a file descriptor until end of file calling
+ * the block for each line. The line and its text are only valid for the
+ * duration of the call.
+ */
+
+void unifiedDiffParseFileDescriptor(int fd, void (^_Nonnull NS_NOESCAPE block)(const UnifiedDiffLine *_Nonnull line));
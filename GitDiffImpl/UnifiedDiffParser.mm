@@ -0,0 +1,44 @@
+//
+//  UnifiedDiffParser.mm
+//  LNProvider
+//
+//  Copyright © 2017 John Holdsworth. All rights reserved.
+//
+
+#import "UnifiedDiffParser.h"
+
+#include "UnifiedDiff.hpp"
+
+#include <unistd.h>
+#include <vector>
+
+void unifiedDiffParseFileDescriptor(int fd, void (^block)(const UnifiedDiffLine *line)) {
+    std::vector<char> buffer(256 * 1024);
+    unidiff::Parser parser;
+    size_t filled = 0;
+
+    auto callback = [&](const unidiff::Line &line) {
+        UnifiedDiffLine out = {(UnifiedDiffLineType)line.type, line.text, (NSInteger)line.length,
+                               line.old_start, line.old_count, line.new_start, line.new_count};
+        block(&out);
+    };
+
+    while (true) {
+        if (filled == buffer.size())
+            // A line longer than the buffer
+            buffer.resize(buffer.size() * 2);
+
+        ssize_t bytesRead = read(fd, buffer.data() + filled, buffer.size() - filled);
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+        if (bytesRead <= 0) {
+            parser.parse(buffer.data(), filled, true, callback);
+            break;
+        }
+
+        filled += bytesRead;
+        size_t consumed = parser.parse(buffer.data(), filled, false, callback);
+        memmove(buffer.data(), buffer.data() + consumed, filled - consumed);
+        filled -= consumed;
+    }
+}
@@ -0,0 +1,333 @@
+//
+//  Watcher.hpp
+//  LNProvider
+//
+//  Copyright © 2017 John Holdsworth. All rights reserved.
+//
+//  Finds which files' diffs may have changed from changes on disk rather
+//  than by diffing them again every so often. A backend reports paths that
+//  changed in the directories of the files watched and of their repository:
+//  a file's own changes affect only it, while its repository's index, HEAD
+//  or branches changing affects every file watched in that repository.
+//  Changes are collected until they stop for a moment, as when a branch is
+//  checked out, so each file affected is reported once. Backends are FSEvents
+//  on macOS, in GitRepository.mm, and inotify on Linux below for testing.
+//
+
+#ifndef Watcher_hpp
+#define Watcher_hpp
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace git {
+
+// Reports changes in directories from a thread of its own
+class WatchBackend {
+public:
+    /**
+     * A path changed: a file or directory in a directory watched, the directory
+     * itself when what changed in it isn't known, or "" when changes were lost.
+     */
+    typedef std::function<void (const std::string &path)> Changed;
+
+    virtual ~WatchBackend() {}
+
+    virtual bool start(Changed changed) = 0;
+
+    // Report changes to a directory's entries, not necessarily recursively
+    virtual bool watch(const std::string &directory) = 0;
+};
+
+class Watcher {
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void (const std::vector<std::string> &files)> Changed;
+
+    /**
+     * @param quiet How long changes must stop for before files are reported.
+     * @param longest The longest files are held for while changes continue.
+     */
+
+    Watcher(std::unique_ptr<WatchBackend> backend, Changed changed,
+            Clock::duration quiet = std::chrono::milliseconds(250),
+            Clock::duration longest = std::chrono::seconds(2))
+        : backend(std::move(backend)), changed(std::move(changed)), quiet(quiet), longest(longest)
+    {
+        started = this->backend->start([this](const std::string &path) {
+            pathChanged(path);
+        });
+        reporter = std::thread([this] {
+            report();
+        });
+    }
+
+    Watcher(const Watcher &) = delete;
+    Watcher &operator=(const Watcher &) = delete;
+
+    ~Watcher()
+    {
+        {
+            std::lock_guard<std::mutex> locked(lock);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        reporter.join();
+        // Stopped before the state it reports into goes
+        backend.reset();
+    }
+
+    /**
+     * Report a file when it, or the index, HEAD or branches of the repository
+     * it's in, changes. Files stay watched for the life of the watcher.
+     * @param git_dir The repository's directory, a work tree's own if it's one.
+     * @param common_dir That of the repository shared by its work trees.
+     */
+
+    bool watch(const std::string &file, const std::string &git_dir, const std::string &common_dir)
+    {
+        std::lock_guard<std::mutex> locked(lock);
+        if (!started)
+            return false;
+        if (!files.emplace(file, git_dir).second)
+            return true;
+
+        Repository &repository = repositories[git_dir];
+        repository.common_dir = common_dir;
+        repository.files.insert(file);
+        if (repository.files.size() == 1) {
+            watchDirectory(git_dir);
+            watchDirectory(common_dir);
+            watchTree(common_dir + "/refs/heads");
+        }
+        return watchDirectory(file.substr(0, file.rfind('/')));
+    }
+
+    bool watching(const std::string &file)
+    {
+        std::lock_guard<std::mutex> locked(lock);
+        return files.count(file) != 0;
+    }
+
+private:
+    struct Repository {
+        std::string common_dir;
+        std::set<std::string> files;
+    };
+
+    std::unique_ptr<WatchBackend> backend;
+    Changed changed;
+    Clock::duration quiet, longest;
+    bool started = false;
+
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::thread reporter;
+    bool stopping = false;
+
+    std::map<std::string, std::string> files;       // Watched, to their repository's directory
+    std::map<std::string, Repository> repositories; // By directory
+    std::set<std::string> directories;              // Given to the backend
+
+    std::set<std::string> pending;                  // Files to report
+    Clock::time_point first, last;                  // Changes since those were last reported
+
+    bool watchDirectory(const std::string &directory)
+    {
+        return directories.count(directory) || (backend->watch(directory) && directories.insert(directory).second);
+    }
+
+    // Branches can be in directories of their own, "feature/name"
+    void watchTree(const std::string &directory)
+    {
+        if (!watchDirectory(directory))
+            return;
+        if (DIR *dir = opendir(directory.c_str())) {
+            while (struct dirent *entry = readdir(dir)) {
+                std::string name = entry->d_name, path = directory + "/" + name;
+                struct stat info;
+                if (name != "." && name != ".." && stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode))
+                    watchTree(path);
+            }
+            closedir(dir);
+        }
+    }
+
+    // Whether a path changing changes what files in a repository are diffed against
+    static bool affectsRepository(const std::string &path, const std::string &git_dir, const std::string &common_dir)
+    {
+        return path == git_dir + "/index" || path == git_dir + "/HEAD" || path == common_dir + "/packed-refs" ||
+               path.compare(0, common_dir.size() + 6, common_dir + "/refs/") == 0;
+    }
+
+    // Files in or under a directory, all of them for ""
+    bool addUnder(const std::string &directory)
+    {
+        std::string prefix = directory.empty() ? "" : directory + "/";
+        bool found = false;
+        for (auto file = files.lower_bound(prefix);
+             file != files.end() && file->first.compare(0, prefix.size(), prefix) == 0; ++file, found = true)
+            pending.insert(file->first);
+        return found;
+    }
+
+    void pathChanged(const std::string &path)
+    {
+        std::lock_guard<std::mutex> locked(lock);
+        bool was_pending = !pending.empty();
+        bool affects = files.count(path) != 0;
+        if (affects)
+            pending.insert(path);
+        else
+            affects = addUnder(path);
+
+        for (auto &repository : repositories)
+            if (affectsRepository(path, repository.first, repository.second.common_dir)) {
+                pending.insert(repository.second.files.begin(), repository.second.files.end());
+                affects = true;
+                // A branch in a new directory
+                struct stat info;
+                if (path.find("/refs/heads/") != std::string::npos && stat(path.c_str(), &info) == 0 &&
+                    S_ISDIR(info.st_mode))
+                    watchTree(path);
+            }
+
+        // Changes to the same files still put off reporting them
+        if (!affects)
+            return;
+        last = Clock::now();
+        if (!was_pending)
+            first = last;
+        wakeup.notify_one();
+    }
+
+    void report()
+    {
+        std::unique_lock<std::mutex> locked(lock);
+        while (!stopping) {
+            if (pending.empty()) {
+                wakeup.wait(locked);
+                continue;
+            }
+
+            Clock::time_point due = std::min(last + quiet, first + longest);
+            if (Clock::now() < due) {
+                wakeup.wait_until(locked, due);
+                continue;
+            }
+
+            std::vector<std::string> report(pending.begin(), pending.end());
+            pending.clear();
+            locked.unlock();
+            changed(report);
+            locked.lock();
+        }
+    }
+};
+
+#ifdef __linux__
+
+class InotifyBackend : public WatchBackend {
+public:
+    InotifyBackend() {}
+    InotifyBackend(const InotifyBackend &) = delete;
+    InotifyBackend &operator=(const InotifyBackend &) = delete;
+
+    ~InotifyBackend()
+    {
+        if (reader.joinable()) {
+            char stop = 0;
+            (void)!write(wake[1], &stop, 1);
+            reader.join();
+        }
+        for (int fd : {notify, wake[0], wake[1]})
+            if (fd >= 0)
+                close(fd);
+    }
+
+    bool start(Changed changed) override
+    {
+        this->changed = std::move(changed);
+        if ((notify = inotify_init1(IN_CLOEXEC | IN_NONBLOCK)) < 0 || pipe(wake) != 0)
+            return false;
+        reader = std::thread([this] {
+            read();
+        });
+        return true;
+    }
+
+    bool watch(const std::string &directory) override
+    {
+        // Git replaces files by renaming, editors may write them in place
+        int wd = inotify_add_watch(notify, directory.c_str(),
+                                   IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ATTRIB);
+        if (wd < 0)
+            return false;
+        std::lock_guard<std::mutex> locked(lock);
+        directories[wd] = directory;
+        return true;
+    }
+
+private:
+    Changed changed;
+    int notify = -1, wake[2] = {-1, -1};
+    std::thread reader;
+    std::mutex lock;
+    std::map<int, std::string> directories;     // By watch descriptor
+
+    void read()
+    {
+        alignas(struct inotify_event) char buffer[64 * 1024];
+        struct pollfd fds[] = {{notify, POLLIN, 0}, {wake[0], POLLIN, 0}};
+        while (poll(fds, 2, -1) >= 0 || errno == EINTR) {
+            if (fds[1].revents)
+                return;
+            ssize_t length = ::read(notify, buffer, sizeof buffer);
+            for (ssize_t offset = 0; offset < length;) {
+                const struct inotify_event *event = (const struct inotify_event *)(buffer + offset);
+                offset += sizeof *event + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    changed("");
+                    continue;
+                }
+
+                std::string path;
+                {
+                    std::lock_guard<std::mutex> locked(lock);
+                    auto directory = directories.find(event->wd);
+                    if (directory == directories.end())
+                        continue;
+                    path = directory->second;
+                }
+                if (event->len && event->name[0])
+                    path += "/" + std::string(event->name);
+                changed(path);
+            }
+        }
+    }
+};
+
+#endif
+
+} // namespace git
+
+#endif /* Watcher_hpp */
@@ -7,3 +7,4 @@
 
 #import "DiffMatchPatch.h"
 #import "DMDiff.h"
+#import "UnifiedDiffParser.h"
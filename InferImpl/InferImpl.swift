@@ -19,12 +19,19 @@ class InferDefaults: DefaultManager {
 
 open class InferImpl: LNExtensionBase, LNExtensionService {
 
+    let deltas = HighlightDeltas()
+
     open var defaults: DefaultManager {
         return InferDefaults()
     }
 
+    open override func forgetHighlights(forFile filepath: String) {
+        deltas.forget(file: filepath)
+    }
+
     open override func getConfig(_ callback: @escaping LNConfigCallback) {
         callback([
+            LNExtraColorKey: defaults.extraColor.stringRepresentation,
             LNApplyTitleKey: "Infer Types",
             LNApplyPromptKey: "Make type explicit",
             LNApplyConfirmKey: "Modify",
@@ -44,16 +51,18 @@ open class InferImpl: LNExtensionBase, LNExtensionService {
             return
         }
 
-        DispatchQueue.global().async {
-            let generator = TaskGenerator(launchPath: script, arguments: [filepath],
-                                          directory: url.deletingLastPathComponent().path)
-
-            for _ in 0 ..< 2 {
-                _ = generator.next()
+        requests.request(forFile: filepath, callback: callback) {
+            request in
+            DispatchQueue.global().async {
+                let generator = TaskGenerator(launchPath: script, arguments: [filepath],
+                                              directory: url.deletingLastPathComponent().path)
+                request.running(generator.task)
+
+                let highlights = diffgen.generateHighlights(generator: generator, defaults: self.defaults)
+                request.finish {
+                    self.encoded(self.deltas.delta(highlights, forFile: filepath))
+                }
             }
-
-            let highlights = diffgen.generateHighlights(sequence: generator.lineSequence, defaults: self.defaults)
-            callback(highlights.jsonData(), nil)
         }
     }
 
@@ -6,3 +6,4 @@
 
 #import "DiffMatchPatch.h"
 #import "DMDiff.h"
+#import "UnifiedDiffParser.h"
@@ -60,10 +60,156 @@ class LNProviderTests: XCTestCase {
         XCTAssertTrue(highlights[1] === highlights[2], "alias")
     }
 
+    // Highlights with elements shared between lines, some with inserted text
+    func referenceHighlights() -> LNFileHighlights {
+        let reference = LNFileHighlights(), other = LNHighlightElement()
+        reference.spliceStart = 5
+        reference.spliceOldEnd = 9
+        reference.spliceEnd = 12
+        other.color = NSColor(string: "1 0 0 1")
+        other.text = ""
+        other.range = ""
+        for i in stride(from: 1, to: 10_000, by: 10) {
+            let element = LNHighlightElement()
+            element.start = i
+            element.color = NSColor(string: ".1 .3 .3 .4")
+            element.text = "line \(i)\n\u{0}é\n"
+            element.range = "\(i) \(i + 1)"
+            element.inserted = i % 20 == 1 ? "line \(i + 1)\n" : nil
+            for j in 0 ..< 5 {
+                reference[i + j] = element
+            }
+            reference[i + 7] = other
+        }
+        return reference
+    }
+
+    func testBinaryRoundTrip() {
+        let reference = referenceHighlights()
+        let binary = reference.binaryData(), json = reference.jsonData()
+        let highlights = LNFileHighlights(data: binary, service: "none")!
+        XCTAssertEqual(highlights.spliceEnd, 12)
+        for line in 0 ..< 10_010 {
+            XCTAssertTrue(highlights[line] == reference[line], "line \(line)")
+        }
+        XCTAssertTrue(highlights[1] === highlights[4] && highlights[8] === highlights[18], "interned")
+        XCTAssertEqual(highlights[1]?.inserted, "line 2\n")
+        XCTAssertNil(highlights[11]?.inserted)
+        XCTAssertLessThan(binary.count, json.count / 2)
+
+        // Truncated data is rejected rather than read past
+        let truncated = LNFileHighlights(data: binary.subdata(in: 0 ..< binary.count / 2), service: "none")!
+        XCTAssertNil(truncated[1])
+    }
+
+    func testJSONDecodePerformance() {
+        let json = referenceHighlights().jsonData()
+        measure {
+            for _ in 0 ..< 100 {
+                _ = LNFileHighlights(data: json, service: "none")
+            }
+        }
+    }
+
+    func testBinaryDecodePerformance() {
+        let binary = referenceHighlights().binaryData()
+        measure {
+            for _ in 0 ..< 100 {
+                _ = LNFileHighlights(data: binary, service: "none")
+            }
+        }
+    }
+
+    func testHighlightDeltas() {
+        func hunk(_ start: Int, _ color: String) -> LNHighlightElement {
+            let element = LNHighlightElement()
+            element.start = start
+            element.color = NSColor(string: color)
+            element.text = "hunk \(start)\n"
+            element.range = "\(start) 3"
+            return element
+        }
+        let before = LNFileHighlights(), after = LNFileHighlights()
+        for start in stride(from: 10, to: 10_000, by: 100) {
+            // A line inserted at 5000 moves the hunks after it down and modifies one
+            let moved = start > 5000 ? start + 1 : start
+            let element = hunk(start, "0 1 0 1"), other = hunk(moved, start == 5010 ? "1 0 0 1" : "0 1 0 1")
+            for line in start ..< start + 3 {
+                before[line] = element
+                after[line + moved - start] = other
+            }
+        }
+
+        let deltas = HighlightDeltas()
+        let full = deltas.delta(before, forFile: "f")
+        XCTAssertEqual(full.baseVersion, 0)
+        let delta = deltas.delta(after, forFile: "f")
+        XCTAssertEqual(delta.baseVersion, full.version)
+        XCTAssertEqual([delta.spliceStart, delta.spliceOldEnd, delta.spliceEnd], [5010, 5110, 5111])
+
+        for data in [delta.jsonData(), delta.binaryData()] {
+            let received = LNFileHighlights(data: data, service: "none")!
+            XCTAssertEqual(received.version, delta.version)
+            XCTAssertEqual(received.baseVersion, full.version)
+            let spliced = before.highlightsSplicing(received)
+            for line in 0 ..< 10_010 {
+                XCTAssertTrue(spliced[line] == after[line], "line \(line)")
+            }
+        }
+
+        // Nothing changed and the window is empty
+        let same = deltas.delta(after, forFile: "f")
+        XCTAssertEqual(same.baseVersion, delta.version)
+        XCTAssertEqual(same.spliceOldEnd, same.spliceEnd)
+        XCTAssertNil(same[same.spliceStart])
+
+        // Splices apply to what was sent unless forgotten
+        XCTAssertNotNil(deltas.splice(same, forFile: "f"))
+        deltas.forget(file: "f")
+        XCTAssertNil(deltas.splice(same, forFile: "f"))
+        XCTAssertEqual(deltas.delta(after, forFile: "f").baseVersion, 0)
+    }
+
+    func testHighlightRanges() {
+        // An added block with a modified line and one cleared
+        let highlights = LNFileHighlights(), added = LNHighlightElement(), modified = LNHighlightElement()
+        for line in 1 ... 2000 {
+            highlights[line] = added
+        }
+        highlights[1000] = modified
+        highlights[1500] = nil
+        XCTAssertTrue(highlights[999] === added && highlights[1000] === modified && highlights[1001] === added)
+        XCTAssertNil(highlights[1500])
+        XCTAssertNil(highlights[2001])
+
+        var ranges = [NSRange]()
+        highlights.foreachHighlightRange(in: NSMakeRange(990, 20)) {
+            (range, _) in
+            ranges.append(range)
+        }
+        XCTAssertEqual(ranges, [NSMakeRange(1, 999), NSMakeRange(1000, 1), NSMakeRange(1001, 499)])
+    }
+
+    func testMarkerRows() {
+        // 10,000 lines on 100 rows, each range marking 2 rows or more
+        let highlights = LNFileHighlights(), element = LNHighlightElement()
+        for line in 1 ... 10 {
+            highlights[line] = element
+        }
+        highlights[5000] = element
+        let markers = highlights.markerRows(100, scale: 0.01)
+        XCTAssertEqual([UInt8](markers).indices.filter { markers[$0] != 0 }, [0, 1, 49, 50])
+        XCTAssertTrue(highlights.markerRows(100, scale: 0.01) == markers)
+
+        highlights[9950] = element
+        XCTAssertEqual([UInt8](highlights.markerRows(100, scale: 0.01))[99], 1)
+        XCTAssertEqual(highlights.markerRows(50, scale: 0.005).count, 50)
+    }
+
     func testDiff() {
         let path = Bundle(for: type(of: self)).path(forResource: "example_diff", ofType: "txt")
-        let sequence = FileGenerator(path: path!)!.lineSequence
-        let highlights = DiffProcessor().generateHighlights(sequence: sequence, defaults: DefaultManager())
+        let generator = FileGenerator(path: path!)!
+        let highlights = DiffProcessor().generateHighlights(generator: generator, defaults: DefaultManager())
         print(String(data: highlights.jsonData(), encoding: .utf8)!)
         highlights.foreachHighlightRange {
             (range, element) in
@@ -71,6 +217,81 @@ class LNProviderTests: XCTestCase {
         }
     }
 
+    func testLineReader() {
+        let long = String(repeating: "x", count: 600_000)
+        let path = NSTemporaryDirectory() + "LNProviderTests.lines"
+        try! "one\n\nthree\n\(long)\nlast".write(toFile: path, atomically: false, encoding: .utf8)
+        XCTAssertEqual(Array(FileGenerator(path: path)!.lineSequence), ["one", "", "three", long, "last"])
+
+        let generator = FileGenerator(path: path)!
+        XCTAssertEqual(generator.nextLine()?.count, 3)
+        XCTAssertEqual(generator.nextLine()?.count, 0)
+        XCTAssertEqual(generator.next(), "three")
+    }
+
+    func testLineReaderPerformance() {
+        // 100MB of piped output in lines typical of a diff
+        let command = "yes '+        let value = compute(index, options: defaults)' | head -c 100000000"
+        var start = Date(), lines = 0, bytes = 0
+
+        let borrowed = TaskGenerator(command: command)
+        while let line = borrowed.nextLine() {
+            lines += 1
+            bytes += line.count
+        }
+        let viewed = Date().timeIntervalSince(start)
+        // Separators between the lines, the last being cut short
+        XCTAssertEqual(bytes + lines - 1, 100_000_000)
+
+        start = Date()
+        XCTAssertEqual(TaskGenerator(command: command).lineSequence.reduce(0) { count, _ in count + 1 }, lines)
+        let copied = Date().timeIntervalSince(start)
+
+        print("Line reader: \(lines) lines, borrowed \(viewed)s, as Strings \(copied)s")
+    }
+
+    func testDiffCore() {
+        let diffs = diff_diffsBetweenTexts("Apples are a fruit.", "Bananas are also fruit.") as! [DMDiff]
+        XCTAssertEqual(diffs.map { $0.operation }, [DIFF_DELETE, DIFF_INSERT, DIFF_EQUAL, DIFF_INSERT, DIFF_EQUAL])
+        XCTAssertEqual(diffs.map { $0.text! }, ["Apple", "Banana", "s are a", "lso", " fruit."])
+    }
+
+    func testDiffCorePerformance() {
+        let alphabet = Array("abcdefgh \n".utf16)
+        let chars1 = (0 ..< 20_000).map { _ in alphabet[Int(arc4random_uniform(UInt32(alphabet.count)))] }
+        var chars2 = chars1
+        for _ in 0 ..< 200 {
+            chars2[Int(arc4random_uniform(UInt32(chars2.count)))] = "x".utf16.first!
+        }
+        let text1 = String(utf16CodeUnits: chars1, count: chars1.count)
+        let changed = String(utf16CodeUnits: chars2, count: chars2.count)
+        measure {
+            _ = diff_diffsBetweenTextsWithOptions(text1, changed, true, 0.0)
+        }
+    }
+
+    func testLineModeManyLines() {
+        // More distinct lines than could be munged into UniChars
+        let lines = (0 ..< 70_000).map { "line \($0)\n" }
+        var changed = lines
+        changed[0] = "first line changed\n"
+        changed[69_999] = "last line changed\n"
+        let text1 = lines.joined(), text2 = changed.joined()
+        let diffs = diff_diffsBetweenTextsWithOptions(text1, text2, false, 0.0)!
+        XCTAssertEqual(diff_text1(diffs), text1)
+        XCTAssertEqual(diff_text2(diffs), text2)
+        XCTAssertLessThan(diffs.count, 10)
+    }
+
+    func testMatchLongPattern() {
+        // Longer than the 32 bits Bitap used to be limited to
+        let text = (0 ..< 100).map { "word\($0) " }.joined()
+        var pattern = Array(text.utf16[text.utf16.index(text.utf16.startIndex, offsetBy: 300) ..< text.utf16.index(text.utf16.startIndex, offsetBy: 400)])
+        pattern[50] = "#".utf16.first!
+        let fuzzy = String(utf16CodeUnits: pattern, count: pattern.count)
+        XCTAssertEqual(match_locationOfMatchInTextWithOptions(text, fuzzy, 290, 0.5, 1000), 300)
+    }
+
     func testFormat() {
         FormatImpl(connection: nil)?.requestHighlights(forFile: #file, callback: {
             json, _ in
@@ -88,6 +309,93 @@ class LNProviderTests: XCTestCase {
         print("\(String(describing: element.attributedText()))")
     }
 
+    func testAttributedRoundTrip() {
+        let string = NSMutableAttributedString(string: "let value = compute(1)\nlet other = 2\n")
+        string.addAttributes([NSAttributedStringKey.font: NSFont(name: "Menlo", size: 11)!], range: NSMakeRange(0, 10))
+        string.addAttributes([NSAttributedStringKey.foregroundColor: NSColor(string: "0.5 0 0 1")], range: NSMakeRange(4, 5))
+        string.addAttributes([NSAttributedStringKey.foregroundColor: NSColor(string: "0.5 0 0 1")], range: NSMakeRange(27, 5))
+        string.addAttributes([NSAttributedStringKey.backgroundColor: NSColor(string: "1 1 0 1")], range: NSMakeRange(30, 4))
+
+        let element = LNHighlightElement()
+        element.color = NSColor(string: "1 0 0 1")
+        element.setAttributedText(string)
+        XCTAssertEqual(element.text, string.string)
+
+        let highlights = LNFileHighlights()
+        highlights[1] = element
+        let decoded = LNFileHighlights(data: highlights.jsonData(), service: "none")![1]!.attributedText()!
+        XCTAssertEqual(decoded.string, string.string)
+
+        string.enumerateAttributes(in: NSMakeRange(0, string.length), options: []) {
+            (attributes, range, _) in
+            var effective = NSRange()
+            let other = decoded.attributes(at: range.location, longestEffectiveRange: &effective, in: range)
+            XCTAssertEqual(effective.length, range.length, "run \(range)")
+            XCTAssertEqual(other[.font] as? NSFont, attributes[.font] as? NSFont)
+            XCTAssertEqual((other[.foregroundColor] as? NSColor)?.stringRepresentation,
+                           (attributes[.foregroundColor] as? NSColor)?.stringRepresentation)
+            XCTAssertEqual((other[.backgroundColor] as? NSColor)?.stringRepresentation,
+                           (attributes[.backgroundColor] as? NSColor)?.stringRepresentation)
+        }
+    }
+
+    // A hunk coloured by an intra-line diff, archived as setAttributedText: used to archive it
+    func attributedHunk() -> (string: NSAttributedString, archived: Data) {
+        let string = NSMutableAttributedString(string: (0 ..< 20).map { "    let value\($0) = compute(\($0))\n" }.joined())
+        for location in stride(from: 4, to: string.length - 8, by: 37) {
+            string.addAttributes([NSAttributedStringKey.foregroundColor: NSColor(string: "0.5 0 0 1")],
+                                 range: NSMakeRange(location, 8))
+        }
+
+        let data = NSMutableData()
+        let archiver = NSKeyedArchiver(forWritingWith: data)
+        archiver.outputFormat = .xml
+        archiver.encode(string, forKey: NSKeyedArchiveRootObjectKey)
+        archiver.finishEncoding()
+        return (string, data as Data)
+    }
+
+    func testAttributedPerformance() {
+        let hunk = attributedHunk()
+        let element = LNHighlightElement()
+        element.setAttributedText(hunk.string)
+        let compact = [element.text, element.styles, element.runs].map { $0?.utf8.count ?? 0 }.reduce(0, +)
+        XCTAssertLessThan(compact, hunk.archived.count / 4)
+
+        measure {
+            for _ in 0 ..< 1000 {
+                _ = element.attributedText()
+            }
+        }
+    }
+
+    // What testAttributedPerformance is to be compared with
+    func testUnarchivedPerformance() {
+        let archived = attributedHunk().archived
+        measure {
+            for _ in 0 ..< 1000 {
+                _ = NSKeyedUnarchiver.unarchiveObject(with: archived)
+            }
+        }
+    }
+
+    func testLazyDiff() {
+        let element = LNHighlightElement()
+        element.text = "let a = 1\n"
+        element.inserted = "let b = 1\n"
+        var diffs = 0
+        let differ = { (text: String, inserted: String) -> NSAttributedString in
+            diffs += 1
+            return NSAttributedString(string: text)
+        }
+        XCTAssertEqual(element.attributedTextDiffing(differ)?.string, "let a = 1\n")
+        _ = element.attributedTextDiffing(differ)
+        XCTAssertEqual(diffs, 1, "memoised")
+        element.inserted = "let c = 1\n"
+        _ = element.attributedTextDiffing(differ)
+        XCTAssertEqual(diffs, 2, "rediffed")
+    }
+
     func testPerformanceExample() {
         // This is an example of a performance test case.
         measure {
@@ -0,0 +1,2487 @@
+//
+//  PortableTests.cpp
+//  LNProviderTests
+//
+//  Created by John Holdsworth on 17/10/2026.
+//  Copyright © 2026 John Holdsworth. All rights reserved.
+//
+//  Tests for the portable C++ parts of the project. These have no
+//  dependency on Foundation so can be run on Linux as well as macOS:
+//
+//  c++ -std=c++17 -O2 -pthread -o /tmp/PortableTests LNProviderTests/PortableTests.cpp -lz && /tmp/PortableTests
+//
+//  Pass "bench" as an argument to also run the benchmarks.
+//
+
+#include "../GitDiffImpl/DiffMatchPatch/DiffMatchPatchCore.hpp"
+#include "../GitDiffImpl/DiffMatchPatch/DiffMatchPatchLines.hpp"
+#include "../GitDiffImpl/DiffMatchPatch/DiffMatchPatchMatch.hpp"
+#include "../GitDiffImpl/DiffMatchPatch/DiffMatchPatchUTF8.hpp"
+#include "../GitDiffImpl/BaseCache.hpp"
+#include "../GitDiffImpl/CoProcess.hpp"
+#include "../GitDiffImpl/EditSession.hpp"
+#include "../GitDiffImpl/GitRepository.hpp"
+#include "../GitDiffImpl/UnifiedDiff.hpp"
+#include "../GitDiffImpl/Watcher.hpp"
+#include "../LNXcodeSupport/HighlightOverlay.hpp"
+#include "../LNXcodeSupport/LineIndex.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <regex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static int failures, checks;
+
+#define CHECK(cond) check(cond, #cond, __FILE__, __LINE__)
+#define CHECK_EQUAL(a, b) checkEqual(a, b, #a, __FILE__, __LINE__)
+
+static void check(bool ok, const char *what, const char *file, int line) {
+    checks++;
+    if (!ok) {
+        failures++;
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+    }
+}
+
+static void checkEqual(const std::string &got, const std::string &expected,
+                       const char *what, const char *file, int line) {
+    checks++;
+    if (got != expected) {
+        failures++;
+        fprintf(stderr, "%s:%d: %s\n  got:      %s\n  expected: %s\n",
+                file, line, what, got.c_str(), expected.c_str());
+    }
+}
+
+template <typename Block>
+static double timeBlock(int iterations, Block block) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        block();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+// MARK: DiffMatchPatchCore
+
+static const char *const opPrefix = "?-+=";
+
+template <typename Char>
+static std::string render(const dmp::Differ<Char> &differ, const std::vector<dmp::Span> &spans,
+                          char separator = ' ') {
+    std::string out;
+    for (const dmp::Span &span : spans) {
+        if (!out.empty())
+            out += separator;
+        out += opPrefix[int(span.op)];
+        out.append(differ.textFor(span), differ.textFor(span) + span.length);
+    }
+    return out;
+}
+
+static std::string diff(const std::string &text1, const std::string &text2,
+                        dmp::Deadline deadline = dmp::NoDeadline) {
+    dmp::Arena arena;
+    dmp::Differ<char> differ(text1.data(), text1.size(), text2.data(), text2.size(), arena, deadline);
+    return render(differ, differ.diff());
+}
+
+static std::string bisect(const std::string &text1, const std::string &text2,
+                          dmp::Deadline deadline = dmp::NoDeadline) {
+    dmp::Arena arena;
+    dmp::Differ<char> differ(text1.data(), text1.size(), text2.data(), text2.size(), arena, deadline);
+    return render(differ, differ.bisect());
+}
+
+// Runs a cleanup pass over a diff written as "-a +b =c ..."
+template <typename Pass>
+static std::string cleanup(const std::string &diffs, Pass pass, char separator = ' ') {
+    std::string text1, text2;
+    std::vector<dmp::Span> spans;
+    for (size_t pos = 0; pos < diffs.size();) {
+        size_t end = diffs.find(separator, pos);
+        if (end == std::string::npos)
+            end = diffs.size();
+        std::string text = diffs.substr(pos + 1, end - pos - 1);
+        dmp::Op op = dmp::Op(strchr(opPrefix, diffs[pos]) - opPrefix);
+        std::string &into = op == dmp::Op::Insert ? text2 : text1;
+        spans.push_back({op, uint32_t(into.size()), uint32_t(text.size())});
+        into += text;
+        if (op == dmp::Op::Equal)
+            text2 += text;
+        pos = end + 1;
+    }
+
+    dmp::Arena arena;
+    dmp::Differ<char> differ(text1.data(), text1.size(), text2.data(), text2.size(), arena);
+    arena.spans = spans;
+    pass(differ);
+    return render(differ, arena.spans, separator);
+}
+
+static std::string merge(const std::string &diffs) {
+    return cleanup(diffs, [](dmp::Differ<char> &differ) { differ.cleanupMerge(); });
+}
+
+static void testDiffCore() {
+    CHECK_EQUAL(diff("", ""), "");
+    CHECK_EQUAL(diff("abc", "abc"), "=abc");
+    CHECK_EQUAL(diff("abc", "ab123c"), "=ab +123 =c");
+    CHECK_EQUAL(diff("a123bc", "abc"), "=a -123 =bc");
+    CHECK_EQUAL(diff("abc", "a123b456c"), "=a +123 =b +456 =c");
+    CHECK_EQUAL(diff("a", "b"), "-a +b");
+    CHECK_EQUAL(diff("Apples are a fruit.", "Bananas are also fruit."),
+                "-Apple +Banana =s are a +lso = fruit.");
+    CHECK_EQUAL(diff("1ayb2", "abxab"), "-1 =a -y =b -2 +xab");
+    CHECK_EQUAL(diff("abcy", "xaxcxabc"), "+xaxcx =abc -y");
+
+    CHECK_EQUAL(bisect("cat", "map"), "-c +m =a -t +p");
+    CHECK_EQUAL(bisect("cat", "map", dmp::Clock::now() - std::chrono::seconds(1)), "-cat +map");
+
+    CHECK_EQUAL(merge(""), "");
+    CHECK_EQUAL(merge("=a -b +c"), "=a -b +c");
+    CHECK_EQUAL(merge("=a =b =c"), "=abc");
+    CHECK_EQUAL(merge("-a -b -c"), "-abc");
+    CHECK_EQUAL(merge("-a +b -c +d =e =f"), "-ac +bd =ef");
+    CHECK_EQUAL(merge("-a +abc -dc"), "=a -d +b =c");
+    CHECK_EQUAL(merge("=a +ba =c"), "+ab =ac");
+    CHECK_EQUAL(merge("=c +ab =a"), "=ca +ba");
+    CHECK_EQUAL(merge("=a -b =c -ac =x"), "-abc =acx");
+    CHECK_EQUAL(merge("=x -ca =c -b =a"), "=xca -cba");
+
+    // Random edits must always reconstruct both texts
+    std::mt19937 rng(1234);
+    dmp::Arena arena;
+    for (int i = 0; i < 1000; i++) {
+        std::string text1, text2;
+        for (int j = rng() % 40; j > 0; j--)
+            text1 += "abcd\n"[rng() % 5];
+        text2 = text1;
+        for (int j = rng() % 8; j > 0; j--) {
+            size_t at = text2.empty() ? 0 : rng() % text2.size();
+            if (rng() % 2 && !text2.empty())
+                text2.erase(at, 1 + rng() % 3);
+            else
+                text2.insert(at, std::string(1 + rng() % 3, "abxy"[rng() % 4]));
+        }
+        dmp::Deadline deadline = i % 2 ? dmp::Clock::now() + std::chrono::hours(1) : dmp::NoDeadline;
+        dmp::Differ<char> differ(text1.data(), text1.size(), text2.data(), text2.size(), arena, deadline);
+        std::string from, to;
+        for (const dmp::Span &span : differ.diff()) {
+            std::string text(differ.textFor(span), span.length);
+            if (span.op != dmp::Op::Insert)
+                from += text;
+            if (span.op != dmp::Op::Delete)
+                to += text;
+        }
+        CHECK(from == text1 && to == text2);
+    }
+}
+
+static void benchDiffCore() {
+    std::mt19937 rng(42);
+    std::u16string text1, text2;
+    for (int i = 0; i < 20000; i++)
+        text1 += u"abcdefgh \n"[rng() % 10];
+    text2 = text1;
+    for (int i = 0; i < 200; i++)
+        text2[rng() % text2.size()] = u'x';
+
+    dmp::Arena arena;
+    double seconds = timeBlock(20, [&] {
+        dmp::Differ<char16_t> differ(text1.data(), text1.size(), text2.data(), text2.size(), arena);
+        differ.diff();
+    });
+    printf("DiffMatchPatchCore: %zu chars, 200 edits: %.2fms/diff\n", text1.size(), seconds * 1000.);
+}
+
+// MARK: DiffMatchPatchSIMD
+
+struct AffixKernel {
+    const char *name;
+    dmp::simd::AffixKernel prefix, suffix;
+};
+
+static std::vector<AffixKernel> affixKernels() {
+    std::vector<AffixKernel> kernels = {
+        {"scalar", dmp::simd::commonPrefixScalar, dmp::simd::commonSuffixScalar},
+    };
+#if DMP_SIMD_X86
+    kernels.push_back({"sse2", dmp::simd::commonPrefixSSE2, dmp::simd::commonSuffixSSE2});
+    if (__builtin_cpu_supports("avx2"))
+        kernels.push_back({"avx2", dmp::simd::commonPrefixAVX2, dmp::simd::commonSuffixAVX2});
+#elif DMP_SIMD_NEON
+    kernels.push_back({"neon", dmp::simd::commonPrefixNEON, dmp::simd::commonSuffixNEON});
+#endif
+    return kernels;
+}
+
+static void testAffixKernels() {
+    std::mt19937 rng(99);
+    std::vector<uint8_t> text1(300), text2;
+    for (uint8_t &byte : text1)
+        byte = rng();
+
+    for (const AffixKernel &kernel : affixKernels())
+        for (size_t length = 0; length < 100; length++)
+            for (size_t at = 0; at <= length; at++) {
+                // Unaligned starts, a single difference at "at" (or none)
+                size_t offset = length % 7;
+                text2 = text1;
+                if (at < length)
+                    text2[offset + at] ^= 1 + rng() % 255;
+                CHECK(kernel.prefix(&text1[offset], &text2[offset], length) == at);
+                size_t fromEnd = at < length ? length - 1 - at : length;
+                CHECK(kernel.suffix(&text1[offset + length], &text2[offset + length], length) == fromEnd);
+            }
+
+    // Character level functions only match whole characters
+    std::u16string chars1 = u"common prefix\u0101 and suffix", chars2 = u"common prefix\u0102 and suffix";
+    CHECK(dmp::commonPrefix(chars1.data(), chars2.data(), chars1.size()) == 13);
+    CHECK(dmp::commonSuffix(chars1.data() + chars1.size(), chars2.data() + chars2.size(), chars1.size()) == 11);
+
+    std::string none = "", abc = "abc", abcd = "abcd", xyz = "xyz";
+    CHECK(dmp::commonOverlap(none.data(), 0, abc.data(), 3) == 0);
+    CHECK(dmp::commonOverlap(abc.data(), 3, abcd.data(), 4) == 3);
+    CHECK(dmp::commonOverlap("123456xxx", 9, "xxxabcd", 7) == 3);
+    CHECK(dmp::commonOverlap(abc.data(), 3, xyz.data(), 3) == 0);
+    std::u16string fi = u"fi", ligature = u"\ufb01i";
+    CHECK(dmp::commonOverlap(fi.data(), 2, ligature.data(), 2) == 0);
+}
+
+static void benchAffixKernels() {
+    // Long, mostly identical lines differing near the end.
+    std::string line1(4000, ' '), line2;
+    for (size_t i = 0; i < line1.size(); i++)
+        line1[i] = "abcdefghijklmnopqrstuvwxyz ;{}()"[i * 7 % 32];
+    line2 = line1;
+    line2[line2.size() - 10] = '!';
+    std::u16string chars1(line1.begin(), line1.end()), chars2(line2.begin(), line2.end());
+
+    const int iterations = 20000;
+    volatile size_t sink = 0;
+    double baseline = timeBlock(iterations, [&] {
+        size_t i = 0;
+        while (i < chars1.size() && chars1[i] == chars2[i])
+            i++;
+        sink = sink + i;
+    });
+    printf("commonPrefix: %zu UTF-16 chars, per character loop: %.2fus\n", chars1.size(), baseline * 1e6);
+
+    for (const AffixKernel &kernel : affixKernels()) {
+        double prefix = timeBlock(iterations, [&] {
+            sink = sink + kernel.prefix((const uint8_t *)chars1.data(), (const uint8_t *)chars2.data(), chars1.size() * 2);
+        });
+        double suffix = timeBlock(iterations, [&] {
+            sink = sink + kernel.suffix((const uint8_t *)(chars1.data() + 20), (const uint8_t *)(chars2.data() + 20), 40);
+        });
+        printf("  %-6s prefix %.2fus (%.1fx), short suffix %.3fus\n", kernel.name,
+               prefix * 1e6, baseline / prefix, suffix * 1e6);
+    }
+    printf("  selected kernel: %s\n", dmp::simd::kernels().name);
+}
+
+// MARK: Histogram diff
+
+// Lines as ids as the line table interns them.
+static std::vector<uint32_t> lineIds(const std::vector<std::string> &lines,
+                                     std::vector<std::string> &lineArray) {
+    std::vector<uint32_t> ids;
+    for (const std::string &line : lines) {
+        auto found = std::find(lineArray.begin(), lineArray.end(), line);
+        ids.push_back(uint32_t(found - lineArray.begin()));
+        if (found == lineArray.end())
+            lineArray.push_back(line);
+    }
+    return ids;
+}
+
+struct LineDiffStats {
+    size_t spans, edited;
+    bool reconstructs;
+};
+
+template <typename Char>
+static LineDiffStats lineDiffStats(const dmp::Differ<Char> &differ, const std::vector<dmp::Span> &spans,
+                                   const std::vector<Char> &text1, const std::vector<Char> &text2) {
+    LineDiffStats stats = {spans.size(), 0, true};
+    std::vector<Char> from, to;
+    for (const dmp::Span &span : spans) {
+        const Char *text = differ.textFor(span);
+        if (span.op != dmp::Op::Insert)
+            from.insert(from.end(), text, text + span.length);
+        if (span.op != dmp::Op::Delete)
+            to.insert(to.end(), text, text + span.length);
+        if (span.op != dmp::Op::Equal)
+            stats.edited += span.length;
+    }
+    stats.reconstructs = from == text1 && to == text2;
+    return stats;
+}
+
+static void testHistogramDiff() {
+    std::string text1 = "abcdefgh", text2 = "abxdefhg";
+    dmp::Arena arena;
+    dmp::Differ<char> differ(text1.data(), text1.size(), text2.data(), text2.size(), arena);
+    CHECK_EQUAL(render(differ, differ.histogram()), "=ab -c +x =def -g =h +g");
+
+    // Unique lines anchor the diff rather than common ones such as "}"
+    std::vector<std::string> lineArray;
+    std::vector<uint32_t> before = lineIds({"a() {", "}", "b() {", "}", "c() {", "}"}, lineArray);
+    std::vector<uint32_t> after = lineIds({"a() {", "}", "c() {", "}", "b() {", "}"}, lineArray);
+    dmp::Differ<uint32_t> lines(before.data(), before.size(), after.data(), after.size(), arena);
+    LineDiffStats stats = lineDiffStats(lines, lines.histogram(), before, after);
+    CHECK(stats.reconstructs && stats.edited == 4);
+
+    std::mt19937 rng(5678);
+    for (int i = 0; i < 1000; i++) {
+        std::vector<uint16_t> text1, text2;
+        for (int j = rng() % 60; j > 0; j--)
+            text1.push_back(rng() % (i % 3 ? 20 : 200));
+        text2 = text1;
+        for (int j = rng() % 6; j > 0; j--) {
+            size_t at = text2.empty() ? 0 : rng() % text2.size();
+            if (rng() % 2 && !text2.empty())
+                text2.erase(text2.begin() + at, text2.begin() + std::min(text2.size(), at + 1 + rng() % 5));
+            else
+                text2.insert(text2.begin() + at, 1 + rng() % 5, uint16_t(rng() % 300));
+        }
+        dmp::Differ<uint16_t> differ(text1.data(), text1.size(), text2.data(), text2.size(), arena);
+        CHECK(lineDiffStats(differ, differ.histogram(), text1, text2).reconstructs);
+    }
+}
+
+// Synthetic "refactor": functions reordered, renamed, some rewritten.
+static void refactorCorpus(std::mt19937 &rng, size_t functions,
+                           std::vector<std::string> &before, std::vector<std::string> &after) {
+    std::vector<std::vector<std::string>> bodies;
+    for (size_t f = 0; f < functions; f++) {
+        std::vector<std::string> body = {"func f" + std::to_string(f) + "() {"};
+        for (int l = 3 + rng() % 20; l > 0; l--)
+            body.push_back(rng() % 4 ? "    let v" + std::to_string(rng() % 50) + " = g(" + std::to_string(rng() % 1000) + ")" :
+                           rng() % 2 ? "    }" : "");
+        body.push_back("}");
+        body.push_back("");
+        bodies.push_back(body);
+    }
+    for (auto &body : bodies)
+        before.insert(before.end(), body.begin(), body.end());
+
+    for (size_t f = 0; f < bodies.size(); f++) {
+        switch (rng() % 8) {
+        case 0: // move
+            std::swap(bodies[f], bodies[rng() % bodies.size()]);
+            break;
+        case 1: // rewrite
+            for (auto &line : bodies[f])
+                if (rng() % 2)
+                    line = "    rewritten(" + std::to_string(rng()) + ")";
+            break;
+        case 2: // rename
+            bodies[f][0] = "func renamed" + std::to_string(f) + "() {";
+            break;
+        }
+    }
+    for (auto &body : bodies)
+        after.insert(after.end(), body.begin(), body.end());
+}
+
+static void benchHistogramDiff() {
+    std::mt19937 rng(2024);
+    for (size_t functions : {100, 1000, 5000}) {
+        std::vector<std::string> before, after, lineArray;
+        refactorCorpus(rng, functions, before, after);
+        std::vector<uint32_t> text1 = lineIds(before, lineArray), text2 = lineIds(after, lineArray);
+
+        dmp::Arena arena;
+        LineDiffStats bisectStats, histogramStats;
+        double bisect = timeBlock(1, [&] {
+            // Diff_Timeout's default of one second
+            dmp::Differ<uint32_t> differ(text1.data(), text1.size(), text2.data(), text2.size(), arena,
+                                         dmp::Clock::now() + std::chrono::seconds(1));
+            bisectStats = lineDiffStats(differ, differ.diff(), text1, text2);
+        });
+        double histogram = timeBlock(1, [&] {
+            dmp::Differ<uint32_t> differ(text1.data(), text1.size(), text2.data(), text2.size(), arena);
+            histogramStats = lineDiffStats(differ, differ.histogram(), text1, text2);
+        });
+        CHECK(bisectStats.reconstructs && histogramStats.reconstructs);
+        printf("Line diff: %zu -> %zu lines, bisect %.1fms %zu spans %zu lines edited, "
+               "histogram %.1fms %zu spans %zu lines edited\n", text1.size(), text2.size(),
+               bisect * 1000., bisectStats.spans, bisectStats.edited,
+               histogram * 1000., histogramStats.spans, histogramStats.edited);
+    }
+}
+
+// MARK: Parallel bisection
+
+// Large text with scattered edits, as a regenerated JSON fixture might be.
+static void scatteredEdits(std::mt19937 &rng, size_t length, size_t edits,
+                           std::u16string &text1, std::u16string &text2) {
+    text1.clear();
+    for (size_t i = 0; i < length; i++)
+        text1 += u"{}[]:,\"abcdefgh0123456789 \n"[rng() % 28];
+    text2 = text1;
+    for (size_t i = 0; i < edits; i++) {
+        size_t at = rng() % text2.size();
+        if (rng() % 2)
+            text2.erase(at, 1 + rng() % 8);
+        else
+            text2.insert(at, 1 + rng() % 8, u"xyz"[rng() % 3]);
+    }
+}
+
+static void testParallelDiff() {
+    std::mt19937 rng(777);
+    dmp::WorkStealingPool pool(4), single(0);
+    dmp::Arena serialArena, parallelArena;
+
+    for (int i = 0; i < 6; i++) {
+        std::u16string text1, text2;
+        scatteredEdits(rng, 20000 + rng() % 60000, 50 + rng() % 500, text1, text2);
+        dmp::Differ<char16_t> serial(text1.data(), text1.size(), text2.data(), text2.size(), serialArena);
+        dmp::Differ<char16_t> parallel(text1.data(), text1.size(), text2.data(), text2.size(), parallelArena,
+                                       dmp::NoDeadline, i % 3 ? &pool : &single);
+        const std::vector<dmp::Span> &expected = serial.diff(), &got = parallel.diff();
+        CHECK(expected.size() == got.size() &&
+              std::equal(expected.begin(), expected.end(), got.begin(), [](const dmp::Span &a, const dmp::Span &b) {
+                  return a.op == b.op && a.offset == b.offset && a.length == b.length;
+              }));
+    }
+
+    // An expired deadline is still honoured by forked halves
+    std::u16string text1, text2;
+    scatteredEdits(rng, 50000, 1000, text1, text2);
+    dmp::Differ<char16_t> late(text1.data(), text1.size(), text2.data(), text2.size(), parallelArena,
+                               dmp::Clock::now() - std::chrono::seconds(1), &pool);
+    CHECK(timeBlock(1, [&] { late.bisect(); }) < 0.1 && parallelArena.spans.size() == 2);
+}
+
+static void benchParallelDiff() {
+    std::mt19937 rng(888);
+    std::u16string text1, text2;
+    scatteredEdits(rng, 400000, 4000, text1, text2);
+
+    dmp::Arena arena;
+    dmp::WorkStealingPool &pool = dmp::WorkStealingPool::shared();
+    double serial = timeBlock(1, [&] {
+        dmp::Differ<char16_t> differ(text1.data(), text1.size(), text2.data(), text2.size(), arena);
+        differ.bisect();
+    });
+    double parallel = timeBlock(1, [&] {
+        dmp::Differ<char16_t> differ(text1.data(), text1.size(), text2.data(), text2.size(), arena,
+                                     dmp::NoDeadline, &pool);
+        differ.bisect();
+    });
+    printf("Bisect: %zu chars, 4000 edits: serial %.0fms, parallel (%zu workers) %.0fms (%.1fx)\n",
+           text1.size(), serial * 1000., pool.workerCount(), parallel * 1000., serial / parallel);
+}
+
+// MARK: Interned line table
+
+static std::u16string numberedLines(size_t count, const char16_t *prefix) {
+    std::u16string text;
+    for (size_t i = 0; i < count; i++) {
+        std::string number = std::to_string(i);
+        text += prefix;
+        text.append(number.begin(), number.end());
+        text += u'\n';
+    }
+    return text;
+}
+
+static void testLineTable() {
+    dmp::LineTable<char16_t> table;
+    std::u16string text = u"a\nb\na\n\nb";
+    std::vector<uint32_t> ids;
+    std::vector<size_t> offsets;
+    table.linesToIds(text.data(), text.size(), ids, &offsets);
+    CHECK(ids == std::vector<uint32_t>({1, 2, 1, 3, 4}));
+    CHECK(offsets == std::vector<size_t>({0, 2, 4, 6, 7, 8}));
+    CHECK(table.size() == 5 && table.line(4).length == 1);
+
+    // More distinct lines than a UniChar can number
+    std::u16string many = numberedLines(70000, u"line "), more = many + u"extra\n";
+    std::vector<uint32_t> ids1, ids2;
+    table.linesToIds(many.data(), many.size(), ids1);
+    table.linesToIds(more.data(), more.size(), ids2);
+    CHECK(ids1.size() == 70000 && ids2.size() == 70001 && ids2.back() == table.size() - 1);
+    CHECK(std::equal(ids1.begin(), ids1.end(), ids2.begin()) && table.size() == 70000 + 5 + 1);
+
+    // A persistent table owns its lines and reuses the ids of a repeated text
+    dmp::LineTable<char16_t> persistent(true);
+    std::vector<uint32_t> first, second;
+    {
+        std::u16string base = numberedLines(1000, u"base ");
+        persistent.linesToIds(base.data(), base.size(), first);
+        std::u16string edited = base + u"edit\n";
+        persistent.linesToIds(edited.data(), edited.size(), second);
+        base = numberedLines(1000, u"base ");
+        persistent.linesToIds(base.data(), base.size(), second);
+    }
+    CHECK(first == second && persistent.size() == 1002);
+    std::u16string line = u"base 999\n";
+    CHECK(persistent.intern(line.data(), line.size()) == 1000);
+
+    // Truncated back to a text's lines, interning another gives the same ids as before
+    dmp::LineTable<char16_t> reused;
+    std::u16string base = numberedLines(3000, u"base "), other = numberedLines(5000, u"other ") + base;
+    reused.linesToIds(base.data(), base.size(), first);
+    size_t size = reused.size();
+    reused.linesToIds(other.data(), other.size(), second);
+    reused.truncate(size);
+    CHECK(reused.size() == size);
+    std::vector<uint32_t> again;
+    reused.linesToIds(other.data(), other.size(), again);
+    CHECK(again == second);
+    reused.linesToIds(base.data(), base.size(), again);
+    CHECK(again == first && reused.size() == size + 5000);
+}
+
+static void benchLineTable() {
+    std::mt19937 rng(31);
+    std::u16string text;
+    for (int i = 0; i < 200000; i++) {
+        std::string line = "    let value" + std::to_string(rng() % 50000) + " = compute(" + std::to_string(i % 977) + ")\n";
+        text.append(line.begin(), line.end());
+    }
+
+    std::vector<uint32_t> ids;
+    double dictionary = timeBlock(3, [&] {
+        // As the CFDictionary of substrings line mode used to munge lines with
+        std::unordered_map<std::u16string, uint32_t> lineHash;
+        ids.clear();
+        for (size_t start = 0; start < text.size();) {
+            size_t end = std::min(text.find(u'\n', start) + 1, text.size());
+            auto inserted = lineHash.emplace(text.substr(start, end - start), uint32_t(lineHash.size() + 1));
+            ids.push_back(inserted.first->second);
+            start = end;
+        }
+    });
+    double interned = timeBlock(3, [&] {
+        dmp::LineTable<char16_t> table;
+        table.linesToIds(text.data(), text.size(), ids);
+    });
+    dmp::LineTable<char16_t> persistent(true);
+    persistent.linesToIds(text.data(), text.size(), ids);
+    double reused = timeBlock(3, [&] {
+        persistent.linesToIds(text.data(), text.size(), ids);
+    });
+    printf("Line table: %zu lines, dictionary of substrings %.1fms, interned %.1fms, "
+           "persistent base %.1fms\n", ids.size(), dictionary * 1000., interned * 1000., reused * 1000.);
+}
+
+// MARK: Cleanup passes
+
+// The cleanup passes as DiffMatchPatch.m, inserting into and erasing
+// from the middle of an array of strings.
+typedef std::vector<std::pair<dmp::Op, std::string>> StringDiffs;
+
+static bool hasPrefix(const std::string &text, const std::string &prefix) {
+    return !prefix.empty() && text.compare(0, prefix.size(), prefix) == 0;
+}
+
+static bool hasSuffix(const std::string &text, const std::string &suffix) {
+    return !suffix.empty() && text.size() >= suffix.size() &&
+        text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static void arrayCleanupMerge(StringDiffs &diffs) {
+    if (diffs.empty())
+        return;
+    diffs.push_back({dmp::Op::Equal, ""});
+    size_t index = 0, count_delete = 0, count_insert = 0;
+    std::string text_delete, text_insert;
+    while (index < diffs.size()) {
+        switch (diffs[index].first) {
+            case dmp::Op::Insert:
+                count_insert++;
+                text_insert += diffs[index++].second;
+                break;
+            case dmp::Op::Delete:
+                count_delete++;
+                text_delete += diffs[index++].second;
+                break;
+            case dmp::Op::Equal:
+                if (count_delete + count_insert > 1) {
+                    if (count_delete != 0 && count_insert != 0) {
+                        size_t common = dmp::commonPrefix(text_insert.data(), text_delete.data(),
+                                                          std::min(text_insert.size(), text_delete.size()));
+                        if (common != 0) {
+                            size_t before = index - count_delete - count_insert;
+                            if (before > 0 && diffs[before - 1].first == dmp::Op::Equal)
+                                diffs[before - 1].second += text_insert.substr(0, common);
+                            else {
+                                diffs.insert(diffs.begin(), {dmp::Op::Equal, text_insert.substr(0, common)});
+                                index++;
+                            }
+                            text_insert.erase(0, common);
+                            text_delete.erase(0, common);
+                        }
+                        common = dmp::commonSuffix(text_insert.data() + text_insert.size(), text_delete.data() + text_delete.size(),
+                                                   std::min(text_insert.size(), text_delete.size()));
+                        if (common != 0) {
+                            diffs[index].second = text_insert.substr(text_insert.size() - common) + diffs[index].second;
+                            text_insert.resize(text_insert.size() - common);
+                            text_delete.resize(text_delete.size() - common);
+                        }
+                    }
+                    size_t start = index - count_delete - count_insert;
+                    diffs.erase(diffs.begin() + start, diffs.begin() + index);
+                    StringDiffs merged;
+                    if (count_delete != 0)
+                        merged.push_back({dmp::Op::Delete, text_delete});
+                    if (count_insert != 0)
+                        merged.push_back({dmp::Op::Insert, text_insert});
+                    diffs.insert(diffs.begin() + start, merged.begin(), merged.end());
+                    index = start + merged.size() + 1;
+                } else if (index != 0 && diffs[index - 1].first == dmp::Op::Equal) {
+                    diffs[index - 1].second += diffs[index].second;
+                    diffs.erase(diffs.begin() + index);
+                } else
+                    index++;
+                count_insert = count_delete = 0;
+                text_delete.clear();
+                text_insert.clear();
+                break;
+        }
+    }
+    if (diffs.back().second.empty())
+        diffs.pop_back();
+
+    bool changes = false;
+    for (index = 1; index + 1 < diffs.size(); index++) {
+        auto &prev = diffs[index - 1], &edit = diffs[index], &next = diffs[index + 1];
+        if (prev.first == dmp::Op::Equal && next.first == dmp::Op::Equal) {
+            if (hasSuffix(edit.second, prev.second)) {
+                edit.second = prev.second + edit.second.substr(0, edit.second.size() - prev.second.size());
+                next.second = prev.second + next.second;
+                diffs.erase(diffs.begin() + (index - 1));
+                changes = true;
+            } else if (hasPrefix(edit.second, next.second)) {
+                prev.second += next.second;
+                edit.second = edit.second.substr(next.second.size()) + next.second;
+                diffs.erase(diffs.begin() + (index + 1));
+                changes = true;
+            }
+        }
+    }
+    if (changes)
+        arrayCleanupMerge(diffs);
+}
+
+static int stringScore(const std::string &one, const std::string &two) {
+    return dmp::semanticScore(one.data(), one.size(), two.data(), two.size(), dmp::asciiCharacterClasses);
+}
+
+static void arrayCleanupSemanticLossless(StringDiffs &diffs) {
+    for (size_t index = 1; index + 1 < diffs.size(); index++) {
+        auto &prev = diffs[index - 1], &edit_diff = diffs[index], &next = diffs[index + 1];
+        if (prev.first != dmp::Op::Equal || next.first != dmp::Op::Equal)
+            continue;
+        std::string equality1 = prev.second, edit = edit_diff.second, equality2 = next.second;
+        size_t common = dmp::commonSuffix(equality1.data() + equality1.size(), edit.data() + edit.size(),
+                                          std::min(equality1.size(), edit.size()));
+        bool changed = common != 0;
+        if (common != 0) {
+            std::string common_string = edit.substr(edit.size() - common);
+            equality1.resize(equality1.size() - common);
+            edit = common_string + edit.substr(0, edit.size() - common);
+            equality2 = common_string + equality2;
+        }
+        std::string best1 = equality1, best_edit = edit, best2 = equality2;
+        int best_score = stringScore(equality1, edit) + stringScore(edit, equality2);
+        while (!edit.empty() && !equality2.empty() && edit[0] == equality2[0]) {
+            equality1 += edit[0];
+            edit = edit.substr(1) + equality2[0];
+            equality2.erase(0, 1);
+            int score = stringScore(equality1, edit) + stringScore(edit, equality2);
+            if (score >= best_score) {
+                best_score = score;
+                best1 = equality1;
+                best_edit = edit;
+                best2 = equality2;
+                changed = true;
+            }
+        }
+        if (changed) {
+            if (!best1.empty())
+                prev.second = best1;
+            else {
+                diffs.erase(diffs.begin() + (index - 1));
+                index--;
+            }
+            diffs[index].second = best_edit;
+            if (!best2.empty())
+                diffs[index + 1].second = best2;
+            else {
+                diffs.erase(diffs.begin() + (index + 1));
+                index--;
+            }
+        }
+    }
+}
+
+static void arrayCleanupSemantic(StringDiffs &diffs) {
+    if (diffs.empty())
+        return;
+    std::vector<size_t> equalities;
+    const std::string *last_equality = nullptr;
+    size_t insertions1 = 0, deletions1 = 0, insertions2 = 0, deletions2 = 0;
+    bool changes = false;
+    for (size_t index = 0; index < diffs.size(); index++) {
+        if (diffs[index].first == dmp::Op::Equal) {
+            equalities.push_back(index);
+            insertions1 = insertions2;
+            deletions1 = deletions2;
+            insertions2 = deletions2 = 0;
+            last_equality = &diffs[index].second;
+        } else {
+            (diffs[index].first == dmp::Op::Insert ? insertions2 : deletions2) += diffs[index].second.size();
+            if (last_equality && last_equality->size() <= std::max(insertions1, deletions1) &&
+                last_equality->size() <= std::max(insertions2, deletions2)) {
+                size_t last = equalities.back();
+                diffs.insert(diffs.begin() + last, {dmp::Op::Delete, diffs[last].second});
+                diffs[last + 1].first = dmp::Op::Insert;
+                equalities.pop_back();
+                if (!equalities.empty())
+                    equalities.pop_back();
+                index = equalities.empty() ? SIZE_MAX : equalities.back();
+                insertions1 = deletions1 = insertions2 = deletions2 = 0;
+                last_equality = nullptr;
+                changes = true;
+            }
+        }
+    }
+    if (changes)
+        arrayCleanupMerge(diffs);
+    arrayCleanupSemanticLossless(diffs);
+
+    for (size_t index = 1; index < diffs.size(); index++) {
+        if (diffs[index - 1].first == dmp::Op::Delete && diffs[index].first == dmp::Op::Insert) {
+            std::string deletion = diffs[index - 1].second, insertion = diffs[index].second;
+            size_t overlap1 = dmp::commonOverlap(deletion.data(), deletion.size(), insertion.data(), insertion.size());
+            size_t overlap2 = dmp::commonOverlap(insertion.data(), insertion.size(), deletion.data(), deletion.size());
+            if (overlap1 >= overlap2) {
+                if (overlap1 >= deletion.size() / 2.0 || overlap1 >= insertion.size() / 2.0) {
+                    diffs.insert(diffs.begin() + index, {dmp::Op::Equal, insertion.substr(0, overlap1)});
+                    diffs[index - 1].second = deletion.substr(0, deletion.size() - overlap1);
+                    diffs[index + 1].second = insertion.substr(overlap1);
+                    index++;
+                }
+            } else if (overlap2 >= deletion.size() / 2.0 || overlap2 >= insertion.size() / 2.0) {
+                diffs.insert(diffs.begin() + index, {dmp::Op::Equal, deletion.substr(0, overlap2)});
+                diffs[index - 1] = {dmp::Op::Insert, insertion.substr(0, insertion.size() - overlap2)};
+                diffs[index + 1] = {dmp::Op::Delete, deletion.substr(overlap2)};
+                index++;
+            }
+            index++;
+        }
+    }
+}
+
+static void arrayCleanupEfficiency(StringDiffs &diffs, size_t edit_cost) {
+    if (diffs.empty())
+        return;
+    std::vector<size_t> equalities;
+    std::string last_equality;
+    bool have_last = false, pre_ins = false, pre_del = false, post_ins = false, post_del = false, changes = false;
+    for (size_t index = 0; index < diffs.size(); index++) {
+        if (diffs[index].first == dmp::Op::Equal) {
+            if (diffs[index].second.size() < edit_cost && (post_ins || post_del)) {
+                equalities.push_back(index);
+                pre_ins = post_ins;
+                pre_del = post_del;
+                last_equality = diffs[index].second;
+                have_last = true;
+            } else {
+                equalities.clear();
+                have_last = false;
+            }
+            post_ins = post_del = false;
+        } else {
+            (diffs[index].first == dmp::Op::Delete ? post_del : post_ins) = true;
+            if (have_last && ((pre_ins && pre_del && post_ins && post_del) ||
+                              (last_equality.size() < edit_cost / 2 && pre_ins + pre_del + post_ins + post_del == 3))) {
+                size_t last = equalities.back();
+                diffs.insert(diffs.begin() + last, {dmp::Op::Delete, last_equality});
+                diffs[last + 1].first = dmp::Op::Insert;
+                equalities.pop_back();
+                have_last = false;
+                if (pre_ins && pre_del) {
+                    post_ins = post_del = true;
+                    equalities.clear();
+                } else {
+                    if (!equalities.empty())
+                        equalities.pop_back();
+                    index = !equalities.empty() ? last : SIZE_MAX;
+                    post_ins = post_del = false;
+                }
+                changes = true;
+            }
+        }
+    }
+    if (changes)
+        arrayCleanupMerge(diffs);
+}
+
+static std::string renderArray(const StringDiffs &diffs, char separator = ' ') {
+    std::string out;
+    for (auto &diff : diffs) {
+        if (!out.empty())
+            out += separator;
+        out += opPrefix[int(diff.first)] + diff.second;
+    }
+    return out;
+}
+
+static std::string semantic(const std::string &diffs) {
+    return cleanup(diffs, [](dmp::Differ<char> &differ) { differ.cleanupSemantic(); }, '|');
+}
+
+static std::string lossless(const std::string &diffs) {
+    return cleanup(diffs, [](dmp::Differ<char> &differ) { differ.cleanupSemanticLossless(); }, '|');
+}
+
+static std::string efficiency(const std::string &diffs, size_t edit_cost = 4) {
+    return cleanup(diffs, [=](dmp::Differ<char> &differ) { differ.cleanupEfficiency(edit_cost); });
+}
+
+// Noisy diff of random words with many small edits and equalities.
+static StringDiffs noisyDiffs(std::mt19937 &rng, size_t count, const char *alphabet) {
+    StringDiffs diffs;
+    size_t alphabet_length = strlen(alphabet);
+    for (size_t i = 0; i < count; i++) {
+        std::string text;
+        for (size_t length = 1 + rng() % 6; text.size() < length;)
+            text += alphabet[rng() % alphabet_length];
+        dmp::Op op = dmp::Op(1 + rng() % 3);
+        if (diffs.empty() || diffs.back().first != op)
+            diffs.push_back({op, text});
+    }
+    return diffs;
+}
+
+static void spansFromArray(const StringDiffs &diffs, std::string &text1, std::string &text2, std::vector<dmp::Span> &spans) {
+    text1.clear();
+    text2.clear();
+    spans.clear();
+    for (auto &diff : diffs) {
+        std::string &into = diff.first == dmp::Op::Insert ? text2 : text1;
+        spans.push_back({diff.first, uint32_t(into.size()), uint32_t(diff.second.size())});
+        into += diff.second;
+        if (diff.first == dmp::Op::Equal)
+            text2 += diff.second;
+    }
+}
+
+static void testCleanup() {
+    // From the upstream diff-match-patch tests
+    CHECK_EQUAL(lossless(""), "");
+    CHECK_EQUAL(lossless("=AAA\r\n\r\nBBB|+\r\nDDD\r\n\r\nBBB|=\r\nEEE"), "=AAA\r\n\r\n|+BBB\r\nDDD\r\n\r\n|=BBB\r\nEEE");
+    CHECK_EQUAL(lossless("=AAA\r\nBBB|+ DDD\r\nBBB|= EEE"), "=AAA\r\n|+BBB DDD\r\n|=BBB EEE");
+    CHECK_EQUAL(lossless("=The c|+ow and the c|=at."), "=The |+cow and the |=cat.");
+    CHECK_EQUAL(lossless("=The-c|+ow-and-the-c|=at."), "=The-|+cow-and-the-|=cat.");
+    CHECK_EQUAL(lossless("=a|-a|=ax"), "-a|=aax");
+    CHECK_EQUAL(lossless("=xa|-a|=a"), "=xaa|-a");
+    CHECK_EQUAL(lossless("=The xxx. The |+zzz. The |=yyy."), "=The xxx.|+ The zzz.|= The yyy.");
+
+    CHECK_EQUAL(semantic(""), "");
+    CHECK_EQUAL(semantic("-ab|+cd|=12|-e"), "-ab|+cd|=12|-e");
+    CHECK_EQUAL(semantic("-abc|+ABC|=1234|-wxyz"), "-abc|+ABC|=1234|-wxyz");
+    CHECK_EQUAL(semantic("-a|=b|-c"), "-abc|+b");
+    CHECK_EQUAL(semantic("-ab|=cd|-e|=f|+g"), "-abcdef|+cdfg");
+    CHECK_EQUAL(semantic("+1|=A|-B|+2|=_|+1|=A|-B|+2"), "-AB_AB|+1A2_1A2");
+    CHECK_EQUAL(semantic("=The c|-ow and the c|=at."), "=The |-cow and the |=cat.");
+    CHECK_EQUAL(semantic("-abcxx|+xxdef"), "-abcxx|+xxdef");
+    CHECK_EQUAL(semantic("-abcxxx|+xxxdef"), "-abc|=xxx|+def");
+    CHECK_EQUAL(semantic("-xxxabc|+defxxx"), "+def|=xxx|-abc");
+    CHECK_EQUAL(semantic("-abcd1212|+1212efghi|=----|-A3|+3BC"), "-abcd|=1212|+efghi|=----|-A|=3|+BC");
+
+    CHECK_EQUAL(efficiency(""), "");
+    CHECK_EQUAL(efficiency("-ab +12 =wxyz -cd +34"), "-ab +12 =wxyz -cd +34");
+    CHECK_EQUAL(efficiency("-ab +12 =xyz -cd +34"), "-abxyzcd +12xyz34");
+    CHECK_EQUAL(efficiency("+12 =x -cd +34"), "-xcd +12x34");
+    CHECK_EQUAL(efficiency("-ab +12 =xy +34 =z -cd +56"), "-abxyzcd +12xy34z56");
+    CHECK_EQUAL(efficiency("-ab +12 =wxyz -cd +34", 5), "-abwxyzcd +12wxyz34");
+
+    // Same results as the array implementation on noisy diffs
+    std::mt19937 rng(43);
+    std::string text1, text2;
+    std::vector<dmp::Span> spans;
+    dmp::Arena arena;
+    for (int i = 0; i < 3000; i++) {
+        StringDiffs diffs = noisyDiffs(rng, rng() % 30, i % 2 ? "ab \n." : "abc");
+        spansFromArray(diffs, text1, text2, spans);
+        dmp::Differ<char> differ(text1.data(), text1.size(), text2.data(), text2.size(), arena);
+
+        StringDiffs expected = diffs;
+        arena.spans = spans;
+        switch (i % 4) {
+            case 0:
+                arrayCleanupMerge(expected);
+                differ.cleanupMerge();
+                break;
+            case 1:
+                arrayCleanupSemanticLossless(expected);
+                differ.cleanupSemanticLossless();
+                break;
+            case 2:
+                arrayCleanupSemantic(expected);
+                differ.cleanupSemantic();
+                break;
+            case 3:
+                arrayCleanupEfficiency(expected, 4);
+                differ.cleanupEfficiency(4);
+                break;
+        }
+        CHECK_EQUAL(render(differ, arena.spans, '|'), renderArray(expected, '|'));
+    }
+}
+
+static void benchCleanup() {
+    std::mt19937 rng(47);
+    StringDiffs diffs = noisyDiffs(rng, 40000, "abcdefgh \n");
+    std::string text1, text2;
+    std::vector<dmp::Span> spans;
+    spansFromArray(diffs, text1, text2, spans);
+
+    StringDiffs result;
+    double array = timeBlock(1, [&] {
+        result = diffs;
+        arrayCleanupSemantic(result);
+        arrayCleanupEfficiency(result, 4);
+    });
+
+    dmp::Arena arena;
+    dmp::Differ<char> differ(text1.data(), text1.size(), text2.data(), text2.size(), arena);
+    double inPlace = timeBlock(1, [&] {
+        arena.spans = spans;
+        differ.cleanupSemantic();
+        differ.cleanupEfficiency(4);
+    });
+    CHECK(render(differ, arena.spans, '|') == renderArray(result, '|'));
+    printf("Cleanup: %zu diffs -> %zu, semantic & efficiency on an array %.1fms, span vector %.1fms\n",
+           diffs.size(), result.size(), array * 1000., inPlace * 1000.);
+}
+
+// MARK: DiffMatchPatchMatch
+
+static long bitap(const std::string &text, const std::string &pattern, size_t loc,
+                  double threshold = 0.5, size_t distance = 100) {
+    dmp::Bitap<char> bitap(pattern.data(), pattern.size());
+    size_t found = bitap.locate(text.data(), text.size(), loc, threshold, distance);
+    return found == SIZE_MAX ? -1 : long(found);
+}
+
+// Single word Bitap with a hashed alphabet as in match_bitapOfTextAndPattern
+template <typename Char>
+static size_t singleWordBitap(const std::basic_string<Char> &text, const std::basic_string<Char> &pattern,
+                              size_t loc, double threshold, size_t distance) {
+    std::unordered_map<Char, uint64_t> alphabet;
+    for (size_t i = 0; i < pattern.size(); i++)
+        alphabet[pattern[i]] |= uint64_t(1) << (pattern.size() - i - 1);
+
+    size_t m = pattern.size();
+    auto score = [&](size_t e, size_t x) {
+        size_t proximity = loc > x ? loc - x : x - loc;
+        if (distance == 0)
+            return proximity == 0 ? double(e) / m : 1.0;
+        return double(e) / m + proximity / double(distance);
+    };
+
+    double score_threshold = threshold;
+    size_t best_loc = text.find(pattern, loc);
+    if (best_loc != std::basic_string<Char>::npos) {
+        score_threshold = std::min(score(0, best_loc), score_threshold);
+        best_loc = text.rfind(pattern, std::min(loc + m, text.size()) - m);
+        if (best_loc != std::basic_string<Char>::npos)
+            score_threshold = std::min(score(0, best_loc), score_threshold);
+    }
+
+    uint64_t matchmask = uint64_t(1) << (m - 1);
+    best_loc = SIZE_MAX;
+    size_t bin_max = m + text.size();
+    std::vector<uint64_t> rd, last_rd;
+
+    for (size_t d = 0; d < m; d++) {
+        size_t bin_min = 0, bin_mid = bin_max;
+        while (bin_min < bin_mid) {
+            if (score(d, loc + bin_mid) <= score_threshold)
+                bin_min = bin_mid;
+            else
+                bin_max = bin_mid;
+            bin_mid = (bin_max - bin_min) / 2 + bin_min;
+        }
+        bin_max = bin_mid;
+        size_t start = loc <= bin_mid ? 1 : loc - bin_mid + 1;
+        size_t finish = std::min(loc + bin_mid, text.size()) + m;
+
+        rd.assign(finish + 2, 0);
+        rd[finish + 1] = (uint64_t(1) << d) - 1;
+        for (size_t j = finish; j >= start; j--) {
+            auto found = j - 1 < text.size() ? alphabet.find(text[j - 1]) : alphabet.end();
+            uint64_t charMatch = found == alphabet.end() ? 0 : found->second;
+            rd[j] = ((rd[j + 1] << 1) | 1) & charMatch;
+            if (d != 0)
+                rd[j] |= (((last_rd[j + 1] | last_rd[j]) << 1) | 1) | last_rd[j + 1];
+            if (rd[j] & matchmask) {
+                double match_score = score(d, j - 1);
+                if (match_score <= score_threshold) {
+                    score_threshold = match_score;
+                    best_loc = j - 1;
+                    if (best_loc > loc)
+                        start = 2 * loc <= best_loc ? 1 : 2 * loc - best_loc + 1;
+                    else
+                        break;
+                }
+            }
+        }
+        std::swap(rd, last_rd);
+        if (score(d + 1, loc) > score_threshold)
+            break;
+    }
+
+    return best_loc;
+}
+
+static void testBitap() {
+    // From the upstream diff-match-patch match_bitap tests
+    CHECK(bitap("abcdefghijk", "fgh", 5) == 5);
+    CHECK(bitap("abcdefghijk", "fgh", 0) == 5);
+    CHECK(bitap("abcdefghijk", "efxhi", 0) == 4);
+    CHECK(bitap("abcdefghijk", "cdefxyhijk", 5) == 2);
+    CHECK(bitap("abcdefghijk", "bxy", 1) == -1);
+    CHECK(bitap("123456789xx0", "3456789x0", 2) == 2);
+    CHECK(bitap("abcdef", "xxabc", 4) == 0);
+    CHECK(bitap("abcdef", "defyy", 4) == 3);
+    CHECK(bitap("abcdef", "xabcdefy", 0) == 0);
+    CHECK(bitap("abcdefghijk", "efxyhi", 1, 0.4) == 4);
+    CHECK(bitap("abcdefghijk", "efxyhi", 1, 0.3) == -1);
+    CHECK(bitap("abcdefghijk", "bcdef", 1, 0.0) == 1);
+    CHECK(bitap("abcdexyzabcde", "abccde", 3) == 0);
+    CHECK(bitap("abcdexyzabcde", "abccde", 5) == 8);
+    CHECK(bitap("abcdefghijklmnopqrstuvwxyz", "abcdefg", 24, 0.5, 10) == -1);
+    CHECK(bitap("abcdefghijklmnopqrstuvwxyz", "abcdxxefg", 1, 0.5, 10) == 0);
+    CHECK(bitap("abcdefghijklmnopqrstuvwxyz", "abcdefg", 24, 0.5, 1000) == 0);
+
+    // Characters outside the direct table
+    dmp::Bitap<char16_t> alphabet(u"\u03b1\u03b2\u03b3a\u03b1", 5);
+    CHECK(alphabet.mask(u'\u03b1')[0] == 0x11 && alphabet.mask(u'\u03b3')[0] == 0x4 &&
+          alphabet.mask(u'a')[0] == 0x2 && alphabet.mask(u'\u03b4')[0] == 0);
+
+    // Same results as a single word implementation for patterns that fit
+    std::mt19937 rng(37);
+    const std::u16string letters = u"ab\u0430\u0431\u4e2d c\n";
+    for (int i = 0; i < 2000; i++) {
+        std::u16string text;
+        for (size_t length = rng() % 300; text.size() < length;)
+            text += letters[rng() % letters.size()];
+        std::u16string pattern;
+        if (text.size() > 8 && rng() % 2) {
+            size_t start = rng() % (text.size() - 4);
+            pattern = text.substr(start, 1 + rng() % std::min<size_t>(63, text.size() - start));
+            for (size_t edits = rng() % 4; edits--;)
+                pattern[rng() % pattern.size()] = letters[rng() % letters.size()];
+        } else {
+            for (size_t length = 1 + rng() % 63; pattern.size() < length;)
+                pattern += letters[rng() % letters.size()];
+        }
+        size_t loc = rng() % (text.size() + 1);
+        double threshold = (rng() % 10) / 10.;
+        size_t distance = rng() % 3 ? 100 : rng() % 2 ? 1000 : 0;
+
+        dmp::Bitap<char16_t> multiWord(pattern.data(), pattern.size());
+        CHECK(multiWord.locate(text.data(), text.size(), loc, threshold, distance) ==
+              singleWordBitap(text, pattern, loc, threshold, distance));
+    }
+
+    // Patterns longer than a word
+    std::string text;
+    for (int i = 0; i < 2000; i++)
+        text += char('a' + rng() % 26);
+    std::string pattern = text.substr(1200, 200);
+    pattern[10] = '#';
+    pattern[100] = '#';
+    pattern.erase(150, 1);
+    CHECK(bitap(text, pattern, 1000, 0.5, 1000) == 1200);
+    CHECK(bitap(text, text.substr(700, 130), 650, 0.5, 1000) == 700);
+    CHECK(bitap(text, std::string(130, '#'), 0, 0.5, 1000) == -1);
+}
+
+static void benchBitap() {
+    std::mt19937 rng(41);
+    std::u16string text;
+    for (int i = 0; i < 100000; i++)
+        text += char16_t(rng() % 8 ? 'a' + rng() % 26 : 0x3b1 + rng() % 20);
+    std::u16string pattern = text.substr(50000, 32);
+    pattern[5] = pattern[20] = u'#';
+
+    size_t expected = SIZE_MAX, found = SIZE_MAX;
+    double hashed = timeBlock(20, [&] {
+        expected = singleWordBitap(text, pattern, 49900, 0.5, 1000);
+    });
+    double flat = timeBlock(20, [&] {
+        dmp::Bitap<char16_t> bitap(pattern.data(), pattern.size());
+        found = bitap.locate(text.data(), text.size(), 49900, 0.5, 1000);
+    });
+    CHECK(found == expected && found == 50000);
+
+    std::u16string longPattern = text.substr(50000, 256);
+    longPattern[100] = u'#';
+    double multiWord = timeBlock(20, [&] {
+        dmp::Bitap<char16_t> bitap(longPattern.data(), longPattern.size());
+        found = bitap.locate(text.data(), text.size(), 49900, 0.5, 1000);
+    });
+    CHECK(found == 50000);
+    printf("Bitap: 32 char pattern hashed alphabet %.2fms, flat table %.2fms, 256 char pattern %.2fms\n",
+           hashed * 1000., flat * 1000., multiWord * 1000.);
+}
+
+// MARK: DiffMatchPatchUTF8
+
+static std::u16string utf16(const std::string &utf8) {
+    std::u16string out;
+    for (size_t i = 0; i < utf8.size();) {
+        uint8_t lead = utf8[i];
+        size_t extra = lead < 0x80 ? 0 : lead < 0xE0 ? 1 : lead < 0xF0 ? 2 : 3;
+        uint32_t code = extra == 0 ? lead : lead & (0x3F >> extra);
+        for (size_t j = 1; j <= extra; j++)
+            code = code << 6 | (utf8[i + j] & 0x3F);
+        if (code >= 0x10000) {
+            out += char16_t(0xD800 + ((code - 0x10000) >> 10));
+            out += char16_t(0xDC00 + (code & 0x3FF));
+        } else
+            out += char16_t(code);
+        i += extra + 1;
+    }
+    return out;
+}
+
+static std::string utf8Diff(const std::string &text1, const std::string &text2) {
+    dmp::Arena arena;
+    const uint8_t *bytes1 = (const uint8_t *)text1.data(), *bytes2 = (const uint8_t *)text2.data();
+    dmp::utf8::diff(bytes1, text1.size(), bytes2, text2.size(), arena);
+    dmp::Differ<uint8_t> differ(bytes1, text1.size(), bytes2, text2.size(), arena);
+    return render(differ, arena.spans);
+}
+
+static void testUTF8Diff() {
+    CHECK_EQUAL(utf8Diff("", ""), "");
+    CHECK_EQUAL(utf8Diff("abc", "abc"), "=abc");
+    CHECK_EQUAL(utf8Diff("é", "è"), "-é +è");
+    CHECK_EQUAL(utf8Diff("aéb", "aèb"), "=a -é +è =b");
+    CHECK_EQUAL(utf8Diff("x\U0001F600y", "x\U0001F601y"), "=x -\U0001F600 +\U0001F601 =y");
+    CHECK_EQUAL(utf8Diff("中文", "中斈"), "=中 -文 +斈");
+    CHECK_EQUAL(utf8Diff("aаb", "aбаb"), "=a +б =аb");
+
+    // UTF-16 ranges
+    std::string text1 = "a\U0001F600bé", text2 = "a\U0001F600cé";
+    dmp::Arena arena;
+    std::vector<dmp::utf8::Utf16Span> spans;
+    const uint8_t *bytes1 = (const uint8_t *)text1.data(), *bytes2 = (const uint8_t *)text2.data();
+    dmp::utf8::utf16Spans(bytes1, bytes2, dmp::utf8::diff(bytes1, text1.size(), bytes2, text2.size(), arena), spans);
+    CHECK(spans.size() == 4);
+    CHECK(spans[0].op == dmp::Op::Equal && spans[0].length == 5 && spans[0].utf16_offset == 0 && spans[0].utf16_length == 3);
+    CHECK(spans[1].op == dmp::Op::Delete && spans[1].offset == 5 && spans[1].utf16_offset == 3 && spans[1].utf16_length == 1);
+    CHECK(spans[2].op == dmp::Op::Insert && spans[2].offset == 5 && spans[2].utf16_offset == 3 && spans[2].utf16_length == 1);
+    CHECK(spans[3].op == dmp::Op::Equal && spans[3].offset == 6 && spans[3].utf16_offset == 4 && spans[3].utf16_length == 1);
+
+    // Random texts sharing lead bytes: spans end on code points and map onto the UTF-16
+    const char *const pieces[] = {"a", "b", " ", "é", "è", "а", "б", "中", "丮", "\U0001F600", "\U0001F601"};
+    std::mt19937 rng(53);
+    for (int i = 0; i < 2000; i++) {
+        std::string text1, text2;
+        for (size_t count = rng() % 20; count > 0; count--) {
+            text1 += pieces[rng() % 11];
+            if (count % 2 && rng() % 2)
+                text2 = text1;
+        }
+        for (size_t count = rng() % 20; count > 0; count--)
+            text2 += pieces[rng() % 11];
+
+        const uint8_t *bytes1 = (const uint8_t *)text1.data(), *bytes2 = (const uint8_t *)text2.data();
+        dmp::utf8::utf16Spans(bytes1, bytes2, dmp::utf8::diff(bytes1, text1.size(), bytes2, text2.size(), arena), spans);
+        std::u16string wide1 = utf16(text1), wide2 = utf16(text2), from, to;
+        bool whole = true;
+        for (const dmp::utf8::Utf16Span &span : spans) {
+            const std::string &text = span.op == dmp::Op::Insert ? text2 : text1;
+            const std::u16string &wide = span.op == dmp::Op::Insert ? wide2 : wide1;
+            std::u16string piece = utf16(text.substr(span.offset, span.length));
+            whole = whole && span.length != 0 && !dmp::utf8::isContinuation(text[span.offset]) &&
+                (span.offset + span.length == text.size() || !dmp::utf8::isContinuation(text[span.offset + span.length])) &&
+                wide.compare(span.utf16_offset, span.utf16_length, piece) == 0;
+            if (span.op != dmp::Op::Insert)
+                from += piece;
+            if (span.op != dmp::Op::Delete)
+                to += piece;
+        }
+        CHECK(whole && from == wide1 && to == wide2);
+    }
+}
+
+static void benchUTF8Diff() {
+    // ASCII source with the odd non-ASCII comment
+    std::mt19937 rng(59);
+    std::string text1;
+    for (int i = 0; i < 4000; i++) {
+        text1 += "    let value" + std::to_string(rng() % 1000) + " = compute(" + std::to_string(i) + ")";
+        text1 += i % 50 ? "\n" : " // résumé → 中文\n";
+    }
+    std::string text2 = text1;
+    for (int i = 0; i < 100; i++)
+        text2[rng() % text2.size()] = "xyz"[rng() % 3];
+    text2 = utf16(text2).size() ? text2 : text1;
+
+    dmp::Arena arena;
+    std::vector<dmp::utf8::Utf16Span> spans;
+    const uint8_t *bytes1 = (const uint8_t *)text1.data(), *bytes2 = (const uint8_t *)text2.data();
+    double bytes = timeBlock(5, [&] {
+        dmp::utf8::utf16Spans(bytes1, bytes2, dmp::utf8::diff(bytes1, text1.size(), bytes2, text2.size(), arena), spans);
+    });
+    double wide = timeBlock(5, [&] {
+        // As converting to NSString then copying out its UniChars
+        std::u16string wide1 = utf16(text1), wide2 = utf16(text2);
+        dmp::Differ<char16_t> differ(wide1.data(), wide1.size(), wide2.data(), wide2.size(), arena);
+        differ.diff();
+    });
+    printf("UTF-8 diff: %zu bytes, transcoded to UTF-16 %.1fms (%zu bytes), bytes %.1fms\n",
+           text1.size() + text2.size(), wide * 1000., (utf16(text1).size() + utf16(text2).size()) * 2, bytes * 1000.);
+}
+
+// MARK: UnifiedDiff
+
+// Events rendered one per line, buffer fed in chunks of the given size
+static std::string parseUnifiedDiff(const std::string &diff, size_t chunk = SIZE_MAX) {
+    static const char *const types = "hHCDIN";
+    unidiff::Parser parser;
+    std::string out, pending;
+
+    auto callback = [&](const unidiff::Line &line) {
+        out += types[int(line.type)];
+        if (line.type == unidiff::LineType::Hunk)
+            out += std::to_string(line.old_start) + "," + std::to_string(line.old_count) + " " +
+                std::to_string(line.new_start) + "," + std::to_string(line.new_count);
+        out += ":";
+        out.append(line.text, line.length);
+        out += "\n";
+    };
+
+    for (size_t offset = 0; offset < diff.size(); offset += chunk) {
+        pending += diff.substr(offset, chunk);
+        pending.erase(0, parser.parse(pending.data(), pending.size(), false, callback));
+    }
+    parser.parse(pending.data(), pending.size(), true, callback);
+    return out;
+}
+
+static void testUnifiedDiff() {
+    std::string diff =
+        "diff --git a/file.txt b/file.txt\n"
+        "index 83db48f..bf269f4 100644\n"
+        "--- a/file.txt\n"
+        "+++ b/file.txt\n"
+        "@@ -1,3 +1,3 @@ section\n"
+        " one\n"
+        "-two\n"
+        "+deux\n"
+        " three\n"
+        "@@ -5 +5 @@\n"
+        "--- not a header\n"
+        "+++ nor this\n"
+        "@@ -9,0 +10,2 @@\n"
+        "+ten\n"
+        "+eleven\n"
+        "@@ -20,2 +21,2 @@\n"
+        " last\n"
+        "-end\n"
+        "\\ No newline at end of file\n"
+        "+end\n"
+        "\n"
+        "diff --git a/other.txt b/other.txt\n"
+        "@@ -1,2 +1 @@\n"
+        "-x\n"
+        "\n"
+        "@@@ -1 +1 @@@\n"
+        "+unterminated";
+
+    std::string expected =
+        "h:diff --git a/file.txt b/file.txt\n"
+        "h:index 83db48f..bf269f4 100644\n"
+        "h:--- a/file.txt\n"
+        "h:+++ b/file.txt\n"
+        "H1,3 1,3:section\n"
+        "C:one\n"
+        "D:two\n"
+        "I:deux\n"
+        "C:three\n"
+        "H5,1 5,1:\n"
+        "D:-- not a header\n"
+        "I:++ nor this\n"
+        "H9,0 10,2:\n"
+        "I:ten\n"
+        "I:eleven\n"
+        "H20,2 21,2:\n"
+        "C:last\n"
+        "D:end\n"
+        "N: No newline at end of file\n"
+        "I:end\n"
+        "h:\n"
+        "h:diff --git a/other.txt b/other.txt\n"
+        "H1,2 1,1:\n"
+        "D:x\n"
+        "C:\n"
+        "h:@@@ -1 +1 @@@\n"
+        "h:+unterminated\n";
+
+    CHECK_EQUAL(parseUnifiedDiff(diff), expected);
+
+    // Lines split across reads come out the same
+    for (size_t chunk = 1; chunk < 40; chunk++)
+        CHECK_EQUAL(parseUnifiedDiff(diff, chunk), expected);
+
+    // Malformed hunk headers are not hunks
+    CHECK_EQUAL(parseUnifiedDiff("@@ -1,2 +1,2\n-x\n"), "h:@@ -1,2 +1,2\nh:-x\n");
+    CHECK_EQUAL(parseUnifiedDiff("@@ -a +1 @@\n"), "h:@@ -a +1 @@\n");
+    CHECK_EQUAL(parseUnifiedDiff("@@ -1, +1 @@\n"), "h:@@ -1, +1 @@\n");
+
+    // More deletes than the hunk has leaves the hunk
+    CHECK_EQUAL(parseUnifiedDiff("@@ -1 +1 @@\n-a\n-b\n"), "H1,1 1,1:\nD:a\nh:-b\n");
+}
+
+static void benchUnifiedDiff() {
+    // A multi-megabyte diff of many files and hunks
+    std::mt19937 rng(61);
+    std::string diff;
+    for (int file = 0; diff.size() < 8 << 20; file++) {
+        diff += "diff --git a/Source" + std::to_string(file) + ".swift b/Source" + std::to_string(file) + ".swift\n"
+            "index 83db48f..bf269f4 100644\n--- a/Source.swift\n+++ b/Source.swift\n";
+        for (int hunk = 0, line = 1; hunk < 20; hunk++, line += 40) {
+            diff += "@@ -" + std::to_string(line) + ",8 +" + std::to_string(line) + ",8 @@ func hunk()\n";
+            for (int i = 0; i < 8; i++) {
+                std::string text = "        let value" + std::to_string(rng() % 1000) + " = compute(" + std::to_string(i) + ")\n";
+                diff += i == 3 || i == 4 ? "-" + text + "+" + text : " " + text;
+            }
+        }
+    }
+
+    size_t lines = 0, bytes = 0;
+    double parsed = timeBlock(5, [&] {
+        unidiff::Parser parser;
+        lines = bytes = 0;
+        auto callback = [&](const unidiff::Line &line) {
+            lines++;
+            bytes += line.length;
+        };
+
+        // As unifiedDiffParseFileDescriptor() reading from git into a 256K buffer
+        std::vector<char> buffer(256 * 1024);
+        for (size_t offset = 0, filled = 0, read; ; offset += read) {
+            read = std::min(buffer.size() - filled, diff.size() - offset);
+            if (read == 0) {
+                parser.parse(buffer.data(), filled, true, callback);
+                break;
+            }
+            memcpy(buffer.data() + filled, diff.data() + offset, read);
+            filled += read;
+            size_t consumed = parser.parse(buffer.data(), filled, false, callback);
+            memmove(buffer.data(), buffer.data() + consumed, filled - consumed);
+            filled -= consumed;
+        }
+    });
+
+    // As the NSRegularExpression DiffProcessor.delta used with Strings for each line and capture
+    std::regex regex("^(?:(?:@@ -\\d+,\\d+ \\+(\\d+),\\d+ @@)|([-+])(.*))");
+    size_t matches = 0;
+    double regexed = timeBlock(1, [&] {
+        std::smatch match;
+        for (size_t offset = 0, eol; offset < diff.size(); offset = eol + 1) {
+            eol = diff.find('\n', offset);
+            std::string line = diff.substr(offset, eol - offset);
+            if (std::regex_search(line, match, regex))
+                matches += match.str(3).size() + match.str(1).size();
+        }
+    });
+
+    printf("Unified diff: %.1fMB %zu lines, regex per line %.0fms, parser %.1fms (%.0fMB/s)\n",
+           diff.size() / 1048576., lines, regexed * 1000., parsed * 1000., diff.size() / 1048576. / parsed);
+    CHECK(matches != 0 && bytes != 0);
+}
+
+// MARK: GitRepository
+
+static std::string shell(const std::string &command) {
+    std::string out;
+    if (FILE *pipe = popen(command.c_str(), "r")) {
+        char buffer[64 * 1024];
+        size_t bytesRead;
+        while ((bytesRead = fread(buffer, 1, sizeof buffer, pipe)) > 0)
+            out.append(buffer, bytesRead);
+        pclose(pipe);
+    }
+    return out;
+}
+
+static void writeFile(const std::string &path, const std::string &contents) {
+    if (FILE *file = fopen(path.c_str(), "w")) {
+        fwrite(contents.data(), 1, contents.size(), file);
+        fclose(file);
+    }
+}
+
+// A repository made with git for the reader to read
+struct Fixture {
+    std::string directory, git;
+
+    Fixture() {
+        char path[] = "/tmp/GitRepositoryXXXXXX";
+        directory = mkdtemp(path) ?: "";
+        git = "git -C " + directory + " -c user.name=Test -c user.email=test@example.com";
+        shell(git + " init -q && mkdir -p " + directory + "/dir/sub");
+    }
+
+    ~Fixture() {
+        shell("rm -rf " + directory + " " + directory + "-worktree");
+    }
+};
+
+static std::string lines(int count, int changed, const char *change) {
+    std::string text;
+    for (int i = 0; i < count; i++)
+        text += i % 17 == changed ? change + std::to_string(i) + "\n" : "    let value" + std::to_string(i) + " = compute()\n";
+    return text;
+}
+
+// Every object git has read back the same
+static void checkObjects(const Fixture &fixture, const char *what) {
+    git::Repository repository;
+    CHECK(repository.open(fixture.directory + "/file.txt"));
+
+    std::string batch = shell(fixture.git + " cat-file --batch-all-objects --batch"), data;
+    size_t objects = 0, matched = 0;
+    static const char *const types[] = {"", "commit", "tree", "blob", "tag"};
+
+    // "<id> <type> <size>\n<contents>\n"
+    for (size_t p = 0; p < batch.size(); objects++) {
+        size_t eol = batch.find('\n', p);
+        char hex[41], type_name[16];
+        size_t size;
+        if (eol == std::string::npos || sscanf(batch.c_str() + p, "%40s %15s %zu", hex, type_name, &size) != 3)
+            break;
+
+        git::ObjectId id;
+        git::ObjectType type;
+        matched += git::ObjectId::fromHex(hex, id) && repository.read(id, type, data) &&
+            strcmp(types[int(type)], type_name) == 0 && batch.compare(eol + 1, size, data) == 0;
+        p = eol + 1 + size + 1;
+    }
+
+    if (matched != objects || objects == 0)
+        fprintf(stderr, "%s: %zu of %zu objects read\n", what, matched, objects);
+    CHECK(objects != 0 && matched == objects);
+}
+
+static void checkBlobs(const std::string &directory, const char *what) {
+    git::Repository repository;
+    CHECK(repository.open(directory + "/file.txt"));
+    std::string text, git = "git -C " + directory;
+
+    for (const char *path : {"file.txt", "dir/sub/nested.txt"}) {
+        bool head = repository.blob(path, true, text) == git::Lookup::Found;
+        if (!head || text != shell(git + " show HEAD:" + path))
+            fprintf(stderr, "%s: HEAD:%s\n", what, path);
+        CHECK(head && text == shell(git + " show HEAD:" + path));
+
+        bool staged = repository.blob(path, false, text) == git::Lookup::Found;
+        if (!staged || text != shell(git + " show :" + path))
+            fprintf(stderr, "%s: :%s\n", what, path);
+        CHECK(staged && text == shell(git + " show :" + path));
+    }
+
+    // Index entries match git's listing, "<mode> <id> <stage>\t<path>"
+    std::string listing = shell(git + " ls-files -s");
+    for (size_t p = 0, eol; (eol = listing.find('\n', p)) != std::string::npos; p = eol + 1) {
+        std::string path = listing.substr(listing.find('\t', p) + 1, eol - listing.find('\t', p) - 1);
+        git::IndexEntry entry;
+        CHECK(repository.indexEntry(path, entry) == git::Lookup::Found && entry.id.hex() == listing.substr(p + 7, 40));
+    }
+
+    CHECK(repository.blob("untracked.txt", false, text) == git::Lookup::Missing);
+    CHECK(repository.blob("untracked.txt", true, text) == git::Lookup::Missing);
+    CHECK(repository.blob("dir/sub", true, text) == git::Lookup::Missing);
+    CHECK(repository.blob("file.txt/sub", true, text) != git::Lookup::Found);
+}
+
+// The index is reread when written and its stat data tells unchanged files
+static void testIndexStat() {
+    Fixture fixture;
+    std::string file = fixture.directory + "/file.txt", state, before, after;
+    writeFile(file, lines(100, 1, "first "));
+    shell("touch -d '2 hours ago' " + file + " && " + fixture.git + " add file.txt && " + fixture.git + " commit -qm 1");
+
+    git::Repository repository;
+    CHECK(repository.open(file));
+    git::IndexEntry entry;
+    struct stat info;
+    CHECK(repository.indexEntry("file.txt", entry) == git::Lookup::Found && stat(file.c_str(), &info) == 0);
+    CHECK(repository.upToDate(entry, info));
+    CHECK(repository.fileState("file.txt", false, before) && repository.fileState("file.txt", false, after));
+    CHECK(before == after);
+
+    // Edited but not staged
+    writeFile(file, lines(100, 2, "second "));
+    shell("touch -d '1 hour ago' " + file);
+    CHECK(stat(file.c_str(), &info) == 0 && !repository.upToDate(entry, info));
+    CHECK(repository.fileState("file.txt", false, after) && after != before);
+
+    // Staged, so the index is read again
+    shell(fixture.git + " add file.txt");
+    CHECK(repository.indexEntry("file.txt", entry) == git::Lookup::Found);
+    CHECK_EQUAL(entry.id.hex() + "\n", shell(fixture.git + " rev-parse :file.txt"));
+    CHECK(repository.upToDate(entry, info));
+
+    // Committing changes the state against HEAD but not the index
+    CHECK(repository.fileState("file.txt", false, before) && repository.fileState("file.txt", true, state));
+    shell(fixture.git + " commit -qm 2");
+    CHECK(repository.fileState("file.txt", false, after) && before == after);
+    CHECK(repository.fileState("file.txt", true, after) && state != after);
+
+    // Path compression after the index is rewritten in place of the one read
+    shell(fixture.git + " update-index --index-version 4");
+    CHECK(repository.indexEntry("file.txt", entry) == git::Lookup::Found &&
+          entry.id.hex() + "\n" == shell(fixture.git + " rev-parse :file.txt"));
+    CHECK(repository.indexEntry("untracked.txt", entry) == git::Lookup::Missing);
+
+    // A file just written might change again without its stat showing it
+    writeFile(file, lines(100, 3, "third "));
+    CHECK(!repository.fileState("file.txt", false, state));
+}
+
+// core.autocrlf as git reads it, only settings of that key in [core] counting
+static void testAutocrlf(const Fixture &fixture) {
+    auto autocrlf = [](const std::string &contents) {
+        bool value = false;
+        git::Repository::configBoolean(contents, "core", "autocrlf", value);
+        return value;
+    };
+    CHECK(autocrlf("[core]\n\tautocrlf = true\n"));
+    CHECK(autocrlf("[Core]\n  AutoCRLF=input ; as git for windows\n"));
+    CHECK(autocrlf("[core] autocrlf\n"));
+    CHECK(autocrlf("[core]\nautocrlf = \"yes\"\n"));
+    CHECK(!autocrlf("[core]\nautocrlf = true\nautocrlf = false\n"));
+    CHECK(!autocrlf("# autocrlf = true\n[core]\n\t; autocrlf = true\n\tsafecrlf = true\n"));
+    CHECK(!autocrlf("[core \"sub\"]\n\tautocrlf = true\n[other]\n\tautocrlf = true\n"));
+    CHECK(!autocrlf("[core]\n\tautocrlfx = true\n\tnoautocrlf = true\n"));
+
+    // Read again as the repository's config changes, later files overriding earlier ones
+    std::string home = getenv("HOME") ?: "";
+    setenv("HOME", fixture.directory.c_str(), 1);
+    git::Repository repository;
+    CHECK(repository.open(fixture.directory + "/file.txt"));
+    writeFile(fixture.directory + "/.gitconfig", "[core]\n\tautocrlf = true\n");
+    bool global = repository.convertsLineEndings();
+    shell(fixture.git + " config core.autocrlf false");
+    bool local = repository.convertsLineEndings();
+    shell(fixture.git + " config core.autocrlf input");
+    CHECK(global && !local && repository.convertsLineEndings());
+    shell(fixture.git + " config --unset core.autocrlf && rm " + fixture.directory + "/.gitconfig");
+    CHECK(!repository.convertsLineEndings());
+    setenv("HOME", home.c_str(), 1);
+}
+
+static void testGitRepository() {
+    if (shell("git --version").empty()) {
+        printf("GitRepository: git not found, skipped\n");
+        return;
+    }
+
+    Fixture fixture;
+    for (int commit = 0; commit < 6; commit++) {
+        writeFile(fixture.directory + "/file.txt", lines(400, commit, "    // changed "));
+        writeFile(fixture.directory + "/dir/sub/nested.txt", lines(50 + commit, commit, "nested "));
+        shell(fixture.git + " add -A && " + fixture.git + " commit -qm " + std::to_string(commit));
+    }
+    writeFile(fixture.directory + "/file.txt", lines(400, 9, "    // staged "));
+    writeFile(fixture.directory + "/untracked.txt", "untracked\n");
+    shell(fixture.git + " add file.txt");
+
+    checkObjects(fixture, "loose");
+    checkBlobs(fixture.directory, "loose");
+
+    // Offset deltas and packed refs
+    shell(fixture.git + " gc -q");
+    checkObjects(fixture, "packed");
+    checkBlobs(fixture.directory, "packed");
+
+    // Ref deltas
+    shell(fixture.git + " -c repack.useDeltaBaseOffset=false repack -adfq");
+    checkObjects(fixture, "ref deltas");
+
+    // Index v3 has extended flags for intent to add
+    writeFile(fixture.directory + "/added.txt", "added\n");
+    shell(fixture.git + " add -N added.txt");
+    CHECK(shell("od -An -tx1 -j4 -N4 " + fixture.directory + "/.git/index") == " 00 00 00 03\n");
+    checkBlobs(fixture.directory, "v3 index");
+
+    // Index v4 compresses paths
+    shell(fixture.git + " update-index --index-version 4");
+    CHECK(shell("od -An -tx1 -j4 -N4 " + fixture.directory + "/.git/index") == " 00 00 00 04\n");
+    checkBlobs(fixture.directory, "v4 index");
+
+    // A linked worktree on an earlier commit
+    shell(fixture.git + " worktree add -q -b older " + fixture.directory + "-worktree HEAD~2");
+    checkBlobs(fixture.directory + "-worktree", "worktree");
+
+    git::Repository repository;
+    CHECK(!repository.open("/"));
+
+    // Split and sparse indexes have entries elsewhere so are left to git
+    CHECK(repository.open(fixture.directory + "/file.txt"));
+    git::IndexEntry entry;
+    CHECK(repository.indexEntry("file.txt", entry) == git::Lookup::Found);
+    shell(fixture.git + " update-index --split-index");
+    CHECK(shell("ls " + fixture.directory + "/.git").find("sharedindex.") != std::string::npos);
+    CHECK(repository.indexEntry("file.txt", entry) == git::Lookup::Failed);
+    std::string state;
+    CHECK(!repository.fileState("file.txt", false, state));
+    shell(fixture.git + " update-index --no-split-index");
+    CHECK(repository.indexEntry("file.txt", entry) == git::Lookup::Found);
+
+    if (shell(fixture.git + " sparse-checkout set --cone --sparse-index none 2>&1").empty()) {
+        CHECK(shell(fixture.git + " ls-files --sparse").find("\ndir/\n") != std::string::npos);
+        CHECK(repository.indexEntry("file.txt", entry) == git::Lookup::Failed);
+        shell(fixture.git + " sparse-checkout disable");
+        CHECK(repository.indexEntry("dir/sub/nested.txt", entry) == git::Lookup::Found);
+    } else
+        printf("GitRepository: sparse index not supported, skipped\n");
+
+    testAutocrlf(fixture);
+    testIndexStat();
+}
+
+static void benchGitRepository() {
+    if (shell("git --version").empty())
+        return;
+
+    Fixture fixture;
+    for (int commit = 0; commit < 20; commit++) {
+        writeFile(fixture.directory + "/file.txt", lines(5000, commit, "    // changed "));
+        shell(fixture.git + " add -A && " + fixture.git + " commit -qm " + std::to_string(commit));
+    }
+    shell(fixture.git + " gc -q");
+    writeFile(fixture.directory + "/file.txt", lines(5000, 3, "    // edited "));
+
+    double spawned = timeBlock(10, [&] {
+        shell(fixture.git + " diff --no-ext-diff --no-color file.txt");
+    });
+
+    std::string working, base;
+    std::vector<uint32_t> ids1, ids2;
+    dmp::Arena arena;
+    size_t spans = 0;
+    double in_process = timeBlock(10, [&] {
+        git::Repository repository;
+        repository.open(fixture.directory + "/file.txt");
+        repository.blob("file.txt", false, base);
+        git::readFile(fixture.directory + "/file.txt", working);
+
+        dmp::LineTable<char> table;
+        table.linesToIds(base.data(), base.size(), ids1);
+        table.linesToIds(working.data(), working.size(), ids2);
+        dmp::Differ<uint32_t> differ(ids1.data(), ids1.size(), ids2.data(), ids2.size(), arena);
+        spans = differ.diff().size();
+    });
+
+    printf("Git diff of %zu bytes: spawning git diff %.1fms, in process %.1fms\n",
+           working.size(), spawned * 1000., in_process * 1000.);
+    CHECK(spans > 1);
+}
+
+// MARK: BaseCache
+
+static git::ObjectId objectId(int n) {
+    char hex[41];
+    snprintf(hex, sizeof hex, "%040x", n);
+    git::ObjectId id;
+    git::ObjectId::fromHex(hex, id);
+    return id;
+}
+
+static void testBaseCache() {
+    std::string text = lines(1000, 3, "changed ");
+    size_t footprint = git::Base(std::string(text)).footprint();
+    git::BaseCache cache(footprint * 3);
+
+    CHECK(cache.find(objectId(1)) == nullptr);
+    std::shared_ptr<git::Base> base = cache.insert(objectId(1), std::string(text));
+    CHECK(base->ids.size() == 1000 && base->offsets.size() == 1001 && base->text == text);
+    CHECK(cache.find(objectId(1)) == base);
+
+    // Diffing against it leaves the base's lines as they were
+    std::vector<uint32_t> ids, before = base->ids;
+    std::string working = lines(1000, 5, "edited ");
+    base->idsFor(working.data(), working.size(), ids, nullptr);
+    CHECK(ids.size() == 1000 && ids[0] == before[0] && ids[5] != before[5]);
+    size_t size = base->table.size();
+    base->done();
+    CHECK(base->table.size() < size && base->ids == before);
+
+    // Least recently used evicted first
+    cache.insert(objectId(2), std::string(text));
+    cache.insert(objectId(3), std::string(text));
+    CHECK(cache.find(objectId(1)) != nullptr);
+    cache.insert(objectId(4), std::string(text));
+    CHECK(cache.find(objectId(2)) == nullptr && cache.find(objectId(1)) != nullptr);
+
+    git::BaseCache::Statistics statistics = cache.statistics();
+    CHECK(statistics.hits == 3 && statistics.misses == 2 && statistics.evictions == 1);
+    CHECK(statistics.entries == 3 && statistics.bytes == footprint * 3 && statistics.capacity == footprint * 3);
+
+    // Too large to cache but still usable
+    cache.setCapacity(footprint / 2);
+    statistics = cache.statistics();
+    CHECK(statistics.entries == 0 && statistics.bytes == 0 && statistics.evictions == 4);
+    CHECK(cache.insert(objectId(5), std::string(text))->ids.size() == 1000 && cache.find(objectId(5)) == nullptr);
+}
+
+static void benchBaseCache() {
+    // A save changing a single line
+    std::string base = lines(20000, 3, "    // changed "), working = base;
+    working.insert(working.size() / 2, "    // edited\n");
+    std::vector<uint32_t> ids1, ids2;
+    dmp::Arena arena;
+
+    double uncached = timeBlock(20, [&] {
+        dmp::LineTable<char> table;
+        table.linesToIds(base.data(), base.size(), ids1);
+        table.linesToIds(working.data(), working.size(), ids2);
+        dmp::Differ<uint32_t> differ(ids1.data(), ids1.size(), ids2.data(), ids2.size(), arena);
+        differ.diff();
+    });
+
+    git::BaseCache cache;
+    cache.insert(objectId(1), std::string(base));
+    double cached = timeBlock(20, [&] {
+        std::shared_ptr<git::Base> hit = cache.find(objectId(1));
+        hit->idsFor(working.data(), working.size(), ids2, nullptr);
+        dmp::Differ<uint32_t> differ(hit->ids.data(), hit->ids.size(), ids2.data(), ids2.size(), arena);
+        differ.diff();
+        hit->done();
+    });
+
+    git::BaseCache::Statistics statistics = cache.statistics();
+    printf("Re-diff of %zu bytes: splitting both %.2fms, base cached %.2fms (%zu bytes cached)\n",
+           working.size(), uncached * 1000., cached * 1000., statistics.bytes);
+}
+
+// MARK: EditSession
+
+static std::vector<std::string> splitLines(const std::string &text) {
+    std::vector<std::string> lines;
+    for (size_t start = 0; start < text.size();) {
+        size_t end = std::min(text.find('\n', start), text.size() - 1) + 1;
+        lines.push_back(text.substr(start, end - start));
+        start = end;
+    }
+    return lines;
+}
+
+// The spans align every line of both texts in order, equal lines being the same
+static bool aligns(const std::string &base, const std::string &text, const std::vector<dmp::Span> &spans) {
+    std::vector<std::string> lines1 = splitLines(base), lines2 = splitLines(text);
+    size_t b = 0, w = 0;
+    for (const dmp::Span &span : spans) {
+        if (span.op == dmp::Op::Insert) {
+            if (span.offset != w)
+                return false;
+            w += span.length;
+            continue;
+        }
+        if (span.offset != b)
+            return false;
+        for (size_t i = 0; span.op == dmp::Op::Equal && i < span.length; i++)
+            if (b + i >= lines1.size() || w + i >= lines2.size() || lines1[b + i] != lines2[w + i])
+                return false;
+        b += span.length;
+        w += span.op == dmp::Op::Equal ? span.length : 0;
+    }
+    return b == lines1.size() && w == lines2.size();
+}
+
+// Lines of the text inserted or replaced
+static std::vector<uint32_t> insertedLines(const std::vector<dmp::Span> &spans) {
+    std::vector<uint32_t> lines;
+    for (const dmp::Span &span : spans)
+        for (uint32_t i = 0; span.op == dmp::Op::Insert && i < span.length; i++)
+            lines.push_back(span.offset + i);
+    return lines;
+}
+
+static void testEditSession() {
+    std::string base = lines(2000, 4, "    // base ");
+    std::shared_ptr<git::Base> cached = std::make_shared<git::Base>(std::string(base));
+    git::ObjectId id = objectId(1);
+    git::EditSession session;
+    dmp::Arena arena;
+
+    std::string text = base;
+    text.insert(text.find("    let value100 "), "    // added\n");
+    git::EditSession::Window window = session.diff(id, cached, std::string(text), arena);
+    CHECK(window.whole && aligns(base, text, session.allSpans()));
+
+    // A line changed is re-diffed with the equal lines either side
+    size_t at = text.find("value500 ");
+    text.replace(at, 8, "changed5");
+    window = session.diff(id, cached, std::string(text), arena);
+    CHECK(!window.whole && window.anchored_start && window.anchored_end);
+    CHECK(window.start == 501 && window.old_end == 502 && window.end == 502 && window.base_start == 500);
+    CHECK(session.windowSpans().size() == 2 && aligns(base, text, session.allSpans()));
+    CHECK(insertedLines(session.allSpans()) == std::vector<uint32_t>({100, 501}));
+
+    // Lines added at the end have no anchor after them
+    text += "    // appended\n    // appended\n";
+    window = session.diff(id, cached, std::string(text), arena);
+    CHECK(window.anchored_start && !window.anchored_end && window.end - window.old_end == 2);
+    CHECK(insertedLines(session.allSpans()) == std::vector<uint32_t>({100, 501, 2001, 2002}));
+
+    // Reverting the added line moves the rest up
+    text.erase(text.find("    // added\n"), 13);
+    window = session.diff(id, cached, std::string(text), arena);
+    CHECK(window.end + 1 == window.old_end && aligns(base, text, session.allSpans()));
+    CHECK(insertedLines(session.allSpans()) == std::vector<uint32_t>({500, 2000, 2001}));
+
+    // Random edits keep the spans aligned and agree with diffing the whole text
+    std::mt19937 rng(15);
+    for (int edit = 0; edit < 300; edit++) {
+        std::vector<std::string> current = splitLines(text);
+        size_t line = rng() % (current.size() + 1), count = rng() % 4;
+        std::string changed;
+        for (size_t i = 0; i < count; i++)
+            changed += "    // edit " + std::to_string(rng() % 50) + "\n";
+        size_t removed = std::min<size_t>(rng() % 3, current.size() - line);
+        current.erase(current.begin() + line, current.begin() + line + removed);
+        current.insert(current.begin() + line, changed.empty() ? std::string() : changed);
+        text.clear();
+        for (const std::string &line : current)
+            text += line;
+        if (edit % 37 == 0)
+            text.insert(rng() % text.size(), "partial");
+
+        window = session.diff(id, cached, std::string(text), arena);
+        CHECK(!window.whole && session.currentText() == text && aligns(base, text, session.allSpans()));
+        CHECK(window.start <= window.old_end && window.start <= window.end);
+    }
+
+    // Another base is diffed whole
+    window = session.diff(objectId(2), std::make_shared<git::Base>(std::string(text)), std::string(text), arena);
+    CHECK(window.whole && session.allSpans().size() == 1 && session.allSpans()[0].op == dmp::Op::Equal);
+}
+
+static void benchEditSession() {
+    std::string base = lines(10000, 4, "    // base ");
+    std::shared_ptr<git::Base> cached = std::make_shared<git::Base>(std::string(base));
+    git::EditSession session;
+    dmp::Arena arena;
+    std::string text = base;
+    session.diff(objectId(1), cached, std::string(text), arena);
+
+    // Typing on a line of a 10,000 line file
+    size_t at = text.find("value5000 ");
+    int typed = 0;
+    double incremental = timeBlock(100, [&] {
+        text.insert(at + typed++, "x");
+        session.diff(objectId(1), cached, std::string(text), arena);
+    });
+
+    std::vector<uint32_t> ids;
+    double whole = timeBlock(100, [&] {
+        cached->idsFor(text.data(), text.size(), ids, nullptr);
+        dmp::Differ<uint32_t> differ(cached->ids.data(), cached->ids.size(), ids.data(), ids.size(), arena);
+        differ.diff();
+        cached->done();
+    });
+
+    printf("Buffer diff of %zu bytes per keystroke: whole %.2fms, incremental %.3fms\n",
+           text.size(), whole * 1000., incremental * 1000.);
+}
+
+// MARK: CoProcess
+
+static void testCoProcess() {
+    // Restarted after being killed
+    git::CoProcess cat({"cat"});
+    std::string line;
+    CHECK(cat.start() && cat.alive() && cat.write("hello\n") && cat.readLine(line) && line == "hello");
+    kill(cat.processId(), SIGKILL);
+    for (int wait = 0; wait < 100 && cat.alive(); wait++)
+        usleep(10000);
+    CHECK(!cat.alive() && !cat.write("lost\n"));
+    // Failing rather than raising SIGPIPE when a process stops reading,
+    // without changing how this process handles it
+    git::CoProcess closed({"sh", "-c", "exec <&-; sleep 5"});
+    CHECK(closed.start());
+    usleep(100000);
+    CHECK(!closed.write("unread\n") && errno == EPIPE);
+    closed.stop();
+    struct sigaction pipe_action;
+    CHECK(sigaction(SIGPIPE, nullptr, &pipe_action) == 0 && pipe_action.sa_handler == SIG_DFL);
+    CHECK(cat.start() && cat.write("again\n") && cat.readLine(line) && line == "again" && cat.startCount() == 2);
+
+    if (shell("git --version").empty()) {
+        printf("CoProcess: git not found, skipped\n");
+        return;
+    }
+
+    Fixture fixture;
+    writeFile(fixture.directory + "/file.txt", lines(200, 1, "first "));
+    writeFile(fixture.directory + "/dir/sub/nested.txt", lines(30, 2, "nested "));
+    shell(fixture.git + " add -A && " + fixture.git + " commit -qm 1");
+    writeFile(fixture.directory + "/file.txt", lines(200, 3, "staged "));
+    shell(fixture.git + " add file.txt");
+
+    // Objects by name and id, pipelined beyond what is written at once
+    git::GitProcesses processes(fixture.directory);
+    std::vector<std::string> names = {"HEAD:file.txt", ":file.txt", "HEAD:missing.txt",
+                                      shell(fixture.git + " rev-parse HEAD:dir/sub/nested.txt").substr(0, 40)};
+    while (names.size() < 2000)
+        names.push_back(names.size() % 2 ? "HEAD:dir/sub/nested.txt" : ":file.txt");
+    std::vector<std::string> expected;
+    for (size_t i = 0; i < 4; i++)
+        expected.push_back(i == 2 ? "" : shell(fixture.git + " cat-file blob " + names[i]));
+    size_t matched = 0, missing = 0;
+    CHECK(processes.catFile(names, [&](size_t index, git::ObjectType type, std::string &data) {
+        const std::string &want = index < 4 ? expected[index] : expected[index % 2 ? 3 : 1];
+        matched += (type == git::ObjectType::Blob || index == 2) && data == want;
+        missing += type == git::ObjectType::None;
+    }));
+    CHECK(matched == names.size() && missing == 1);
+
+    git::ObjectType type;
+    std::string data;
+    CHECK(processes.catFile("HEAD", type, data) == git::Lookup::Found && type == git::ObjectType::Commit);
+    CHECK(processes.catFile("HEAD:dir", type, data) == git::Lookup::Found && type == git::ObjectType::Tree);
+    CHECK(processes.catFile("HEAD:none", type, data) == git::Lookup::Missing);
+
+    // A process that has exited is restarted
+    shell("pkill -f '" + fixture.directory + " cat-file'");
+    for (int wait = 0; wait < 100 && shell("pgrep -f '" + fixture.directory + " cat-file'").size(); wait++)
+        usleep(10000);
+    CHECK(processes.catFile(":file.txt", type, data) == git::Lookup::Found && data == expected[1]);
+    git::GitProcesses::Statistics statistics = processes.statistics();
+    CHECK(statistics.restarts == 1 && statistics.starts == 2 && statistics.requests == 5);
+
+    // Attributes converting text or diffing it otherwise
+    writeFile(fixture.directory + "/.gitattributes",
+              "*.txt text\n*.bin filter=lfs\n*.c -text\n*.dat -diff\n*.pdf diff=pdf\n*.raw diff\n");
+    std::map<std::string, std::string> values;
+    CHECK(processes.attributes("file.txt", values) && values.size() == git::GitProcesses::Attributes);
+    CHECK(values["text"] == "set" && values["filter"] == "unspecified" && values["diff"] == "unspecified");
+    CHECK(processes.attributes("data.bin", values) && values["filter"] == "lfs");
+    CHECK(processes.attributes("main.c", values) && values["text"] == "unset");
+    CHECK(processes.attributes("doc.pdf", values) && values["diff"] == "pdf");
+
+    CHECK(processes.diffAs("file.txt", false, "a\n", "b\n") == git::DiffAs::Text);
+    CHECK(processes.diffAs("file.txt", false, "a\n", "b\r\n") == git::DiffAs::Git);
+    CHECK(processes.diffAs("data.bin", false, "a\n", "b\n") == git::DiffAs::Git);
+    CHECK(processes.diffAs("main.c", false, "a\r\n", "b\r\n") == git::DiffAs::Text);
+    CHECK(processes.diffAs("main.c", true, "a\r\n", "b\n") == git::DiffAs::Git);
+    CHECK(processes.diffAs("table.dat", false, "a\n", "b\n") == git::DiffAs::Git);
+    CHECK(processes.diffAs("doc.pdf", false, "a\n", "b\n") == git::DiffAs::Git);
+
+    // A NUL within the first 8000 bytes of either text makes it binary, unless diff is set
+    std::string nul = lines(50, 1, "first ") + std::string(1, '\0') + "\n", late = std::string(8000, 'x') + nul;
+    CHECK(processes.diffAs("image.png", false, nul, "b\n") == git::DiffAs::Binary);
+    CHECK(processes.diffAs("image.png", false, "a\n", nul) == git::DiffAs::Binary);
+    CHECK(processes.diffAs("image.png", false, late, late + "b\n") == git::DiffAs::Text);
+    CHECK(processes.diffAs("image.raw", false, nul, nul + "b\n") == git::DiffAs::Text);
+
+    // As git diff has it
+    writeFile(fixture.directory + "/image.png", nul);
+    writeFile(fixture.directory + "/image.raw", nul);
+    shell(fixture.git + " add image.png image.raw && " + fixture.git + " commit -qm binary");
+    writeFile(fixture.directory + "/image.png", nul + "changed\n");
+    writeFile(fixture.directory + "/image.raw", nul + "changed\n");
+    CHECK(shell(fixture.git + " diff image.png").find("Binary files") != std::string::npos);
+    CHECK(shell(fixture.git + " diff image.raw").find("+changed") != std::string::npos);
+
+    // Objects only in alternates are read through cat-file
+    std::string shared = fixture.directory + "-shared";
+    shell("git clone -qs " + fixture.directory + " " + shared);
+    git::Repository repository;
+    std::string text;
+    CHECK(repository.open(shared + "/file.txt") && repository.blob("file.txt", true, text) == git::Lookup::Failed);
+    git::GitProcesses alternates(shared);
+    repository.setMissingObjects([&](const git::ObjectId &id, git::ObjectType &type, std::string &data) {
+        return alternates.catFile(id.hex(), type, data) == git::Lookup::Found;
+    });
+    CHECK(repository.blob("file.txt", true, text) == git::Lookup::Found && text == shell(fixture.git + " show HEAD:file.txt"));
+    shell("rm -rf " + shared);
+
+    // Pooled by work tree
+    git::CoProcessPool pool(2);
+    std::shared_ptr<git::GitProcesses> first = pool.forWorkTree("/a");
+    CHECK(pool.forWorkTree("/a") == first && pool.forWorkTree("/b") != first);
+    pool.forWorkTree("/c");
+    CHECK(pool.forWorkTree("/a") != first);
+}
+
+static void benchCoProcess() {
+    if (shell("git --version").empty())
+        return;
+
+    Fixture fixture;
+    writeFile(fixture.directory + "/file.txt", lines(100, 1, "first "));
+    shell(fixture.git + " add -A && " + fixture.git + " commit -qm 1");
+    std::string id = shell(fixture.git + " rev-parse HEAD:file.txt").substr(0, 40), data;
+
+    // A small file's base read per request
+    double spawned = timeBlock(100, [&] {
+        data = shell(fixture.git + " cat-file blob " + id);
+    });
+
+    git::GitProcesses processes(fixture.directory);
+    git::ObjectType type;
+    double pooled = timeBlock(100, [&] {
+        processes.catFile(id, type, data);
+    });
+
+    std::vector<std::string> names(1000, id);
+    size_t bytes = 0;
+    double pipelined = timeBlock(1, [&] {
+        processes.catFile(names, [&](size_t, git::ObjectType, std::string &object) {
+            bytes += object.size();
+        });
+    });
+
+    printf("cat-file of %zu bytes: git per request %.2fms, pooled %.3fms, pipelined %.3fms\n",
+           data.size(), spawned * 1000., pooled * 1000., pipelined * 1000. / names.size());
+    CHECK(bytes == data.size() * names.size());
+}
+
+// MARK: LineIndex
+
+// Line starts as NSString's lineRangeForRange: finds them for "\n", "\r\n" and "\r"
+static std::vector<size_t> lineStarts(const std::u16string &text) {
+    std::vector<size_t> starts = {0};
+    for (size_t i = 0; i < text.size(); i++)
+        if (text[i] == '\n' || (text[i] == '\r' && (i + 1 == text.size() || text[i + 1] != '\n')))
+            starts.push_back(i + 1);
+    return starts;
+}
+
+static bool sameLines(const ln::LineIndex &index, const std::u16string &text) {
+    std::vector<size_t> starts = lineStarts(text);
+    size_t lines = text.empty() ? 0 : starts.size() - (starts.back() == text.size());
+    if (index.textLength() != text.size() || index.lines() != lines)
+        return false;
+    for (size_t line = 0; line <= starts.size(); line++)
+        if (index.offsetOfLine(line) != (line < starts.size() ? starts[line] : text.size()))
+            return false;
+    for (size_t offset = 0, line = 0; offset <= text.size(); offset++) {
+        while (line + 1 < starts.size() && starts[line + 1] <= offset)
+            line++;
+        if (index.lineOfOffset(offset) != line)
+            return false;
+    }
+    return true;
+}
+
+static void testLineIndex() {
+    ln::LineIndex index;
+    const struct {
+        std::u16string text;
+        size_t lines;
+    } examples[] = {{u"", 0}, {u"a", 1}, {u"a\n", 1}, {u"a\nb", 2}, {u"\n\n", 2}, {u"\r\n\r\n", 2}, {u"a\rb\r", 2}};
+    for (auto &example : examples) {
+        index.scan((const uint16_t *)example.text.data(), example.text.size());
+        CHECK(index.lines() == example.lines && sameLines(index, example.text));
+    }
+
+    // Units with a byte of a line break aren't one, across blocks of 8 units
+    std::u16string text = u"0123456\u0A0D\r\n0123\u0D0A\u0A00\n\r\r\n\n01234567890\r";
+    index.scan((const uint16_t *)text.data(), text.size());
+    CHECK(sameLines(index, text));
+
+    // Edits joining and splitting "\r\n", as from or to the start and end
+    std::mt19937 random(17);
+    const char16_t alphabet[] = u"ab\n\r\n\r\u0A0D";
+    auto randomText = [&](size_t length) {
+        std::u16string text;
+        for (size_t i = 0; i < length; i++)
+            text += alphabet[random() % 7];
+        return text;
+    };
+    for (int trial = 0; trial < 2000; trial++) {
+        text = randomText(random() % 40);
+        index.scan((const uint16_t *)text.data(), text.size());
+        for (int edit = 0; edit < 10; edit++) {
+            size_t location = random() % (text.size() + 1), old_length = random() % (text.size() - location + 1);
+            std::u16string inserted = randomText(random() % 20);
+            text.replace(location, old_length, inserted);
+            size_t from = location ? location - 1 : 0;
+            index.replace(location, old_length, inserted.size(), (const uint16_t *)text.data() + from);
+            if (!sameLines(index, text)) {
+                CHECK(!"edited index differs from one scanned");
+                return;
+            }
+        }
+    }
+    CHECK(sameLines(index, text));
+}
+
+static void benchLineIndex() {
+    // A 50,000 line file as NSString holds it
+    std::string source = lines(50000, 4, "        let value = compute(");
+    std::u16string text(source.begin(), source.end());
+    const uint16_t *units = (const uint16_t *)text.data();
+    ln::LineIndex index;
+
+    size_t counted = 0;
+    double scalar = timeBlock(20, [&] {
+        counted = 0;
+        for (char16_t unit : text)
+            counted += unit == '\n';
+    });
+    double scanned = timeBlock(20, [&] {
+        index.scan(units, text.size());
+    });
+
+    // The offset of a line near the end as when reverting a hunk there
+    size_t offset = 0;
+    double walked = timeBlock(20, [&] {
+        size_t line = 0, i = 0;
+        for (; i < text.size() && line < 49000; i++)
+            line += text[i] == '\n';
+        offset = i;
+    });
+    size_t probe = 0, looked_up = 0;
+    double found = timeBlock(10000, [&] {
+        looked_up += index.offsetOfLine(probe++ * 7919 % 50000);
+    });
+    CHECK(counted == 50000 && index.lines() == 50000 && index.offsetOfLine(49000) == offset && looked_up);
+
+    // Typing a line break near the end
+    size_t at = index.offsetOfLine(49000) + 4;
+    double patched = timeBlock(1000, [&] {
+        text.insert(at, u"\n");
+        index.replace(at, 0, 1, (const uint16_t *)text.data() + at - 1);
+        text.erase(at, 1);
+        index.replace(at, 1, 0, (const uint16_t *)text.data() + at - 1);
+    });
+    CHECK(sameLines(index, text));
+
+    printf("Line index of %zu units: scan %.3fms (scalar count %.3fms), "
+           "offset of line walked %.3fms found %.5fms, edit patched %.4fms\n",
+           text.size(), scanned * 1000., scalar * 1000., walked * 1000., found * 1000., patched * 500.);
+}
+
+// Changes reported as the test makes them
+struct ScriptedBackend : git::WatchBackend {
+    Changed changed;
+    std::vector<std::string> watched;
+
+    bool start(Changed changed) override {
+        this->changed = changed;
+        return true;
+    }
+
+    bool watch(const std::string &directory) override {
+        watched.push_back(directory);
+        return true;
+    }
+};
+
+// Files reported by a watcher, in the order they were
+struct WatchReports {
+    std::mutex lock;
+    std::condition_variable arrived;
+    std::vector<std::vector<std::string>> reports;
+
+    git::Watcher::Changed collector() {
+        return [this](const std::vector<std::string> &files) {
+            std::lock_guard<std::mutex> locked(lock);
+            reports.push_back(files);
+            arrived.notify_one();
+        };
+    }
+
+    // The next report joined by spaces, "" if none comes in time
+    std::string next(int milliseconds = 2000) {
+        std::unique_lock<std::mutex> locked(lock);
+        if (!arrived.wait_for(locked, std::chrono::milliseconds(milliseconds), [this] { return !reports.empty(); }))
+            return "";
+        std::string joined;
+        for (const std::string &file : reports.front())
+            joined += (joined.empty() ? "" : " ") + file;
+        reports.erase(reports.begin());
+        return joined;
+    }
+};
+
+static void testWatcher() {
+    using std::chrono::milliseconds;
+    WatchReports reports;
+    ScriptedBackend *backend = new ScriptedBackend();
+    {
+        git::Watcher watcher(std::unique_ptr<git::WatchBackend>(backend), reports.collector(),
+                             milliseconds(30), milliseconds(150));
+        CHECK(watcher.watch("/r/dir/a.swift", "/r/.git", "/r/.git"));
+        CHECK(watcher.watch("/r/b.swift", "/r/.git", "/r/.git"));
+        CHECK(watcher.watch("/w/c.swift", "/r/.git/worktrees/w", "/r/.git"));
+        CHECK(watcher.watching("/r/b.swift") && !watcher.watching("/r/c.swift"));
+        std::set<std::string> watched(backend->watched.begin(), backend->watched.end());
+        CHECK(watched.size() == backend->watched.size() && watched.count("/r/.git/refs/heads") &&
+              watched.count("/r/dir") && watched.count("/r") && watched.count("/r/.git/worktrees/w"));
+
+        // A file's own changes, those in its directory or the repository's
+        backend->changed("/r/dir/a.swift");
+        CHECK_EQUAL(reports.next(), "/r/dir/a.swift");
+        backend->changed("/r/.git/index.lock");
+        backend->changed("/r/.git/objects/ab");
+        backend->changed("/r/other.swift");
+        backend->changed("/r/.git/worktrees/w/index");
+        CHECK_EQUAL(reports.next(), "/w/c.swift");
+        backend->changed("/r/.git/index");
+        CHECK_EQUAL(reports.next(), "/r/b.swift /r/dir/a.swift");
+        backend->changed("/r/.git/refs/heads/main");
+        CHECK_EQUAL(reports.next(), "/r/b.swift /r/dir/a.swift /w/c.swift");
+        backend->changed("/r/.git/packed-refs");
+        CHECK_EQUAL(reports.next(), "/r/b.swift /r/dir/a.swift /w/c.swift");
+        backend->changed("/r/dir");
+        CHECK_EQUAL(reports.next(), "/r/dir/a.swift");
+        backend->changed("");
+        CHECK_EQUAL(reports.next(), "/r/b.swift /r/dir/a.swift /w/c.swift");
+
+        // Changes together reported once after they stop
+        for (int i = 0; i < 5; i++) {
+            backend->changed("/r/b.swift");
+            backend->changed("/r/.git/HEAD");
+            std::this_thread::sleep_for(milliseconds(10));
+        }
+        CHECK_EQUAL(reports.next(), "/r/b.swift /r/dir/a.swift");
+        CHECK_EQUAL(reports.next(100), "");
+
+        // ...unless they go on too long
+        git::Watcher::Clock::time_point start = git::Watcher::Clock::now();
+        while (git::Watcher::Clock::now() - start < milliseconds(500)) {
+            backend->changed("/r/b.swift");
+            std::this_thread::sleep_for(milliseconds(10));
+        }
+        std::lock_guard<std::mutex> locked(reports.lock);
+        CHECK(reports.reports.size() >= 2);
+    }
+    reports.reports.clear();
+
+#ifdef __linux__
+    if (shell("git --version").empty()) {
+        printf("Watcher: git not found, skipped\n");
+        return;
+    }
+
+    Fixture fixture;
+    std::string file = fixture.directory + "/file.txt", nested = fixture.directory + "/dir/sub/nested.txt";
+    writeFile(file, lines(50, 1, "first "));
+    writeFile(nested, lines(30, 2, "nested "));
+    shell(fixture.git + " add -A && " + fixture.git + " commit -qm 1");
+
+    git::Repository repository;
+    CHECK(repository.open(file));
+    git::Watcher watcher(std::unique_ptr<git::WatchBackend>(new git::InotifyBackend()), reports.collector(),
+                         milliseconds(50), milliseconds(1000));
+    CHECK(watcher.watch(file, repository.gitDir(), repository.commonDir()));
+    CHECK(watcher.watch(nested, repository.gitDir(), repository.commonDir()));
+    std::string both = file + " " + nested;
+    if (nested < file)
+        both = nested + " " + file;
+
+    writeFile(file, lines(50, 3, "edited "));
+    CHECK_EQUAL(reports.next(), file);
+    writeFile(fixture.directory + "/untracked.txt", "untracked\n");
+    shell("mv " + nested + " " + nested + ".tmp && mv " + nested + ".tmp " + nested);
+    CHECK_EQUAL(reports.next(), nested);
+
+    // Staged, committed, a branch checked out and one in a directory of its own
+    shell(fixture.git + " add file.txt");
+    CHECK_EQUAL(reports.next(), both);
+    shell(fixture.git + " commit -qm 2");
+    CHECK_EQUAL(reports.next(), both);
+    shell(fixture.git + " checkout -q -b feature/one");
+    CHECK_EQUAL(reports.next(), both);
+    writeFile(nested, lines(30, 4, "branch "));
+    shell(fixture.git + " commit -qam 3");
+    CHECK_EQUAL(reports.next(), both);
+    CHECK_EQUAL(reports.next(200), "");
+    shell(fixture.git + " update-ref refs/heads/feature/one HEAD~1");
+    CHECK_EQUAL(reports.next(), both);
+
+    // A checkout changing many files at once
+    shell(fixture.git + " checkout -q master 2>/dev/null || " + fixture.git + " checkout -q main");
+    CHECK_EQUAL(reports.next(), both);
+    CHECK_EQUAL(reports.next(200), "");
+#endif
+}
+
+static void benchWatcher() {
+    using std::chrono::milliseconds;
+    WatchReports reports;
+    ScriptedBackend *backend = new ScriptedBackend();
+    git::Watcher watcher(std::unique_ptr<git::WatchBackend>(backend), reports.collector(),
+                         milliseconds(20), milliseconds(1000));
+    for (int i = 0; i < 5000; i++)
+        watcher.watch("/r/dir" + std::to_string(i % 50) + "/file" + std::to_string(i) + ".swift",
+                      "/r/.git", "/r/.git");
+
+    // Paths as a checkout touching every file reports them
+    std::vector<std::string> paths;
+    for (int i = 0; i < 5000; i++)
+        paths.push_back("/r/dir" + std::to_string(i % 50) + "/file" + std::to_string(i) + ".swift");
+    paths.push_back("/r/.git/index");
+    paths.push_back("/r/.git/HEAD");
+    double mapped = timeBlock(20, [&] {
+        for (const std::string &path : paths)
+            backend->changed(path);
+        reports.next();
+    });
+    printf("Watcher: %zu paths reported as %zu files once in %.3fms, including the 20ms quiet period\n",
+           paths.size(), (size_t)5000, mapped * 1000.);
+}
+
+typedef ln::HighlightOverlay<int> Overlay;
+
+// Ranges for a provider of random lengths and gaps, elements numbered from base
+static std::vector<Overlay::Range> overlayRanges(std::mt19937 &random, long lines, int gap, int length, int base) {
+    std::vector<Overlay::Range> ranges;
+    for (long line = 1 + random() % gap; line < lines; line += 1 + random() % gap) {
+        long end = std::min(line + 1 + (long)(random() % length), lines);
+        ranges.push_back({line, end, base + (int)ranges.size()});
+        line = end;
+    }
+    return ranges;
+}
+
+// The element of each provider on a line, looked up in their ranges
+static std::vector<Overlay::Entry> overlayLookup(const std::vector<std::vector<Overlay::Range>> &providers, long line) {
+    std::vector<Overlay::Entry> found;
+    for (size_t provider = 0; provider < providers.size(); provider++) {
+        const std::vector<Overlay::Range> &ranges = providers[provider];
+        auto range = std::upper_bound(ranges.begin(), ranges.end(), line, [](long line, const Overlay::Range &range) {
+            return line < range.end;
+        });
+        if (range != ranges.end() && range->start <= line)
+            found.push_back({provider, range->element});
+    }
+    return found;
+}
+
+static void testHighlightOverlay() {
+    // A hunk of one provider inside a range of another and one adjoining it
+    Overlay overlay;
+    overlay.build({{{10, 20, 1}, {20, 30, 2}}, {{15, 17, 3}}, {}});
+    std::string segments;
+    overlay.segmentsIn(0, 100, [&](long start, long end, const Overlay::Entry *entries, size_t count) {
+        segments += "[" + std::to_string(start) + "," + std::to_string(end) + ")";
+        for (size_t i = 0; i < count; i++)
+            segments += " " + std::to_string(entries[i].provider) + ":" + std::to_string(entries[i].element);
+        segments += ";";
+    });
+    CHECK_EQUAL(segments, "[10,15) 0:1;[15,17) 0:1 1:3;[17,20) 0:1;[20,30) 0:2;");
+    segments.clear();
+    overlay.segmentsIn(16, 21, [&](long start, long end, const Overlay::Entry *, size_t count) {
+        segments += "[" + std::to_string(start) + "," + std::to_string(end) + ")" + std::to_string(count);
+    });
+    CHECK_EQUAL(segments, "[16,17)2[17,20)1[20,21)1");
+
+    // Ranges of one element split by another provider's are joined again after it
+    overlay.build({{{1, 5, 7}, {5, 9, 7}}});
+    CHECK(overlay.segments() == 1);
+    overlay.build({});
+    CHECK(overlay.segments() == 0);
+
+    // Every line of random windows as looked up in each provider
+    std::mt19937 random(42);
+    for (int trial = 0; trial < 200; trial++) {
+        long lines = 1 + random() % 2000;
+        std::vector<std::vector<Overlay::Range>> providers;
+        for (int provider = 0, count = random() % 5; provider < count; provider++)
+            providers.push_back(overlayRanges(random, lines, 1 + random() % 40, 1 + random() % 30, provider * 10000));
+        overlay.build(providers);
+
+        long from = random() % lines, to = from + random() % 100;
+        long line = from;
+        bool same = true;
+        overlay.segmentsIn(from, to, [&](long start, long end, const Overlay::Entry *entries, size_t count) {
+            for (; line < start; line++)
+                same = same && overlayLookup(providers, line).empty();
+            for (; line < end; line++)
+                same = same && overlayLookup(providers, line) == std::vector<Overlay::Entry>(entries, entries + count);
+        });
+        for (; line < to; line++)
+            same = same && overlayLookup(providers, line).empty();
+        CHECK(same);
+    }
+}
+
+static void benchHighlightOverlay() {
+    // Four services on a 20,000 line file, blame on every line
+    std::mt19937 random(7);
+    long lines = 20000;
+    std::vector<std::vector<Overlay::Range>> providers = {
+        overlayRanges(random, lines, 1, 12, 0), overlayRanges(random, lines, 80, 6, 100000),
+        overlayRanges(random, lines, 200, 3, 200000), overlayRanges(random, lines, 400, 2, 300000)};
+    Overlay overlay;
+    double built = timeBlock(20, [&] {
+        overlay.build(providers);
+    });
+
+    // The 60 lines visible at each point scrolling through the file
+    size_t probed = 0, swept = 0;
+    double lookedUp = timeBlock(5, [&] {
+        for (long top = 1; top + 60 < lines; top += 20)
+            for (long line = top; line < top + 60; line++)
+                probed += overlayLookup(providers, line).size();
+    });
+    double found = timeBlock(5, [&] {
+        for (long top = 1; top + 60 < lines; top += 20)
+            overlay.segmentsIn(top, top + 60, [&](long, long, const Overlay::Entry *, size_t count) {
+                swept += count;
+            });
+    });
+    CHECK(probed && swept);
+    printf("Highlight overlay: %zu segments built in %.3fms, %ld scroll positions lines x services %.3fms, "
+           "swept %.3fms\n", overlay.segments(), built * 1000., lines / 20, lookedUp * 1000., found * 1000.);
+}
+
+int main(int argc, const char *argv[]) {
+    bool bench = argc > 1 && strcmp(argv[1], "bench") == 0;
+    std::vector<std::pair<std::function<void ()>, std::function<void ()>>> suites = {
+        {testDiffCore, benchDiffCore},
+        {testAffixKernels, benchAffixKernels},
+        {testHistogramDiff, benchHistogramDiff},
+        {testParallelDiff, benchParallelDiff},
+        {testLineTable, benchLineTable},
+        {testCleanup, benchCleanup},
+        {testBitap, benchBitap},
+        {testUTF8Diff, benchUTF8Diff},
+        {testUnifiedDiff, benchUnifiedDiff},
+        {testGitRepository, benchGitRepository},
+        {testBaseCache, benchBaseCache},
+        {testEditSession, benchEditSession},
+        {testCoProcess, benchCoProcess},
+        {testLineIndex, benchLineIndex},
+        {testWatcher, benchWatcher},
+        {testHighlightOverlay, benchHighlightOverlay},
+    };
+
+    for (auto &suite : suites) {
+        suite.first();
+        if (bench)
+            suite.second();
+    }
+
+    printf("%d checks, %d failures\n", checks, failures);
+    return failures != 0;
+}
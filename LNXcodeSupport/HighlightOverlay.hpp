@@ -0,0 +1,122 @@
+//
+//  HighlightOverlay.hpp
+//  LNProvider
+//
+//  Copyright © 2017 John Holdsworth. All rights reserved.
+//
+//  The highlights of several services for a file overlaid so the elements
+//  of all of them on a range of lines are found in one sweep rather than by
+//  looking up each line in each service's highlights. Lines are split into
+//  segments over which the elements highlighting them are the same; drawing
+//  the visible lines then costs in the segments they cross, which are as
+//  many as the hunks visible rather than lines times services.
+//
+
+#ifndef HighlightOverlay_hpp
+#define HighlightOverlay_hpp
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace ln {
+
+template <typename Element>
+class HighlightOverlay {
+public:
+    // Lines [start, end) highlighted by an element
+    struct Range {
+        long start, end;
+        Element element;
+    };
+
+    // An element on a segment's lines and the provider of its highlights
+    struct Entry {
+        size_t provider;
+        Element element;
+
+        bool operator==(const Entry &other) const
+        {
+            return provider == other.provider && element == other.element;
+        }
+    };
+
+    /**
+     * Overlay the ranges of each provider, providers in the order their
+     * elements are to be listed for a line.
+     * @param providers Ranges sorted and not overlapping for each provider.
+     */
+
+    void build(const std::vector<std::vector<Range>> &providers)
+    {
+        starts.clear();
+        ends.clear();
+        first.assign(1, 0);
+        entries.clear();
+
+        std::vector<long> bounds;
+        for (const std::vector<Range> &ranges : providers)
+            for (const Range &range : ranges) {
+                bounds.push_back(range.start);
+                bounds.push_back(range.end);
+            }
+        std::sort(bounds.begin(), bounds.end());
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+        // The next range of each provider not ended before the segment
+        std::vector<size_t> next(providers.size(), 0);
+        for (size_t bound = 0; bound + 1 < bounds.size(); bound++) {
+            long start = bounds[bound], end = bounds[bound + 1];
+            size_t entry = entries.size();
+            for (size_t provider = 0; provider < providers.size(); provider++) {
+                const std::vector<Range> &ranges = providers[provider];
+                size_t &index = next[provider];
+                while (index < ranges.size() && ranges[index].end <= start)
+                    index++;
+                if (index < ranges.size() && ranges[index].start <= start)
+                    entries.push_back({provider, ranges[index].element});
+            }
+
+            if (entries.size() == entry)
+                continue;
+            // Joined to the segment before when no element changes between them
+            if (!ends.empty() && ends.back() == start && entries.size() - entry == entry - first[first.size() - 2] &&
+                std::equal(entries.begin() + entry, entries.end(), entries.begin() + first[first.size() - 2])) {
+                entries.resize(entry);
+                ends.back() = end;
+                continue;
+            }
+            starts.push_back(start);
+            ends.push_back(end);
+            first.push_back(entries.size());
+        }
+    }
+
+    /**
+     * Call a block with each segment overlapping lines [from, to) in order,
+     * clipped to them: block(start, end, const Entry *entries, size_t count).
+     */
+
+    template <typename Block>
+    void segmentsIn(long from, long to, Block block) const
+    {
+        for (size_t segment = std::upper_bound(ends.begin(), ends.end(), from) - ends.begin();
+             segment < starts.size() && starts[segment] < to; segment++)
+            block(std::max(starts[segment], from), std::min(ends[segment], to),
+                  entries.data() + first[segment], first[segment + 1] - first[segment]);
+    }
+
+    size_t segments() const
+    {
+        return starts.size();
+    }
+
+private:
+    std::vector<long> starts, ends;     // Of each segment, sorted and not overlapping
+    std::vector<size_t> first = {0};    // The entries of segment i are [first[i], first[i + 1])
+    std::vector<Entry> entries;
+};
+
+} // namespace ln
+
+#endif /* HighlightOverlay_hpp */
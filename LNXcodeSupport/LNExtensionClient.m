@@ -53,6 +53,8 @@
     [self.connectionDO setRootObject:self];
     [self.connectionDO registerName:self.serviceNameDO];
 
+    [self.service acceptHighlightFormats:@[ LNHighlightFormatBinary, LNHighlightFormatJSON ]];
+
     [self.service ping:1 callback:^(int test){
         NSLog(@"Connected to %@ -> %d", self.serviceName, test);
     }];
@@ -95,37 +97,69 @@
     [self.delegate updateConfig:config forService:self.serviceName];
 }
 
-- (void)_requestHighlightsForFile:(NSString *)filepath callback:(LNHighlightCallback)callback {
-    [self.service requestHighlightsForFile:filepath callback:^(NSData *json, NSError *error) {
-        [self updateHighlights:json error:error forFile:filepath];
-        if (callback)
-            callback(json, error);
-    }];
-}
-
-- (void)requestHighlightsForFile:(NSString *)filepath callback:(LNHighlightCallback)callback {
+// a request sent again once connected afresh should the service have gone away
+- (void)retrying:(NSString *)method request:(void (^)(void))request {
     @try {
-        [self _requestHighlightsForFile:filepath callback:callback];
+        request();
     }
     @catch (NSException *e) {
         @try {
             [self setup];
-            [self _requestHighlightsForFile:filepath callback:callback];
+            request();
         }
         @catch (NSException *e) {
-            NSLog(@"-[LNExtensionClient requestHighlightsForFile: %@", e);
+            NSLog(@"-[LNExtensionClient %@ %@", method, e);
         }
     }
 }
 
+- (void)requestHighlightsForFile:(NSString *)filepath callback:(LNHighlightCallback)callback {
+    [self retrying:@"requestHighlightsForFile:" request:^{
+        [self.service requestHighlightsForFile:filepath callback:^(NSData *json, NSError *error) {
+            [self updateHighlights:json error:error forFile:filepath];
+            if (callback)
+                callback(json, error);
+        }];
+    }];
+}
+
 - (void)requestHighlightsForFile:(NSString *)filepath {
     [self requestHighlightsForFile:filepath callback:^(NSData *json, NSError *error) {}];
 }
 
+- (void)requestHighlightsForFile:(NSString *)filepath buffer:(NSString *)buffer callback:(LNHighlightCallback)callback {
+    [self retrying:@"requestHighlightsForFile:buffer:" request:^{
+        [self.service requestHighlightsForFile:filepath buffer:buffer callback:^(NSData *json, NSError *error) {
+            [self updateHighlights:json error:error forFile:filepath];
+            if (callback)
+                callback(json, error);
+        }];
+    }];
+}
+
+- (void)requestHighlightsForFile:(NSString *)filepath buffer:(NSString *)buffer {
+    [self requestHighlightsForFile:filepath buffer:buffer callback:^(NSData *json, NSError *error) {}];
+}
+
 - (void)updateHighlights:(NSData *)json error:(NSError *)error forFile:(NSString *)filepath {
     if (self.highightsByFile)
         @synchronized(self.highightsByFile) {
-            self.highightsByFile[filepath] = [[LNFileHighlights alloc] initWithData:json service:self.serviceName];
+            LNFileHighlights *highlights = [[LNFileHighlights alloc] initWithData:json service:self.serviceName];
+            // lines changed since the version held replace those of it
+            if (highlights.baseVersion) {
+                LNFileHighlights *last = self.highightsByFile[filepath];
+                // delivered again to a request merged with another
+                if (last.version == highlights.version)
+                    return;
+                if (last.version != highlights.baseVersion) {
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        [self resyncHighlightsForFile:filepath];
+                    });
+                    return;
+                }
+                highlights = [last highlightsSplicing:highlights];
+            }
+            self.highightsByFile[filepath] = highlights;
         }
 #if 0
     NSLog(@"%@: %@ %@ %@ %@ %@ %@",
@@ -136,6 +170,24 @@
     [self.delegate updateHighlights:json error:error forFile:filepath];
 }
 
+- (void)resyncHighlightsForFile:(NSString *)filepath {
+    @try {
+        [self.service forgetHighlightsForFile:filepath];
+    }
+    @catch (NSException *e) {
+        NSLog(@"-[LNExtensionClient resyncHighlightsForFile: %@]", e);
+    }
+    [self requestHighlightsForFile:filepath];
+}
+
+- (void)forgetHighlightsForFile:(NSString *)filepath {
+    [self.service forgetHighlightsForFile:filepath];
+}
+
+- (void)acceptHighlightFormats:(NSArray<NSString *> *)formats {
+    [self.service acceptHighlightFormats:formats];
+}
+
 - (void)ping:(int)test callback:(void (^)(int))callback {
     NSLog(@"-[%@ ping:callback:]", self);
 }
@@ -36,4 +36,15 @@
     }
 }
 
+- (void)requestHighlightsForFile:(NSString *)filepath buffer:(NSString *)buffer {
+    @try {
+        if (!self.service)
+            [self setup];
+        [self.service requestHighlightsForFile:filepath buffer:buffer];
+    }
+    @catch (NSException *e) {
+        NSLog(@"-[LNExtensionClientDO requestHighlightsForFile:buffer: %@]", e);
+    }
+}
+
 @end
@@ -15,9 +15,16 @@ typedef NSDictionary<NSString *, NSString *> *_Nullable LNConfig;
 typedef void (^_Nonnull LNConfigCallback)(LNConfig config);
 
 #define LNPopoverColorKey @"LNPopoverColor"
+#define LNExtraColorKey   @"LNExtraColor"
 #define LNApplyTitleKey   @"LNApplyTitle"
 #define LNApplyPromptKey  @"LNApplyPrompt"
 #define LNApplyConfirmKey @"LNApplyConfirm"
+#define LNBufferDiffKey   @"LNBufferDiff"
+#define LNWatchFilesKey   @"LNWatchFiles"
+
+// encodings of highlights, JSON unless a service is told otherwise
+#define LNHighlightFormatJSON   @"json"
+#define LNHighlightFormatBinary @"binary.1"
 
 typedef void (^LNHighlightCallback)(NSData *_Nullable json, NSError *_Nullable error);
 
@@ -30,6 +37,20 @@ typedef void (^LNHighlightCallback)(NSData *_Nullable json, NSError *_Nullable e
                         callback:(LNHighlightCallback _Nonnull)callback
 NS_SWIFT_NAME(requestHighlights(forFile:callback:));
 
+// highlights for the unsaved contents of an editor, for services with LNBufferDiffKey in their config
+- (void)requestHighlightsForFile:(NSString *_Nonnull)filepath
+                          buffer:(NSString *_Nonnull)buffer
+                        callback:(LNHighlightCallback _Nonnull)callback
+NS_SWIFT_NAME(requestHighlights(forFile:buffer:callback:));
+
+// highlights are sent in full next, as when a splice doesn't apply to those held
+- (void)forgetHighlightsForFile:(NSString *_Nonnull)filepath
+NS_SWIFT_NAME(forgetHighlights(forFile:));
+
+// formats the client can read, most preferred first
+- (void)acceptHighlightFormats:(NSArray<NSString *> *_Nonnull)formats
+NS_SWIFT_NAME(acceptHighlightFormats(_:));
+
 - (void)ping:(int)test callback:(void (^_Nonnull)(int test))callback;
 
 @end
@@ -38,6 +59,7 @@ NS_SWIFT_NAME(requestHighlights(forFile:callback:));
 @protocol LNExtensionPlugin <NSObject>
 
 - (void)updateConfig:(LNConfig)config forService:(NSString *_Nonnull)serviceName;
+// also sent unrequested as files change by services with LNWatchFilesKey in their config
 - (void)updateHighlights:(NSData *_Nullable)json error:(NSError *_Nullable)error forFile:(NSString *_Nonnull)filepath;
 
 @end
@@ -46,6 +68,7 @@ NS_SWIFT_NAME(requestHighlights(forFile:callback:));
 
 - (void)setPluginDO:(id<LNExtensionPlugin> _Nonnull)pluginDO;
 - (void)requestHighlightsForFile:(NSString *_Nonnull)filepath;
+- (void)requestHighlightsForFile:(NSString *_Nonnull)filepath buffer:(bycopy NSString *_Nonnull)buffer;
 - (void)getConfig;
 
 @end
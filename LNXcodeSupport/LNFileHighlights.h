@@ -15,15 +15,31 @@
 @property NSColor *_Nonnull color;
 @property NSString *_Nullable text;
 @property NSString *_Nullable range;
+// text that replaced text, diffed against it only when hovered
+@property NSString *_Nullable inserted;
+// attributes of text set by setAttributedText:
+@property NSString *_Nullable styles;
+@property NSString *_Nullable runs;
 
 - (void)setAttributedText:(NSAttributedString *_Nonnull)text;
 - (NSAttributedString *_Nullable)attributedText;
+// attributedText or the result of differ when there is inserted text, memoised
+- (NSAttributedString *_Nullable)attributedTextDiffing:
+    (NSAttributedString *_Nonnull (^_Nonnull)(NSString *_Nonnull text, NSString *_Nonnull inserted))differ;
 
 @end
 
 @interface LNFileHighlights : NSObject
 
 @property NSTimeInterval updated;
+// set when only lines [spliceStart, spliceOldEnd) of the last highlights
+// were diffed again, now lines [spliceStart, spliceEnd)
+@property NSInteger spliceStart, spliceOldEnd, spliceEnd;
+// numbered by the service sending them, a splice applying only to the
+// highlights of its baseVersion
+@property NSInteger version, baseVersion;
+// counts lines set or cleared in place rather than arriving as new highlights
+@property (readonly) NSInteger changes;
 
 - (instancetype _Nullable)initWithData:(NSData *_Nullable)json service:(NSString *_Nonnull)serviceName;
 
@@ -32,8 +48,23 @@
 
 - (void)foreachHighlight:(void (^_Nonnull)(NSInteger line, LNHighlightElement *_Nonnull element))block;
 - (void)foreachHighlightRange:(void (^_Nonnull)(NSRange range, LNHighlightElement *_Nonnull element))block;
+// lines highlighted alike that overlap those given, as when drawing visible lines
+- (void)foreachHighlightRangeIn:(NSRange)lines
+                          block:(void (^_Nonnull)(NSRange range, LNHighlightElement *_Nonnull element))block;
+
+// a copy of these highlights with the lines of a splice replaced by its own
+- (LNFileHighlights *_Nonnull)highlightsSplicing:(LNFileHighlights *_Nonnull)window;
+// a splice of the lines that differ from earlier highlights, empty if none do
+- (LNFileHighlights *_Nonnull)highlightsChangedFrom:(LNFileHighlights *_Nonnull)last
+NS_SWIFT_NAME(highlightsChanged(from:));
+
+// a byte per row of a scrollbar, set for those the highlighted lines are on when line n
+// is at row (n - 1) * scale and marks at least 2 rows, kept until asked for other rows
+- (NSData *_Nonnull)markerRows:(NSInteger)rows scale:(CGFloat)scale;
 
 - (NSData *_Nonnull)jsonData;
+// versioned binary form, read by initWithData:service: as well as JSON
+- (NSData *_Nonnull)binaryData;
 - (void)invalidate;
 
 @end
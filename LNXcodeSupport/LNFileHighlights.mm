@@ -8,13 +8,18 @@
 
 #import "LNFileHighlights.h"
 
-#import <map>
+#import <algorithm>
+#import <vector>
 
 // JSON wire format
 typedef NSDictionary<NSString *, NSString *> LNHighlightMap;
 typedef NSDictionary<NSString *, LNHighlightMap *> LNHighlightInfo;
 
-@implementation LNHighlightElement
+@implementation LNHighlightElement {
+    // memoised diff and the strings it was made from
+    NSAttributedString *diffed;
+    NSString *diffedText, *diffedInserted;
+}
 
 - (void)updadateFrom:(LNHighlightMap *)map {
     if (NSString *start = map[@"start"])
@@ -27,6 +32,14 @@ typedef NSDictionary<NSString *, LNHighlightMap *> LNHighlightInfo;
     // undo range
     if (NSString *range = map[@"range"])
         self.range = range == (id)[NSNull null] ? nil : range;
+    // intra-line diff made when hovered
+    if (NSString *inserted = map[@"inserted"])
+        self.inserted = inserted;
+    // attributes of text
+    if (NSString *styles = map[@"styles"])
+        self.styles = styles;
+    if (NSString *runs = map[@"runs"])
+        self.runs = runs;
 }
 
 - (id)copyWithZone:(NSZone *)zone {
@@ -35,6 +48,9 @@ typedef NSDictionary<NSString *, LNHighlightMap *> LNHighlightInfo;
     copy.color = self.color;
     copy.text  = self.text;
     copy.range = self.range;
+    copy.inserted = self.inserted;
+    copy.styles = self.styles;
+    copy.runs = self.runs;
     return copy;
 }
 
@@ -42,100 +58,540 @@ typedef NSDictionary<NSString *, LNHighlightMap *> LNHighlightInfo;
     return self.start == object.start &&
            [self.color isEqual:object.color] &&
            [self.text isEqualToString:object.text] &&
-           [self.range isEqualToString:object.range];
+           [self.range isEqualToString:object.range] &&
+           (self.inserted == object.inserted || [self.inserted isEqualToString:object.inserted]) &&
+           (self.styles == object.styles || [self.styles isEqualToString:object.styles]) &&
+           (self.runs == object.runs || [self.runs isEqualToString:object.runs]);
+}
+
+// Attributed text is sent as its plain string in text, the distinct sets of
+// attributes it uses in styles, one per line, and "offset length style" runs.
+// Styles are ";" separated "c=" colour, "b=" background, "f=" font & "u=" underline.
+
+static NSString *LNStyleForAttributes(NSDictionary<NSString *, id> *attributes) {
+    NSMutableArray<NSString *> *style = [NSMutableArray new];
+    if (NSColor *color = attributes[NSForegroundColorAttributeName])
+        [style addObject:[@"c=" stringByAppendingString:color.stringRepresentation]];
+    if (NSColor *color = attributes[NSBackgroundColorAttributeName])
+        [style addObject:[@"b=" stringByAppendingString:color.stringRepresentation]];
+    if (NSFont *font = attributes[NSFontAttributeName])
+        [style addObject:[NSString stringWithFormat:@"f=%g %@", font.pointSize, font.fontName]];
+    if (NSNumber *underline = attributes[NSUnderlineStyleAttributeName])
+        [style addObject:[NSString stringWithFormat:@"u=%ld", (long)underline.integerValue]];
+    return [style componentsJoinedByString:@";"];
 }
 
-// http://stackoverflow.com/questions/22620615/cocoa-how-to-save-nsattributedstring-to-json
+static NSDictionary<NSString *, id> *LNAttributesForStyle(NSString *style) {
+    NSMutableDictionary<NSString *, id> *attributes = [NSMutableDictionary new];
+    for (NSString *setting in [style componentsSeparatedByString:@";"]) {
+        if (setting.length < 2 || [setting characterAtIndex:1] != '=')
+            continue;
+        NSString *value = [setting substringFromIndex:2];
+        switch ([setting characterAtIndex:0]) {
+        case 'c':
+            attributes[NSForegroundColorAttributeName] = [NSColor colorWithString:value];
+            break;
+        case 'b':
+            attributes[NSBackgroundColorAttributeName] = [NSColor colorWithString:value];
+            break;
+        case 'f': {
+            NSRange space = [value rangeOfString:@" "];
+            if (space.location != NSNotFound)
+                if (NSFont *font = [NSFont fontWithName:[value substringFromIndex:NSMaxRange(space)]
+                                                   size:value.doubleValue])
+                    attributes[NSFontAttributeName] = font;
+            break;
+        }
+        case 'u':
+            attributes[NSUnderlineStyleAttributeName] = @(value.integerValue);
+            break;
+        }
+    }
+    return attributes;
+}
 
 - (void)setAttributedText:(NSAttributedString *_Nonnull)text {
-    NSMutableData *data = [NSMutableData new];
-    NSKeyedArchiver *archiver = [[NSKeyedArchiver alloc] initForWritingWithMutableData:data];
-    archiver.outputFormat = NSPropertyListXMLFormat_v1_0;
-    [archiver encodeObject:text forKey:NSKeyedArchiveRootObjectKey];
-    self.text = [[NSString alloc] initWithData:archiver.encodedData encoding:NSUTF8StringEncoding];
+    NSMutableDictionary<NSString *, NSNumber *> *styleIDs = [NSMutableDictionary new];
+    NSMutableArray<NSString *> *styles = [NSMutableArray new];
+    NSMutableString *runs = [NSMutableString new];
+    __block NSNumber *lastID = nil;
+    __block NSRange lastRange = {0, 0};
+
+    void (^flushRun)() = ^{
+        if (lastID)
+            [runs appendFormat:@"%s%lu %lu %@", runs.length ? " " : "",
+                               (unsigned long)lastRange.location, (unsigned long)lastRange.length, lastID];
+    };
+
+    [text enumerateAttributesInRange:NSMakeRange(0, text.length)
+                             options:0
+                          usingBlock:^(NSDictionary<NSString *, id> *attributes, NSRange range, BOOL *stop) {
+        NSString *style = LNStyleForAttributes(attributes);
+        NSNumber *styleID = nil;
+        if (style.length && !(styleID = styleIDs[style])) {
+            styleID = styleIDs[style] = @(styles.count);
+            [styles addObject:style];
+        }
+
+        // runs differing only in attributes not sent are joined
+        if (styleID && [styleID isEqual:lastID] && NSMaxRange(lastRange) == range.location)
+            lastRange.length += range.length;
+        else {
+            flushRun();
+            lastID = styleID;
+            lastRange = range;
+        }
+    }];
+    flushRun();
+
+    self.text = text.string;
+    self.styles = styles.count ? [styles componentsJoinedByString:@"\n"] : nil;
+    self.runs = styles.count ? runs : nil;
 }
 
 - (NSAttributedString *_Nullable)attributedText {
     if (!self.text)
         return nil;
+    // from providers before styles and runs
     if ([self.text hasPrefix:@"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
          "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">"])
         return [NSKeyedUnarchiver unarchiveObjectWithData:[self.text dataUsingEncoding:NSUTF8StringEncoding]];
-    else
-        return [[NSAttributedString alloc] initWithString:self.text];
+
+    NSMutableAttributedString *attString = [[NSMutableAttributedString alloc] initWithString:self.text];
+    if (!self.styles || !self.runs)
+        return attString;
+
+    std::vector<NSDictionary<NSString *, id> *> attributes;
+    for (NSString *style in [self.styles componentsSeparatedByString:@"\n"])
+        attributes.push_back(LNAttributesForStyle(style));
+
+    auto scan = [](const char *&next, unsigned long &value) {
+        char *end;
+        value = strtoul(next, &end, 10);
+        bool scanned = end != next;
+        next = end;
+        return scanned;
+    };
+
+    NSUInteger length = attString.length;
+    const char *next = self.runs.UTF8String;
+    unsigned long offset, count, style;
+    while (scan(next, offset) && scan(next, count) && scan(next, style))
+        if (style < attributes.size() && offset <= length && count <= length - offset)
+            [attString setAttributes:attributes[style] range:NSMakeRange(offset, count)];
+
+    return attString;
+}
+
+- (NSAttributedString *_Nullable)attributedTextDiffing:
+    (NSAttributedString *_Nonnull (^_Nonnull)(NSString *_Nonnull text, NSString *_Nonnull inserted))differ {
+    NSString *text = self.text, *inserted = self.inserted;
+    if (!text || !inserted)
+        return [self attributedText];
+    if (!diffed || text != diffedText || inserted != diffedInserted) {
+        diffed = differ(text, inserted);
+        diffedText = text;
+        diffedInserted = inserted;
+    }
+    return diffed;
 }
 
 @end
 
+// lines [start, end) highlighted by an element
+struct LNHighlightRange {
+    NSInteger start, end;
+    LNHighlightElement *element;
+};
+
+typedef std::vector<LNHighlightRange> LNHighlightRanges;
+
+// the first range ending after a line
+static LNHighlightRanges::iterator LNRangeAfter(LNHighlightRanges &ranges, NSInteger line) {
+    return std::upper_bound(ranges.begin(), ranges.end(), line, [](NSInteger line, const LNHighlightRange &range) {
+        return line < range.end;
+    });
+}
+
+// highlight lines [start, end) with an element or none, joining ranges of the same element
+static void LNHighlightLines(LNHighlightRanges &ranges, NSInteger start, NSInteger end, LNHighlightElement *element) {
+    // appended in order as highlights are read
+    if (element && (ranges.empty() || ranges.back().end <= start)) {
+        if (!ranges.empty() && ranges.back().end == start && ranges.back().element == element)
+            ranges.back().end = end;
+        else
+            ranges.push_back({start, end, element});
+        return;
+    }
+
+    // ranges overlapping the lines are replaced by what is left of them either side
+    auto first = LNRangeAfter(ranges, start), last = first;
+    while (last != ranges.end() && last->start < end)
+        ++last;
+
+    std::vector<LNHighlightRange> replacement;
+    if (first != last && first->start < start)
+        replacement.push_back({first->start, start, first->element});
+    if (element)
+        replacement.push_back({start, end, element});
+    if (first != last && (last - 1)->end > end)
+        replacement.push_back({end, (last - 1)->end, (last - 1)->element});
+
+    size_t index = first - ranges.begin();
+    ranges.erase(first, last);
+    ranges.insert(ranges.begin() + index, replacement.begin(), replacement.end());
+
+    size_t from = index ? index - 1 : 0, to = std::min(index + replacement.size() + 1, ranges.size());
+    for (size_t i = from; i + 1 < to;)
+        if (ranges[i].end == ranges[i + 1].start && ranges[i].element == ranges[i + 1].element) {
+            ranges[i].end = ranges[i + 1].end;
+            ranges.erase(ranges.begin() + i + 1);
+            to--;
+        } else
+            i++;
+}
+
+// elements alike once the first is moved down some lines, as when spliced
+static BOOL LNSameElement(LNHighlightElement *from, LNHighlightElement *to, NSInteger delta) {
+    if (from == to && delta == 0)
+        return YES;
+    auto same = [](NSString *a, NSString *b) {
+        return a == b || [a isEqualToString:b];
+    };
+
+    NSString *range = from.range;
+    NSRange lineRange;
+    if (delta && sscanf(range.UTF8String ?: "", "%ld %ld", &lineRange.location, &lineRange.length) == 2)
+        range = [NSString stringWithFormat:@"%ld %ld", lineRange.location + delta, lineRange.length];
+    return from.start + delta == to.start && [from.color isEqual:to.color] && same(range, to.range) &&
+           same(from.text, to.text) && same(from.inserted, to.inserted) && same(from.styles, to.styles) &&
+           same(from.runs, to.runs);
+}
+
+// binary highlights, version in the last byte of the magic:
+// flags [spliceStart spliceOldEnd spliceEnd] [version baseVersion] colors... elements... ranges...
+static const uint8_t LNBinaryMagic[] = {'L', 'N', 'H', 1};
+
+enum : uint64_t { LNBinarySplice = 1, LNBinaryVersion = 2 };
+enum : uint64_t { LNBinaryText = 1, LNBinaryRange = 2, LNBinaryInserted = 4, LNBinaryStyles = 8, LNBinaryRuns = 16 };
+
+static void LNPutVarint(NSMutableData *data, uint64_t value) {
+    uint8_t bytes[10], *out = bytes;
+    for (; value >= 0x80; value >>= 7)
+        *out++ = (uint8_t)value | 0x80;
+    *out++ = (uint8_t)value;
+    [data appendBytes:bytes length:out - bytes];
+}
+
+// zigzag so small negative numbers stay short
+static void LNPutInteger(NSMutableData *data, NSInteger value) {
+    LNPutVarint(data, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+static void LNPutString(NSMutableData *data, NSString *string) {
+    NSUInteger length = [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    LNPutVarint(data, length);
+    [data increaseLengthBy:length];
+    [string getBytes:(char *)data.mutableBytes + data.length - length maxLength:length usedLength:NULL
+            encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, string.length) remainingRange:NULL];
+}
+
+// reads values from the bytes it is given, clearing ok rather than reading past their end
+struct LNBinaryReader {
+    const uint8_t *p, *end;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; ok && shift < 64; shift += 7) {
+            if (p == end)
+                break;
+            uint8_t byte = *p++;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        ok = false;
+        return 0;
+    }
+
+    NSInteger integer() {
+        uint64_t value = varint();
+        return (NSInteger)(value >> 1) ^ -(NSInteger)(value & 1);
+    }
+
+    // each item takes at least a byte so no more than remain
+    uint64_t count() {
+        uint64_t value = varint();
+        if (value > (uint64_t)(end - p))
+            ok = false;
+        return ok ? value : 0;
+    }
+
+    NSString *string() {
+        uint64_t length = varint();
+        if (!ok || length > (uint64_t)(end - p)) {
+            ok = false;
+            return nil;
+        }
+        NSString *string = [[NSString alloc] initWithBytes:p length:length encoding:NSUTF8StringEncoding];
+        p += length;
+        return string;
+    }
+};
+
 @implementation LNFileHighlights {
-    std::map<NSInteger, LNHighlightElement *> elements;
+    // sorted and not overlapping
+    LNHighlightRanges ranges;
+    // scrollbar rows of the ranges, for markerRowCount rows and markerScale
+    NSData *markers;
+    NSInteger markerRowCount;
+    CGFloat markerScale;
 }
 
 - (instancetype)initWithData:(NSData *)json service:(NSString *)serviceName {
     if ((self = [super init]) && json) {
-        NSError *error;
-        LNHighlightInfo *info = [NSJSONSerialization JSONObjectWithData:json options:0 error:&error];
-        if (error)
-            NSLog(@"%@ -[LNFileHighlights initWithData: %@]", serviceName, error);
-
-        for (NSString *line in [info.allKeys
-                 sortedArrayUsingComparator:^NSComparisonResult(id _Nonnull obj1, id _Nonnull obj2) {
-                     return [obj1 intValue] < [obj2 intValue] ? NSOrderedAscending : NSOrderedDescending;
-                 }]) {
-            LNHighlightMap *map = info[line];
-            LNHighlightElement *element;
-
-            if (NSString *alias = map[@"alias"]) {
-                LNHighlightElement *original = elements[alias.intValue];
-                if (map.count == 1)
-                    element = original;
-                else {
-                    element = [original copy];
-                    [element updadateFrom:map];
-                }
-            } else {
-                element = [LNHighlightElement new];
-                [element updadateFrom:map];
+        if (json.length >= sizeof LNBinaryMagic && memcmp(json.bytes, LNBinaryMagic, sizeof LNBinaryMagic) == 0) {
+            if (![self decodeBinary:json]) {
+                NSLog(@"%@ -[LNFileHighlights initWithData: malformed binary highlights]", serviceName);
+                ranges.clear();
             }
-
-            elements[line.intValue] = element;
-        }
-        NSLog(@"Updated map: %ld elements", elements.size());
+        } else
+            [self decodeJSON:json service:serviceName];
+        NSLog(@"Updated map: %ld ranges", ranges.size());
     }
 
     self.updated = [NSDate timeIntervalSinceReferenceDate];
     return self;
 }
 
+- (void)decodeJSON:(NSData *)json service:(NSString *)serviceName {
+    NSError *error;
+    LNHighlightInfo *info = [NSJSONSerialization JSONObjectWithData:json options:0 error:&error];
+    if (error)
+        NSLog(@"%@ -[LNFileHighlights initWithData: %@]", serviceName, error);
+
+    // "start oldEnd end" of lines diffed again
+    if (NSString *splice = (NSString *)info[@"splice"]) {
+        NSArray<NSString *> *lines = [splice componentsSeparatedByString:@" "];
+        if (lines.count == 3) {
+            self.spliceStart = lines[0].integerValue;
+            self.spliceOldEnd = lines[1].integerValue;
+            self.spliceEnd = lines[2].integerValue;
+        }
+    }
+
+    // "version baseVersion"
+    if (NSString *version = (NSString *)info[@"version"]) {
+        NSArray<NSString *> *versions = [version componentsSeparatedByString:@" "];
+        if (versions.count == 2) {
+            self.version = versions[0].integerValue;
+            self.baseVersion = versions[1].integerValue;
+        }
+    }
+
+    for (NSString *line in [info.allKeys
+             sortedArrayUsingComparator:^NSComparisonResult(id _Nonnull obj1, id _Nonnull obj2) {
+                 return [obj1 intValue] < [obj2 intValue] ? NSOrderedAscending : NSOrderedDescending;
+             }]) {
+        LNHighlightMap *map = info[line];
+        LNHighlightElement *element;
+        if ([line isEqualToString:@"splice"] || [line isEqualToString:@"version"])
+            continue;
+
+        if (NSString *alias = map[@"alias"]) {
+            LNHighlightElement *original = self[alias.intValue];
+            if (map.count == 1)
+                element = original;
+            else {
+                element = [original copy];
+                [element updadateFrom:map];
+            }
+        } else {
+            element = [LNHighlightElement new];
+            [element updadateFrom:map];
+        }
+
+        LNHighlightLines(ranges, line.intValue, line.intValue + 1, element);
+    }
+}
+
+// read in place, element by element then range by range
+- (BOOL)decodeBinary:(NSData *)data {
+    LNBinaryReader reader = {(const uint8_t *)data.bytes + sizeof LNBinaryMagic, (const uint8_t *)data.bytes + data.length};
+
+    uint64_t flags = reader.varint();
+    if (flags & LNBinarySplice) {
+        self.spliceStart = reader.integer();
+        self.spliceOldEnd = reader.integer();
+        self.spliceEnd = reader.integer();
+    }
+    if (flags & LNBinaryVersion) {
+        self.version = reader.integer();
+        self.baseVersion = reader.integer();
+    }
+
+    std::vector<NSColor *> colors;
+    for (uint64_t count = reader.count(); reader.ok && colors.size() < count;)
+        colors.push_back([NSColor colorWithString:reader.string() ?: NULL_COLOR_STRING]);
+
+    std::vector<LNHighlightElement *> elements;
+    for (uint64_t count = reader.count(); reader.ok && elements.size() < count;) {
+        LNHighlightElement *element = [LNHighlightElement new];
+        element.start = reader.integer();
+        uint64_t color = reader.varint(), present = reader.varint();
+        if (color >= colors.size())
+            return NO;
+        element.color = colors[color];
+        if (present & LNBinaryText)
+            element.text = reader.string();
+        if (present & LNBinaryRange)
+            element.range = reader.string();
+        if (present & LNBinaryInserted)
+            element.inserted = reader.string();
+        if (present & LNBinaryStyles)
+            element.styles = reader.string();
+        if (present & LNBinaryRuns)
+            element.runs = reader.string();
+        elements.push_back(element);
+    }
+
+    // "<lines since the last range> <lines> <element>"
+    NSInteger end = 0;
+    for (uint64_t count = reader.count(), index = 0; reader.ok && index < count; index++) {
+        NSInteger start = end + reader.integer();
+        uint64_t length = reader.varint(), element = reader.varint();
+        if (!reader.ok || element >= elements.size() || length == 0 || start < end)
+            return NO;
+        end = start + length;
+        ranges.push_back({start, end, elements[element]});
+    }
+
+    return reader.ok;
+}
+
 - (void)setObject:(LNHighlightElement *)element atIndexedSubscript:(NSInteger)line {
-    elements[line] = element;
+    LNHighlightLines(ranges, line, line + 1, element);
+    markers = nil;
+    _changes++;
 }
 
 - (LNHighlightElement *)objectAtIndexedSubscript:(NSInteger)line {
-    return elements.find(line) != elements.end() ? elements[line] : nil;
+    auto range = LNRangeAfter(ranges, line);
+    return range != ranges.end() && range->start <= line ? range->element : nil;
 }
 
 - (void)foreachHighlight:(void (^)(NSInteger line, LNHighlightElement *element))block {
-    for (auto it = elements.begin(); it != elements.end(); ++it)
-        block(it->first, it->second);
+    for (const LNHighlightRange &range : ranges)
+        for (NSInteger line = range.start; line < range.end; line++)
+            block(line, range.element);
 }
 
 - (void)foreachHighlightRange:(void (^)(NSRange range, LNHighlightElement *element))block {
-    __block LNHighlightElement *lastElement = nil;
-    __block NSInteger lastLine = -1;
+    LNHighlightElement *lastElement = nil;
+    NSInteger lastLine = -1;
 
-    auto callbackOnNewElement = ^(LNHighlightElement *element) {
-        if (lastElement && element != lastElement)
+    for (const LNHighlightRange &range : ranges) {
+        if (lastElement && range.element != lastElement)
             block(NSMakeRange(lastElement.start, lastLine - lastElement.start + 1), lastElement);
-    };
+        lastElement = range.element;
+        lastLine = range.end - 1;
+    }
+
+    if (lastElement)
+        block(NSMakeRange(lastElement.start, lastLine - lastElement.start + 1), lastElement);
+}
+
+- (void)foreachHighlightRangeIn:(NSRange)lines block:(void (^)(NSRange range, LNHighlightElement *element))block {
+    for (auto range = LNRangeAfter(ranges, lines.location);
+         range != ranges.end() && range->start < (NSInteger)NSMaxRange(lines); ++range)
+        block(NSMakeRange(range->start, range->end - range->start), range->element);
+}
+
+- (NSData *)markerRows:(NSInteger)rows scale:(CGFloat)scale {
+    if (markers && rows == markerRowCount && scale == markerScale)
+        return markers;
+
+    NSMutableData *marked = [NSMutableData dataWithLength:MAX(rows, 0)];
+    uint8_t *row = (uint8_t *)marked.mutableBytes;
+    for (const LNHighlightRange &range : ranges) {
+        NSInteger first = MAX((NSInteger)floor((range.start - 1) * scale), 0);
+        if (first >= rows)
+            break;
+        NSInteger last = MIN(MAX((NSInteger)ceil((range.end - 1) * scale), first + 2), rows);
+        memset(row + first, 1, last - first);
+    }
+
+    markers = marked;
+    markerRowCount = rows;
+    markerScale = scale;
+    return markers;
+}
+
+- (LNFileHighlights *)highlightsSplicing:(LNFileHighlights *)window {
+    LNFileHighlights *spliced = [[[self class] alloc] initWithData:nil service:@""];
+    LNHighlightRanges &out = spliced->ranges;
+    NSInteger start = window.spliceStart, oldEnd = window.spliceOldEnd, end = window.spliceEnd, delta = end - oldEnd;
+
+    // elements before the window are shared, those after are copied and moved
+    for (const LNHighlightRange &range : ranges)
+        if (range.start < start)
+            LNHighlightLines(out, range.start, std::min(range.end, start), range.element);
+    for (const LNHighlightRange &range : window->ranges)
+        if (range.end > start && range.start < end)
+            LNHighlightLines(out, std::max(range.start, start), std::min(range.end, end), range.element);
 
-    for (auto it = elements.begin(); it != elements.end(); ++it) {
-        callbackOnNewElement(it->second);
-        lastElement = it->second;
-        lastLine = it->first;
+    LNHighlightElement *last = nil, *moved = nil;
+    for (auto range = LNRangeAfter(ranges, oldEnd); range != ranges.end(); ++range) {
+        if (delta && range->element != last) {
+            last = range->element;
+            moved = [last copy];
+            moved.start += delta;
+            NSRange lineRange;
+            if (sscanf(moved.range.UTF8String ?: "", "%ld %ld", &lineRange.location, &lineRange.length) == 2)
+                moved.range = [NSString stringWithFormat:@"%ld %ld", lineRange.location + delta, lineRange.length];
+        }
+        LNHighlightLines(out, std::max(range->start, oldEnd) + delta, range->end + delta, delta ? moved : range->element);
+    }
+
+    spliced.version = window.version;
+    return spliced;
+}
+
+- (LNFileHighlights *)highlightsChangedFrom:(LNFileHighlights *)last {
+    const LNHighlightRanges &before = last->ranges, &after = ranges;
+    size_t prefix = 0, suffix = 0;
+    while (prefix < before.size() && prefix < after.size() && before[prefix].start == after[prefix].start &&
+           before[prefix].end == after[prefix].end && LNSameElement(before[prefix].element, after[prefix].element, 0))
+        prefix++;
+
+    // lines before the first range that differs are the same
+    NSInteger start = prefix ? before[prefix - 1].end : 0;
+    if (prefix < before.size())
+        start = before[prefix].start;
+    if (prefix < after.size())
+        start = std::min(start, after[prefix].start);
+
+    // as are lines after the last, moved by as many lines as the last range was
+    NSInteger delta = !before.empty() && !after.empty() ? after.back().end - before.back().end : 0;
+    while (suffix < before.size() - prefix && suffix < after.size() - prefix) {
+        const LNHighlightRange &from = before[before.size() - 1 - suffix], &to = after[after.size() - 1 - suffix];
+        if (from.start + delta != to.start || from.end + delta != to.end || !LNSameElement(from.element, to.element, delta))
+            break;
+        suffix++;
     }
 
-    callbackOnNewElement(nil);
+    LNFileHighlights *window = [[[self class] alloc] initWithData:nil service:@""];
+    window->ranges.assign(after.begin() + prefix, after.end() - suffix);
+    window.spliceStart = start;
+    if (suffix) {
+        window.spliceOldEnd = before[before.size() - suffix].start;
+        window.spliceEnd = after[after.size() - suffix].start;
+    } else {
+        window.spliceOldEnd = std::max(start, before.empty() ? 0 : before.back().end);
+        window.spliceEnd = std::max(start, after.empty() ? 0 : after.back().end);
+    }
+    return window;
 }
 
 - (NSData *)jsonData {
@@ -143,25 +599,98 @@ typedef NSDictionary<NSString *, LNHighlightMap *> LNHighlightInfo;
     __block LNHighlightElement *lastElement = nil;
     __block NSInteger lastLine = 0;
 
-    for (auto it = elements.begin(); it != elements.end(); ++it) {
-        NSInteger line = it->first;
-        if (it->second == lastElement)
+    [self foreachHighlight:^(NSInteger line, LNHighlightElement *element) {
+        if (element == lastElement)
             highlights[@(line).stringValue] = @{ @"alias" : @(lastLine).stringValue };
         else {
             lastLine = line;
-            lastElement = it->second;
-            highlights[@(line).stringValue] = @{ @"start" : @(lastElement.start).stringValue,
-                                                 @"color" : lastElement.color.stringRepresentation ?: NULL_COLOR_STRING,
-                                                 @"text"  : lastElement.text ?: [NSNull null],
-                                                 @"range" : lastElement.range ?: [NSNull null] };
+            lastElement = element;
+            NSMutableDictionary *map = [@{ @"start" : @(lastElement.start).stringValue,
+                                           @"color" : lastElement.color.stringRepresentation ?: NULL_COLOR_STRING,
+                                           @"text"  : lastElement.text ?: [NSNull null],
+                                           @"range" : lastElement.range ?: [NSNull null] } mutableCopy];
+            if (lastElement.inserted)
+                map[@"inserted"] = lastElement.inserted;
+            if (lastElement.runs) {
+                map[@"styles"] = lastElement.styles;
+                map[@"runs"] = lastElement.runs;
+            }
+            highlights[@(line).stringValue] = map;
         }
-    };
+    }];
 
+    if (self.spliceEnd)
+        highlights[@"splice"] = [NSString stringWithFormat:@"%ld %ld %ld",
+                                 (long)self.spliceStart, (long)self.spliceOldEnd, (long)self.spliceEnd];
+    if (self.version)
+        highlights[@"version"] = [NSString stringWithFormat:@"%ld %ld", (long)self.version, (long)self.baseVersion];
     return [NSJSONSerialization dataWithJSONObject:highlights options:0 error:NULL];
 }
 
+- (NSData *)binaryData {
+    NSMutableData *data = [NSMutableData dataWithBytes:LNBinaryMagic length:sizeof LNBinaryMagic];
+    LNPutVarint(data, (self.spliceEnd ? LNBinarySplice : 0) | (self.version ? LNBinaryVersion : 0));
+    if (self.spliceEnd) {
+        LNPutInteger(data, self.spliceStart);
+        LNPutInteger(data, self.spliceOldEnd);
+        LNPutInteger(data, self.spliceEnd);
+    }
+    if (self.version) {
+        LNPutInteger(data, self.version);
+        LNPutInteger(data, self.baseVersion);
+    }
+
+    // colors and elements are written once and referred to by index
+    NSMutableArray<NSString *> *colors = [NSMutableArray new];
+    NSMutableDictionary<NSString *, NSNumber *> *colorIndex = [NSMutableDictionary new];
+    std::vector<LNHighlightElement *> elements;
+    NSMapTable<LNHighlightElement *, NSNumber *> *elementIndex = [NSMapTable strongToStrongObjectsMapTable];
+    for (const LNHighlightRange &range : ranges)
+        if (![elementIndex objectForKey:range.element]) {
+            [elementIndex setObject:@(elements.size()) forKey:range.element];
+            elements.push_back(range.element);
+            NSString *color = range.element.color.stringRepresentation ?: NULL_COLOR_STRING;
+            if (!colorIndex[color]) {
+                colorIndex[color] = @(colors.count);
+                [colors addObject:color];
+            }
+        }
+
+    LNPutVarint(data, colors.count);
+    for (NSString *color in colors)
+        LNPutString(data, color);
+
+    LNPutVarint(data, elements.size());
+    for (LNHighlightElement *element : elements) {
+        LNPutInteger(data, element.start);
+        LNPutVarint(data, colorIndex[element.color.stringRepresentation ?: NULL_COLOR_STRING].unsignedLongLongValue);
+        NSString *strings[] = {element.text, element.range, element.inserted, element.styles, element.runs};
+        uint64_t present = 0;
+        for (int i = 0; i < 5; i++)
+            if (strings[i])
+                present |= 1 << i;
+        LNPutVarint(data, present);
+        for (NSString *string : strings)
+            if (string)
+                LNPutString(data, string);
+    }
+
+    LNPutVarint(data, ranges.size());
+    NSInteger end = 0;
+    for (const LNHighlightRange &range : ranges) {
+        LNPutInteger(data, range.start - end);
+        LNPutVarint(data, range.end - range.start);
+        LNPutVarint(data, [elementIndex objectForKey:range.element].unsignedLongLongValue);
+        end = range.end;
+    }
+
+    return data;
+}
+
 - (void)invalidate {
-    elements.clear();
+    ranges.clear();
+    markers = nil;
+    _changes++;
 }
 
 @end
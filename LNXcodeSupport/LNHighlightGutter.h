@@ -17,6 +17,7 @@
 @interface LNHighlightFleck : NSView
 @property LNHighlightElement *element;
 @property LNExtensionClient *extension;
+@property NSString *filepath;
 @property CGFloat yoffset;
 + (LNHighlightFleck *)fleck;
 + (void)recycle:(NSArray *)used;
@@ -14,12 +14,18 @@
 #import "LNXcodeSupport-Swift.h"
 #import "LNExtensionClientDO.h"
 #import "LNHighlightGutter.h"
+#import "DiffMatchPatch.h"
+#import "HighlightOverlay.hpp"
+#import "LineIndex.hpp"
 
 #import "XcodePrivate.h"
 #import <objc/runtime.h>
+#import <vector>
 
 #define REFRESH_INTERVAL 60.
 #define REVERT_DELAY 1.5
+#define BUFFER_DELAY .3
+#define OVERLAYS_KEPT 16
 
 static LNXcodeSupport *lineNumberPlugin;
 static NSString *lastSaved;
@@ -53,6 +59,10 @@ static NSString *lastSaved;
                       exchange:@selector(_finishSavingToURL:ofType:forSaveOperation:changeCount:)
                           with:@selector(ln_finishSavingToURL:ofType:forSaveOperation:changeCount:)];
 
+            [self swizzleClass:[NSDocument class]
+                      exchange:@selector(updateChangeCount:)
+                          with:@selector(ln_updateChangeCount:)];
+
             [self swizzleClass:objc_getClass("IDEEditorDocument")
                       exchange:@selector(closeToRevert)
                           with:@selector(ln_closeToRevert)];
@@ -130,15 +140,23 @@ static NSString *lastSaved;
         [extension requestHighlightsForFile:filepath];
 }
 
+- (void)updateLinenumberHighlightsForFile:(NSString *)filepath buffer:(NSString *)buffer {
+    for (LNExtensionClient *extension in self.extensions)
+        if (extension.config[LNBufferDiffKey])
+            [extension requestHighlightsForFile:filepath buffer:buffer];
+}
+
 - (void)updateConfig:(LNConfig)config forService:(NSString *_Nonnull)serviceName {
     NSLog(@"%@ updateConfig: %@", serviceName, config);
 }
 
 - (void)initialOrOccaisionalLineNumberUpdate:(NSString *)filepath {
     // update if not already in memory or 60 seconds has passed
+    // for services that don't send highlights as files change
     NSTimeInterval stale = [NSDate timeIntervalSinceReferenceDate] - REFRESH_INTERVAL;
     for (LNExtensionClient *extension in self.extensions) {
-        if (filepath && extension[filepath].updated < stale) {
+        if (filepath && (!extension[filepath] ||
+                         (!extension.config[LNWatchFilesKey] && extension[filepath].updated < stale))) {
             if (!extension[filepath])
                 extension.highightsByFile[filepath] = [[LNFileHighlights alloc] initWithData:nil
                                                                                      service:extension.serviceName];
@@ -162,6 +180,21 @@ static NSString *lastSaved;
     [self forceLineNumberUpdate];
 }
 
+// source file has been edited, diff the buffer once typing pauses
+- (void)ln_updateChangeCount:(NSDocumentChangeType)change {
+    [self ln_updateChangeCount:change];
+    if ([self isKindOfClass:lineNumberPlugin.sourceDocClass]) {
+        [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(bufferLineNumberUpdate) object:nil];
+        [self performSelector:@selector(bufferLineNumberUpdate) withObject:nil afterDelay:BUFFER_DELAY];
+    }
+}
+
+- (void)bufferLineNumberUpdate {
+    NSString *buffer = [KeyPath objectFor:@"textStorage.string" from:self];
+    if (self.isDocumentEdited && [buffer isKindOfClass:[NSString class]])
+        [lineNumberPlugin updateLinenumberHighlightsForFile:[[self fileURL] path] buffer:[buffer copy]];
+}
+
 // revert on change on disk
 - (void)ln_closeToRevert {
     [self ln_closeToRevert];
@@ -170,30 +203,153 @@ static NSString *lastSaved;
 
 @end
 
-@implementation NSString (LineNumber)
+static void LNScanLines(ln::LineIndex &index, NSString *string) {
+    NSUInteger length = string.length;
+    if (const UniChar *units = CFStringGetCharactersPtr((__bridge CFStringRef)string))
+        index.scan(units, length);
+    else {
+        std::vector<unichar> units(length);
+        [string getCharacters:units.data() range:NSMakeRange(0, length)];
+        index.scan(units.data(), length);
+    }
+}
 
-// https://stackoverflow.com/questions/1085524/how-to-count-the-number-of-lines-in-an-objective-c-string-nsstring
+// for short strings such as a popover's text, documents' lines are indexed by LNLineIndexForFile()
+@implementation NSString (LineNumber)
 
 - (NSUInteger)numberOfLines {
-    NSUInteger numberOfLines, index, stringLength = [self length];
+    ln::LineIndex index;
+    LNScanLines(index, self);
+    return index.lines();
+}
 
-    for (index = 0, numberOfLines = 0; index < stringLength; numberOfLines++)
-        index = NSMaxRange([self lineRangeForRange:NSMakeRange(index, 0)]);
+@end
+
+// line starts of a document's text, patched as it is edited
+@interface LNLineIndex : NSObject
+@end
 
-    return numberOfLines;
+@implementation LNLineIndex {
+@public
+    ln::LineIndex index;
 }
 
-- (NSUInteger)indexForLine:(NSUInteger)lineNumber {
-    NSUInteger numberOfLines, index, stringLength = [self length];
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
+- (void)textStorageDidProcessEditing:(NSNotification *)notification {
+    NSTextStorage *storage = notification.object;
+    if (!(storage.editedMask & NSTextStorageEditedCharacters))
+        return;
+
+    NSString *string = storage.string;
+    NSRange edited = storage.editedRange;
+    NSUInteger oldLength = edited.length - storage.changeInLength;
+    if (index.textLength() - oldLength + edited.length != string.length) {
+        LNScanLines(index, string);
+        return;
+    }
 
-    for (index = 0, numberOfLines = 0; index < stringLength && numberOfLines < lineNumber; numberOfLines++)
-        index = NSMaxRange([self lineRangeForRange:NSMakeRange(index, 0)]);
+    // the units inserted and those either side that may end lines with them
+    NSUInteger from = edited.location ? edited.location - 1 : 0;
+    NSRange units = NSMakeRange(from, MIN(NSMaxRange(edited) + 1, string.length) - from);
+    std::vector<unichar> buffer(units.length);
+    [string getCharacters:buffer.data() range:units];
+    index.replace(edited.location, oldLength, edited.length, buffer.data());
+}
 
+@end
+
+// kept by the storage so it goes with it
+static char LNLineIndexKey;
+
+static LNLineIndex *LNLineIndexForFile(NSString *filepath) {
+    NSDocument *document = [[NSDocumentController sharedDocumentController]
+                            documentForURL:[NSURL fileURLWithPath:filepath]];
+    NSTextStorage *storage = document ? [KeyPath objectFor:@"textStorage" from:document] : nil;
+    if (![storage isKindOfClass:[NSTextStorage class]])
+        return nil;
+
+    LNLineIndex *index = objc_getAssociatedObject(storage, &LNLineIndexKey);
+    if (!index) {
+        index = [LNLineIndex new];
+        LNScanLines(index->index, storage.string);
+        objc_setAssociatedObject(storage, &LNLineIndexKey, index, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+        [[NSNotificationCenter defaultCenter] addObserver:index
+                                                 selector:@selector(textStorageDidProcessEditing:)
+                                                     name:NSTextStorageDidProcessEditingNotification
+                                                   object:storage];
+    }
     return index;
 }
 
+// the highlights of every extension for a file, in the order their flecks are laid out
+@interface LNHighlightOverlay : NSObject
 @end
 
+@implementation LNHighlightOverlay {
+@public
+    ln::HighlightOverlay<LNHighlightElement *> overlay;
+    std::vector<LNExtensionClient *> extensions;
+    std::vector<LNFileHighlights *> sources;
+    std::vector<NSInteger> changes;
+}
+
+@end
+
+// rebuilt when any extension's highlights for the file are replaced or changed,
+// kept only for the files drawn most recently as they hold their highlights
+static LNHighlightOverlay *LNOverlayForFile(NSString *filepath) {
+    static NSMutableDictionary<NSString *, LNHighlightOverlay *> *overlays;
+    static NSMutableArray<NSString *> *recent;
+    if (!overlays) {
+        overlays = [NSMutableDictionary new];
+        recent = [NSMutableArray new];
+    }
+
+    std::vector<LNExtensionClient *> extensions;
+    std::vector<LNFileHighlights *> sources;
+    std::vector<NSInteger> changes;
+    for (LNExtensionClient *extension in lineNumberPlugin.extensions.reverseObjectEnumerator)
+        if (LNFileHighlights *diffs = extension[filepath]) {
+            extensions.push_back(extension);
+            sources.push_back(diffs);
+            changes.push_back(diffs.changes);
+        }
+
+    [recent removeObject:filepath];
+    if (sources.empty()) {
+        [overlays removeObjectForKey:filepath];
+        return [LNHighlightOverlay new];
+    }
+
+    [recent addObject:filepath];
+    if (recent.count > OVERLAYS_KEPT) {
+        [overlays removeObjectForKey:recent.firstObject];
+        [recent removeObjectAtIndex:0];
+    }
+
+    LNHighlightOverlay *overlay = overlays[filepath];
+    if (overlay && overlay->extensions == extensions && overlay->sources == sources && overlay->changes == changes)
+        return overlay;
+
+    typedef ln::HighlightOverlay<LNHighlightElement *>::Range Range;
+    std::vector<std::vector<Range>> providers(sources.size());
+    for (size_t provider = 0; provider < sources.size(); provider++)
+        [sources[provider] foreachHighlightRangeIn:NSMakeRange(0, NSIntegerMax)
+                                             block:^(NSRange range, LNHighlightElement *element) {
+            providers[provider].push_back({(long)range.location, (long)NSMaxRange(range), element});
+        }];
+
+    overlays[filepath] = overlay = [LNHighlightOverlay new];
+    overlay->overlay.build(providers);
+    overlay->extensions = extensions;
+    overlay->sources = sources;
+    overlay->changes = changes;
+    return overlay;
+}
+
 @implementation NSScroller (LineNumber)
 
 - (NSString *)editedDocPath {
@@ -263,28 +419,48 @@ static CGFloat gutterWidth;
     SourceEditorContentView *sourceTextView = self.superview.subviews[0].subviews[0];
     CGFloat lineHeight = [sourceTextView defaultLineHeight];
 
+    // lines visible, numbered from 0 unlike those highlighted
+    NSInteger top = NSIntegerMax, bottom = -1;
     for (NSNumber *line in lineNumberLayers) {
-        SourceEditorFontSmoothingTextLayer *layer = lineNumberLayers[line];
-        NSRect rect = layer.frame;
-        rect.size.width = LNFLECK_WIDTH;
-        rect.size.height = lineHeight;
-        rect.origin.x = NSWidth(highlightGutter.frame) - NSWidth(rect);
-        rect.origin.y = NSHeight(highlightGutter.frame) -
-                        lineNumberGutter.frame.origin.y - rect.origin.y - lineHeight + 4.;
-        for (LNExtensionClient *extension in lineNumberPlugin.extensions.reverseObjectEnumerator) {
-            if (LNFileHighlights *diffs = extension[filepath]) {
-                if (LNHighlightElement *element = diffs[line.integerValue + 1]) {
+        top = MIN(top, line.integerValue);
+        bottom = MAX(bottom, line.integerValue);
+    }
+
+    LNHighlightOverlay *overlay = LNOverlayForFile(filepath);
+    typedef ln::HighlightOverlay<LNHighlightElement *>::Entry Entry;
+    if (bottom >= 0)
+        overlay->overlay.segmentsIn(top + 1, bottom + 2, [&](long start, long end, const Entry *entries, size_t count) {
+            // a fleck for each element over each run of lines with layers
+            for (NSInteger line = start - 1; line < end - 1;) {
+                NSRect first = [lineNumberLayers[@(line)] frame], last = first;
+                NSInteger after = line;
+                while (after < end - 1 && lineNumberLayers[@(after)])
+                    last = [lineNumberLayers[@(after++)] frame];
+                if (after == line) {
+                    line++;
+                    continue;
+                }
+                line = after;
+
+                NSRect rect;
+                rect.size.width = LNFLECK_WIDTH;
+                rect.size.height = last.origin.y - first.origin.y + lineHeight;
+                rect.origin.x = NSWidth(highlightGutter.frame) - NSWidth(rect);
+                rect.origin.y = NSHeight(highlightGutter.frame) -
+                                lineNumberGutter.frame.origin.y - last.origin.y - lineHeight + 4.;
+                for (size_t entry = 0; entry < count; entry++) {
+                    LNHighlightElement *element = entries[entry].element;
                     LNHighlightFleck *fleck = [LNHighlightFleck fleck];
                     fleck.frame = rect;
                     fleck.element = element;
-                    fleck.extension = extension;
+                    fleck.extension = overlay->extensions[entries[entry].provider];
+                    fleck.filepath = filepath;
                     fleck.yoffset = [lineNumberLayers[@(element.start - 1)] frame].origin.y;
                     [next addObject:fleck];
                     rect.origin.x -= LNFLECK_VISIBLE;
                 }
             }
-        }
-    }
+        });
 
     #define NSOrderedCompare(a, b) a<b ? NSOrderedAscending : a>b ? NSOrderedDescending : NSOrderedSame
     [next sortUsingComparator:^NSComparisonResult(LNHighlightFleck *obj1, LNHighlightFleck *obj2) {
@@ -300,17 +476,16 @@ static CGFloat gutterWidth;
 }
 
 - (void)updateScrollbarMarkersFor:(NSString *)filepath in:(NSRect)rect {
-    static NSMutableDictionary<NSString *, NSNumber *> *lineCountCache;
-    if (!lineCountCache)
-        lineCountCache = [NSMutableDictionary new];
-
     SourceEditorContentView *sourceTextView = self.superview.subviews[0].subviews[0];
-    NSInteger lines = lineCountCache[filepath].intValue;
-    if (!lines)
-        lineCountCache[filepath] = @(lines = [sourceTextView.accessibilityValue numberOfLines] ?: 1);
+    LNLineIndex *lineIndex = LNLineIndexForFile(filepath);
+    // Xcode's own count if the file's document isn't found
+    NSInteger lines = (lineIndex ? lineIndex->index.lines() :
+                       [sourceTextView respondsToSelector:@selector(numberOfLines)] ? [sourceTextView numberOfLines] :
+                       [sourceTextView.accessibilityValue numberOfLines]) ?: 1;
 
     CGFloat lineHeight = [sourceTextView defaultLineHeight];
     CGFloat scale = lines * lineHeight < NSHeight(self.frame) ? lineHeight : NSHeight(self.frame) / lines;
+    NSInteger rows = (NSInteger)ceil(NSHeight(self.frame));
     NSMutableArray *marks = [NSMutableArray new], *markRects = [NSMutableArray new];
 
     static Class markerListClass9_2;
@@ -324,19 +499,31 @@ static CGFloat gutterWidth;
     if (!markerListClass9_2)
         [self clearDiffMarks];
 
+    // rows marked by any extension, each kept by its highlights until they or the line count change
+    std::vector<uint8_t> marked(rows);
     for (LNExtensionClient *extension in lineNumberPlugin.extensions) {
         if (LNFileHighlights *diffs = extension[filepath]) {
-            [diffs foreachHighlightRange:^(NSRange range, LNHighlightElement *element) {
-                if (markerListClass9_2) {
-                    NSRect rect = NSMakeRect(4., (range.location - 1) * scale, 2., MAX(range.length * scale, 2.));
-                    [marks addObject:@((range.location - 1.) / lines)];
-                    [markRects addObject:[NSValue valueWithRect:rect]];
-                } else
-                    [self addMark:(range.location - 1.) / lines onLine:range.location ofType:2];
-            }];
+            const uint8_t *markers = (const uint8_t *)[diffs markerRows:rows scale:scale].bytes;
+            for (NSInteger row = 0; row < rows; row++)
+                marked[row] |= markers[row];
         }
     }
 
+    // a mark for each run of rows
+    for (NSInteger row = 0; row < rows; row++) {
+        if (!marked[row])
+            continue;
+        NSInteger end = row;
+        while (end < rows && marked[end])
+            end++;
+        if (markerListClass9_2) {
+            [marks addObject:@(row / scale / lines)];
+            [markRects addObject:[NSValue valueWithRect:NSMakeRect(4., row, 2., end - row)]];
+        } else
+            [self addMark:row / scale / lines onLine:(NSInteger)(row / scale) + 1 ofType:2];
+        row = end;
+    }
+
     if (markerListClass9_2) {
         _DVTMarkerList *markers = [[markerListClass9_2 alloc] initWithSlotRect:rect];
         [markers setValue:marks forKey:@"_marks"];
@@ -349,6 +536,20 @@ static CGFloat gutterWidth;
 
 @implementation LNHighlightFleck (LNXcodeSupport)
 
+// colour the parts of text not in inserted
+static NSAttributedString *LNIntraLineDiff(NSString *text, NSString *inserted, NSColor *color) {
+    NSMutableAttributedString *attString = [[NSMutableAttributedString alloc] initWithString:text];
+    NSData *diffs = diff_utf8DiffsBetweenTexts([text dataUsingEncoding:NSUTF8StringEncoding],
+                                               [inserted dataUsingEncoding:NSUTF8StringEncoding], 0.);
+    const DMUTF8Diff *diff = (const DMUTF8Diff *)diffs.bytes;
+
+    for (NSUInteger i = 0; i < diffs.length / sizeof *diff; i++)
+        if (diff[i].operation == DIFF_DELETE)
+            [attString addAttribute:NSForegroundColorAttributeName value:color range:diff[i].characters];
+
+    return attString;
+}
+
 - (SourceEditorContentView *)editorContentView {
     return self.superview.superview.superview.subviews[0].subviews[0];
 }
@@ -358,7 +559,10 @@ static CGFloat gutterWidth;
         return;
     NSLog(@"mouseEntered: %@", self);
 //    NSUInteger start = self.element.start;
-    NSMutableAttributedString *attString = [[self.element attributedText] mutableCopy];
+    NSColor *extraColor = [NSColor colorWithString:self.extension.config[LNExtraColorKey] ?: @"0.5 0 0 1"];
+    NSMutableAttributedString *attString = [[self.element attributedTextDiffing:^(NSString *text, NSString *inserted) {
+        return LNIntraLineDiff(text, inserted, extraColor);
+    }] mutableCopy];
 
     // https://panupan.com/2012/06/04/trim-leading-and-trailing-whitespaces-from-nsmutableattributedstring/
 
@@ -378,8 +582,8 @@ static CGFloat gutterWidth;
 
     NSMutableParagraphStyle *myStyle = [NSMutableParagraphStyle new];
     [myStyle setMinimumLineHeight:lineHeight];
-    [attString setAttributes:@{NSParagraphStyleAttributeName : myStyle}
-                       range:NSMakeRange(0, attString.length)];
+    [attString addAttribute:NSParagraphStyleAttributeName value:myStyle
+                      range:NSMakeRange(0, attString.length)];
 
     [lineNumberPlugin.popover removeFromSuperview];
     NSTextView *popover =
@@ -414,8 +618,10 @@ static CGFloat gutterWidth;
         undoButton.action = @selector(performUndo:);
         undoButton.target = self;
 
+        // by the first line of the fleck, which may cover several
         CGFloat width = NSWidth(self.superview.frame);
-        undoButton.frame = NSMakeRect(0, self.frame.origin.y + width, width, width);
+        CGFloat lineHeight = [[self editorContentView] defaultLineHeight];
+        undoButton.frame = NSMakeRect(0, NSMaxY(self.frame) - lineHeight + width, width, width);
         [self.superview addSubview:undoButton];
     }
 }
@@ -440,8 +646,13 @@ static CGFloat gutterWidth;
 
     lineRange.location--;
     NSString *buffer = sourceTextView.accessibilityValue;
-    charRange.location = [buffer indexForLine:lineRange.location];
-    charRange.length = [buffer indexForLine:lineRange.location + lineRange.length] - charRange.location;
+    LNLineIndex *lineIndex = LNLineIndexForFile(self.filepath);
+    if (!lineIndex || lineIndex->index.textLength() != buffer.length) {
+        lineIndex = [LNLineIndex new];
+        LNScanLines(lineIndex->index, buffer);
+    }
+    charRange.location = lineIndex->index.offsetOfLine(lineRange.location);
+    charRange.length = lineIndex->index.offsetOfLine(lineRange.location + lineRange.length) - charRange.location;
     NSLog(@"performUndo: %@ %@", sourceTextView, [buffer substringWithRange:charRange]);
 
     [sourceTextView setAccessibilitySelectedTextRange:charRange];
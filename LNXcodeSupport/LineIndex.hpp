@@ -0,0 +1,148 @@
+//
+//  LineIndex.hpp
+//  LNProvider
+//
+//  Copyright © 2017 John Holdsworth. All rights reserved.
+//
+//  The offsets at which the lines of an editor's text start, so that lines
+//  and offsets can be mapped to each other by binary search rather than by
+//  walking the text from its start. Texts are UTF-16 as NSString's are with
+//  lines ended by "\n", "\r\n" or "\r". Line breaks are found eight units at
+//  a time with SSE2 or NEON and an edit rescans only the units it inserted,
+//  moving the offsets of the lines after them.
+//
+
+#ifndef LineIndex_hpp
+#define LineIndex_hpp
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LN_LINES_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#define LN_LINES_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace ln {
+
+class LineIndex {
+public:
+    typedef uint16_t Unit;
+
+    LineIndex()
+        : starts(1, 0) {}
+
+    // Index a whole text
+    void scan(const Unit *text, size_t length)
+    {
+        starts.assign(1, 0);
+        text_length = length;
+        findStarts(text, 0, length, length, starts);
+    }
+
+    /**
+     * Move the index on to units [location, location + old_length) of the
+     * text having been replaced by new_length units.
+     * @param units Those of the new text from location - 1, or 0 when location
+     * is, to the unit after those inserted unless they end the text.
+     */
+
+    void replace(size_t location, size_t old_length, size_t new_length, const Unit *units)
+    {
+        size_t length = text_length - old_length + new_length;
+        size_t from = location ? location - 1 : 0;
+        std::vector<size_t> inserted;
+        findStarts(units, from, location + new_length - from, length, inserted);
+
+        // Lines starting before location are unchanged, those starting after
+        // the unit after the replaced units only moved.
+        auto first = std::lower_bound(starts.begin() + 1, starts.end(), location);
+        auto last = std::upper_bound(first, starts.end(), location + old_length);
+        for (auto moved = last; moved != starts.end(); ++moved)
+            *moved = *moved - old_length + new_length;
+
+        size_t index = first - starts.begin();
+        starts.erase(first, last);
+        starts.insert(starts.begin() + index, inserted.begin(), inserted.end());
+        text_length = length;
+    }
+
+    size_t textLength() const
+    {
+        return text_length;
+    }
+
+    // Not counting the empty line after a line break ending the text
+    size_t lines() const
+    {
+        return text_length == 0 ? 0 : starts.size() - (starts.back() == text_length);
+    }
+
+    // The offset a line (0 based) starts at, the text's length after the last
+    size_t offsetOfLine(size_t line) const
+    {
+        return line < starts.size() ? starts[line] : text_length;
+    }
+
+    // The line (0 based) containing an offset
+    size_t lineOfOffset(size_t offset) const
+    {
+        return std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1;
+    }
+
+private:
+    std::vector<size_t> starts;     // Of each line, the first always 0
+    size_t text_length = 0;
+
+    /**
+     * Append the offsets of the lines started by the line breaks at offsets
+     * [offset, offset + count) of a text.
+     * @param units Those of the text from offset, and the unit after the last
+     * searched unless it ends the text so that "\r\n" can be recognised.
+     */
+
+    static void findStarts(const Unit *units, size_t offset, size_t count, size_t length, std::vector<size_t> &out)
+    {
+        size_t i = 0;
+#if LN_LINES_SSE2
+        const __m128i newline = _mm_set1_epi16('\n'), carriage_return = _mm_set1_epi16('\r');
+        for (; i + 8 <= count; i += 8) {
+            __m128i block = _mm_loadu_si128((const __m128i *)(units + i));
+            __m128i found = _mm_or_si128(_mm_cmpeq_epi16(block, newline), _mm_cmpeq_epi16(block, carriage_return));
+            // Two bits per unit
+            for (unsigned mask = (unsigned)_mm_movemask_epi8(found) & 0x5555u; mask; mask &= mask - 1)
+                addStart(units, offset, i + __builtin_ctz(mask) / 2, length, out);
+        }
+#elif LN_LINES_NEON
+        const uint16x8_t newline = vdupq_n_u16('\n'), carriage_return = vdupq_n_u16('\r');
+        for (; i + 8 <= count; i += 8) {
+            uint16x8_t block = vld1q_u16(units + i);
+            uint16x8_t found = vorrq_u16(vceqq_u16(block, newline), vceqq_u16(block, carriage_return));
+            // NEON has no movemask, narrowing leaves a byte per unit
+            uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(found)), 0) & 0x0101010101010101ull;
+            for (; mask; mask &= mask - 1)
+                addStart(units, offset, i + __builtin_ctzll(mask) / 8, length, out);
+        }
+#endif
+        for (; i < count; i++)
+            if (units[i] == '\n' || units[i] == '\r')
+                addStart(units, offset, i, length, out);
+    }
+
+    static void addStart(const Unit *units, size_t offset, size_t i, size_t length, std::vector<size_t> &out)
+    {
+        // A line ended by "\r\n" starts after the "\n"
+        if (units[i] == '\r' && offset + i + 1 < length && units[i + 1] == '\n')
+            return;
+        out.push_back(offset + i + 1);
+    }
+};
+
+} // namespace ln
+
+#endif /* LineIndex_hpp */
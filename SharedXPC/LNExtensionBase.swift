@@ -11,11 +11,26 @@ import Cocoa
 open class LNExtensionBase: NSObject {
 
     var owner: LNExtensionPlugin!
+    let requests = LNRequestTracker()
+    var highlightFormats = [LNHighlightFormatJSON]
+
+    // Services that send highlights in full each time
+    @objc open func forgetHighlights(forFile filepath: String) {
+    }
+
+    @objc open func acceptHighlightFormats(_ formats: [String]) {
+        highlightFormats = formats
+    }
 
     @objc open func getConfig(_ callback: @escaping LNConfigCallback) {
         callback(["config": "here"])
     }
 
+    // Services that can only diff saved files
+    @objc open func requestHighlights(forFile filepath: String, buffer: String, callback: @escaping LNHighlightCallback) {
+        (self as? LNExtensionService)?.requestHighlights(forFile: filepath, callback: callback)
+    }
+
     @objc open func ping(_ test: Int32, callback: @escaping (Int32) -> Void) {
         callback(test + 1000)
     }
@@ -40,3 +55,130 @@ open class LNExtensionBase: NSObject {
     }
 
 }
+
+/// A highlight request for a file being worked on by a service
+open class LNRequest {
+
+    public let filepath: String
+    public let generation: Int
+    fileprivate unowned let tracker: LNRequestTracker
+
+    fileprivate init(filepath: String, generation: Int, tracker: LNRequestTracker) {
+        self.filepath = filepath
+        self.generation = generation
+        self.tracker = tracker
+    }
+
+    /// Whether a newer request has been made for the file
+    open var isStale: Bool {
+        return tracker.generation(forFile: filepath) != generation
+    }
+
+    /// A subprocess to terminate if the request becomes stale
+    open func running(_ task: Process) {
+        tracker.running(task, for: self)
+    }
+
+    /// The result, delivered only if no newer request has been made
+    open func finish(_ json: Data?, _ error: Error?) {
+        tracker.finish(self, result: { json }, error: error)
+    }
+
+    /// A result encoded only if it is to be delivered, as when encoding it records it as sent
+    open func finish(encoding: () -> Data?) {
+        tracker.finish(self, result: encoding, error: nil)
+    }
+}
+
+/// Coalesces the highlight requests for each file. Requests made while one
+/// runs wait to run once after it, any subprocess it started terminated as
+/// its result would be stale. Only the newest result is delivered, to the
+/// callbacks of all the requests it superseded.
+open class LNRequestTracker {
+
+    private class File {
+        var generation = 0
+        var running: LNRequest?
+        var task: Process?
+        var callbacks = [LNHighlightCallback]()
+        var work: ((LNRequest) -> Void)?
+    }
+
+    private var files = [String: File]()
+    private let lock = NSLock()
+
+    /// Run work for a request unless one is running for the file already,
+    /// work passing its result to the request's finish().
+    open func request(forFile filepath: String, callback: @escaping LNHighlightCallback,
+                      work: @escaping (LNRequest) -> Void) {
+        lock.lock()
+        let file = files[filepath] ?? File()
+        files[filepath] = file
+        file.generation += 1
+        file.callbacks.append(callback)
+        file.work = work
+
+        if file.running != nil {
+            file.task?.terminate()
+            file.task = nil
+            lock.unlock()
+            return
+        }
+
+        let request = start(file, filepath: filepath)
+        lock.unlock()
+        work(request)
+    }
+
+    fileprivate func generation(forFile filepath: String) -> Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return files[filepath]?.generation ?? 0
+    }
+
+    fileprivate func running(_ task: Process, for request: LNRequest) {
+        lock.lock()
+        defer { lock.unlock() }
+        guard let file = files[request.filepath], file.running === request else { return }
+        if request.generation == file.generation {
+            file.task = task
+        } else {
+            task.terminate()
+        }
+    }
+
+    fileprivate func finish(_ request: LNRequest, result: () -> Data?, error: Error?) {
+        lock.lock()
+        guard let file = files[request.filepath], file.running === request else {
+            lock.unlock()
+            return
+        }
+        file.running = nil
+        file.task = nil
+
+        var callbacks = [LNHighlightCallback](), next: LNRequest?
+        if request.generation == file.generation {
+            callbacks = file.callbacks
+            files[request.filepath] = nil
+        } else {
+            // Superseded while running
+            next = start(file, filepath: request.filepath)
+        }
+        let work = file.work
+        lock.unlock()
+
+        if !callbacks.isEmpty {
+            let json = result()
+            callbacks.forEach { $0(json, error) }
+        }
+        if let next = next {
+            work?(next)
+        }
+    }
+
+    private func start(_ file: File, filepath: String) -> LNRequest {
+        let request = LNRequest(filepath: filepath, generation: file.generation, tracker: self)
+        file.running = request
+        return request
+    }
+}
@@ -42,10 +42,25 @@ open class LNExtensionRelay: LNExtensionBase, LNExtensionService, LNExtensionPlu
         })
     }
 
+    open override func requestHighlights(forFile filepath: String, buffer: String, callback: @escaping LNHighlightCallback) {
+        guard let impl = implXPCService.remoteObjectProxy as? LNExtensionService else { return }
+        impl.requestHighlights(forFile: filepath, buffer: buffer, callback: {
+            callback($0, $1)
+        })
+    }
+
     open func updateHighlights(_ json: Data?, error: Error?, forFile filepath: String) {
         owner.updateHighlights(json, error: error, forFile: filepath)
     }
 
+    open override func forgetHighlights(forFile filepath: String) {
+        impl?.forgetHighlights(forFile: filepath)
+    }
+
+    open override func acceptHighlightFormats(_ formats: [String]) {
+        impl?.acceptHighlightFormats(formats)
+    }
+
     open override func ping(_ test: Int32, callback: @escaping (Int32) -> Void) {
         impl?.ping(test, callback: {
             callback($0 + 1_000_000)
@@ -22,29 +22,33 @@ open class LNScriptImpl: LNExtensionBase, LNExtensionService {
             return
         }
 
-        DispatchQueue.global().async {
-            let url = URL(fileURLWithPath: filepath)
-            let task = Process()
-
-            task.launchPath = script
-            task.arguments = [url.lastPathComponent]
-            task.currentDirectoryPath = url.deletingLastPathComponent().path
-
-            let pipe = Pipe()
-            task.standardOutput = pipe.fileHandleForWriting
-            task.standardError = pipe.fileHandleForWriting
-
-            task.launch()
-            pipe.fileHandleForWriting.closeFile()
-            let json = pipe.fileHandleForReading.readDataToEndOfFile()
-            task.waitUntilExit()
-
-            if task.terminationStatus != 0 {
-                let alert = "Script \(EXTENSION_IMPL_SCRIPT).\(self.scriptExt) exit status " +
-                    "\(task.terminationStatus):\n" + (String(data: json, encoding: .utf8) ?? "No output")
-                callback(json, self.error(description: alert))
-            } else {
-                callback(json, nil)
+        requests.request(forFile: filepath, callback: callback) {
+            request in
+            DispatchQueue.global().async {
+                let url = URL(fileURLWithPath: filepath)
+                let task = Process()
+
+                task.launchPath = script
+                task.arguments = [url.lastPathComponent]
+                task.currentDirectoryPath = url.deletingLastPathComponent().path
+
+                let pipe = Pipe()
+                task.standardOutput = pipe.fileHandleForWriting
+                task.standardError = pipe.fileHandleForWriting
+
+                task.launch()
+                request.running(task)
+                pipe.fileHandleForWriting.closeFile()
+                let json = pipe.fileHandleForReading.readDataToEndOfFile()
+                task.waitUntilExit()
+
+                if task.terminationStatus != 0 {
+                    let alert = "Script \(EXTENSION_IMPL_SCRIPT).\(self.scriptExt) exit status " +
+                        "\(task.terminationStatus):\n" + (String(data: json, encoding: .utf8) ?? "No output")
+                    request.finish(json, self.error(description: alert))
+                } else {
+                    request.finish(json, nil)
+                }
             }
         }
     }
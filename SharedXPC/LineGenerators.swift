@@ -51,9 +51,14 @@ open class TaskGenerator: FileGenerator {
 
 open class FileGenerator: IteratorProtocol {
 
-    let eol: Int32
+    let eol: UInt8
     let handle: FileHandle
-    let readBuffer = NSMutableData()
+
+    // Bytes read but not yet returned as lines are buffer[start ..< end]. The
+    // partial line left when a read is needed is moved to the front once per
+    // read rather than the buffer being shifted for every line returned.
+    private var buffer = UnsafeMutableRawBufferPointer.allocate(byteCount: 256 * 1024, alignment: 1)
+    private var start = 0, end = 0, finished = false
 
     convenience init?(path: String, lineSeparator: String? = nil) {
         guard let handle = FileHandle(forReadingAtPath: path) else { return nil }
@@ -61,39 +66,63 @@ open class FileGenerator: IteratorProtocol {
     }
 
     init(handle: FileHandle, lineSeparator: String? = nil) {
-        eol = Int32((lineSeparator ?? "\n").utf16.first!)
+        eol = (lineSeparator ?? "\n").utf8.first!
         self.handle = handle
     }
 
-    open func next() -> String? {
+    /// The next line without its separator, borrowed from the read buffer
+    /// and only valid until the next call. Use next() for a String copy.
+    open func nextLine() -> UnsafeRawBufferPointer? {
+        // Bytes after start already searched for a separator
+        var searched = 0
         while true {
-            if let endOfLine = memchr(readBuffer.bytes, eol, readBuffer.length) {
-                let endOfLine = endOfLine.assumingMemoryBound(to: Int8.self)
-                endOfLine[0] = 0
-
-                let start = readBuffer.bytes.assumingMemoryBound(to: Int8.self)
-                let line = String(cString: start)
-
-                let consumed = NSMakeRange(0, UnsafePointer<Int8>(endOfLine) + 1 - start)
-                readBuffer.replaceBytes(in: consumed, withBytes: nil, length: 0)
-
-                return line
+            let line = buffer.baseAddress! + start
+            if let endOfLine = memchr(line + searched, Int32(eol), end - start - searched) {
+                let length = line.distance(to: endOfLine)
+                start += length + 1
+                return UnsafeRawBufferPointer(start: line, count: length)
             }
-
-            let bytesRead = handle.availableData
-            if bytesRead.count <= 0 {
-                if readBuffer.length != 0 {
-                    let last = String.fromData(data: readBuffer)
-                    readBuffer.length = 0
-                    return last
-                } else {
-                    break
-                }
+            searched = end - start
+
+            if finished || !fill() {
+                finished = true
+                guard start < end else { return nil }
+                let last = UnsafeRawBufferPointer(start: buffer.baseAddress! + start, count: end - start)
+                start = end
+                return last
             }
+        }
+    }
+
+    open func next() -> String? {
+        return nextLine().map { String(decoding: $0, as: UTF8.self) }
+    }
+
+    // Read more of the file after any partial line, false at end of file
+    private func fill() -> Bool {
+        if start > 0 {
+            // Only the partial line is moved
+            memmove(buffer.baseAddress!, buffer.baseAddress! + start, end - start)
+            end -= start
+            start = 0
+        }
+        if end == buffer.count {
+            // A line longer than the buffer
+            let larger = UnsafeMutableRawBufferPointer.allocate(byteCount: buffer.count * 2, alignment: 1)
+            larger.baseAddress!.copyMemory(from: buffer.baseAddress!, byteCount: end)
+            buffer.deallocate()
+            buffer = larger
+        }
 
-            readBuffer.append(bytesRead)
+        var bytesRead: Int
+        repeat {
+            bytesRead = read(handle.fileDescriptor, buffer.baseAddress! + end, buffer.count - end)
+        } while bytesRead < 0 && errno == EINTR
+        if bytesRead <= 0 {
+            return false
         }
-        return nil
+        end += bytesRead
+        return true
     }
 
     open var lineSequence: AnySequence<String> {
@@ -101,6 +130,7 @@ open class FileGenerator: IteratorProtocol {
     }
 
     deinit {
+        buffer.deallocate()
         handle.closeFile()
     }
 }